@@ -5,16 +5,24 @@
 #include "gui.hpp"
 #include "error.hpp"
 #include "system.hpp"
+#include "settings.hpp"
+#include "log.hpp"
+#include "memory.hpp"
+#include "trace.hpp"
+#include "output.hpp"
+#include "inference.hpp"
+#include "detector.hpp"
+#include "recognizer.hpp"
+#include "rectifier.hpp"
+#include "classifier.hpp"
+#include "batch.hpp"
+#include "spatial.hpp"
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/dnn.hpp>
-#include <tesseract/baseapi.h>
 #include <leptonica/allheaders.h>
 #include <algorithm>
-#include <locale>
-#include <codecvt>
 #include <cmath>
-#include <fstream>
 
 
 //
@@ -33,6 +41,7 @@ GUI::Button*  Application::Application::mOpenImageBtn;
 GUI::Button*  Application::Application::mCloseWindowBtn;
 cv::Mat       Application::Application::mImage;
 std::wstring  Application::Application::mImageFileFullPath;
+Memory::Plan  Application::Application::mMemoryPlan;
 
 //
 // Member Functions
@@ -145,6 +154,31 @@ void Application::Application::Initialize()
 	if (!Graphics::MainFont->load("font.ttf")) {
 		Error::ShowErrorAndQuit(L"Can't load the main font!", L"Application Start Error");
 	}
+
+	// Open the log file
+	if (Settings::GetBool(L"Log", L"Enabled", true)) {
+		Log::Initialize(Settings::GetPath(L"Log", L"File", L"katip.log"));
+	}
+
+	// Read memory budget
+	Memory::InitializeBudget();
+
+	// Share the bits of identical rendered words
+	Graphics::SetTextCacheSize((size_t)std::max(0, Settings::GetInt(L"Graphics", L"TextCacheSize", 0)));
+
+	// Start tracing if it is enabled in the settings
+	if (Settings::GetBool(L"Trace", L"Enabled", false)) {
+		if (Trace::Initialize(Settings::GetPath(L"Trace", L"File", L"katip_trace.json"))) {
+			Trace::SetThreadName("main");
+		} else {
+			Error::ShowError(L"Can't open the trace file, tracing is disabled!", L"Application Start Error");
+		}
+	}
+
+	// Select the inference backend (benchmarks the available ones on Auto)
+	if (!Inference::Initialize()) {
+		Error::ShowError(L"Can't run the text detection model, OpenCV CPU backend is used!", L"Application Start Error");
+	}
 }
 
 void Application::Application::Deinitialize()
@@ -195,6 +229,9 @@ void Application::Application::Deinitialize()
 		delete Graphics::MainFont;
 		Graphics::MainFont = nullptr;
 	}
+
+	Trace::Deinitialize();
+	Log::Deinitialize();
 }
 
 void Application::Application::Run(void)
@@ -286,7 +323,7 @@ int Application::Application::CheckAndReturnFontSize(void)
 	}
 }
 
-bool Application::Application::OpenAndDecodeImageFile(void)
+bool Application::Application::OpenAndDecodeImageFile(const int inputScale)
 {
 	try {
 		OPENFILENAME ofn;
@@ -300,7 +337,7 @@ bool Application::Application::OpenAndDecodeImageFile(void)
 		ofn.hwndOwner       = mWindow->getHandle();
 		ofn.lpstrFile       = szFile;
 		ofn.nMaxFile        = sizeof(szFile);
-		ofn.lpstrFilter     = L"JPG\0*.JPG\0PNG\0*.PNG\0";
+		ofn.lpstrFilter     = L"JPG\0*.JPG;*.JPEG\0PNG\0*.PNG\0TIFF\0*.TIF;*.TIFF\0";
 		ofn.nFilterIndex    = 1;
 		ofn.lpstrFileTitle  = NULL;
 		ofn.nMaxFileTitle   = 0;
@@ -330,13 +367,46 @@ bool Application::Application::OpenAndDecodeImageFile(void)
 				mImage.release();
 			}
 
+			//plan the memory of the image from its header before decoding it
+			int width{ 0 }, height{ 0 };
+			Memory::IMAGE_FORMAT format = Memory::ProbeImageSize(buf, (size_t)n, width, height);
+
+			mMemoryPlan = Memory::PlanImage(format, width, height, inputScale);
+
+			if (mMemoryPlan.mAction == Memory::PA_REFUSE) {
+				delete[] buf;
+				fclose(fp);
+
+				Log::Write(System::ConvertWstringToString(mImageFileFullPath) + " refused: estimated " + std::to_string(mMemoryPlan.mEstimate / Memory::MEGABYTE) +
+				           " MB exceeds the memory budget");
+
+				throw Error::Exception(L"The image needs about " + std::to_wstring(mMemoryPlan.mEstimate / Memory::MEGABYTE) + L" MB, memory budget is " +
+				                       std::to_wstring(Memory::GetBudget() / Memory::MEGABYTE) + L" MB!", L"Open Image Error");
+			}
+
 			//decode from data
-			mImage = imdecode(arr, cv::IMREAD_COLOR);
+			{
+				Trace::Span span("decode", mImageFileFullPath);
+				mImage = imdecode(arr, mMemoryPlan.mDecodeFlags);
+			}
 
 			//delete buffer and close file
 			delete[] buf;
 			fclose(fp);
 
+			//downscale to the planned size (reduced JPEG decoding may already be there)
+			if (mMemoryPlan.mAction == Memory::PA_DOWNSCALE && !mImage.empty()) {
+				int newWidth  = std::max(1, (int)(mMemoryPlan.mWidth * mMemoryPlan.mScale));
+				int newHeight = std::max(1, (int)(mMemoryPlan.mHeight * mMemoryPlan.mScale));
+
+				if (mImage.cols > newWidth || mImage.rows > newHeight) {
+					cv::resize(mImage, mImage, { newWidth, newHeight }, 0.0, 0.0, cv::INTER_AREA);
+				}
+
+				Log::Write(System::ConvertWstringToString(mImageFileFullPath) + " downscaled from " + std::to_string(mMemoryPlan.mWidth) + "x" +
+				           std::to_string(mMemoryPlan.mHeight) + " to fit the memory budget");
+			}
+
 			return true;
 		}
 
@@ -362,222 +432,118 @@ bool Application::Application::ProcessImageFile(const int inputScale, const int
 			inputScale bigger the better results but more processing time
 		*/
 
-		constexpr float confThreshold{ 0.5f };
-		constexpr float nonMaxThreshold{ 0.4f };
-
-		//Load the network
-		cv::dnn::Net net = cv::dnn::readNet(System::ConvertWstringToString(System::GetApplicationDirectory()) + "\\frozen_east_text_detection.pb");
-
-		//prefer GPU and CUDA cores
-		net.setPreferableBackend(cv::dnn::DNN_BACKEND_CUDA);
-		net.setPreferableTarget(cv::dnn::DNN_TARGET_CUDA);
-
-		//prepare the input image 
-		cv::Mat blob;
-		cv::dnn::blobFromImage(mImage, blob, 1.0f, cv::Size(inputScale, inputScale), cv::Scalar(123.68, 116.78, 103.94), true, false);
-
-		//pass input through the netwok
-		std::vector<cv::String> outputLayers(2);
-		outputLayers[0] = "feature_fusion/Conv_7/Sigmoid";
-		outputLayers[1] = "feature_fusion/concat_3";
-
-		std::vector<cv::Mat> output;
-		net.setInput(blob);
-		net.forward(output, outputLayers);
-		cv::Mat scores = output[0];
-		cv::Mat geometry = output[1];
-
-		//process the output
-		std::vector<cv::RotatedRect> boxes;
-		std::vector<float>           confidences;
-
-		CV_Assert(scores.dims == 4); CV_Assert(geometry.dims == 4); CV_Assert(scores.size[0] == 1);
-		CV_Assert(geometry.size[0] == 1); CV_Assert(scores.size[1] == 1); CV_Assert(geometry.size[1] == 5);
-		CV_Assert(scores.size[2] == geometry.size[2]); CV_Assert(scores.size[3] == geometry.size[3]);
-
-		const int height = scores.size[2];
-		const int width = scores.size[3];
-		for (int y = 0; y < height; ++y) {
-			const float* scoresData = scores.ptr<float>(0, 0, y);
-			const float* x0_data    = geometry.ptr<float>(0, 0, y);
-			const float* x1_data    = geometry.ptr<float>(0, 1, y);
-			const float* x2_data    = geometry.ptr<float>(0, 2, y);
-			const float* x3_data    = geometry.ptr<float>(0, 3, y);
-			const float* anglesData = geometry.ptr<float>(0, 4, y);
-			for (int x = 0; x < width; ++x) {
-				float score = scoresData[x];
-				if (score < confThreshold)
-					continue;
-
-				// Decode a prediction.
-				// Multiple by 4 because feature maps are 4 time less than input image.
-				float offsetX = x * 4.0f, offsetY = y * 4.0f;
-				float angle   = anglesData[x];
-				float cosA    = std::cos(angle);
-				float sinA    = std::sin(angle);
-				float h       = x0_data[x] + x2_data[x];
-				float w       = x1_data[x] + x3_data[x];
-
-				cv::Point2f offset(offsetX + cosA * x1_data[x] + sinA * x2_data[x], offsetY - sinA * x1_data[x] + cosA * x2_data[x]);
-				cv::Point2f p1 = cv::Point2f(-sinA * h, -cosA * h) + offset;
-				cv::Point2f p3 = cv::Point2f(-cosA * w, sinA * w) + offset;
-				cv::RotatedRect r(0.5f * (p1 + p3), cv::Size2f(w, h), -angle * 180.0f / (float)CV_PI);
-				boxes.push_back(r);
-				confidences.push_back(score);
-			}
-		}
+		Trace::Span imageSpan("image", mImageFileFullPath);
 
-		// filter out the false positives
-		std::vector<int> indices;
-		cv::dnn::NMSBoxes(boxes, confidences, confThreshold, nonMaxThreshold, indices); 
+		// wait until the image fits into the memory budget (images with unknown headers are estimated after decoding)
+		size_t estimate = mMemoryPlan.mEstimate ? mMemoryPlan.mEstimate : Memory::EstimateImageBytes(mImage.cols, mImage.rows, inputScale);
 
-		//
-		// Render detections
-		//
+		Memory::Ticket  ticket(estimate);
+		Memory::Account account;
+		Memory::Tracker imageTracker(account, Memory::MC_IMAGE, mImage);
 
-		// initialize tesseract
-		tesseract::TessBaseAPI* ocr = new tesseract::TessBaseAPI();
+		// scratch data of the image comes from the worker's arena and is released at once when the image is done
+		Memory::Arena&     arena = Memory::GetThreadArena();
+		Memory::ArenaScope arenaScope(arena);
+		const size_t       arenaBlocks = arena.getBlockAllocations();
 
-		std::string path = System::ConvertWstringToString(System::GetApplicationDirectory()) + "\\tessdata";
-		if (ocr->Init(path.c_str(), "tur")) {
-			throw Error::Exception(L"Can't initialize Tesserract!", L"Image Processing Error");
-		}
-		
-		// set page seg mode
-		ocr->SetPageSegMode(tesseract::PSM_SINGLE_WORD);
-		
-		// convert image to gray scale for proper text recognition
-		cv::Mat greyImage;
-		cv::cvtColor(mImage, greyImage, cv::COLOR_BGR2GRAY);
-
-		// set image
-		ocr->SetImage(greyImage.data, (int)greyImage.cols, (int)greyImage.rows, 1, (int)greyImage.step);
-
-		//convert BGR to ABGR
-		cv::cvtColor(mImage, mImage, cv::COLOR_BGR2BGRA);
-
-		std::wfstream file{ mImageFileFullPath+L"_words.txt", std::ios::out | std::ios::trunc};
-		file.imbue(std::locale(std::locale(), new std::codecvt_utf8<wchar_t>()));
-
-		cv::Point2f ratio((float)mImage.cols / inputScale, (float)mImage.rows / inputScale);
-		for (size_t i = 0; i < indices.size(); ++i) {
-			cv::RotatedRect& box = boxes[indices[i]];
-
-			// set box 
-			int minX{ std::numeric_limits<int>::max() }, minY{ std::numeric_limits<int>::max() };
-			int maxX{ std::numeric_limits<int>::min() }, maxY{ std::numeric_limits<int>::min() };
-			cv::Point2f vertices[4];
-			box.points(vertices);
-			for (int j = 0; j < 4; ++j) {
-				vertices[j].x *= ratio.x;
-				vertices[j].y *= ratio.y;
-
-				//calculate bounding box of the rotated rect
-				if (vertices[j].x < minX) {
-					minX = (int)vertices[j].x;
-				}
+		arena.resetPeak();
 
-				if (vertices[j].x > maxX) {
-					maxX = (int)std::roundf(vertices[j].x);
-				}
+		// words go to the file as the recognizer's UTF-8 bytes
+		Output::WordWriter file;
 
-				if (vertices[j].y < minY) {
-					minY = (int)vertices[j].y;
-				}
+		if (!file.open(mImageFileFullPath + L"_words.txt", (size_t)std::max(Settings::GetInt(L"Output", L"BufferKB", 1024), 4) * 1024,
+		               Settings::GetBool(L"Output", L"AsyncFlush", false))) {
+			throw Error::Exception(L"Can't create the words file!", L"Image Processing Error");
+		}
 
-				if (vertices[j].y > maxY) {
-					maxY = (int)std::roundf(vertices[j].y);
-				}
-			}
+		// boxes of the image with their words for the boxes file (in image coordinates)
+		std::vector<Detection::Box> imageBoxes;
+		std::vector<std::string>    imageWords;
 
-			//draw line connecting the vertices
-			for (int j = 0; j < 4; ++j) {
-				cv::line(mImage, vertices[j], vertices[(j + 1) % 4], { 0 ,255, 0 }, 1, cv::LINE_AA);
-			}
+		const cv::Rect imageRect(0, 0, mImage.cols, mImage.rows);
+		const bool     tiled = mMemoryPlan.mAction == Memory::PA_TILE && mMemoryPlan.mTileSize < std::max(mImage.cols, mImage.rows);
 
-			//get text on the rectangle 
-			if (minX >= 0 && maxX <= mImage.cols && minY>= 0 && maxY <= mImage.rows) {
-				//set rectangle to recognize text
-				ocr->SetRectangle(minX, minY, maxX - minX, maxY - minY);
-				
-				if (ocr->MeanTextConf()) {
-					//get text
-					char*       text    = ocr->GetUTF8Text();
-					std::string wordStr = text;
-					delete[] text;
-					//convert UTF8 string to wstring
-					std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>, wchar_t> converter;
-					std::wstring word = converter.from_bytes(wordStr);
-
-					file << word + L'\n';
-					
-					// create text element
-					Graphics::Text textElement{ word, fontSize, Graphics::MainFont };
-
-					if (!textElement.compose()) {
-						continue;
-					}
-					
-					//create text mat					
-					cv::Mat textImage(textElement.getHeight(), textElement.getWidth(), CV_8UC4, textElement.getBits());
-					
-					// create mask mat (unfortunately somehow OpenCV doesn't process Alpha channel)
-					BYTE* maskBits = new BYTE[textElement.getHeight() * textElement.getWidth()];
-					BYTE* textBits = textElement.getBits();
-
-					for (int i = 0;i < textElement.getHeight() * textElement.getWidth() * 4;i += 4) {
-						if (textBits[i + 3] == 0) { //transparent
-							maskBits[i / 4] = 0;
-						} else { //not transparent
-							maskBits[i / 4] = 1;
-						}
-					}
+		// clean document scans go through Tesseract's page layout analysis (tiled images stay on the detector)
+		Classifier::Decision decision{ Classifier::RT_DETECTOR, Classifier::Statistics{}, std::string{ "classifier disabled" } };
 
-					cv::Mat maskMat(textElement.getHeight(), textElement.getWidth(), CV_8UC1, maskBits);
+		if (Settings::GetBool(L"Classifier", L"Enabled", true)) {
+			decision = Classifier::Classify(mImage);
 
-					delete[] maskBits;
+			if (decision.mRoute == Classifier::RT_PAGE && tiled) {
+				decision.mRoute  = Classifier::RT_DETECTOR;
+				decision.mReason = "tiled";
+			}
+		}
 
-					//draw text mat on image 
-					int x1{ minX }, y1{ minY - fontSize };
-					int x2{ minX + textImage.cols }, y2{ minY - fontSize + textImage.rows };
+		Log::Write(System::ConvertWstringToString(mImageFileFullPath) + ": " + Classifier::Describe(decision));
 
-					//check bounds (make sure textImage fits in the processed Image)
-					if (x1 < 0) {
-						x1 = 0;
-					}
+		if (decision.mRoute == Classifier::RT_PAGE) {
+			ProcessPage(file, account, fontSize, imageBoxes, imageWords);
+		} else {
+			//Load the detector on the backend selected at startup
+			Trace::Span loadSpan("load network");
+			Inference::ConfigureThreads(false);
+			std::unique_ptr<Detection::Detector> detector = Detection::CreateDetector();
+			loadSpan.end();
 
-					if (x2 > mImage.cols) {
-						x2 = mImage.cols;
-					}
+			// initialize the recognizer
+			Trace::Span recognizerSpan("recognizer init");
+			std::unique_ptr<Recognition::Recognizer> recognizer = Recognition::CreateRecognizer();
+			recognizerSpan.end();
 
-					if (y1 < 0) {
-						y1 = 0;
-					}
+			// strip buffer of the recognizer input is shared by the regions
+			Rectification::Rectifier rectifier;
 
-					if (y2 > mImage.rows) {
-						y2 = mImage.rows;
-					}
+			// outlines and words are drawn after the last tile, a tile never sees the overlay of its neighbours
+			std::vector<Detection::Box> outlines;
+			std::vector<cv::Point>      origins;
+
+			//
+			// Process the whole image or tile by tile if the memory plan says so
+			//
+			const int step = tiled ? mMemoryPlan.mTileSize - 2 * Memory::TILE_OVERLAP : std::max(mImage.cols, mImage.rows);
 
-					//crop text image in case bounds are changed
-					textImage = textImage(cv::Range(0, y2 - y1), cv::Range(0, x2 - x1));
+			for (int y = 0; y < mImage.rows; y += step) {
+				for (int x = 0; x < mImage.cols; x += step) {
+					// words are kept by the tile that contains their center, the overlap only gives them room
+					cv::Rect core   = cv::Rect(x, y, step, step) & imageRect;
+					cv::Rect region = tiled ? cv::Rect(x - Memory::TILE_OVERLAP, y - Memory::TILE_OVERLAP, mMemoryPlan.mTileSize, mMemoryPlan.mTileSize) & imageRect : core;
 
-					//crop mask Mat in case bounds are changed
-					maskMat = maskMat(cv::Range(0, y2 - y1), cv::Range(0, x2 - x1));
+					ProcessImageRegion(*detector, rectifier, *recognizer, file, account, region, core, inputScale, outlines, imageBoxes, imageWords, origins);
+				}
+			}
 
-					// copy text image to processed image using the mask
-					textImage.copyTo(mImage.rowRange(y1, y2).colRange(x1, x2), maskMat);
+			//
+			// Render detections
+			//
+			Batch::DrawBoxes(mImage, outlines);
 
-					textImage.release();
+			for (size_t i = 0; i < imageWords.size(); ++i) {
+				if (!imageWords[i].empty()) {
+					Graphics::RenderText(mImage, imageWords[i], origins[i].x, origins[i].y, fontSize);
 				}
 			}
 		}
 		
-		file.close();
+		const bool written = file.close();
 
-		// Destroy tesseract object and release memory
-		greyImage.release();
-		ocr->End();
-		delete ocr;
+		if (Settings::GetBool(L"Batch", L"WriteBoxes", false) &&
+		    !Spatial::WriteBoxes(Batch::GetBoxesPath(mImageFileFullPath), mImage.size(), imageBoxes, imageWords)) {
+			throw Error::Exception(L"Can't write the boxes file!", L"Image Processing Error");
+		}
+
+		// report memory of the image
+		Log::Write(System::ConvertWstringToString(mImageFileFullPath) + " (" + std::to_string(mImage.cols) + "x" + std::to_string(mImage.rows) +
+		           (tiled ? ", " + std::to_string(mMemoryPlan.mTileSize) + " px tiles" : std::string{}) + "): estimated " +
+		           std::to_string(estimate / Memory::MEGABYTE) + " MB, " + account.getReport() + ", arena peak " + std::to_string(arena.getPeak() / 1024) +
+		           " KB in " + std::to_string(arena.getBlockAllocations() - arenaBlocks) + " new blocks");
+
+		imageSpan.end();
+		Trace::Flush();
+
+		if (!written) {
+			throw Error::Exception(L"Can't write the words file!", L"Image Processing Error");
+		}
 
 		return true;
 	} catch (Error::Exception& ex) {
@@ -591,6 +557,150 @@ bool Application::Application::ProcessImageFile(const int inputScale, const int
 	}
 }
 
+void Application::Application::ProcessImageRegion(Detection::Detector& detector, Rectification::Rectifier& rectifier, Recognition::Recognizer& recognizer,
+                                                   Output::WordWriter& file, Memory::Account& account, const cv::Rect& region, const cv::Rect& core, const int inputScale,
+                                                   std::vector<Detection::Box>& outlines, std::vector<Detection::Box>& imageBoxes, std::vector<std::string>& imageWords,
+                                                   std::vector<cv::Point>& origins)
+{
+	// view of the region on the image (no copy)
+	cv::Mat image = mImage(region);
+
+	// detect the text boxes (in region coordinates)
+	std::vector<Detection::Box> boxes;
+	detector.detect(image, inputScale, account, boxes);
+
+	// convert region to gray scale for proper text recognition
+	cv::Mat greyImage;
+	cv::cvtColor(image, greyImage, cv::COLOR_BGR2GRAY);
+	Memory::Tracker greyTracker(account, Memory::MC_GREY, greyImage);
+
+	// boxes of the region that are recognized and their bounds (in region coordinates)
+	std::vector<Detection::Box> wordBoxes;
+	std::vector<cv::Rect>       rects;
+	wordBoxes.reserve(boxes.size());
+	rects.reserve(boxes.size());
+
+	for (size_t i = 0; i < boxes.size(); ++i) {
+		// set box (in image coordinates)
+		int minX{ std::numeric_limits<int>::max() }, minY{ std::numeric_limits<int>::max() };
+		int maxX{ std::numeric_limits<int>::min() }, maxY{ std::numeric_limits<int>::min() };
+		cv::Point2f vertices[4];
+		cv::Point2f center(0.0f, 0.0f);
+		for (int j = 0; j < 4; ++j) {
+			vertices[j].x = boxes[i].mVertices[j].x + region.x;
+			vertices[j].y = boxes[i].mVertices[j].y + region.y;
+			center       += vertices[j] * 0.25f;
+
+			//calculate bounding box of the rotated rect
+			if (vertices[j].x < minX) {
+				minX = (int)vertices[j].x;
+			}
+
+			if (vertices[j].x > maxX) {
+				maxX = (int)std::roundf(vertices[j].x);
+			}
+
+			if (vertices[j].y < minY) {
+				minY = (int)vertices[j].y;
+			}
+
+			if (vertices[j].y > maxY) {
+				maxY = (int)std::roundf(vertices[j].y);
+			}
+		}
+
+		// the word belongs to the neighbouring tile
+		if (!core.contains(cv::Point((int)center.x, (int)center.y))) {
+			continue;
+		}
+
+		// the outline is drawn by the caller after the last region
+		Detection::Box outline = boxes[i];
+
+		for (int j = 0; j < 4; ++j) {
+			outline.mVertices[j] = vertices[j];
+		}
+
+		outlines.push_back(outline);
+
+		//get text on the rectangle
+		if (minX >= region.x && maxX <= region.x + region.width && minY >= region.y && maxY <= region.y + region.height) {
+			wordBoxes.push_back(boxes[i]);
+			rects.push_back(cv::Rect(minX - region.x, minY - region.y, maxX - minX, maxY - minY));
+		}
+	}
+
+	// warp the rotated boxes into upright strips
+	std::vector<cv::Mat> strips;
+	rectifier.rectify(greyImage, wordBoxes, strips);
+	Memory::Tracker stripTracker(account, Memory::MC_GREY, rectifier.getBufferBytes());
+
+	// recognize the words of the region at once (batched by the recognizer if it can)
+	std::vector<std::string> words;
+	recognizer.recognize(strips, account, words);
+
+	for (size_t i = 0; i < rects.size(); ++i) {
+		// every recognized box is kept for the boxes file, empty words count like in the batch outputs
+		Detection::Box box = wordBoxes[i];
+
+		for (cv::Point2f& vertex : box.mVertices) {
+			vertex.x += (float)region.x;
+			vertex.y += (float)region.y;
+		}
+
+		imageBoxes.push_back(box);
+		imageWords.push_back(words[i]);
+		origins.push_back(cv::Point(rects[i].x + region.x, rects[i].y + region.y));
+
+		// UTF-8 bytes are written as they are, only the overlay needs the wide string
+		if (!words[i].empty()) {
+			file.writeLine(words[i].c_str());
+		}
+	}
+
+	greyImage.release();
+}
+
+void Application::Application::ProcessPage(Output::WordWriter& file, Memory::Account& account, const int fontSize, std::vector<Detection::Box>& imageBoxes,
+                                           std::vector<std::string>& imageWords)
+{
+	// convert image to gray scale for proper text recognition
+	cv::Mat greyImage;
+	cv::cvtColor(mImage, greyImage, cv::COLOR_BGR2GRAY);
+	Memory::Tracker greyTracker(account, Memory::MC_GREY, greyImage);
+
+	// page layout analysis gives the words with their boxes
+	Trace::Span                      tesseractSpan("recognizer init");
+	Recognition::TesseractRecognizer tesseract;
+	tesseractSpan.end();
+
+	std::vector<cv::Rect>    rects;
+	std::vector<std::string> words;
+	tesseract.recognizePage(greyImage, account, rects, words);
+
+	greyImage.release();
+
+	for (size_t i = 0; i < rects.size(); ++i) {
+		//draw the word box
+		cv::rectangle(mImage, rects[i], { 0 ,255, 0 }, 1, cv::LINE_AA);
+
+		file.writeLine(words[i].c_str());
+
+		// the page words are upright boxes without a detector score
+		const cv::RotatedRect upright(cv::Point2f(rects[i].x + rects[i].width * 0.5f, rects[i].y + rects[i].height * 0.5f),
+		                              cv::Size2f((float)rects[i].width, (float)rects[i].height), 0.0f);
+		Detection::Box        box;
+
+		upright.points(box.mVertices);
+		box.mConfidence = 1.0f;
+
+		imageBoxes.push_back(box);
+		imageWords.push_back(words[i]);
+
+		Graphics::RenderText(mImage, words[i], rects[i].x, rects[i].y, fontSize);
+	}
+}
+
 bool Application::Application::ShowImageFile(void)
 {
 	try {
@@ -658,7 +768,7 @@ LRESULT CALLBACK Application::Application::WndProc(HWND hwnd, UINT msg, WPARAM w
 					if (inputScale) {
 						int fontSize = CheckAndReturnFontSize();
 						if (fontSize) {
-							if (OpenAndDecodeImageFile()) {
+							if (OpenAndDecodeImageFile(inputScale)) {
 								if (ProcessImageFile(inputScale, fontSize)) {
 									ShowImageFile();
 								}
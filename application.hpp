@@ -17,6 +17,11 @@
 
 #include "main.hpp"
 #include "gui.hpp"
+#include "memory.hpp"
+#include "detector.hpp"
+#include "recognizer.hpp"
+#include "rectifier.hpp"
+#include "output.hpp"
 #include <opencv2\opencv.hpp>
 
 namespace Application
@@ -79,8 +84,13 @@ namespace Application
 			static int CheckAndReturnFontSize(void);
 			/**
 				Opens the image using image selector and decodes it(returns true on success)
+
+				Image size is read from the file header first, images exceeding the memory budget
+				are refused or decoded smaller depending on the budget policy
+
+				inputScale - scale of the input image
 			*/
-			static bool OpenAndDecodeImageFile(void);
+			static bool OpenAndDecodeImageFile(const int inputScale);
 			/**
 				Processes the image file detecting text on the image(returns true on success)
 
@@ -101,6 +111,28 @@ namespace Application
 
 		private:
 
+			/**
+				Detects and recognizes the text on a region of the image, the image isn't drawn on (the caller renders the
+				outlines and the words after the last region, so overlapping regions see the original pixels)
+
+				region     - region of the image given to the detector and the recognizer
+				core       - words whose centers are outside of the core belong to another region
+				outlines   - boxes of the region to outline are appended (in image coordinates)
+				imageBoxes - recognized boxes of the region are appended (in image coordinates)
+				imageWords - UTF-8 word of each appended box
+				origins    - top left corner of the rendered text of each appended box (in image coordinates)
+			*/
+			static void ProcessImageRegion(Detection::Detector& detector, Rectification::Rectifier& rectifier, Recognition::Recognizer& recognizer, Output::WordWriter& file,
+			                               Memory::Account& account, const cv::Rect& region, const cv::Rect& core, const int inputScale,
+			                               std::vector<Detection::Box>& outlines, std::vector<Detection::Box>& imageBoxes, std::vector<std::string>& imageWords,
+			                               std::vector<cv::Point>& origins);
+			/**
+				Recognizes the whole image with Tesseract's page layout analysis and renders the words (clean document scans), the word
+				boxes are appended to imageBoxes and the words to imageWords
+			*/
+			static void ProcessPage(Output::WordWriter& file, Memory::Account& account, const int fontSize, std::vector<Detection::Box>& imageBoxes,
+			                        std::vector<std::string>& imageWords);
+
 			static HINSTANCE    mInstance;
 			static std::wstring mCmdLine;
 			static int          mCmdShow;
@@ -115,6 +147,7 @@ namespace Application
 			static GUI::Button*   mCloseWindowBtn;       //Main Window's Close Window Button
 			static cv::Mat        mImage;                //Image file to be processed
 			static std::wstring   mImageFileFullPath;    //Full path of the image file
+			static Memory::Plan   mMemoryPlan;           //Memory plan of the image file
 	};
 }
 
@@ -0,0 +1,835 @@
+#include "batch.hpp"
+#include "error.hpp"
+#include "graphics.hpp"
+#include "inference.hpp"
+#include "log.hpp"
+#include "output.hpp"
+#include "settings.hpp"
+#include "spatial.hpp"
+#include "system.hpp"
+#include "trace.hpp"
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cwchar>
+
+namespace
+{
+	//
+	// Local Functions
+	//
+
+	/**
+		Writes the bytes to the file (returns false on failure)
+	*/
+	bool WriteFile(const std::wstring& fileName, const std::vector<unsigned char>& data)
+	{
+		FILE* file = _wfopen(fileName.c_str(), L"wb");
+
+		if (!file) {
+			return false;
+		}
+
+		bool written = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+
+		return std::fclose(file) == 0 && written;
+	}
+
+	/**
+		Downscales the decoded image to the size of its memory plan (returns false if the image is empty)
+	*/
+	bool FitPlan(const Memory::Plan& plan, cv::Mat& image)
+	{
+		if (image.empty()) {
+			return false;
+		}
+
+		// batches plan without tiles, so the image is either kept or downscaled
+		if (plan.mAction == Memory::PA_DOWNSCALE) {
+			int newWidth  = std::max(1, (int)(plan.mWidth * plan.mScale));
+			int newHeight = std::max(1, (int)(plan.mHeight * plan.mScale));
+
+			if (image.cols > newWidth || image.rows > newHeight) {
+				cv::resize(image, image, { newWidth, newHeight }, 0.0, 0.0, cv::INTER_AREA);
+			}
+		}
+
+		return true;
+	}
+}
+
+//
+// Processor Class Member Functions
+//
+Batch::Processor::Processor(Scheduler::Pool& pool, const Options& options) :
+	mPool(pool), mOptions(options), mCallback(), mEngines(pool.getWorkerCount()), mIndex(), mSearch(), mResults(), mImages(0), mDuplicates(0), mFailed(0),
+	mBoxes(0), mWords(0)
+{
+	if (mOptions.mIndexes) {
+		mIndex   = Deduplication::CreateIndex();
+		mSearch  = Search::CreateWriter();
+		mResults = Results::CreateWriter(mOptions.mResultsFolder);
+	}
+
+	//
+	// One task per worker: every task waits until all of them have started, so no worker can take two of them
+	//
+	const int               workers = pool.getWorkerCount();
+	int                     arrived{ 0 };
+	std::mutex              mutex;
+	std::condition_variable condition;
+	std::wstring            error;
+
+	for (int i = 0; i < workers; ++i) {
+		mPool.submit([&]() {
+			try {
+				getEngines();
+			} catch (Error::Exception& ex) {
+				std::lock_guard<std::mutex> lock(mutex);
+				error = ex.getErrorMessage();
+			} catch (std::exception& ex) {
+				std::lock_guard<std::mutex> lock(mutex);
+				error = System::ConvertStringToWstring(ex.what());
+			}
+
+			std::unique_lock<std::mutex> lock(mutex);
+
+			if (++arrived == workers) {
+				condition.notify_all();
+			} else {
+				condition.wait(lock, [&]() {
+					return arrived == workers;
+				});
+			}
+		});
+	}
+
+	mPool.wait();
+
+	if (!error.empty()) {
+		throw Error::Exception(L"Can't create the engines of a worker: " + error, L"Batch Error");
+	}
+}
+
+Batch::Statistics Batch::Processor::run(const std::vector<std::wstring>& files)
+{
+	mImages     = 0;
+	mDuplicates = 0;
+	mFailed     = 0;
+	mBoxes      = 0;
+	mWords      = 0;
+
+	int64_t start = cv::getTickCount();
+
+	std::vector<cv::Size> pages;
+
+	for (const std::wstring& file : files) {
+		// a multi-page TIFF goes page by page, a single page TIFF is read like any other image
+		if (IsTiff(file) && Memory::ProbeTiffPages(file, pages) && pages.size() > 1) {
+			submitPages(file, pages);
+
+			continue;
+		}
+
+		std::shared_ptr<Job> job(new Job());
+		job->mFile        = file;
+		job->mPage        = 0;
+		job->mFingerprint = Deduplication::Fingerprint{};
+		job->mRemaining   = 0;
+
+		{
+			Trace::Span span("read", file);
+
+			if (!System::ReadFile(file, job->mData)) {
+				fail(file, "can't be read");
+
+				continue;
+			}
+		}
+
+		// plan the memory of the image from its header before decoding it
+		int                  width{ 0 }, height{ 0 };
+		Memory::IMAGE_FORMAT format = Memory::ProbeImageSize((const char*)job->mData.data(), job->mData.size(), width, height);
+
+		job->mPlan = Memory::PlanImage(format, width, height, mOptions.mInputScale, false);
+
+		if (job->mPlan.mAction == Memory::PA_REFUSE) {
+			fail(file, "refused: estimated " + std::to_string(job->mPlan.mEstimate / Memory::MEGABYTE) + " MB exceeds the memory budget");
+
+			continue;
+		}
+
+		// reading waits here while the images in flight fill the budget
+		job->mTicket.reset(new Memory::Ticket(job->mPlan.mEstimate ? job->mPlan.mEstimate : job->mData.size() * 4));
+
+		mPool.submit([this, job]() {
+			detect(job);
+		});
+	}
+
+	mPool.wait();
+
+	if (mSearch && !mSearch->flush()) {
+		Log::Write("The last words of the batch can't be written to the search index");
+	}
+
+	if (mResults && !mResults->flush()) {
+		Log::Write("The last rows of the batch can't be written to the results");
+	}
+
+	Statistics statistics;
+	statistics.mImages     = mImages;
+	statistics.mDuplicates = mDuplicates;
+	statistics.mFailed     = mFailed;
+	statistics.mBoxes      = mBoxes;
+	statistics.mWords      = mWords;
+	statistics.mSeconds    = (double)(cv::getTickCount() - start) / cv::getTickFrequency();
+
+	return statistics;
+}
+
+Batch::Processor::Engines& Batch::Processor::getEngines(void)
+{
+	const int index = Scheduler::GetWorkerIndex();
+
+	if (index < 0 || index >= (int)mEngines.size()) {
+		throw Error::Exception(L"Batch engines are used outside of the pool!", L"Batch Error");
+	}
+
+	// only this worker touches its engines, so they are created without a lock
+	Engines& engines = mEngines[index];
+
+	if (!engines.mDetector) {
+		Trace::Span span("engines init");
+
+		engines.mDetector   = Detection::CreateDetector();
+		engines.mRectifier  = std::unique_ptr<Rectification::Rectifier>(new Rectification::Rectifier());
+		engines.mRecognizer = Recognition::CreateRecognizer();
+	}
+
+	return engines;
+}
+
+void Batch::Processor::submitPages(const std::wstring& file, const std::vector<cv::Size>& pages)
+{
+	std::shared_ptr<Document> document(new Document());
+	document->mFile       = file;
+	document->mPages      = pages.size();
+	document->mWriting    = false;
+	document->mWriteError = false;
+	document->mNext       = 0;
+
+	if (mOptions.mWriteWords) {
+		document->mWriting = document->mWriter.open(GetWordsPath(file), (size_t)std::max(Settings::GetInt(L"Output", L"BufferKB", 1024), 4) * 1024,
+		                                            Settings::GetBool(L"Output", L"AsyncFlush", false));
+		document->mWriteError = !document->mWriting;
+	}
+
+	Log::Write(System::ConvertWstringToString(file) + ": " + std::to_string(pages.size()) + " pages");
+
+	for (size_t page = 0; page < pages.size(); ++page) {
+		std::shared_ptr<Job> job(new Job());
+		job->mFile        = file;
+		job->mDocument    = document;
+		job->mPage        = page;
+		job->mFingerprint = Deduplication::Fingerprint{};
+		job->mRemaining   = 0;
+		job->mPlan        = Memory::PlanImage(Memory::IF_TIFF, pages[page].width, pages[page].height, mOptions.mInputScale, false);
+
+		if (job->mPlan.mAction == Memory::PA_REFUSE) {
+			fail(job, "refused: estimated " + std::to_string(job->mPlan.mEstimate / Memory::MEGABYTE) + " MB exceeds the memory budget");
+
+			continue;
+		}
+
+		// reading waits here while the images in flight fill the budget, so the pages of a long TIFF aren't all decoded at once
+		job->mTicket.reset(new Memory::Ticket(job->mPlan.mEstimate));
+
+		mPool.submit([this, job]() {
+			detect(job);
+		});
+	}
+}
+
+void Batch::Processor::detect(const std::shared_ptr<Job>& job)
+{
+	Trace::Span span("image", Trace::IsEnabled() ? System::ConvertWstringToString(job->mDocument ? GetPagePath(job->mFile, job->mPage) : job->mFile) : std::string{});
+
+	try {
+		const bool decoded = job->mDocument ? DecodePage(job->mFile, job->mPage, job->mPlan, job->mImage) : DecodeImage(job->mData, job->mPlan, job->mImage);
+
+		if (!decoded) {
+			fail(job, "can't be decoded");
+
+			return;
+		}
+
+		job->mData = std::vector<unsigned char>{};
+
+		if (reuse(job)) {
+			return;
+		}
+
+		// buffers of the image outlive this task, so they are tracked until the image is finished
+		job->mAccount.track(Memory::MC_IMAGE, Memory::GetMatBytes(job->mImage));
+
+		std::vector<Detection::Box> boxes;
+		getEngines().mDetector->detect(job->mImage, mOptions.mInputScale, job->mAccount, boxes);
+
+		cv::cvtColor(job->mImage, job->mGrey, cv::COLOR_BGR2GRAY);
+		job->mAccount.track(Memory::MC_GREY, Memory::GetMatBytes(job->mGrey));
+
+		// boxes that are recognized and their outlines
+		SelectBoxes(job->mImage.size(), boxes, job->mBoxes, job->mRects);
+
+		if (mOptions.mRender) {
+			DrawBoxes(job->mImage, job->mBoxes);
+		}
+
+		job->mWords.assign(job->mBoxes.size(), std::string{});
+		job->mConfidences.assign(job->mBoxes.size(), 0.0f);
+
+		if (job->mBoxes.empty()) {
+			finish(job);
+
+			return;
+		}
+
+		//
+		// Spawn the box tasks (they go to this worker's deque, idle workers steal them)
+		//
+		const size_t perTask = std::max<size_t>(1, mOptions.mBoxesPerTask);
+		const size_t tasks   = (job->mBoxes.size() + perTask - 1) / perTask;
+
+		job->mRemaining = tasks;
+
+		for (size_t first = 0; first < job->mBoxes.size(); first += perTask) {
+			const size_t count = std::min(perTask, job->mBoxes.size() - first);
+
+			mPool.submit([this, job, first, count]() {
+				recognize(job, first, count);
+			});
+		}
+	} catch (...) {
+		fail(job, "detection failed");
+
+		throw;
+	}
+}
+
+void Batch::Processor::recognize(const std::shared_ptr<Job>& job, const size_t first, const size_t count)
+{
+	Trace::Span span("boxes", Trace::IsEnabled() ? std::to_string(first) + "+" + std::to_string(count) : std::string{});
+
+	try {
+		Engines& engines = getEngines();
+
+		// strips and words of the slice (strips are views on the worker's rectifier buffer)
+		std::vector<Detection::Box> boxes(job->mBoxes.begin() + first, job->mBoxes.begin() + first + count);
+		std::vector<cv::Mat>        strips;
+		std::vector<std::string>    words;
+
+		engines.mRectifier->rectify(job->mGrey, boxes, strips);
+		engines.mRecognizer->recognize(strips, job->mAccount, words);
+
+		// slices don't overlap, so the words are stored without a lock
+		const std::vector<float>& confidences = engines.mRecognizer->getConfidences();
+
+		for (size_t i = 0; i < count; ++i) {
+			job->mWords[first + i]       = words[i];
+			job->mConfidences[first + i] = i < confidences.size() ? confidences[i] : 0.0f;
+		}
+
+		if (mOptions.mRender) {
+			std::lock_guard<std::mutex> lock(job->mMutex);
+
+			for (size_t i = 0; i < count; ++i) {
+				if (!words[i].empty()) {
+					Graphics::RenderText(job->mImage, words[i], job->mRects[first + i].x, job->mRects[first + i].y, mOptions.mFontSize);
+				}
+			}
+		}
+	} catch (...) {
+		// the image is still finished by its last box task, the words of this slice stay empty
+		if (--job->mRemaining == 0) {
+			finish(job);
+		}
+
+		throw;
+	}
+
+	if (--job->mRemaining == 0) {
+		finish(job);
+	}
+}
+
+void Batch::Processor::finish(const std::shared_ptr<Job>& job)
+{
+	std::string error;
+	size_t      words{ 0 };
+
+	// the words of a page go to the words file of its image, only the other outputs are written for the page
+	Options pageOptions     = mOptions;
+	pageOptions.mWriteWords = false;
+
+	const std::wstring name = job->mDocument ? GetPagePath(job->mFile, job->mPage) : job->mFile;
+
+	if (!WriteOutputs(name, job->mBoxes, job->mWords, job->mImage, job->mDocument ? pageOptions : mOptions, error)) {
+		fail(job, error);
+
+		return;
+	}
+
+	for (const std::string& word : job->mWords) {
+		words += word.empty() ? 0 : 1;
+	}
+
+	Log::Write(System::ConvertWstringToString(name) + ": " + std::to_string(job->mBoxes.size()) + " boxes, " + std::to_string(words) + " words (" +
+	           job->mAccount.getReport() + ")");
+
+	mBoxes += job->mBoxes.size();
+	mWords += words;
+	++mImages;
+
+	if (mIndex && !job->mDocument) {
+		mIndex->add(job->mFingerprint, job->mFile);
+	}
+
+	if (mSearch) {
+		mSearch->add(name, job->mWords);
+	}
+
+	if (mResults) {
+		mResults->add(name, job->mBoxes, job->mWords, job->mConfidences);
+	}
+
+	// the budget is free for the next image as soon as the image is done, the job may live on in the captures a little longer
+	job->mAccount.untrack(Memory::MC_GREY, Memory::GetMatBytes(job->mGrey));
+	job->mAccount.untrack(Memory::MC_IMAGE, Memory::GetMatBytes(job->mImage));
+	job->mImage.release();
+	job->mGrey.release();
+	job->mTicket.reset();
+
+	if (job->mDocument) {
+		finishPage(job, true);
+	} else if (mCallback) {
+		mCallback(job->mFile, true);
+	}
+}
+
+void Batch::Processor::finishPage(const std::shared_ptr<Job>& job, const bool success)
+{
+	Document& document = *job->mDocument;
+	bool      finished{ false }, written{ false };
+
+	{
+		std::lock_guard<std::mutex> lock(document.mMutex);
+
+		document.mWaiting[job->mPage] = success ? std::move(job->mWords) : std::vector<std::string>{};
+
+		if (!success) {
+			document.mFailedPages.insert(job->mPage);
+		}
+
+		//
+		// Pages go to the words file in order, a page that finished early waits for the pages before it
+		//
+		for (auto waiting = document.mWaiting.find(document.mNext); waiting != document.mWaiting.end(); waiting = document.mWaiting.find(document.mNext)) {
+			if (document.mWriting) {
+				const bool failed = document.mFailedPages.count(document.mNext) != 0;
+
+				document.mWriter.writeLine(("# page " + std::to_string(document.mNext + 1) + (failed ? " failed" : "")).c_str());
+
+				for (const std::string& word : waiting->second) {
+					if (!word.empty()) {
+						document.mWriter.writeLine(word.c_str());
+					}
+				}
+			}
+
+			document.mWaiting.erase(waiting);
+			++document.mNext;
+		}
+
+		if (document.mNext == document.mPages) {
+			if (document.mWriting && !document.mWriter.close()) {
+				document.mWriteError = true;
+			}
+
+			document.mWriting = false;
+			finished          = true;
+			written           = !document.mWriteError && document.mFailedPages.empty();
+		}
+	}
+
+	if (!finished) {
+		return;
+	}
+
+	Log::Write(System::ConvertWstringToString(document.mFile) + ": " + std::to_string(document.mPages) + " pages finished, " +
+	           std::to_string(document.mFailedPages.size()) + " failed" + (document.mWriteError ? ", the words file can't be written" : ""));
+
+	if (mCallback) {
+		mCallback(document.mFile, written);
+	}
+}
+
+void Batch::Processor::setCallback(const Callback& callback)
+{
+	mCallback = callback;
+}
+
+bool Batch::Processor::reuse(const std::shared_ptr<Job>& job)
+{
+	if (!mIndex || job->mDocument) {
+		return false;
+	}
+
+	std::wstring original;
+
+	{
+		Trace::Span span("dedup");
+		job->mFingerprint = Deduplication::ComputeFingerprint(job->mImage);
+
+		// the search index and the results get the words and boxes of the original from its boxes file
+		const bool indexed = mSearch || mResults;
+
+		if ((indexed && !mOptions.mWriteBoxes) || !mIndex->find(job->mFingerprint, job->mFile, original) ||
+		    (indexed && !ReadBoxes(original, job->mBoxes, job->mWords)) || !CopyOutputs(original, job->mFile, mOptions)) {
+			job->mBoxes.clear();
+			job->mWords.clear();
+
+			return false;
+		}
+	}
+
+	Log::Write(System::ConvertWstringToString(job->mFile) + ": near duplicate of " + System::ConvertWstringToString(original) + ", outputs copied");
+
+	if (mSearch) {
+		mSearch->add(job->mFile, job->mWords);
+	}
+
+	// the recognizer confidences aren't in the boxes file, the rows of a copy have 0
+	if (mResults) {
+		mResults->add(job->mFile, job->mBoxes, job->mWords, job->mConfidences);
+	}
+
+	++mDuplicates;
+	++mImages;
+
+	job->mImage.release();
+	job->mTicket.reset();
+
+	if (mCallback) {
+		mCallback(job->mFile, true);
+	}
+
+	return true;
+}
+
+void Batch::Processor::fail(const std::wstring& file, const std::string& reason)
+{
+	Log::Write(System::ConvertWstringToString(file) + " failed: " + reason);
+	++mFailed;
+
+	if (mCallback) {
+		mCallback(file, false);
+	}
+}
+
+void Batch::Processor::fail(const std::shared_ptr<Job>& job, const std::string& reason)
+{
+	job->mTicket.reset();
+
+	if (!job->mDocument) {
+		fail(job->mFile, reason);
+
+		return;
+	}
+
+	Log::Write(System::ConvertWstringToString(GetPagePath(job->mFile, job->mPage)) + " failed: " + reason);
+	++mFailed;
+
+	finishPage(job, false);
+}
+
+//
+// Global Functions
+//
+Batch::Options Batch::GetOptions(void)
+{
+	Options options;
+	options.mInputScale   = std::max(32, Settings::GetInt(L"Batch", L"InputScale", 1280) / 32 * 32);
+	options.mFontSize     = std::max(1, Settings::GetInt(L"Batch", L"FontSize", 16));
+	options.mBoxesPerTask = (size_t)std::max(1, Settings::GetInt(L"Batch", L"BoxesPerTask", 16));
+	options.mRender       = Settings::GetBool(L"Batch", L"Render", true);
+	options.mWriteWords   = Settings::GetBool(L"Batch", L"WriteWords", true);
+	options.mWriteImage   = Settings::GetBool(L"Batch", L"WriteImage", false);
+	options.mWriteBoxes   = Settings::GetBool(L"Batch", L"WriteBoxes", false);
+	options.mIndexes      = true;
+
+	return options;
+}
+
+std::vector<std::wstring> Batch::ReadManifest(const std::wstring& manifest)
+{
+	std::vector<std::wstring> entries;
+
+	return ReadManifest(manifest, entries);
+}
+
+std::vector<std::wstring> Batch::ReadManifest(const std::wstring& manifest, std::vector<std::wstring>& entries)
+{
+	std::vector<unsigned char> data;
+
+	if (!System::ReadFile(manifest, data)) {
+		throw Error::Exception(L"Can't read the manifest " + manifest + L"!", L"Batch Error");
+	}
+
+	const size_t              separator = manifest.find_last_of(L"\\/");
+	const std::wstring        directory = separator == std::wstring::npos ? L"." : manifest.substr(0, separator);
+	std::vector<std::wstring> files;
+	size_t                    begin{ 0 };
+
+	entries.clear();
+
+	// UTF-8 byte order mark
+	if (data.size() >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF) {
+		begin = 3;
+	}
+
+	while (begin < data.size()) {
+		size_t end = begin;
+
+		while (end < data.size() && data[end] != '\n') {
+			++end;
+		}
+
+		std::wstring file = System::TrimWideString(System::ConvertStringToWstring(std::string((const char*)data.data() + begin, end - begin)));
+		begin             = end + 1;
+
+		if (!file.empty() && file.back() == L'\r') {
+			file = System::TrimWideString(file.substr(0, file.size() - 1));
+		}
+
+		if (file.empty() || file[0] == L'#') {
+			continue;
+		}
+
+		entries.push_back(file);
+
+		// absolute paths (drive letter or UNC) are taken as they are
+		if ((file.size() > 1 && file[1] == L':') || (file.size() > 1 && file[0] == L'\\' && file[1] == L'\\')) {
+			files.push_back(file);
+		} else {
+			files.push_back(directory + L"\\" + file);
+		}
+	}
+
+	return files;
+}
+
+std::wstring Batch::GetWordsPath(const std::wstring& file)
+{
+	return file + L"_words.txt";
+}
+
+std::wstring Batch::GetImagePath(const std::wstring& file)
+{
+	return file + L"_katip.png";
+}
+
+std::wstring Batch::GetBoxesPath(const std::wstring& file)
+{
+	return file + L"_boxes.kbx";
+}
+
+std::wstring Batch::GetPagePath(const std::wstring& file, const size_t page)
+{
+	wchar_t suffix[32];
+	std::swprintf(suffix, sizeof(suffix) / sizeof(suffix[0]), L"_p%04zu", page + 1);
+
+	return file + suffix;
+}
+
+bool Batch::IsTiff(const std::wstring& file)
+{
+	const size_t dot = file.find_last_of(L'.');
+
+	if (dot == std::wstring::npos) {
+		return false;
+	}
+
+	std::wstring extension = file.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), towlower);
+
+	return extension == L"tif" || extension == L"tiff";
+}
+
+bool Batch::DecodeImage(const std::vector<unsigned char>& data, const Memory::Plan& plan, cv::Mat& image)
+{
+	Trace::Span span("decode");
+	image = cv::imdecode(data, plan.mDecodeFlags);
+
+	return FitPlan(plan, image);
+}
+
+bool Batch::DecodePage(const std::wstring& file, const size_t page, const Memory::Plan& plan, cv::Mat& image)
+{
+	Trace::Span span("decode page", page + 1);
+
+	// the decoder walks the directories up to the page and decodes that page only, it can only open narrow paths
+	std::vector<cv::Mat> pages;
+	std::string          native;
+
+	if (!System::GetNativePath(file, native)) {
+		Log::Write(System::ConvertWstringToString(file) + ": the ANSI code page can't represent the path and it has no short name, its pages can't be read");
+		image.release();
+
+		return false;
+	}
+
+	if (!cv::imreadmulti(native, pages, (int)page, 1, plan.mDecodeFlags) || pages.empty()) {
+		image.release();
+
+		return false;
+	}
+
+	image = pages.front();
+
+	return FitPlan(plan, image);
+}
+
+void Batch::SelectBoxes(const cv::Size& size, const std::vector<Detection::Box>& boxes, std::vector<Detection::Box>& selected, std::vector<cv::Rect>& rects)
+{
+	const cv::Rect imageRect(0, 0, size.width, size.height);
+
+	selected.clear();
+	rects.clear();
+
+	for (const Detection::Box& box : boxes) {
+		float minX{ box.mVertices[0].x }, maxX{ box.mVertices[0].x };
+		float minY{ box.mVertices[0].y }, maxY{ box.mVertices[0].y };
+
+		for (int j = 1; j < 4; ++j) {
+			minX = std::min(minX, box.mVertices[j].x);
+			maxX = std::max(maxX, box.mVertices[j].x);
+			minY = std::min(minY, box.mVertices[j].y);
+			maxY = std::max(maxY, box.mVertices[j].y);
+		}
+
+		cv::Rect rect((int)minX, (int)minY, (int)std::roundf(maxX) - (int)minX, (int)std::roundf(maxY) - (int)minY);
+
+		if ((rect & imageRect) != rect || rect.empty()) {
+			continue;
+		}
+
+		selected.push_back(box);
+		rects.push_back(rect);
+	}
+}
+
+void Batch::DrawBoxes(cv::Mat& image, const std::vector<Detection::Box>& boxes)
+{
+	for (const Detection::Box& box : boxes) {
+		for (int j = 0; j < 4; ++j) {
+			cv::line(image, box.mVertices[j], box.mVertices[(j + 1) % 4], { 0, 255, 0 }, 1, cv::LINE_AA);
+		}
+	}
+}
+
+bool Batch::WriteOutputs(const std::wstring& file, const std::vector<Detection::Box>& boxes, const std::vector<std::string>& words, const cv::Mat& image,
+                         const Options& options, std::string& error)
+{
+	if (options.mWriteWords) {
+		Output::WordWriter writer;
+
+		if (!writer.open(GetWordsPath(file), (size_t)std::max(Settings::GetInt(L"Output", L"BufferKB", 1024), 4) * 1024,
+		                 Settings::GetBool(L"Output", L"AsyncFlush", false))) {
+			error = "can't create the words file";
+
+			return false;
+		}
+
+		for (const std::string& word : words) {
+			if (!word.empty()) {
+				writer.writeLine(word.c_str());
+			}
+		}
+
+		if (!writer.close()) {
+			error = "can't write the words file";
+
+			return false;
+		}
+	}
+
+	if (options.mWriteBoxes && !Spatial::WriteBoxes(GetBoxesPath(file), image.size(), boxes, words)) {
+		error = "can't write the boxes file";
+
+		return false;
+	}
+
+	if (options.mWriteImage) {
+		Trace::Span                span("encode");
+		std::vector<unsigned char> data;
+
+		if (!cv::imencode(".png", image, data) || !WriteFile(GetImagePath(file), data)) {
+			error = "can't write the rendered image";
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool Batch::CopyOutputs(const std::wstring& original, const std::wstring& file, const Options& options)
+{
+	if (options.mWriteWords && !CopyFileW(GetWordsPath(original).c_str(), GetWordsPath(file).c_str(), FALSE)) {
+		return false;
+	}
+
+	if (options.mWriteBoxes && !CopyFileW(GetBoxesPath(original).c_str(), GetBoxesPath(file).c_str(), FALSE)) {
+		return false;
+	}
+
+	if (options.mWriteImage && !CopyFileW(GetImagePath(original).c_str(), GetImagePath(file).c_str(), FALSE)) {
+		return false;
+	}
+
+	return true;
+}
+
+bool Batch::ReadBoxes(const std::wstring& file, std::vector<Detection::Box>& boxes, std::vector<std::string>& words)
+{
+	Spatial::BoxIndex          index;
+	std::vector<Spatial::Word> read;
+
+	boxes.clear();
+	words.clear();
+
+	if (!index.open(GetBoxesPath(file))) {
+		return false;
+	}
+
+	index.read(read);
+
+	// the rows of the results and the postings need every box index from 0, a file that skips one is damaged
+	for (size_t i = 0; i < read.size(); ++i) {
+		if (read[i].mIndex != i) {
+			boxes.clear();
+			words.clear();
+
+			return false;
+		}
+
+		boxes.push_back(read[i].mBox);
+		words.push_back(std::move(read[i].mText));
+	}
+
+	return true;
+}
\ No newline at end of file
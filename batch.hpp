@@ -0,0 +1,310 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "batch.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Batch Processing Operations
+ *
+ * Structs(Options, Statistics)
+ * Classes(Processor)
+ * Functions(GetOptions, ReadManifest, GetWordsPath, GetImagePath, GetBoxesPath, GetPagePath, IsTiff, DecodeImage, DecodePage, SelectBoxes, DrawBoxes,
+ *           WriteOutputs, CopyOutputs, ReadBoxes)
+ *
+ */
+
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include "main.hpp"
+#include "dedup.hpp"
+#include "detector.hpp"
+#include "memory.hpp"
+#include "output.hpp"
+#include "recognizer.hpp"
+#include "rectifier.hpp"
+#include "results.hpp"
+#include "scheduler.hpp"
+#include "search.hpp"
+#include <opencv2/core.hpp>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Batch
+{
+	//
+	// Global Definitions
+	//
+	typedef std::function<void(const std::wstring& file, const bool success)> Callback; // called when an image is written or fails
+
+	//
+	// Structs
+	//
+
+	/**
+		Options of a batch
+	*/
+	struct Options
+	{
+		int          mInputScale;    // input size of the detector (multiple of 32)
+		int          mFontSize;      // font size of the rendered words in pixels
+		size_t       mBoxesPerTask;  // boxes rectified and recognized by a box task
+		bool         mRender;        // render the words over the image
+		bool         mWriteWords;    // write the words next to the image (<image>_words.txt)
+		bool         mWriteImage;    // write the rendered image next to the image (<image>_katip.png)
+		bool         mWriteBoxes;    // write the boxes and their spatial index next to the image (<image>_boxes.kbx)
+		std::wstring mResultsFolder; // results folder of the batch (empty uses [Results] Folder)
+		bool         mIndexes;       // use the [Dedup] index, the [Search] index and the [Results] folder of the settings
+	};
+
+	/**
+		Counters of a batch
+	*/
+	struct Statistics
+	{
+		size_t mImages;     // processed images
+		size_t mDuplicates; // processed images whose outputs were copied from a near duplicate
+		size_t mFailed;     // images that couldn't be read, decoded or processed
+		size_t mBoxes;      // detected boxes
+		size_t mWords;      // recognized words
+		double mSeconds;    // wall time of the batch
+	};
+
+	//
+	// Classes
+	//
+
+	/**
+		Processes image files on a work-stealing pool
+
+		The calling thread reads the files and takes a memory ticket for each (so reading waits when the budget is full).
+		An image task decodes and detects the image, then spawns box tasks that rectify, recognize and render a slice of
+		the boxes each. Box tasks land on the deque of the worker that detected the image, idle workers steal them, and
+		the last box task of an image writes its outputs. Detectors and recognizers are kept per worker and only used by
+		the thread of that worker (Tesseract isn't thread safe, and the int8 network is per thread).
+
+		A multi-page TIFF is split into a job per page like the pipeline does: every page gets its own outputs
+		(GetPagePath) and ticket, the words of the pages go to the words file of the TIFF in page order, and the TIFF is
+		reported once when its last page is done.
+
+		With [Dedup] Enabled, an image whose perceptual hash is close to an image processed before gets copies of that
+		image's outputs right after decoding, without detection and recognition.
+
+		With [Search] Enabled, the words of every written image go to the search index, the last segment is written when
+		the run ends.
+	*/
+	class Processor
+	{
+		public:
+
+			/**
+				Creates the engines on every worker of the pool (throws Error::Exception if a worker can't create them)
+			*/
+			Processor(Scheduler::Pool& pool, const Options& options);
+			Processor(const Processor& processor) = delete;
+
+			const Processor& operator=(const Processor& processor) = delete;
+
+			/**
+				Processes the files and returns when all of them are done
+			*/
+			Statistics run(const std::vector<std::wstring>& files);
+			/**
+				Sets the function called from the workers whenever an image is written or fails (set it before run)
+			*/
+			void setCallback(const Callback& callback);
+
+		private:
+
+			/**
+				Detector, rectifier and recognizer of a worker
+			*/
+			struct Engines
+			{
+				std::unique_ptr<Detection::Detector>      mDetector;
+				std::unique_ptr<Rectification::Rectifier> mRectifier;
+				std::unique_ptr<Recognition::Recognizer>  mRecognizer;
+			};
+
+			/**
+				A multi-page image whose pages are processed as jobs of their own
+			*/
+			struct Document
+			{
+				std::wstring                                mFile;        // path of the image
+				size_t                                      mPages;       // number of pages
+				Output::WordWriter                          mWriter;      // words of the pages in page order (<file>_words.txt)
+				bool                                        mWriting;     // is the words file open?
+				bool                                        mWriteError;  // did a write to the words file fail?
+				std::map<size_t, std::vector<std::string> > mWaiting;     // words of the pages finished before an earlier page
+				std::set<size_t>                            mFailedPages; // pages that failed
+				size_t                                      mNext;        // next page of the words file
+				std::mutex                                  mMutex;       // guards the members above
+			};
+
+			/**
+				An image (or a page of a multi-page image) in flight
+			*/
+			struct Job
+			{
+				std::wstring                    mFile;        // path of the image
+				std::shared_ptr<Document>       mDocument;    // multi-page image of the page (empty for an image)
+				size_t                          mPage;        // index of the page from 0
+				std::vector<unsigned char>      mData;        // encoded image (released after decoding)
+				Memory::Plan                    mPlan;        // memory plan of the image
+				std::unique_ptr<Memory::Ticket> mTicket;      // admission to the memory budget
+				Memory::Account                 mAccount;     // tracked allocations of the image
+				cv::Mat                         mImage;       // decoded BGR image (words are rendered on it)
+				cv::Mat                         mGrey;        // grey copy for the recognizer
+				std::vector<Detection::Box>     mBoxes;       // boxes to recognize
+				std::vector<cv::Rect>           mRects;       // axis-aligned bounds of the boxes (overlay position)
+				std::vector<std::string>        mWords;       // UTF-8 word of each box
+				std::vector<float>              mConfidences; // recognizer confidence of each box
+				Deduplication::Fingerprint      mFingerprint; // perceptual fingerprint of the decoded image
+				std::atomic<size_t>             mRemaining;   // box tasks that haven't finished yet
+				std::mutex                      mMutex;       // serializes rendering on the image
+			};
+
+			/**
+				Returns the engines of the calling worker
+			*/
+			Engines& getEngines(void);
+			/**
+				Submits an image task for every page of a multi-page image (returns when the last page is submitted)
+
+				pages - sizes of the pages
+			*/
+			void submitPages(const std::wstring& file, const std::vector<cv::Size>& pages);
+			/**
+				Image task: decodes and detects the image and spawns its box tasks
+			*/
+			void detect(const std::shared_ptr<Job>& job);
+			/**
+				Box task: rectifies, recognizes and renders the boxes [first, first + count)
+			*/
+			void recognize(const std::shared_ptr<Job>& job, const size_t first, const size_t count);
+			/**
+				Writes the outputs of the image after its last box task
+			*/
+			void finish(const std::shared_ptr<Job>& job);
+			/**
+				Copies the outputs of a near duplicate of the decoded image (returns false if the image must be processed)
+			*/
+			bool reuse(const std::shared_ptr<Job>& job);
+			/**
+				Adds the words of the page to the words file of its image in page order and reports the image after its last page
+			*/
+			void finishPage(const std::shared_ptr<Job>& job, const bool success);
+			/**
+				Counts the image as failed and logs the reason
+			*/
+			void fail(const std::wstring& file, const std::string& reason);
+			/**
+				Counts the image or the page of the job as failed and logs the reason
+			*/
+			void fail(const std::shared_ptr<Job>& job, const std::string& reason);
+
+			Scheduler::Pool&                      mPool;       // pool the tasks run on
+			Options                               mOptions;    // options of the batch
+			Callback                              mCallback;   // called when an image is written or fails (may be empty)
+			std::vector<Engines>                  mEngines;    // engines of each worker
+			std::unique_ptr<Deduplication::Index> mIndex;      // perceptual hashes of the processed images (empty without [Dedup])
+			std::unique_ptr<Search::Writer>       mSearch;     // search index of the recognized words (empty without [Search])
+			std::unique_ptr<Results::Writer>      mResults;    // columnar results of the processed images (empty without [Results])
+			std::atomic<size_t>                   mImages;     // processed images of the current run
+			std::atomic<size_t>                   mDuplicates; // images of the current run copied from a near duplicate
+			std::atomic<size_t>                   mFailed;     // failed images of the current run
+			std::atomic<size_t>                   mBoxes;      // detected boxes of the current run
+			std::atomic<size_t>                   mWords;      // recognized words of the current run
+	};
+
+	//
+	// Global Functions
+	//
+
+	/**
+		Returns the batch options of the settings ([Batch])
+	*/
+	Options GetOptions(void);
+	/**
+		Returns the images of a manifest, a UTF-8 text file with one image path per line
+
+		Empty lines and lines starting with # are skipped, relative paths are relative to the folder of the manifest
+		(throws Error::Exception if the manifest can't be read)
+	*/
+	std::vector<std::wstring> ReadManifest(const std::wstring& manifest);
+	/**
+		Returns the images of a manifest like ReadManifest and their entries as they are written in the manifest
+
+		entries - path of each image as written in its line (replaced)
+	*/
+	std::vector<std::wstring> ReadManifest(const std::wstring& manifest, std::vector<std::wstring>& entries);
+	/**
+		Returns the path of the words file of the image (<file>_words.txt)
+	*/
+	std::wstring GetWordsPath(const std::wstring& file);
+	/**
+		Returns the path of the rendered image of the image (<file>_katip.png)
+	*/
+	std::wstring GetImagePath(const std::wstring& file);
+	/**
+		Returns the path of the boxes file of the image (<file>_boxes.kbx)
+	*/
+	std::wstring GetBoxesPath(const std::wstring& file);
+	/**
+		Returns the name the outputs of a page of a multi-page image are made from (<file>_p<page from 1, 4 digits>)
+	*/
+	std::wstring GetPagePath(const std::wstring& file, const size_t page);
+	/**
+		Returns true if the file has a TIFF extension (only TIFFs are split into pages)
+	*/
+	bool IsTiff(const std::wstring& file);
+	/**
+		Decodes the image with the flags of its memory plan and downscales it to the planned size (returns false if it can't be decoded)
+	*/
+	bool DecodeImage(const std::vector<unsigned char>& data, const Memory::Plan& plan, cv::Mat& image);
+	/**
+		Decodes one page of a multi-page image file like DecodeImage, the other pages aren't decoded (returns false if it can't be decoded)
+
+		page - index of the page from 0
+	*/
+	bool DecodePage(const std::wstring& file, const size_t page, const Memory::Plan& plan, cv::Mat& image);
+	/**
+		Keeps the boxes whose axis-aligned bounds are inside the image (selected and their bounds are replaced)
+	*/
+	void SelectBoxes(const cv::Size& size, const std::vector<Detection::Box>& boxes, std::vector<Detection::Box>& selected, std::vector<cv::Rect>& rects);
+	/**
+		Draws the outlines of the boxes on the image
+	*/
+	void DrawBoxes(cv::Mat& image, const std::vector<Detection::Box>& boxes);
+	/**
+		Writes the words (GetWordsPath), the boxes (GetBoxesPath) and the rendered image (GetImagePath) as the options ask
+		(returns false and the reason on failure)
+
+		boxes - boxes of the image in image pixels
+		words - UTF-8 word of each box
+	*/
+	bool WriteOutputs(const std::wstring& file, const std::vector<Detection::Box>& boxes, const std::vector<std::string>& words, const cv::Mat& image,
+	                  const Options& options, std::string& error);
+	/**
+		Copies the outputs of the original image to the image as the options ask (returns false if an output can't be copied)
+	*/
+	bool CopyOutputs(const std::wstring& original, const std::wstring& file, const Options& options);
+	/**
+		Reads the boxes and words of an image back from its boxes file (returns false if it can't be read or is damaged)
+
+		boxes - boxes of the image in box index order (replaced)
+		words - UTF-8 word of each box (replaced)
+	*/
+	bool ReadBoxes(const std::wstring& file, std::vector<Detection::Box>& boxes, std::vector<std::string>& words);
+}
+
+#endif
\ No newline at end of file
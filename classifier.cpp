@@ -0,0 +1,187 @@
+#include "classifier.hpp"
+#include "settings.hpp"
+#include "trace.hpp"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+	//
+	// Local Definitions
+	//
+	constexpr int ANALYSIS_SIZE = 1024; // long side of the downsampled image
+
+	//
+	// Local Functions
+	//
+
+	/**
+		Measures the horizontal text lines of the ink mask (returns the median angle and sets the number of lines)
+
+		Ink is closed horizontally so the words of a line merge into one long blob. Blobs running closer to vertical than
+		horizontal aren't lines of an upright page and don't count, so a page turned by 90 degrees doesn't read as straight.
+	*/
+	float MeasureSkew(const cv::Mat& ink, int& lines)
+	{
+		cv::Mat merged;
+		cv::morphologyEx(ink, merged, cv::MORPH_CLOSE, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(15, 3)));
+
+		std::vector<std::vector<cv::Point> > contours;
+		cv::findContours(merged, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+
+		std::vector<float> angles;
+
+		for (const auto& contour : contours) {
+			cv::RotatedRect line = cv::minAreaRect(contour);
+
+			// make the long side the width
+			float width  = line.size.width;
+			float height = line.size.height;
+			float angle  = line.angle;
+
+			if (width < height) {
+				std::swap(width, height);
+				angle += 90.0f;
+			}
+
+			// line candidates are long and thin
+			if (width < 40.0f || height < 3.0f || width < height * 4.0f) {
+				continue;
+			}
+
+			// bring the angle of the long side into -90..90, a line steeper than 45 degrees runs top to bottom
+			while (angle > 90.0f) {
+				angle -= 180.0f;
+			}
+
+			while (angle <= -90.0f) {
+				angle += 180.0f;
+			}
+
+			if (std::fabs(angle) > 45.0f) {
+				continue;
+			}
+
+			angles.push_back(angle);
+		}
+
+		lines = (int)angles.size();
+
+		if (angles.empty()) {
+			return 0.0f;
+		}
+
+		std::nth_element(angles.begin(), angles.begin() + angles.size() / 2, angles.end());
+
+		return angles[angles.size() / 2];
+	}
+}
+
+//
+// Global Functions
+//
+Classifier::Decision Classifier::Classify(const cv::Mat& image)
+{
+	Trace::Span span("classify");
+	Decision    decision{ RT_DETECTOR, Statistics{ 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0, 0 }, std::string{} };
+
+	if (image.empty()) {
+		decision.mReason = "empty image";
+
+		return decision;
+	}
+
+	//
+	// Downsampled grey copy
+	//
+	cv::Mat grey;
+	cv::cvtColor(image, grey, image.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+
+	const double scale = (double)ANALYSIS_SIZE / std::max(grey.cols, grey.rows);
+
+	if (scale < 1.0) {
+		cv::resize(grey, grey, cv::Size(), scale, scale, cv::INTER_AREA);
+	}
+
+	//
+	// Ink and paper levels (Otsu splits the histogram into two classes)
+	//
+	cv::Mat ink;
+	double  level = cv::threshold(grey, ink, 0, 255, cv::THRESH_BINARY_INV | cv::THRESH_OTSU);
+
+	cv::Mat paper;
+	cv::bitwise_not(ink, paper);
+
+	const int    inkPixels   = cv::countNonZero(ink);
+	const int    totalPixels = grey.cols * grey.rows;
+	const double inkLevel    = inkPixels ? cv::mean(grey, ink)[0] : level;
+	const double paperLevel  = inkPixels < totalPixels ? cv::mean(grey, paper)[0] : level;
+
+	Statistics& statistics = decision.mStatistics;
+	statistics.mContrast   = (float)((paperLevel - inkLevel) / 255.0);
+	statistics.mDensity    = (float)inkPixels / totalPixels;
+	statistics.mBackground = 1.0f - statistics.mDensity;
+
+	//
+	// Noise of the paper
+	//
+	cv::Mat median, difference;
+	cv::medianBlur(grey, median, 3);
+	cv::absdiff(grey, median, difference);
+	statistics.mNoise = (float)cv::mean(difference, paper)[0];
+
+	//
+	// Skew of the text lines, and the lines of the page turned by 90 degrees (the rows of the transposed ink)
+	//
+	statistics.mSkew = MeasureSkew(ink, statistics.mLines);
+
+	cv::Mat transposed;
+	cv::transpose(ink, transposed);
+	MeasureSkew(transposed, statistics.mVerticalLines);
+
+	//
+	// Route
+	//
+	const float minContrast = Settings::GetFloat(L"Classifier", L"MinContrast", 0.5f);
+	const float minDensity  = Settings::GetFloat(L"Classifier", L"MinDensity", 0.01f);
+	const float maxDensity  = Settings::GetFloat(L"Classifier", L"MaxDensity", 0.3f);
+	const float maxNoise    = Settings::GetFloat(L"Classifier", L"MaxNoise", 6.0f);
+	const float maxSkew     = Settings::GetFloat(L"Classifier", L"MaxSkew", 1.5f);
+	const int   minLines    = Settings::GetInt(L"Classifier", L"MinLines", 5);
+
+	if (statistics.mContrast < minContrast) {
+		decision.mReason = "low contrast";
+	} else if (statistics.mDensity < minDensity) {
+		decision.mReason = "little ink";
+	} else if (statistics.mDensity > maxDensity) {
+		decision.mReason = "dark image";
+	} else if (statistics.mNoise > maxNoise) {
+		decision.mReason = "noisy";
+	} else if (statistics.mVerticalLines > statistics.mLines) {
+		decision.mReason = "turned by 90 degrees";
+	} else if (statistics.mLines < minLines) {
+		decision.mReason = "few text lines";
+	} else if (std::fabs(statistics.mSkew) > maxSkew) {
+		decision.mReason = "skewed";
+	} else {
+		decision.mRoute = RT_PAGE;
+	}
+
+	return decision;
+}
+
+std::string Classifier::Describe(const Decision& decision)
+{
+	const Statistics& statistics = decision.mStatistics;
+	char              line[256];
+
+	std::snprintf(line, sizeof(line), "route %s%s%s%s (contrast %.2f, ink %.3f, noise %.1f, skew %.1f deg, %d lines, %d vertical lines)",
+	              decision.mRoute == RT_PAGE ? "page" : "detector", decision.mReason.empty() ? "" : " [", decision.mReason.c_str(),
+	              decision.mReason.empty() ? "" : "]", statistics.mContrast, statistics.mDensity, statistics.mNoise, statistics.mSkew, statistics.mLines,
+	              statistics.mVerticalLines);
+
+	return line;
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "classifier.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Image Classification Operations
+ *
+ * Structs(Statistics, Decision)
+ * Functions(Classify, Describe)
+ *
+ */
+
+#ifndef CLASSIFIER_HPP
+#define CLASSIFIER_HPP
+
+#include "main.hpp"
+#include <opencv2/core.hpp>
+#include <string>
+
+namespace Classifier
+{
+	//
+	// Global Definitions
+	//
+
+	/**
+		Route of an image through the pipeline
+	*/
+	enum ROUTE
+	{
+		RT_DETECTOR, // text detector and a recognizer call per box (natural scenes, photos, noisy scans)
+		RT_PAGE      // Tesseract page layout analysis in one call (clean upright document scans)
+	};
+
+	//
+	// Structs
+	//
+
+	/**
+		Cheap statistics of the downsampled image
+	*/
+	struct Statistics
+	{
+		float mContrast;      // distance of the ink and paper levels (0..1)
+		float mBackground;    // share of the paper pixels
+		float mDensity;       // share of the ink pixels
+		float mNoise;         // mean deviation of the paper from its median filtered version (grey levels)
+		float mSkew;          // median angle of the text lines in degrees
+		int   mLines;         // number of text line candidates
+		int   mVerticalLines; // number of text line candidates running top to bottom (a page turned by 90 or 270 degrees)
+	};
+
+	/**
+		Routing decision of an image
+	*/
+	struct Decision
+	{
+		ROUTE       mRoute;      // chosen route
+		Statistics  mStatistics; // statistics the route is based on
+		std::string mReason;     // first failed check for the detector route
+	};
+
+	//
+	// Global Functions
+	//
+
+	/**
+		Classifies the image from the statistics of a downsampled grey copy ([Classifier] thresholds)
+
+		Images are routed to the page path only if every check passes, so anything unusual stays on the detector. The page
+		path has no orientation detection, so a page with more vertical than horizontal text lines stays on the detector.
+	*/
+	Decision Classify(const cv::Mat& image);
+	/**
+		Returns the decision as a log line
+	*/
+	std::string Describe(const Decision& decision);
+}
+
+#endif
\ No newline at end of file
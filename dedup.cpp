@@ -0,0 +1,405 @@
+#include "dedup.hpp"
+#include "error.hpp"
+#include "log.hpp"
+#include "settings.hpp"
+#include "system.hpp"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	//
+	// Local Definitions
+	//
+	constexpr int      HASH_WIDTH       = 9;           // columns of the shrunk image (8 differences per row)
+	constexpr int      HASH_HEIGHT      = 8;           // rows of the shrunk image
+	constexpr int      FINE_HASH_WIDTH  = 17;          // columns of the shrunk image of the 256 bit hash
+	constexpr int      FINE_HASH_HEIGHT = 16;          // rows of the shrunk image of the 256 bit hash
+	constexpr size_t   MAX_PATH_LENGTH  = 4096;        // longest UTF-8 path of a record, a longer one means a damaged record
+	constexpr DWORD    LOCK_OFFSET_HIGH = 0x7FFFFFFF;  // the append lock is a byte far past any record, so it never blocks reading
+	constexpr uint64_t HEADER_SIZE      = 8;           // magic and version at the start of the index file
+
+	//
+	// Local Functions
+	//
+
+	/**
+		Returns the bits of the chunk of the hash, the 64 bits are split into chunks of nearly the same width
+	*/
+	uint64_t GetChunk(const uint64_t hash, const size_t chunk, const size_t chunks)
+	{
+		const size_t begin = chunk * 64 / chunks;
+		const size_t width = (chunk + 1) * 64 / chunks - begin;
+
+		return width == 64 ? hash : (hash >> begin) & ((1ULL << width) - 1);
+	}
+
+	/**
+		Computes the difference hash of the image shrunk to width x height grey pixels into the words
+	*/
+	void ComputeDifferenceHash(const cv::Mat& grey, const int width, const int height, uint64_t* words)
+	{
+		cv::Mat small;
+
+		// area interpolation averages every source pixel into the shrunk pixels, noise and scan grain cancel out
+		cv::resize(grey, small, cv::Size(width, height), 0.0, 0.0, cv::INTER_AREA);
+
+		int bit{ 0 };
+
+		for (int y = 0; y < height; ++y) {
+			const unsigned char* row = small.ptr<unsigned char>(y);
+
+			for (int x = 0; x + 1 < width; ++x, ++bit) {
+				words[bit / 64] = (words[bit / 64] << 1) | (row[x] < row[x + 1] ? 1 : 0);
+			}
+		}
+	}
+
+	/**
+		Returns true if the candidate has the aspect ratio of the image and a 256 bit hash close to it
+	*/
+	bool Confirms(const Deduplication::Fingerprint& image, const Deduplication::Fingerprint& candidate, const int maxFineDistance, const float aspectTolerance)
+	{
+		if (!image.mWidth || !image.mHeight || !candidate.mWidth || !candidate.mHeight) {
+			return false;
+		}
+
+		const double aspect          = (double)image.mWidth / image.mHeight;
+		const double candidateAspect = (double)candidate.mWidth / candidate.mHeight;
+
+		if (std::fabs(aspect - candidateAspect) > aspectTolerance * std::max(aspect, candidateAspect)) {
+			return false;
+		}
+
+		return Deduplication::GetFineDistance(image, candidate) <= maxFineDistance;
+	}
+
+	/**
+		Appends a record (fingerprint, path length, UTF-8 path) to the buffer
+	*/
+	void AppendRecord(std::string& buffer, const Deduplication::Fingerprint& fingerprint, const std::wstring& path)
+	{
+		const std::string utf8   = System::ConvertWstringToString(path);
+		const uint32_t    length = (uint32_t)utf8.size();
+
+		buffer.append((const char*)&fingerprint, sizeof(fingerprint));
+		buffer.append((const char*)&length, sizeof(length));
+		buffer.append(utf8);
+	}
+
+	/**
+		Takes the append lock of the index file, it is held by one process at a time (returns false on failure)
+	*/
+	bool LockIndex(HANDLE file)
+	{
+		OVERLAPPED overlapped{};
+		overlapped.OffsetHigh = LOCK_OFFSET_HIGH;
+
+		return LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &overlapped) != FALSE;
+	}
+
+	/**
+		Releases the append lock of the index file
+	*/
+	void UnlockIndex(HANDLE file)
+	{
+		OVERLAPPED overlapped{};
+		overlapped.OffsetHigh = LOCK_OFFSET_HIGH;
+
+		UnlockFileEx(file, 0, 1, 0, &overlapped);
+	}
+
+	/**
+		Writes the bytes at the end of the file (returns false on failure)
+	*/
+	bool WriteAtEnd(HANDLE file, const std::string& data)
+	{
+		LARGE_INTEGER zero{};
+		DWORD         written{ 0 };
+
+		return SetFilePointerEx(file, zero, nullptr, FILE_END) && WriteFile(file, data.data(), (DWORD)data.size(), &written, nullptr) &&
+		       written == data.size();
+	}
+}
+
+//
+// Index Class Member Functions
+//
+Deduplication::Index::Index(const std::wstring& fileName, const int maxDistance, const int maxFineDistance, const float aspectTolerance) :
+	mFileName(fileName), mFile(INVALID_HANDLE_VALUE), mMaxDistance(std::max(0, std::min(63, maxDistance))),
+	mMaxFineDistance(std::max(0, std::min(256, maxFineDistance))), mAspectTolerance(std::max(0.0f, aspectTolerance)), mFingerprints(), mFiles(),
+	mPositions(), mBuckets((size_t)mMaxDistance + 1), mMutex()
+{
+	// other shards of the manifest may append to the file while this one runs
+	mFile = CreateFileW(mFileName.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL,
+	                    nullptr);
+
+	if (mFile == INVALID_HANDLE_VALUE) {
+		throw Error::Exception(L"Can't open the duplicate index " + mFileName + L"!", L"Dedup Error");
+	}
+
+	if (!LockIndex(mFile)) {
+		CloseHandle(mFile);
+
+		throw Error::Exception(L"Can't lock the duplicate index " + mFileName + L"!", L"Dedup Error");
+	}
+
+	//
+	// A crash cuts the last record and an index of an older version has no header, the file is cut back to the whole records
+	//
+	const uint64_t valid = load();
+	LARGE_INTEGER  size{}, end{};
+	bool           repaired = GetFileSizeEx(mFile, &size) != FALSE;
+
+	end.QuadPart = (LONGLONG)valid;
+
+	if (repaired && (uint64_t)size.QuadPart != valid) {
+		repaired = SetFilePointerEx(mFile, end, nullptr, FILE_BEGIN) && SetEndOfFile(mFile);
+
+		Log::Write("Duplicate index " + System::ConvertWstringToString(mFileName) +
+		           (valid ? ": the damaged last record is dropped" : ": the index has no header of this version and starts empty"));
+	}
+
+	// a new index starts with its header
+	if (repaired && valid == 0) {
+		const uint32_t header[2] = { INDEX_MAGIC, INDEX_VERSION };
+		repaired                 = WriteAtEnd(mFile, std::string((const char*)header, sizeof(header)));
+	}
+
+	UnlockIndex(mFile);
+
+	if (!repaired) {
+		CloseHandle(mFile);
+
+		throw Error::Exception(L"Can't repair the duplicate index " + mFileName + L"!", L"Dedup Error");
+	}
+}
+
+Deduplication::Index::~Index()
+{
+	if (mFile != INVALID_HANDLE_VALUE) {
+		CloseHandle(mFile);
+	}
+}
+
+bool Deduplication::Index::find(const Fingerprint& fingerprint, const std::wstring& file, std::wstring& original) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	int    best{ mMaxDistance + 1 }, bestFine{ mMaxFineDistance + 1 };
+	size_t bestPosition{ 0 };
+
+	// an image within mMaxDistance bits shares a chunk, so only the buckets of the chunks of the hash are compared
+	for (size_t chunk = 0; chunk < mBuckets.size(); ++chunk) {
+		auto bucket = mBuckets[chunk].find(GetChunk(fingerprint.mHash, chunk, mBuckets.size()));
+
+		if (bucket == mBuckets[chunk].end()) {
+			continue;
+		}
+
+		for (size_t position : bucket->second) {
+			const int distance = GetDistance(fingerprint.mHash, mFingerprints[position].mHash);
+
+			if (distance > best || mFiles[position] == file || !Confirms(fingerprint, mFingerprints[position], mMaxFineDistance, mAspectTolerance)) {
+				continue;
+			}
+
+			const int fine = GetFineDistance(fingerprint, mFingerprints[position]);
+
+			if (distance < best || fine < bestFine) {
+				best         = distance;
+				bestFine     = fine;
+				bestPosition = position;
+			}
+		}
+	}
+
+	if (best > mMaxDistance) {
+		return false;
+	}
+
+	original = mFiles[bestPosition];
+
+	return true;
+}
+
+void Deduplication::Index::add(const Fingerprint& fingerprint, const std::wstring& file)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	auto position = mPositions.find(file);
+
+	if (position != mPositions.end()) {
+		if (std::memcmp(&mFingerprints[position->second], &fingerprint, sizeof(fingerprint)) == 0) {
+			return;
+		}
+
+		remove(position->second);
+		mFingerprints[position->second] = fingerprint;
+		insert(position->second);
+	} else {
+		mPositions[file] = mFingerprints.size();
+		mFingerprints.push_back(fingerprint);
+		mFiles.push_back(file);
+		insert(mFingerprints.size() - 1);
+	}
+
+	// the record reaches the file at once in one write under the append lock, a crash loses the images that were in flight only
+	std::string record;
+	AppendRecord(record, fingerprint, file);
+
+	bool written{ false };
+
+	if (LockIndex(mFile)) {
+		written = WriteAtEnd(mFile, record);
+		UnlockIndex(mFile);
+	}
+
+	if (!written) {
+		Log::Write("Duplicate index " + System::ConvertWstringToString(mFileName) + " can't be written");
+	}
+}
+
+size_t Deduplication::Index::getSize(void) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	return mFingerprints.size();
+}
+
+uint64_t Deduplication::Index::load(void)
+{
+	FILE* file = _wfopen(mFileName.c_str(), L"rb");
+
+	if (!file) {
+		return 0;
+	}
+
+	uint32_t header[2] = { 0, 0 };
+
+	if (std::fread(header, sizeof(header), 1, file) != 1 || header[0] != INDEX_MAGIC || header[1] != INDEX_VERSION) {
+		std::fclose(file);
+
+		return 0;
+	}
+
+	Fingerprint fingerprint;
+	uint32_t    length{ 0 };
+	std::string path;
+	uint64_t    valid{ HEADER_SIZE };
+
+	while (std::fread(&fingerprint, sizeof(fingerprint), 1, file) == 1) {
+		path.resize(MAX_PATH_LENGTH);
+
+		if (std::fread(&length, sizeof(length), 1, file) != 1 || length == 0 || length > MAX_PATH_LENGTH ||
+		    std::fread(&path[0], 1, length, file) != length) {
+			break;
+		}
+
+		path.resize(length);
+		valid += sizeof(fingerprint) + sizeof(length) + length;
+
+		// a later record of a path replaces its fingerprint
+		const std::wstring name     = System::ConvertStringToWstring(path);
+		auto               position = mPositions.find(name);
+
+		if (position != mPositions.end()) {
+			remove(position->second);
+			mFingerprints[position->second] = fingerprint;
+			insert(position->second);
+		} else {
+			mPositions[name] = mFingerprints.size();
+			mFingerprints.push_back(fingerprint);
+			mFiles.push_back(name);
+			insert(mFingerprints.size() - 1);
+		}
+	}
+
+	std::fclose(file);
+
+	return valid;
+}
+
+void Deduplication::Index::insert(const size_t position)
+{
+	for (size_t chunk = 0; chunk < mBuckets.size(); ++chunk) {
+		mBuckets[chunk][GetChunk(mFingerprints[position].mHash, chunk, mBuckets.size())].push_back(position);
+	}
+}
+
+void Deduplication::Index::remove(const size_t position)
+{
+	for (size_t chunk = 0; chunk < mBuckets.size(); ++chunk) {
+		std::vector<size_t>& bucket = mBuckets[chunk][GetChunk(mFingerprints[position].mHash, chunk, mBuckets.size())];
+		bucket.erase(std::remove(bucket.begin(), bucket.end(), position), bucket.end());
+	}
+}
+
+//
+// Global Functions
+//
+uint64_t Deduplication::ComputeHash(const cv::Mat& image)
+{
+	cv::Mat grey;
+
+	if (image.channels() == 1) {
+		grey = image;
+	} else {
+		cv::cvtColor(image, grey, image.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+	}
+
+	uint64_t hash{ 0 };
+	ComputeDifferenceHash(grey, HASH_WIDTH, HASH_HEIGHT, &hash);
+
+	return hash;
+}
+
+Deduplication::Fingerprint Deduplication::ComputeFingerprint(const cv::Mat& image)
+{
+	Fingerprint fingerprint{};
+	cv::Mat     grey;
+
+	if (image.channels() == 1) {
+		grey = image;
+	} else {
+		cv::cvtColor(image, grey, image.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+	}
+
+	ComputeDifferenceHash(grey, HASH_WIDTH, HASH_HEIGHT, &fingerprint.mHash);
+	ComputeDifferenceHash(grey, FINE_HASH_WIDTH, FINE_HASH_HEIGHT, fingerprint.mFineHash);
+
+	fingerprint.mWidth  = (uint32_t)image.cols;
+	fingerprint.mHeight = (uint32_t)image.rows;
+
+	return fingerprint;
+}
+
+int Deduplication::GetDistance(const uint64_t first, const uint64_t second)
+{
+	return (int)std::bitset<64>(first ^ second).count();
+}
+
+int Deduplication::GetFineDistance(const Fingerprint& first, const Fingerprint& second)
+{
+	int distance{ 0 };
+
+	for (int i = 0; i < 4; ++i) {
+		distance += GetDistance(first.mFineHash[i], second.mFineHash[i]);
+	}
+
+	return distance;
+}
+
+std::unique_ptr<Deduplication::Index> Deduplication::CreateIndex(void)
+{
+	if (!Settings::GetBool(L"Dedup", L"Enabled", false)) {
+		return std::unique_ptr<Index>();
+	}
+
+	return std::unique_ptr<Index>(new Index(Settings::GetPath(L"Dedup", L"Index", L"katip_dedup.idx"), Settings::GetInt(L"Dedup", L"MaxDistance", 4),
+	                                        Settings::GetInt(L"Dedup", L"MaxFineDistance", 16), Settings::GetFloat(L"Dedup", L"AspectTolerance", 0.02f)));
+}
\ No newline at end of file
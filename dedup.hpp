@@ -0,0 +1,162 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "dedup.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Duplicate Image Operations
+ *
+ * Structs(Fingerprint)
+ * Classes(Index)
+ * Functions(ComputeHash, ComputeFingerprint, GetDistance, GetFineDistance, CreateIndex)
+ *
+ */
+
+#ifndef DEDUP_HPP
+#define DEDUP_HPP
+
+#include "main.hpp"
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Deduplication
+{
+	//
+	// Global Definitions
+	//
+	constexpr uint32_t INDEX_MAGIC   = 0x3158444B; // "KDX1"
+	constexpr uint32_t INDEX_VERSION = 1;
+
+	//
+	// Structs
+	//
+
+	/**
+		Perceptual fingerprint of a decoded image
+	*/
+	struct Fingerprint
+	{
+		uint64_t mHash;        // 64 bit dHash (ComputeHash) that finds the candidates
+		uint64_t mFineHash[4]; // 256 bit dHash of a 17x16 shrink that confirms a candidate
+		uint32_t mWidth;       // width of the decoded image
+		uint32_t mHeight;      // height of the decoded image
+	};
+
+	//
+	// Classes
+	//
+
+	/**
+		Persistent index of the perceptual fingerprints of the processed images
+
+		The index file is a magic and version followed by a record (Fingerprint, path length, UTF-8 path) per processed
+		image, so the index grows across batches. Records are appended under a lock of the file, so shards of a manifest
+		can share the index file without mixing their records (a shard doesn't see the records the other shards add while
+		it runs).
+
+		The 64 bit hash is split into MaxDistance + 1 chunks and every chunk has a table of the images by the bits of that
+		chunk. A hash within MaxDistance bits shares at least one chunk exactly, so a lookup only compares the images of
+		those buckets instead of the whole index. A candidate is a near duplicate only if its aspect ratio matches and
+		its 256 bit hash is within MaxFineDistance bits too, the 64 bit hash alone misses the details that set two pages
+		of the same form apart.
+	*/
+	class Index
+	{
+		public:
+
+			/**
+				Loads the fingerprints of the index file and opens it for appending (throws Error::Exception if it can't be opened)
+
+				fileName        - path of the index file
+				maxDistance     - most differing bits of the 64 bit hashes of a near duplicate
+				maxFineDistance - most differing bits of the 256 bit hashes of a near duplicate
+				aspectTolerance - largest relative difference of the aspect ratios of a near duplicate
+			*/
+			Index(const std::wstring& fileName, const int maxDistance, const int maxFineDistance, const float aspectTolerance);
+			Index(const Index& index) = delete;
+			~Index();
+
+			const Index& operator=(const Index& index) = delete;
+
+			/**
+				Finds the closest image within the maximum distance, the image itself doesn't count (returns false if there is none)
+
+				fingerprint - fingerprint of the image
+				file        - path of the image
+				original    - path of the closest image
+			*/
+			bool find(const Fingerprint& fingerprint, const std::wstring& file, std::wstring& original) const;
+			/**
+				Adds the processed image to the index (thread safe, a path that is in the index gets the new fingerprint)
+			*/
+			void add(const Fingerprint& fingerprint, const std::wstring& file);
+			/**
+				Returns the number of images in the index
+			*/
+			size_t getSize(void) const;
+
+		private:
+
+			/**
+				Reads the records of the index file (returns the bytes up to the end of the last whole record, 0 if the
+				file has no header)
+			*/
+			uint64_t load(void);
+			/**
+				Adds the image at the position to the bucket of each of its chunks
+			*/
+			void insert(const size_t position);
+			/**
+				Removes the image at the position from the buckets of its chunks
+			*/
+			void remove(const size_t position);
+
+			std::wstring                                                     mFileName;        // path of the index file
+			HANDLE                                                           mFile;            // index file opened for appending
+			int                                                              mMaxDistance;     // most differing bits of the 64 bit hashes of a near duplicate
+			int                                                              mMaxFineDistance; // most differing bits of the 256 bit hashes of a near duplicate
+			float                                                            mAspectTolerance; // largest relative difference of the aspect ratios
+			std::vector<Fingerprint>                                         mFingerprints;    // fingerprints of the images
+			std::vector<std::wstring>                                        mFiles;           // paths of the images
+			std::unordered_map<std::wstring, size_t>                         mPositions;       // position of each path in the vectors
+			std::vector<std::unordered_map<uint64_t, std::vector<size_t> > > mBuckets;         // positions of the images by the bits of each chunk
+			mutable std::mutex                                               mMutex;           // guards the members above
+	};
+
+	//
+	// Global Functions
+	//
+
+	/**
+		Returns the 64 bit difference hash (dHash) of the image
+
+		The image is shrunk to 9x8 grey pixels and every bit tells if a pixel is darker than its right neighbour, so
+		rescans, recompressions and small scale changes of a page give the same or a close hash
+	*/
+	uint64_t ComputeHash(const cv::Mat& image);
+	/**
+		Returns the fingerprint of the image: its hash, the 256 bit dHash of a 17x16 shrink and its size
+	*/
+	Fingerprint ComputeFingerprint(const cv::Mat& image);
+	/**
+		Returns the Hamming distance of the hashes
+	*/
+	int GetDistance(const uint64_t first, const uint64_t second);
+	/**
+		Returns the Hamming distance of the 256 bit hashes of the fingerprints
+	*/
+	int GetFineDistance(const Fingerprint& first, const Fingerprint& second);
+	/**
+		Creates the index of the settings ([Dedup]), returns an empty pointer if deduplication is off
+	*/
+	std::unique_ptr<Index> CreateIndex(void);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,379 @@
+#include "detector.hpp"
+#include "error.hpp"
+#include "inference.hpp"
+#include "settings.hpp"
+#include "system.hpp"
+#include "trace.hpp"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	//
+	// Local Definitions
+	//
+
+	/**
+		Detection scratch of a worker
+
+		NMSBoxes only takes std::allocator vectors, so they can't come from the arena.
+		They are cleared for every region instead and keep their capacity between images.
+	*/
+	struct DetectionScratch
+	{
+		std::vector<cv::RotatedRect>         mBoxes;
+		std::vector<float>                   mConfidences;
+		std::vector<int>                     mIndices;
+		std::vector<std::vector<cv::Point> > mPolygons;
+	};
+
+	//
+	// Local Functions
+	//
+	DetectionScratch& GetDetectionScratch(void)
+	{
+		thread_local DetectionScratch scratch;
+
+		return scratch;
+	}
+}
+
+//
+// Detector Class Member Functions
+//
+Detection::Detector::~Detector()
+{}
+
+void Detection::Detector::detect(const cv::Mat& image, const int inputScale, Memory::Account& account, std::vector<Box>& boxes)
+{
+	detect(image, getInputSize(inputScale), account, boxes);
+}
+
+cv::Size Detection::Detector::getInputSize(const int inputScale) const
+{
+	return cv::Size(inputScale, inputScale);
+}
+
+//
+// EAST Detector Class Member Functions
+//
+Detection::EastDetector::EastDetector() :
+	mNet(Inference::LoadNetwork())
+{}
+
+void Detection::EastDetector::detect(const cv::Mat& image, const cv::Size& inputSize, Memory::Account& account, std::vector<Box>& boxes)
+{
+	//prepare the input image
+	cv::Mat blob;
+	Trace::Span blobSpan("blob build");
+	cv::dnn::blobFromImage(image, blob, 1.0f, inputSize, cv::Scalar(123.68, 116.78, 103.94), true, false);
+	Memory::Tracker blobTracker(account, Memory::MC_BLOB, blob);
+	blobSpan.end();
+
+	//pass input through the netwok
+	std::vector<cv::String> outputLayers(2);
+	outputLayers[0] = Inference::EAST_SCORES_LAYER;
+	outputLayers[1] = Inference::EAST_GEOMETRY_LAYER;
+
+	std::vector<cv::Mat> output;
+	Trace::Span     forwardSpan("forward");
+	Memory::Tracker networkTracker(account, Memory::MC_NETWORK, Memory::EstimateNetworkBytes(inputSize) - Memory::GetMatBytes(blob));
+	mNet.setInput(blob);
+	mNet.forward(output, outputLayers);
+	forwardSpan.end();
+
+	// blob is not needed after the forward pass
+	blob.release();
+	blobTracker.release();
+
+	//process the output
+	Trace::Span                   decodeSpan("decode/NMS");
+	DetectionScratch&             scratch     = GetDetectionScratch();
+	std::vector<cv::RotatedRect>& rects       = scratch.mBoxes;
+	std::vector<float>&           confidences = scratch.mConfidences;
+	std::vector<int>&             indices     = scratch.mIndices;
+
+	rects.clear();
+	confidences.clear();
+	indices.clear();
+
+	Inference::DecodeEast(output[0], output[1], Inference::EAST_CONFIDENCE_THRESHOLD, rects, confidences);
+
+	// filter out the false positives
+	cv::dnn::NMSBoxes(rects, confidences, Inference::EAST_CONFIDENCE_THRESHOLD, Inference::EAST_NMS_THRESHOLD, indices);
+
+	output.clear();
+	networkTracker.release();
+
+	// scale the boxes from the network input to the image
+	cv::Point2f ratio((float)image.cols / inputSize.width, (float)image.rows / inputSize.height);
+
+	boxes.resize(indices.size());
+
+	for (size_t i = 0; i < indices.size(); ++i) {
+		rects[indices[i]].points(boxes[i].mVertices);
+
+		for (int j = 0; j < 4; ++j) {
+			boxes[i].mVertices[j].x *= ratio.x;
+			boxes[i].mVertices[j].y *= ratio.y;
+		}
+
+		boxes[i].mConfidence = confidences[indices[i]];
+	}
+}
+
+float Detection::EastDetector::getNmsThreshold(void) const
+{
+	return Inference::EAST_NMS_THRESHOLD;
+}
+
+std::string Detection::EastDetector::getName(void) const
+{
+	return "EAST";
+}
+
+//
+// DB Detector Class Member Functions
+//
+Detection::DbDetector::DbDetector() :
+	mModel(), mInputScale(std::max(0, Settings::GetInt(L"Detection", L"DbInputScale", 736) / 32 * 32)),
+	mNmsThreshold(Settings::GetFloat(L"Detection", L"DbNmsThreshold", 0.3f))
+{
+	cv::dnn::Net net = cv::dnn::readNet(System::GetNativePath(Settings::GetPath(L"Detection", L"DbModel", L"DB_TD500_resnet50.onnx")));
+
+	if (net.empty()) {
+		throw Error::Exception(L"Can't load the DB text detection model!", L"Image Processing Error");
+	}
+
+	mModel = cv::dnn::TextDetectionModel_DB(net);
+	mModel.setBinaryThreshold(Settings::GetFloat(L"Detection", L"DbBinaryThreshold", 0.3f))
+	      .setPolygonThreshold(Settings::GetFloat(L"Detection", L"DbPolygonThreshold", 0.5f))
+	      .setUnclipRatio(Settings::GetFloat(L"Detection", L"DbUnclipRatio", 2.0f))
+	      .setMaxCandidates(std::max(1, Settings::GetInt(L"Detection", L"DbMaxCandidates", 200)));
+
+	// input parameters of the published DB models (OpenCV text detection sample)
+	mModel.setInputScale(1.0 / 255.0);
+	mModel.setInputMean(cv::Scalar(122.67891434, 116.66876762, 104.00698793));
+	mModel.setInputSwapRB(false);
+
+	mModel.setPreferableBackend((cv::dnn::Backend)Inference::GetBackend().mBackend);
+	mModel.setPreferableTarget((cv::dnn::Target)Inference::GetBackend().mTarget);
+}
+
+void Detection::DbDetector::detect(const cv::Mat& image, const cv::Size& inputSize, Memory::Account& account, std::vector<Box>& boxes)
+{
+	Trace::Span     forwardSpan("forward");
+	Memory::Tracker networkTracker(account, Memory::MC_NETWORK, Memory::EstimateNetworkBytes(inputSize));
+
+	// polygons come back in image coordinates
+	DetectionScratch&                     scratch     = GetDetectionScratch();
+	std::vector<std::vector<cv::Point> >& polygons    = scratch.mPolygons;
+	std::vector<float>&                   confidences = scratch.mConfidences;
+
+	polygons.clear();
+	confidences.clear();
+
+	mModel.setInputSize(inputSize);
+	mModel.detect(image, polygons, confidences);
+	forwardSpan.end();
+
+	boxes.clear();
+	boxes.reserve(polygons.size());
+
+	for (size_t i = 0; i < polygons.size(); ++i) {
+		if (polygons[i].size() != 4) {
+			continue;
+		}
+
+		Box box;
+
+		for (int j = 0; j < 4; ++j) {
+			box.mVertices[j] = cv::Point2f((float)polygons[i][j].x, (float)polygons[i][j].y);
+		}
+
+		box.mConfidence = i < confidences.size() ? confidences[i] : 1.0f;
+		boxes.push_back(box);
+	}
+}
+
+cv::Size Detection::DbDetector::getInputSize(const int inputScale) const
+{
+	const int scale = mInputScale ? mInputScale : inputScale;
+
+	return cv::Size(scale, scale);
+}
+
+float Detection::DbDetector::getNmsThreshold(void) const
+{
+	return mNmsThreshold;
+}
+
+std::string Detection::DbDetector::getName(void) const
+{
+	return "DB";
+}
+
+//
+// Coarse To Fine Detector Class Member Functions
+//
+Detection::CoarseToFineDetector::CoarseToFineDetector(std::unique_ptr<Detector> detector) :
+	mDetector(std::move(detector)), mCropBoxes(), mCoarseScale(std::max(32, Settings::GetInt(L"Detection", L"CoarseScale", 320) / 32 * 32)),
+	mMargin(std::max(0, Settings::GetInt(L"Detection", L"CoarseMargin", 32))), mCoverageLimit(Settings::GetFloat(L"Detection", L"CoarseCoverageLimit", 0.6f))
+{}
+
+void Detection::CoarseToFineDetector::detect(const cv::Mat& image, const cv::Size& inputSize, Memory::Account& account, std::vector<Box>& boxes)
+{
+	// the coarse pass is only cheaper if the full pass is bigger
+	if (std::max(inputSize.width, inputSize.height) <= mCoarseScale) {
+		mDetector->detect(image, inputSize, account, boxes);
+
+		return;
+	}
+
+	Trace::Span coarseSpan("coarse pass");
+	mDetector->detect(image, cv::Size(mCoarseScale, mCoarseScale), account, boxes);
+	coarseSpan.end();
+
+	// small print can vanish at the coarse scale, a page without coarse boxes gets the full pass
+	if (boxes.empty()) {
+		Trace::Span fineSpan("fine pass", std::string{ "full image, no coarse boxes" });
+		mDetector->detect(image, inputSize, account, boxes);
+
+		return;
+	}
+
+	//
+	// Merge the grown boxes on a mask of a coarse grid (cells of 8 pixels)
+	//
+	constexpr int cell = 8;
+
+	const cv::Rect bounds(0, 0, image.cols, image.rows);
+	cv::Mat        mask = cv::Mat::zeros((image.rows + cell - 1) / cell, (image.cols + cell - 1) / cell, CV_8UC1);
+
+	for (const Box& box : boxes) {
+		cv::Rect rect = cv::boundingRect(std::vector<cv::Point2f>(box.mVertices, box.mVertices + 4));
+		rect          = cv::Rect(rect.x - mMargin, rect.y - mMargin, rect.width + 2 * mMargin, rect.height + 2 * mMargin) & bounds;
+
+		if (rect.width > 0 && rect.height > 0) {
+			cv::rectangle(mask, cv::Rect(rect.x / cell, rect.y / cell, (rect.width + cell - 1) / cell, (rect.height + cell - 1) / cell), cv::Scalar(255), -1);
+		}
+	}
+
+	std::vector<std::vector<cv::Point> > contours;
+	cv::findContours(mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+
+	//
+	// Size the crops at the resolution of the full pass, each side on its own
+	//
+	const double scaleX = (double)inputSize.width / image.cols;
+	const double scaleY = (double)inputSize.height / image.rows;
+
+	std::vector<cv::Rect> crops;
+	std::vector<cv::Size> cropSizes;
+	double                coverage{ 0.0 };
+
+	for (const auto& contour : contours) {
+		cv::Rect crop = cv::boundingRect(contour);
+		crop          = cv::Rect(crop.x * cell, crop.y * cell, crop.width * cell, crop.height * cell) & bounds;
+
+		cv::Size cropSize(std::max(32, (int)std::lround(crop.width * scaleX / 32.0) * 32), std::max(32, (int)std::lround(crop.height * scaleY / 32.0) * 32));
+
+		crops.push_back(crop);
+		cropSizes.push_back(cropSize);
+		coverage += (double)cropSize.area();
+	}
+
+	coverage /= (double)inputSize.area();
+
+	// text is all over the image, one full pass is cheaper than the crops
+	if (coverage > mCoverageLimit) {
+		Trace::Span fineSpan("fine pass", std::string{ "full image" });
+		mDetector->detect(image, inputSize, account, boxes);
+
+		return;
+	}
+
+	//
+	// Detect the crops
+	//
+	std::vector<cv::Rect> rects;
+	std::vector<float>    confidences;
+	std::vector<int>      indices;
+
+	boxes.clear();
+
+	for (size_t i = 0; i < crops.size(); ++i) {
+		const cv::Rect& crop     = crops[i];
+		const cv::Size& cropSize = cropSizes[i];
+
+		Trace::Span fineSpan("fine pass", Trace::IsEnabled() ? std::to_string(crop.width) + "x" + std::to_string(crop.height) + " at " + std::to_string(cropSize.width) + "x" + std::to_string(cropSize.height) : std::string{});
+		mDetector->detect(image(crop), cropSize, account, mCropBoxes);
+
+		for (Box& box : mCropBoxes) {
+			for (int j = 0; j < 4; ++j) {
+				box.mVertices[j].x += crop.x;
+				box.mVertices[j].y += crop.y;
+			}
+
+			boxes.push_back(box);
+			rects.push_back(cv::boundingRect(std::vector<cv::Point2f>(box.mVertices, box.mVertices + 4)));
+			confidences.push_back(box.mConfidence);
+		}
+	}
+
+	// crops can overlap after they are aligned to the grid, the same word is kept once
+	if (crops.size() > 1) {
+		cv::dnn::NMSBoxes(rects, confidences, 0.0f, mDetector->getNmsThreshold(), indices);
+
+		std::vector<Box> kept;
+		kept.reserve(indices.size());
+
+		for (int index : indices) {
+			kept.push_back(boxes[index]);
+		}
+
+		boxes.swap(kept);
+	}
+}
+
+cv::Size Detection::CoarseToFineDetector::getInputSize(const int inputScale) const
+{
+	return mDetector->getInputSize(inputScale);
+}
+
+float Detection::CoarseToFineDetector::getNmsThreshold(void) const
+{
+	return mDetector->getNmsThreshold();
+}
+
+std::string Detection::CoarseToFineDetector::getName(void) const
+{
+	return mDetector->getName() + " coarse to fine";
+}
+
+//
+// Global Functions
+//
+std::unique_ptr<Detection::Detector> Detection::CreateDetector(void)
+{
+	std::unique_ptr<Detector> detector = CreateDetector(Settings::GetString(L"Detection", L"Detector", L"EAST"));
+
+	if (Settings::GetBool(L"Detection", L"CoarseToFine", false)) {
+		return std::unique_ptr<Detector>(new CoarseToFineDetector(std::move(detector)));
+	}
+
+	return detector;
+}
+
+std::unique_ptr<Detection::Detector> Detection::CreateDetector(const std::wstring& name)
+{
+	std::wstring detector = name;
+	std::transform(detector.begin(), detector.end(), detector.begin(), towlower);
+
+	if (detector == L"db") {
+		return std::unique_ptr<Detector>(new DbDetector());
+	}
+
+	return std::unique_ptr<Detector>(new EastDetector());
+}
\ No newline at end of file
@@ -0,0 +1,184 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "detector.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Text Detection Operations
+ *
+ * Structs(Box)
+ * Classes(Detector, EastDetector, DbDetector, CoarseToFineDetector)
+ * Functions(CreateDetector)
+ *
+ */
+
+#ifndef DETECTOR_HPP
+#define DETECTOR_HPP
+
+#include "main.hpp"
+#include "memory.hpp"
+#include <opencv2/dnn.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Detection
+{
+	//
+	// Structs
+	//
+
+	/**
+		Text box found by a detector
+	*/
+	struct Box
+	{
+		cv::Point2f mVertices[4]; // corners in pixel coordinates of the detected image
+		float       mConfidence;  // score of the box
+	};
+
+	//
+	// Classes
+	//
+
+	/**
+		Text detector interface
+	*/
+	class Detector
+	{
+		public:
+
+			virtual ~Detector();
+
+			/**
+				Detects the text boxes on the image at the input size of the detector for the scale (boxes are replaced)
+
+				image      - BGR image (region views are fine)
+				inputScale - input size of the network (multiple of 32)
+				account    - memory account of the image
+			*/
+			void detect(const cv::Mat& image, const int inputScale, Memory::Account& account, std::vector<Box>& boxes);
+			/**
+				Detects the text boxes on the image at exactly the input size (boxes are replaced)
+
+				image     - BGR image (region views are fine)
+				inputSize - input width and height of the network (multiples of 32)
+				account   - memory account of the image
+			*/
+			virtual void detect(const cv::Mat& image, const cv::Size& inputSize, Memory::Account& account, std::vector<Box>& boxes) = 0;
+			/**
+				Returns the input size a whole image is detected at for the input scale (square by default)
+			*/
+			virtual cv::Size getInputSize(const int inputScale) const;
+			/**
+				Returns the overlap above which two boxes of the detector are the same word
+			*/
+			virtual float getNmsThreshold(void) const = 0;
+			/**
+				Returns the name of the detector for the log
+			*/
+			virtual std::string getName(void) const = 0;
+	};
+
+	/**
+		EAST detector, decodes the score and geometry maps and filters them with rotated NMS
+	*/
+	class EastDetector : public Detector
+	{
+		public:
+
+			/**
+				Loads the EAST model in the configured precision on the selected backend
+			*/
+			EastDetector();
+
+			using Detector::detect;
+
+			void        detect(const cv::Mat& image, const cv::Size& inputSize, Memory::Account& account, std::vector<Box>& boxes) override;
+			float       getNmsThreshold(void) const override;
+			std::string getName(void) const override;
+
+		private:
+
+			cv::dnn::Net mNet; // EAST network
+	};
+
+	/**
+		DB (Differentiable Binarization) detector through cv::dnn::TextDetectionModel_DB
+
+		DB gives the text polygons from a binary map, so there is no rotated NMS
+	*/
+	class DbDetector : public Detector
+	{
+		public:
+
+			/**
+				Loads the DB model ([Detection] DbModel) on the selected backend (throws Error::Exception if it can't be read)
+			*/
+			DbDetector();
+
+			using Detector::detect;
+
+			void        detect(const cv::Mat& image, const cv::Size& inputSize, Memory::Account& account, std::vector<Box>& boxes) override;
+			cv::Size    getInputSize(const int inputScale) const override;
+			float       getNmsThreshold(void) const override;
+			std::string getName(void) const override;
+
+		private:
+
+			cv::dnn::TextDetectionModel_DB mModel;        // DB model
+			int                            mInputScale;   // fixed input size of a whole image ([Detection] DbInputScale), 0 uses the input scale of the image
+			float                          mNmsThreshold; // overlap of the same word in overlapping crops ([Detection] DbNmsThreshold)
+	};
+
+	/**
+		Two pass detector for high resolution documents
+
+		A low resolution pass of the inner detector finds the text bearing areas, the boxes are grown by a margin and merged
+		on a coarse mask, and the inner detector runs again at the full input resolution on those crops only, each crop at its
+		own width and height. Boxes of the crops are mapped back to image coordinates and duplicates of overlapping crops are
+		removed. If the crops cost more than a share of the full pass, or the coarse pass finds nothing (small print can vanish
+		at its resolution), the full resolution pass runs on the whole image instead.
+	*/
+	class CoarseToFineDetector : public Detector
+	{
+		public:
+
+			/**
+				detector - detector of both passes
+			*/
+			CoarseToFineDetector(std::unique_ptr<Detector> detector);
+
+			using Detector::detect;
+
+			void        detect(const cv::Mat& image, const cv::Size& inputSize, Memory::Account& account, std::vector<Box>& boxes) override;
+			cv::Size    getInputSize(const int inputScale) const override;
+			float       getNmsThreshold(void) const override;
+			std::string getName(void) const override;
+
+		private:
+
+			std::unique_ptr<Detector> mDetector;      // detector of both passes
+			std::vector<Box>          mCropBoxes;     // boxes of a crop (capacity is kept between crops)
+			int                       mCoarseScale;   // input size of the coarse pass ([Detection] CoarseScale)
+			int                       mMargin;        // margin around the coarse boxes in image pixels ([Detection] CoarseMargin)
+			float                     mCoverageLimit; // crops with more input pixels than this share of the full pass run as one pass ([Detection] CoarseCoverageLimit)
+	};
+
+	//
+	// Global Functions
+	//
+
+	/**
+		Creates the detector of the settings ([Detection] Detector = EAST or DB, CoarseToFine wraps it into the two pass detector)
+	*/
+	std::unique_ptr<Detector> CreateDetector(void);
+	/**
+		Creates the detector by name (EAST or DB)
+	*/
+	std::unique_ptr<Detector> CreateDetector(const std::wstring& name);
+}
+
+#endif
\ No newline at end of file
@@ -2,8 +2,14 @@
 #include "graphics.hpp"
 #include "error.hpp"
 #include "gui.hpp"
+#include "memory.hpp"
+#include "trace.hpp"
+#include <opencv2/imgproc.hpp>
 #include <algorithm>
 #include <cmath>
+#include <map>
+#include <mutex>
+#include <tuple>
 
 //
 // Global variables
@@ -11,6 +17,29 @@
 FT_Library      Graphics::FontLibrary;
 Graphics::Font* Graphics::MainFont = nullptr;
 
+namespace
+{
+	//
+	// Local Definitions
+	//
+	typedef std::tuple<std::wstring, int, Graphics::Font*> TextKey; // text, size and font of a rendered word
+
+	struct TextCacheEntry
+	{
+		std::shared_ptr<BYTE> mBits;
+		int                   mWidth;
+		int                   mHeight;
+	};
+
+	//
+	// Local Variables
+	//
+	std::mutex                         TextCacheMutex;
+	std::map<TextKey, TextCacheEntry> TextCache;
+	size_t                             TextCacheSize{ 0 }; // maximum number of entries, zero disables the cache
+	std::mutex                         FontMutex;          // FreeType faces can't be used by two threads at once
+}
+
 //
 // Font class member functions
 //
@@ -42,11 +71,13 @@ Graphics::Font& Graphics::Font::operator=(const Font& font)
 	return *this;
 }
 
-BYTE* Graphics::Font::createGlyphBits(wchar_t chr, int size, int &x, int &y, int &width, int &height, int& xAdvance)
+BYTE* Graphics::Font::createGlyphBits(wchar_t chr, int size, int &x, int &y, int &width, int &height, int& xAdvance, Memory::Arena* arena)
 {
 	BYTE* bits{ nullptr };
 
 	try {
+		std::lock_guard<std::mutex> lock(FontMutex);
+
 		UINT dpi = GetDpiForWindow(GetDesktopWindow());
 		if (FT_Set_Char_Size(mFace, 0, size * 64, dpi, dpi)) {
 			throw Error::Exception(L"Can't sent the font char size!", L"Create font char bitmap error");
@@ -76,7 +107,8 @@ BYTE* Graphics::Font::createGlyphBits(wchar_t chr, int size, int &x, int &y, int
 			y        = 0;
 			xAdvance = size / TEXT_SPACE_FACTOR;
 
-			bits = new BYTE[width * height * 4]{ 0 };
+			bits = arena ? arena->allocate<BYTE>(width * height * 4) : new BYTE[width * height * 4];
+			std::fill(bits, bits + width * height * 4, (BYTE)0);
 
 			return bits;
 		}
@@ -92,8 +124,8 @@ BYTE* Graphics::Font::createGlyphBits(wchar_t chr, int size, int &x, int &y, int
 			return nullptr;
 		}
 
-		// create glpyh bits
-		bits = new BYTE[width * height * 4]{ 0 };
+		// create glpyh bits (every byte is written below)
+		bits = arena ? arena->allocate<BYTE>(width * height * 4) : new BYTE[width * height * 4];
 		int index{ 0 };
 		for (int j = 0; j < height; ++j) {
 			for (int k = 0; k < width; ++k) {
@@ -118,20 +150,22 @@ BYTE* Graphics::Font::createGlyphBits(wchar_t chr, int size, int &x, int &y, int
 	} catch (Error::Exception& ex) {
 		Error::ShowError(ex.getErrorMessage(), ex.getErrorTitle());
 
-		if (bits) {
-			delete bits;
-			bits = nullptr;
+		if (bits && !arena) {
+			delete[] bits;
 		}
 
+		bits = nullptr;
+
 		return bits;
 	} catch (std::exception& ex) {
 		Error::ShowError(ex.what(), L"Create font char bitmap error");
 
-		if (bits) {
-			delete bits;
-			bits = nullptr;
+		if (bits && !arena) {
+			delete[] bits;
 		}
 
+		bits = nullptr;
+
 		return bits;
 	}
 }
@@ -141,8 +175,9 @@ bool Graphics::Font::load(const std::string& fileName, const std::string& path)
 	try {
 		if (!fileName.empty()) {
 			//get appdir and load font
-			std::string appDir = System::ConvertWstringToString(System::GetApplicationDirectory());
-			std::string file = path.empty() ? appDir + '\\' + fileName : (path + '\\' + fileName); //if path is empty font is in the application directory
+			std::wstring appDir = System::GetApplicationDirectory();
+			std::wstring name   = System::ConvertStringToWstring(fileName);
+			std::string  file   = System::GetNativePath(path.empty() ? appDir + L'\\' + name : (System::ConvertStringToWstring(path) + L'\\' + name)); //if path is empty font is in the application directory
 
 			FT_Error error = FT_New_Face(Graphics::FontLibrary, file.c_str(), 0, &mFace);
 
@@ -176,11 +211,11 @@ void Graphics::Font::reset(void)
 // Graphics Element Class Member Functions
 //
 Graphics::GraphicsElement::GraphicsElement() : 
-	mWidth(0), mHeight(0), mBits(nullptr)
+	mWidth(0), mHeight(0), mBits(nullptr), mSharedBits()
 {}
 
 Graphics::GraphicsElement::GraphicsElement(const BYTE* bits, const int width, const int height) :
-	mWidth(width), mHeight(height), mBits(nullptr)
+	mWidth(width), mHeight(height), mBits(nullptr), mSharedBits()
 {
 	if (bits) {
 		if (!setBits(bits)) {
@@ -190,13 +225,26 @@ Graphics::GraphicsElement::GraphicsElement(const BYTE* bits, const int width, co
 }
 
 Graphics::GraphicsElement::GraphicsElement(const GraphicsElement& element) :
-	mWidth(element.mWidth), mHeight(element.mHeight), mBits(nullptr)
+	mWidth(element.mWidth), mHeight(element.mHeight), mBits(nullptr), mSharedBits()
 {
-	if (!setBits(element.mBits)) {
-		reset();
+	if (element.mSharedBits) { // shared bits are shared by the copy too
+		mSharedBits = element.mSharedBits;
+		mBits       = element.mBits;
+	} else if (element.mBits) {
+		if (!setBits(element.mBits)) {
+			reset();
+		}
 	}
 }
 
+Graphics::GraphicsElement::GraphicsElement(GraphicsElement&& element) :
+	mWidth(element.mWidth), mHeight(element.mHeight), mBits(element.mBits), mSharedBits(std::move(element.mSharedBits))
+{
+	element.mWidth  = 0;
+	element.mHeight = 0;
+	element.mBits   = nullptr;
+}
+
 Graphics::GraphicsElement::~GraphicsElement()
 {
 	reset();
@@ -204,20 +252,52 @@ Graphics::GraphicsElement::~GraphicsElement()
 
 const Graphics::GraphicsElement& Graphics::GraphicsElement::operator=(const GraphicsElement& element)
 {
-	mWidth  = element.mWidth;
-	mHeight = element.mHeight;
-	mBits   = nullptr;
+	if (this == &element) {
+		return *this;
+	}
+
+	if (element.mSharedBits) {
+		shareBits(element.mSharedBits, element.mWidth, element.mHeight);
+	} else if (element.mBits) {
+		BYTE* bits = SetBits(element.mBits, element.mWidth, element.mHeight);
 
-	if (!setBits(element.mBits)) {
+		if (!adoptBits(bits, element.mWidth, element.mHeight)) {
+			reset();
+		}
+	} else {
 		reset();
 	}
 
 	return *this;
 }
 
+const Graphics::GraphicsElement& Graphics::GraphicsElement::operator=(GraphicsElement&& element)
+{
+	if (this == &element) {
+		return *this;
+	}
+
+	releaseBits();
+
+	mWidth      = element.mWidth;
+	mHeight     = element.mHeight;
+	mBits       = element.mBits;
+	mSharedBits = std::move(element.mSharedBits);
+
+	element.mWidth  = 0;
+	element.mHeight = 0;
+	element.mBits   = nullptr;
+
+	return *this;
+}
+
 bool Graphics::GraphicsElement::operator==(const GraphicsElement& element) const
 {
 	if (element.mWidth == mWidth && element.mHeight == mHeight) {
+		if (element.mBits == mBits) { // same (shared) bits
+			return true;
+		}
+
 		for (int i = 0; i < mWidth * mHeight * 4; ++i) {
 			if (element.mBits[i] != mBits[i]) {
 				return false;
@@ -262,15 +342,74 @@ BYTE* Graphics::GraphicsElement::getBits(void) const
 
 bool Graphics::GraphicsElement::setBits(const BYTE* bits)
 {
-	mBits = SetBits(bits, mWidth, mHeight);
+	BYTE* newBits = SetBits(bits, mWidth, mHeight);
 
-	if (mBits == nullptr) {
+	if (newBits == nullptr) {
 		reset();
 
 		return false;
-	} else {
-		return true;
 	}
+
+	releaseBits();
+	mBits = newBits;
+
+	return true;
+}
+
+bool Graphics::GraphicsElement::adoptBits(BYTE* bits, const int width, const int height)
+{
+	if (bits == nullptr || width <= 0 || height <= 0) {
+		delete[] bits;
+
+		reset();
+
+		return false;
+	}
+
+	if (bits != mBits) {
+		releaseBits();
+	}
+
+	mWidth  = width;
+	mHeight = height;
+	mBits   = bits;
+
+	return true;
+}
+
+bool Graphics::GraphicsElement::shareBits(const std::shared_ptr<BYTE>& bits, const int width, const int height)
+{
+	if (!bits || width <= 0 || height <= 0) {
+		reset();
+
+		return false;
+	}
+
+	if (bits != mSharedBits) {
+		releaseBits();
+	}
+
+	mWidth      = width;
+	mHeight     = height;
+	mSharedBits = bits;
+	mBits       = bits.get();
+
+	return true;
+}
+
+std::shared_ptr<BYTE> Graphics::GraphicsElement::getSharedBits(void)
+{
+	// hand the owned bits over to a shared pointer, the element keeps using them
+	if (mBits && !mSharedBits) {
+		mSharedBits = std::shared_ptr<BYTE>(mBits, std::default_delete<BYTE[]>());
+	}
+
+	return mSharedBits;
+}
+
+bool Graphics::GraphicsElement::isShared(void) const
+{
+	return (bool)mSharedBits;
 }
 
 void Graphics::GraphicsElement::reset(void)
@@ -278,10 +417,18 @@ void Graphics::GraphicsElement::reset(void)
 	mWidth  = 0;
 	mHeight = 0;
 
-	if (mBits) {
+	releaseBits();
+}
+
+void Graphics::GraphicsElement::releaseBits(void)
+{
+	if (mSharedBits) {
+		mSharedBits.reset();
+	} else if (mBits) {
 		delete[] mBits;
-		mBits = nullptr;
 	}
+
+	mBits = nullptr;
 }
 
 //
@@ -297,9 +444,15 @@ Graphics::Text::Text(const std::wstring& text, const int size, Graphics::Font* f
 {}
 
 Graphics::Text::Text(const Text& text) :
-	GraphicsElement(text.mBits, text.mWidth, text.mHeight), mText(text.mText), mSize(text.mSize), mFont(text.mFont)
+	GraphicsElement(text), mText(text.mText), mSize(text.mSize), mFont(text.mFont)
 {}
 
+Graphics::Text::Text(Text&& text) :
+	GraphicsElement(std::move(text)), mText(std::move(text.mText)), mSize(text.mSize), mFont(text.mFont)
+{
+	text.mSize = 0;
+}
+
 Graphics::Text::~Text()
 {
 	reset();
@@ -312,15 +465,33 @@ Graphics::Text::operator std::wstring()
 
 const Graphics::Text& Graphics::Text::operator=(const Text& text)
 {
-	mText   = text.mText;
-	mWidth  = text.mWidth;
-	mHeight = text.mHeight;
-	mSize   = text.mSize;
+	if (this == &text) {
+		return *this;
+	}
 
-	if (!setBits(text.mBits)) {
-		reset();
+	GraphicsElement::operator=(text);
+
+	mText = text.mText;
+	mSize = text.mSize;
+	mFont = text.mFont;
+
+	return *this;
+}
+
+const Graphics::Text& Graphics::Text::operator=(Text&& text)
+{
+	if (this == &text) {
+		return *this;
 	}
 
+	GraphicsElement::operator=(std::move(text));
+
+	mText = std::move(text.mText);
+	mSize = text.mSize;
+	mFont = text.mFont;
+
+	text.mSize = 0;
+
 	return *this;
 }
 
@@ -364,11 +535,37 @@ bool Graphics::Text::compose(void)
 {
 	BYTE* finalBits{ nullptr };
 
+	// glyphs and the vectors are scratch data, the final bits are adopted by the element
+	Memory::Arena&     arena = Memory::GetThreadArena();
+	Memory::ArenaScope scope(arena);
+
 	try {
-		std::vector<BYTE*> bitsVec;      // each characters bits vector
-		std::vector<RECT>  bitsRectsVec; // each characters x, y coords and width, height dimensions vector
-		std::vector<int>   bitsRowsVec;  // each characters row number vector (row that char belongs)
-		std::vector<int>   bitsXAdvVec;  // each characters x advance vector
+		//
+		// share the bits of an identical word if it is rendered before
+		//
+		TextKey key;
+
+		if (TextCacheSize) {
+			key = TextKey(mText, mSize, mFont);
+
+			std::lock_guard<std::mutex> lock(TextCacheMutex);
+
+			auto entry = TextCache.find(key);
+			if (entry != TextCache.end()) {
+				return shareBits(entry->second.mBits, entry->second.mWidth, entry->second.mHeight);
+			}
+		}
+
+		Memory::ArenaVector<BYTE*> bitsVec{ Memory::ArenaAllocator<BYTE*>(arena) };    // each characters bits vector
+		Memory::ArenaVector<RECT>  bitsRectsVec{ Memory::ArenaAllocator<RECT>(arena) }; // each characters x, y coords and width, height dimensions vector
+		Memory::ArenaVector<int>   bitsRowsVec{ Memory::ArenaAllocator<int>(arena) };   // each characters row number vector (row that char belongs)
+		Memory::ArenaVector<int>   bitsXAdvVec{ Memory::ArenaAllocator<int>(arena) };   // each characters x advance vector
+
+		// arena never frees, so grow the vectors only once
+		bitsVec.reserve(mText.size());
+		bitsRectsVec.reserve(mText.size());
+		bitsRowsVec.reserve(mText.size());
+		bitsXAdvVec.reserve(mText.size());
 
 		//
 		// calculate each character coords and dimensions, set bits, determine the row it belongs
@@ -384,7 +581,7 @@ bool Graphics::Text::compose(void)
 		int   maxWidth{ 0 };   // width of the widest row
 		for (size_t i = 0; i < mText.size(); ++i) {
 			if (mText[i] != L'\n') { // same line
-				bits = mFont->createGlyphBits(mText[i], mSize, x, y, width, height, xAdvance);
+				bits = mFont->createGlyphBits(mText[i], mSize, x, y, width, height, xAdvance, &arena);
 
 				rowWidth += xAdvance;
 				if (rowWidth > maxWidth) {
@@ -444,21 +641,34 @@ bool Graphics::Text::compose(void)
 				}
 			}
 			curX += bitsXAdvVec[i];
-
-			delete[] bitsVec[i];
 		}
 
 		//
-		// Set bits of composed lines
+		// Adopt bits of composed lines (no copy)
 		//
-		if (!setBits(finalBits)) {
-			delete[] finalBits;
-
-			reset();
+		BYTE* composedBits = finalBits;
+		finalBits          = nullptr;
 
+		if (!adoptBits(composedBits, mWidth, mHeight)) {
 			return false;
 		}
 
+		if (TextCacheSize) {
+			std::lock_guard<std::mutex> lock(TextCacheMutex);
+
+			// simple bound, documents rarely have that many different words
+			if (TextCache.size() >= TextCacheSize) {
+				TextCache.clear();
+			}
+
+			TextCacheEntry entry;
+			entry.mBits   = getSharedBits();
+			entry.mWidth  = mWidth;
+			entry.mHeight = mHeight;
+
+			TextCache[key] = entry;
+		}
+
 		// it's all good! return true
 		return true;
 	} catch (Error::Exception& ex) {
@@ -488,6 +698,17 @@ void Graphics::Text::reset(void)
 	mSize = 0;
 }
 
+void Graphics::SetTextCacheSize(const size_t entries)
+{
+	std::lock_guard<std::mutex> lock(TextCacheMutex);
+
+	TextCacheSize = entries;
+
+	if (TextCacheSize == 0) {
+		TextCache.clear();
+	}
+}
+
 BYTE* Graphics::SetBits(const BYTE* bits, const int width, const int height)
 {
 	BYTE* newBits{ nullptr };
@@ -527,4 +748,74 @@ BYTE* Graphics::SetBits(const BYTE* bits, const int width, const int height)
 
 		return newBits;
 	}
+}
+
+bool Graphics::RenderText(cv::Mat& image, const std::string& text, const int x, const int y, const int size)
+{
+	Trace::Span    composeSpan("overlay compose", text);
+	Memory::Arena& arena = Memory::GetThreadArena();
+
+	// create text element (word scratch goes back to the arena after the overlay is drawn)
+	Memory::ArenaScope wordScope(arena);
+	Text               textElement{ System::ConvertStringToWstring(text), size, MainFont };
+
+	if (!textElement.compose()) {
+		return false;
+	}
+
+	//create text mat
+	cv::Mat textImage(textElement.getHeight(), textElement.getWidth(), CV_8UC4, textElement.getBits());
+
+	// create mask mat (unfortunately somehow OpenCV doesn't process Alpha channel)
+	BYTE* maskBits = arena.allocate<BYTE>(textElement.getHeight() * textElement.getWidth());
+	BYTE* textBits = textElement.getBits();
+
+	for (int i = 0;i < textElement.getHeight() * textElement.getWidth() * 4;i += 4) {
+		if (textBits[i + 3] == 0) { //transparent
+			maskBits[i / 4] = 0;
+		} else { //not transparent
+			maskBits[i / 4] = 1;
+		}
+	}
+
+	cv::Mat maskMat(textElement.getHeight(), textElement.getWidth(), CV_8UC1, maskBits);
+
+	//draw text mat on image 
+	int x1{ x }, y1{ y - size };
+	int x2{ x + textImage.cols }, y2{ y - size + textImage.rows };
+
+	//check bounds (make sure textImage fits in the processed Image)
+	if (x1 < 0) {
+		x1 = 0;
+	}
+
+	if (x2 > image.cols) {
+		x2 = image.cols;
+	}
+
+	if (y1 < 0) {
+		y1 = 0;
+	}
+
+	if (y2 > image.rows) {
+		y2 = image.rows;
+	}
+
+	//nothing left to draw
+	if (x2 <= x1 || y2 <= y1) {
+		return false;
+	}
+
+	//crop text image in case bounds are changed
+	textImage = textImage(cv::Range(0, y2 - y1), cv::Range(0, x2 - x1));
+
+	//crop mask Mat in case bounds are changed
+	maskMat = maskMat(cv::Range(0, y2 - y1), cv::Range(0, x2 - x1));
+
+	// copy text image to processed image using the mask (image stays BGR, so the text is converted instead of the whole image)
+	cv::Mat textImageBGR(y2 - y1, x2 - x1, CV_8UC3, arena.allocate<BYTE>((y2 - y1) * (x2 - x1) * 3));
+	cv::cvtColor(textImage, textImageBGR, cv::COLOR_BGRA2BGR);
+	textImageBGR.copyTo(image.rowRange(y1, y2).colRange(x1, x2), maskMat);
+
+	return true;
 }
\ No newline at end of file
@@ -10,7 +10,7 @@
 *
 * Classes (Pixel, Font, GraphicsElement, Text)
 *
-* Functions (SetBits)
+* Functions (SetBits, SetTextCacheSize, RenderText)
 * 
 */
 
@@ -20,8 +20,16 @@
 #include "main.hpp"
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include <opencv2/core.hpp>
+#include <memory>
+#include <string>
 #include <vector>
 
+namespace Memory
+{
+	class Arena;
+}
+
 namespace Graphics
 {
 	//
@@ -64,15 +72,16 @@ namespace Graphics
 				[out] width    - width of the glyph
 				[out] height   - height of the glyph
 				[out] xAdvance - advance on the horizontal direction of the glyph
+				[in]  arena    - scratch arena to allocate the bits from (bits are new[]'ed if it is null)
 
 				returns RGBA BYTEs of the glyph
 			*/
-			BYTE* createGlyphBits(wchar_t chr, int size, int& x, int& y, int& width, int& height, int& xAdvance);
+			BYTE* createGlyphBits(wchar_t chr, int size, int& x, int& y, int& width, int& height, int& xAdvance, Memory::Arena* arena = nullptr);
 			/**
 			   Loads font file from the hard drive
 
-			   [in] fileName - name of the font file
-			   [in] path     - full path of the folder that contains the font file
+			   [in] fileName - name of the font file (UTF-8)
+			   [in] path     - full path of the folder that contains the font file (UTF-8)
 
 			   returns true on success
 			*/
@@ -94,10 +103,12 @@ namespace Graphics
 			GraphicsElement();
 			GraphicsElement(const BYTE* bits, const int width, const int height);
 			GraphicsElement(const GraphicsElement& element);
+			GraphicsElement(GraphicsElement&& element);
 			virtual ~GraphicsElement();
 
 
-			virtual const GraphicsElement& operator=(const GraphicsElement& element);
+			virtual const GraphicsElement& operator=(const GraphicsElement& element); //shared bits stay shared, owned bits are copied
+			virtual const GraphicsElement& operator=(GraphicsElement&& element);
 			virtual bool                   operator==(const GraphicsElement& element) const; //compares by the bits
 			virtual bool                   operator!=(const GraphicsElement& element) const; //compares by the bits
 
@@ -111,6 +122,26 @@ namespace Graphics
 			virtual BYTE* getBits(void) const;
 			virtual bool  setBits(const BYTE* bits);
 
+			/**
+				Takes the ownership of the bits without copying them
+
+				[in] bits   - new[]'ed RGBA bits (deleted on failure)
+				[in] width  - width of the bits
+				[in] height - height of the bits
+			*/
+			virtual bool adoptBits(BYTE* bits, const int width, const int height);
+			/**
+				Shares reference counted bits with other elements (shared bits must not be modified)
+			*/
+			virtual bool shareBits(const std::shared_ptr<BYTE>& bits, const int width, const int height);
+			/**
+				Returns the bits as reference counted bits, owned bits are handed over to the shared pointer
+			*/
+			virtual std::shared_ptr<BYTE> getSharedBits(void);
+			/**
+				Returns true if the bits are shared
+			*/
+			virtual bool isShared(void) const;
 			/**
 				Resets the graphics element
 			*/
@@ -118,9 +149,15 @@ namespace Graphics
 
 		protected:
 
-			int   mWidth;  // Width of the graphics element
-			int   mHeight; // Height of the graphics element
-			BYTE* mBits;   // BYTEs of the graphics element
+			/**
+				Deletes owned bits or drops the reference to shared bits (keeps the dimensions)
+			*/
+			void releaseBits(void);
+
+			int                   mWidth;      // Width of the graphics element
+			int                   mHeight;     // Height of the graphics element
+			BYTE*                 mBits;       // BYTEs of the graphics element
+			std::shared_ptr<BYTE> mSharedBits; // Keeps shared bits alive (empty if the bits are owned)
 	};
 
 	class Text : public GraphicsElement
@@ -130,11 +167,13 @@ namespace Graphics
 			Text();
 			Text(const std::wstring& text, const int size, Font* font);
 			Text(const Text& text);
+			Text(Text&& text);
 			virtual ~Text();
 
 
 			operator std::wstring();
 			const Text& operator=(const Text& text);
+			const Text& operator=(Text&& text);
 			Text        operator+(const std::wstring& text) const;
 			const Text& operator+=(const std::wstring& text);
 
@@ -147,6 +186,8 @@ namespace Graphics
 
 			/**
 				Composes text element with the text, size and font 
+
+				Shares the bits of an identical word rendered before if the text cache is enabled
 			*/
 			bool compose(void);
 			/**
@@ -172,6 +213,26 @@ namespace Graphics
 		returna copied bits (new)
 	*/
 	BYTE* SetBits(const BYTE* bits, const int width, const int height);
+	/**
+		Sets how many rendered words are kept to share their bits with identical words (0 disables sharing)
+
+		[in] entries - maximum number of words in the cache
+	*/
+	void SetTextCacheSize(const size_t entries);
+	/**
+		Renders the text with the main font and copies it onto a BGR image (the text is cut at the image borders)
+
+		Glyphs are made under the font lock, so several threads may render at once as long as they draw on different images
+
+		[in] image - BGR image to draw on
+		[in] text  - UTF-8 text
+		[in] x     - left of the text on the image
+		[in] y     - baseline of the text on the image (the text starts size pixels above it)
+		[in] size  - char size in pixels
+
+		returns true if anything is drawn
+	*/
+	bool RenderText(cv::Mat& image, const std::string& text, const int x, const int y, const int size);
 
 	//
 	// Global variables
@@ -0,0 +1,406 @@
+#include "inference.hpp"
+#include "error.hpp"
+#include "log.hpp"
+#include "settings.hpp"
+#include "system.hpp"
+#include "trace.hpp"
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	//
+	// Local Definitions
+	//
+	const Inference::Backend OPENCV_BACKEND{ cv::dnn::DNN_BACKEND_OPENCV, cv::dnn::DNN_TARGET_CPU, "OpenCV" };
+	const Inference::Backend OPENVINO_BACKEND{ cv::dnn::DNN_BACKEND_INFERENCE_ENGINE, cv::dnn::DNN_TARGET_CPU, "OpenVINO" };
+	const Inference::Backend CUDA_BACKEND{ cv::dnn::DNN_BACKEND_CUDA, cv::dnn::DNN_TARGET_CUDA, "CUDA" };
+	constexpr int            DECODE_BAND_ROWS = 8; // score map rows of a decoding band (32 input pixels)
+
+	/**
+		Candidates of a band of score map rows
+	*/
+	struct DecodeBand
+	{
+		std::vector<cv::RotatedRect> mBoxes;       // rotated boxes in network input coordinates
+		std::vector<float>           mConfidences; // score of each box
+	};
+
+	//
+	// Local Variables
+	//
+	Inference::Backend    SelectedBackend{ OPENCV_BACKEND };
+	Inference::PRECISION  Precision{ Inference::PR_FP32 };
+	int                   ThreadCount{ 0 };
+
+	std::mutex            CalibrationMutex;
+	std::vector<cv::Mat>  CalibrationBlobs; // built once for the in-process quantization
+
+	//
+	// Local Functions
+	//
+
+	/**
+		Decodes the EAST outputs of the rows [rowBegin, rowEnd) in row order (boxes and confidences are appended)
+	*/
+	void DecodeEastRows(const cv::Mat& scores, const cv::Mat& geometry, const float confThreshold, const int rowBegin, const int rowEnd,
+	                    std::vector<cv::RotatedRect>& boxes, std::vector<float>& confidences)
+	{
+		const int width = scores.size[3];
+		for (int y = rowBegin; y < rowEnd; ++y) {
+			const float* scoresData = scores.ptr<float>(0, 0, y);
+			const float* x0_data    = geometry.ptr<float>(0, 0, y);
+			const float* x1_data    = geometry.ptr<float>(0, 1, y);
+			const float* x2_data    = geometry.ptr<float>(0, 2, y);
+			const float* x3_data    = geometry.ptr<float>(0, 3, y);
+			const float* anglesData = geometry.ptr<float>(0, 4, y);
+			for (int x = 0; x < width; ++x) {
+				float score = scoresData[x];
+				if (score < confThreshold)
+					continue;
+
+				// Decode a prediction.
+				// Multiple by 4 because feature maps are 4 time less than input image.
+				float offsetX = x * 4.0f, offsetY = y * 4.0f;
+				float angle   = anglesData[x];
+				float cosA    = std::cos(angle);
+				float sinA    = std::sin(angle);
+				float h       = x0_data[x] + x2_data[x];
+				float w       = x1_data[x] + x3_data[x];
+
+				cv::Point2f offset(offsetX + cosA * x1_data[x] + sinA * x2_data[x], offsetY - sinA * x1_data[x] + cosA * x2_data[x]);
+				cv::Point2f p1 = cv::Point2f(-sinA * h, -cosA * h) + offset;
+				cv::Point2f p3 = cv::Point2f(-cosA * w, sinA * w) + offset;
+				cv::RotatedRect r(0.5f * (p1 + p3), cv::Size2f(w, h), -angle * 180.0f / (float)CV_PI);
+				boxes.push_back(r);
+				confidences.push_back(score);
+			}
+		}
+	}
+
+	/**
+		Checks if OpenCV is built with the backend and target
+	*/
+	bool IsAvailable(const Inference::Backend& backend)
+	{
+		for (const auto& available : cv::dnn::getAvailableBackends()) {
+			if (available.first == backend.mBackend && available.second == backend.mTarget) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/**
+		Returns the calibration blobs of the settings ([Inference] CalibrationImages), builds them on the first call
+	*/
+	const std::vector<cv::Mat>& GetCalibrationBlobs(void)
+	{
+		std::lock_guard<std::mutex> lock(CalibrationMutex);
+
+		if (CalibrationBlobs.empty()) {
+			CalibrationBlobs = Inference::BuildCalibrationBlobs(Settings::GetPath(L"Inference", L"CalibrationImages", L"calibration"),
+			                                                    (size_t)std::max(1, Settings::GetInt(L"Inference", L"CalibrationCount", 16)),
+			                                                    std::max(32, Settings::GetInt(L"Inference", L"CalibrationScale", 640) / 32 * 32));
+		}
+
+		return CalibrationBlobs;
+	}
+
+	/**
+		Runs the network on a blank input and returns the mean time of a forward pass in milliseconds (negative if it fails)
+
+		The first pass is not timed, it allocates the layers (and compiles the network on OpenVINO)
+	*/
+	double Benchmark(const Inference::Backend& backend, const cv::Mat& blob, const int runs)
+	{
+		try {
+			cv::dnn::Net net = Inference::LoadNetwork(Inference::PR_FP32);
+			net.setPreferableBackend(backend.mBackend);
+			net.setPreferableTarget(backend.mTarget);
+
+			std::vector<cv::String> outputLayers{ Inference::EAST_SCORES_LAYER, Inference::EAST_GEOMETRY_LAYER };
+			std::vector<cv::Mat>    output;
+
+			net.setInput(blob);
+			net.forward(output, outputLayers);
+
+			int64_t start = cv::getTickCount();
+
+			for (int i = 0; i < runs; ++i) {
+				net.setInput(blob);
+				net.forward(output, outputLayers);
+			}
+
+			return (double)(cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency() / runs;
+		} catch (Error::Exception&) {
+			return -1.0;
+		} catch (std::exception&) {
+			return -1.0;
+		}
+	}
+}
+
+//
+// Global Functions
+//
+bool Inference::Initialize(void)
+{
+	ThreadCount = std::max(0, Settings::GetInt(L"Inference", L"Threads", 0));
+
+	std::wstring precision = Settings::GetString(L"Inference", L"Precision", L"FP32");
+	std::transform(precision.begin(), precision.end(), precision.begin(), towlower);
+
+	Precision = precision == L"int8" ? PR_INT8 : PR_FP32;
+
+	if (Precision == PR_INT8) {
+		Log::Write("Inference precision: int8 (" + (GetFileAttributesW(GetInt8ModelPath().c_str()) != INVALID_FILE_ATTRIBUTES ?
+		           System::ConvertWstringToString(GetInt8ModelPath()) : std::string{ "quantized with the calibration images" }) + ")");
+	}
+
+	std::wstring name = Settings::GetString(L"Inference", L"Backend", L"Auto");
+	std::transform(name.begin(), name.end(), name.begin(), towlower);
+
+	// explicit choice (OpenCV CPU is always there)
+	if (name != L"auto") {
+		const Backend& backend = name == L"cuda" ? CUDA_BACKEND : (name == L"openvino" ? OPENVINO_BACKEND : OPENCV_BACKEND);
+
+		if (IsAvailable(backend)) {
+			SelectedBackend = backend;
+		} else {
+			SelectedBackend = OPENCV_BACKEND;
+			Log::Write("Inference backend " + backend.mName + " is not available, OpenCV CPU is used");
+		}
+
+		Log::Write("Inference backend: " + SelectedBackend.mName + ", threads " + (ThreadCount ? std::to_string(ThreadCount) : std::string{ "default" }));
+
+		return true;
+	}
+
+	// benchmark the candidates on the host
+	Trace::Span span("backend benchmark");
+	ConfigureThreads(false);
+
+	const int inputScale = std::max(32, Settings::GetInt(L"Inference", L"BenchmarkScale", 320) / 32 * 32);
+	const int runs       = std::max(1, Settings::GetInt(L"Inference", L"BenchmarkRuns", 3));
+
+	cv::Mat image(inputScale, inputScale, CV_8UC3, cv::Scalar(127, 127, 127));
+	cv::Mat blob;
+	cv::dnn::blobFromImage(image, blob, 1.0f, cv::Size(inputScale, inputScale), cv::Scalar(123.68, 116.78, 103.94), true, false);
+
+	std::string report;
+	double      bestTime{ -1.0 };
+
+	for (const Backend* backend : { &OPENCV_BACKEND, &OPENVINO_BACKEND, &CUDA_BACKEND }) {
+		if (!IsAvailable(*backend)) {
+			continue;
+		}
+
+		double time = Benchmark(*backend, blob, runs);
+		char   timing[64];
+
+		if (time < 0.0) {
+			std::snprintf(timing, sizeof(timing), "%s failed", backend->mName.c_str());
+		} else {
+			std::snprintf(timing, sizeof(timing), "%s %.1f ms", backend->mName.c_str(), time);
+		}
+
+		report += (report.empty() ? "" : ", ") + std::string(timing);
+
+		if (time >= 0.0 && (bestTime < 0.0 || time < bestTime)) {
+			bestTime        = time;
+			SelectedBackend = *backend;
+		}
+	}
+
+	if (bestTime < 0.0) {
+		SelectedBackend = OPENCV_BACKEND;
+		Log::Write("Inference benchmark failed (" + report + "), OpenCV CPU is used");
+
+		return false;
+	}
+
+	Log::Write("Inference benchmark at " + std::to_string(inputScale) + "x" + std::to_string(inputScale) + ", threads " +
+	           (ThreadCount ? std::to_string(ThreadCount) : std::string{ "default" }) + ": " + report + " -> " + SelectedBackend.mName);
+
+	return true;
+}
+
+const Inference::Backend& Inference::GetBackend(void)
+{
+	return SelectedBackend;
+}
+
+Inference::PRECISION Inference::GetPrecision(void)
+{
+	return Precision;
+}
+
+int Inference::GetThreadCount(void)
+{
+	return ThreadCount;
+}
+
+std::wstring Inference::GetModelPath(void)
+{
+	return Settings::GetPath(L"Inference", L"Model", L"frozen_east_text_detection.pb");
+}
+
+std::wstring Inference::GetInt8ModelPath(void)
+{
+	return Settings::GetPath(L"Inference", L"Int8Model", L"frozen_east_text_detection_int8.onnx");
+}
+
+cv::dnn::Net Inference::LoadNetwork(void)
+{
+	return LoadNetwork(Precision);
+}
+
+cv::dnn::Net Inference::LoadNetwork(const PRECISION precision)
+{
+	if (precision == PR_INT8) {
+		// quantizing runs the network on every calibration blob, so a worker does it once
+		thread_local cv::dnn::Net int8Net;
+
+		if (int8Net.empty()) {
+			std::wstring int8Model = GetInt8ModelPath();
+
+			if (GetFileAttributesW(int8Model.c_str()) != INVALID_FILE_ATTRIBUTES) {
+				int8Net = cv::dnn::readNet(System::GetNativePath(int8Model));
+			} else {
+				cv::dnn::Net net = LoadNetwork(PR_FP32);
+				int8Net = QuantizeNetwork(net, GetCalibrationBlobs());
+			}
+
+			if (int8Net.empty()) {
+				throw Error::Exception(L"Can't load the int8 text detection model!", L"Image Processing Error");
+			}
+
+			// OpenCV runs int8 layers on its own CPU backend only
+			int8Net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+			int8Net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+		}
+
+		return int8Net;
+	}
+
+	cv::dnn::Net net = cv::dnn::readNet(System::GetNativePath(GetModelPath()));
+
+	if (net.empty()) {
+		throw Error::Exception(L"Can't load the text detection model!", L"Image Processing Error");
+	}
+
+	net.setPreferableBackend(SelectedBackend.mBackend);
+	net.setPreferableTarget(SelectedBackend.mTarget);
+
+	return net;
+}
+
+std::vector<cv::Mat> Inference::BuildCalibrationBlobs(const std::wstring& directory, const size_t maxCount, const int inputScale)
+{
+	std::vector<cv::Mat>      blobs;
+	std::vector<std::wstring> files = System::ListFiles(directory, { L"*.png", L"*.jpg", L"*.jpeg", L"*.bmp", L"*.tif", L"*.tiff" });
+
+	for (const std::wstring& file : files) {
+		if (blobs.size() >= maxCount) {
+			break;
+		}
+
+		std::vector<unsigned char> data;
+
+		if (!System::ReadFile(file, data)) {
+			continue;
+		}
+
+		cv::Mat image = cv::imdecode(data, cv::IMREAD_COLOR);
+
+		if (image.empty()) {
+			continue;
+		}
+
+		cv::Mat blob;
+		cv::dnn::blobFromImage(image, blob, 1.0f, cv::Size(inputScale, inputScale), cv::Scalar(123.68, 116.78, 103.94), true, false);
+		blobs.push_back(blob);
+	}
+
+	if (blobs.empty()) {
+		throw Error::Exception(L"There are no calibration images in " + directory + L"!", L"Calibration Error");
+	}
+
+	return blobs;
+}
+
+cv::dnn::Net Inference::QuantizeNetwork(cv::dnn::Net& net, const std::vector<cv::Mat>& calibrationBlobs)
+{
+	Trace::Span span("quantize network");
+
+	net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+	net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+
+	return net.quantize(calibrationBlobs, CV_32F, CV_32F);
+}
+
+void Inference::DecodeEast(const cv::Mat& scores, const cv::Mat& geometry, const float confThreshold, std::vector<cv::RotatedRect>& boxes, std::vector<float>& confidences)
+{
+	CV_Assert(scores.dims == 4); CV_Assert(geometry.dims == 4); CV_Assert(scores.size[0] == 1);
+	CV_Assert(geometry.size[0] == 1); CV_Assert(scores.size[1] == 1); CV_Assert(geometry.size[1] == 5);
+	CV_Assert(scores.size[2] == geometry.size[2]); CV_Assert(scores.size[3] == geometry.size[3]);
+
+	const int height    = scores.size[2];
+	const int bandCount = (height + DECODE_BAND_ROWS - 1) / DECODE_BAND_ROWS;
+
+	// small maps or a single thread aren't worth the bands
+	if (bandCount < 2 || cv::getNumThreads() < 2) {
+		DecodeEastRows(scores, geometry, confThreshold, 0, height, boxes, confidences);
+
+		return;
+	}
+
+	// band buffers of the calling thread keep their capacity between images, the workers of parallel_for_ have their own
+	// thread_local copies, so they only see the buffers through this reference
+	thread_local std::vector<DecodeBand> threadBands;
+	std::vector<DecodeBand>&             bands = threadBands;
+
+	if ((int)bands.size() < bandCount) {
+		bands.resize(bandCount);
+	}
+
+	cv::parallel_for_(cv::Range(0, bandCount), [&](const cv::Range& range) {
+		for (int i = range.start; i < range.end; ++i) {
+			bands[i].mBoxes.clear();
+			bands[i].mConfidences.clear();
+			DecodeEastRows(scores, geometry, confThreshold, i * DECODE_BAND_ROWS, std::min(height, (i + 1) * DECODE_BAND_ROWS), bands[i].mBoxes, bands[i].mConfidences);
+		}
+	});
+
+	// concatenate in row order, so the candidates are the same as the sequential decoding
+	size_t count{ 0 };
+
+	for (int i = 0; i < bandCount; ++i) {
+		count += bands[i].mBoxes.size();
+	}
+
+	boxes.reserve(boxes.size() + count);
+	confidences.reserve(confidences.size() + count);
+
+	for (int i = 0; i < bandCount; ++i) {
+		boxes.insert(boxes.end(), bands[i].mBoxes.begin(), bands[i].mBoxes.end());
+		confidences.insert(confidences.end(), bands[i].mConfidences.begin(), bands[i].mConfidences.end());
+	}
+}
+
+void Inference::ConfigureThreads(const bool batch)
+{
+	if (ThreadCount) {
+		cv::setNumThreads(ThreadCount);
+	} else {
+		// batch workers already keep the cores busy, OpenCV's pool on top of them only oversubscribes (-1 restores OpenCV's default)
+		cv::setNumThreads(batch ? 1 : -1);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "inference.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Inference Operations
+ *
+ * Structs(Backend)
+ * Functions(Initialize, GetBackend, GetPrecision, GetThreadCount, GetModelPath, GetInt8ModelPath, LoadNetwork, ConfigureThreads,
+ *           BuildCalibrationBlobs, QuantizeNetwork, DecodeEast)
+ *
+ */
+
+#ifndef INFERENCE_HPP
+#define INFERENCE_HPP
+
+#include "main.hpp"
+#include <opencv2/dnn.hpp>
+#include <string>
+#include <vector>
+
+namespace Inference
+{
+	//
+	// Global Definitions
+	//
+	constexpr char  EAST_SCORES_LAYER[]       = "feature_fusion/Conv_7/Sigmoid"; // score map output of EAST
+	constexpr char  EAST_GEOMETRY_LAYER[]     = "feature_fusion/concat_3";       // geometry output of EAST
+	constexpr float EAST_CONFIDENCE_THRESHOLD = 0.5f;                            // lowest score of a text box
+	constexpr float EAST_NMS_THRESHOLD        = 0.4f;                            // overlap threshold of the non maximum suppression
+
+	/**
+		Precision of the EAST model
+	*/
+	enum PRECISION
+	{
+		PR_FP32, // frozen_east_text_detection.pb as it is
+		PR_INT8  // int8 model ([Inference] Int8Model) or the fp32 model quantized with the calibration images
+	};
+
+	//
+	// Structs
+	//
+
+	/**
+		DNN backend and target the network runs on
+	*/
+	struct Backend
+	{
+		int         mBackend; // cv::dnn::Backend
+		int         mTarget;  // cv::dnn::Target
+		std::string mName;    // name in the settings and the log
+	};
+
+	//
+	// Global Functions
+	//
+
+	/**
+		Selects the backend from the settings ([Inference] Backend)
+
+		Auto runs every available candidate (OpenCV CPU, OpenVINO, CUDA) on the model and picks the fastest one,
+		the timings and the choice are logged. Returns false if the model couldn't be run (OpenCV CPU is used then).
+	*/
+	bool Initialize(void);
+	/**
+		Returns the selected backend
+	*/
+	const Backend& GetBackend(void);
+	/**
+		Returns the precision of the model workers load ([Inference] Precision)
+	*/
+	PRECISION GetPrecision(void);
+	/**
+		Returns the size of OpenCV's thread pool ([Inference] Threads, 0 is one thread for the batches and OpenCV's default
+		elsewhere)
+	*/
+	int GetThreadCount(void);
+	/**
+		Returns full path of the EAST model
+	*/
+	std::wstring GetModelPath(void);
+	/**
+		Returns full path of the int8 EAST model (ONNX with quantize/dequantize nodes)
+	*/
+	std::wstring GetInt8ModelPath(void);
+	/**
+		Reads the EAST model in the configured precision and sets the backend (throws Error::Exception if the model can't be read)
+	*/
+	cv::dnn::Net LoadNetwork(void);
+	/**
+		Reads the EAST model in the given precision (throws Error::Exception if the model can't be read)
+
+		Int8 models only run on the OpenCV CPU backend. The int8 model file is used if it exists, otherwise the fp32 model
+		is quantized with the calibration images. OpenCV can't save the nets it quantizes, so the quantized net is kept per worker thread.
+	*/
+	cv::dnn::Net LoadNetwork(const PRECISION precision);
+	/**
+		Builds the input blobs of the calibration images (throws Error::Exception if there are no readable images)
+
+		directory  - folder of the images (png, jpg, bmp, tif)
+		maxCount   - number of images used at most
+		inputScale - input size of the network
+	*/
+	std::vector<cv::Mat> BuildCalibrationBlobs(const std::wstring& directory, const size_t maxCount, const int inputScale);
+	/**
+		Quantizes the fp32 EAST network to int8 using the activation ranges seen on the calibration blobs
+
+		Input and outputs stay fp32, so the blobs and the decoding are the same for both precisions
+	*/
+	cv::dnn::Net QuantizeNetwork(cv::dnn::Net& net, const std::vector<cv::Mat>& calibrationBlobs);
+	/**
+		Decodes the EAST outputs into rotated boxes in network input coordinates (boxes and confidences are appended)
+
+		Bands of score map rows are decoded in parallel and concatenated in row order, so the result is the same as a sequential decoding
+	*/
+	void DecodeEast(const cv::Mat& scores, const cv::Mat& geometry, const float confThreshold, std::vector<cv::RotatedRect>& boxes, std::vector<float>& confidences);
+	/**
+		Sets the size of OpenCV's thread pool for the mode of the process, called once when the mode starts
+
+		OpenCV has one pool for the whole process (cv::setNumThreads isn't per thread), every parallel loop of every
+		worker shares it. A pool or a pipeline runs images side by side on its own workers, so with Threads=0 its
+		parallel loops (EAST decoding, rectification) run on the calling worker.
+
+		batch - the process runs images on a pool or a pipeline
+	*/
+	void ConfigureThreads(const bool batch);
+}
+
+#endif
\ No newline at end of file
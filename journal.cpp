@@ -0,0 +1,289 @@
+#include "journal.hpp"
+#include "error.hpp"
+#include "log.hpp"
+#include "settings.hpp"
+#include "system.hpp"
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	//
+	// Local Definitions
+	//
+	constexpr size_t READ_CHUNK_SIZE = 64 * 1024; // bytes read at once from the journal and the outputs
+
+	//
+	// Local Functions
+	//
+
+	/**
+		Returns the checksum of a journal line (the lower 32 bits of its FNV-1a hash)
+	*/
+	uint32_t GetLineChecksum(const char* line, const size_t length)
+	{
+		return (uint32_t)Checkpoint::HashBytes(line, length);
+	}
+}
+
+//
+// Journal Class Member Functions
+//
+Checkpoint::Journal::Journal(const std::wstring& fileName) :
+	mFileName(fileName), mFile(INVALID_HANDLE_VALUE), mRecords(), mBuffer(), mBuffered(0), mLastSync(cv::getTickCount()),
+	mSyncRecords((size_t)std::max(1, Settings::GetInt(L"Journal", L"SyncRecords", 256))),
+	mSyncInterval(std::max(0, Settings::GetInt(L"Journal", L"SyncMs", 1000)) / 1000.0), mFailed(false)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	load();
+
+	mFile = CreateFileW(mFileName.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (mFile == INVALID_HANDLE_VALUE) {
+		throw Error::Exception(L"Can't open the journal " + mFileName + L"!", L"Journal Error");
+	}
+
+	// a line torn by a crash is ended, so the next line starts on its own
+	LARGE_INTEGER size;
+
+	if (GetFileSizeEx(mFile, &size) && size.QuadPart > 0) {
+		FILE* file = _wfopen(mFileName.c_str(), L"rb");
+
+		if (file) {
+			std::fseek(file, -1, SEEK_END);
+			bool ended = std::fgetc(file) == '\n';
+			std::fclose(file);
+
+			if (!ended) {
+				mBuffer = "\n";
+			}
+		}
+	}
+}
+
+Checkpoint::Journal::~Journal()
+{
+	sync();
+
+	if (mFile != INVALID_HANDLE_VALUE) {
+		CloseHandle(mFile);
+	}
+}
+
+bool Checkpoint::Journal::isDone(const std::wstring& input, const std::wstring& output, const bool verify) const
+{
+	Record record;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto                        found = mRecords.find(input);
+
+		if (found == mRecords.end()) {
+			return false;
+		}
+
+		record = found->second;
+	}
+
+	uint64_t size{ 0 }, time{ 0 };
+
+	// the input was replaced since it was finished
+	if (!GetFileStamp(input, size, time) || size != record.mInputSize || time != record.mInputTime) {
+		return false;
+	}
+
+	if (output.empty()) {
+		return true;
+	}
+
+	// the output was lost or cut short
+	if (!GetFileStamp(output, size, time) || size != record.mOutputSize) {
+		return false;
+	}
+
+	uint64_t hash{ 0 };
+
+	return !verify || (HashFile(output, hash) && hash == record.mOutputHash);
+}
+
+bool Checkpoint::Journal::record(const std::wstring& input, const std::wstring& output)
+{
+	Record   record{ 0, 0, 0, 0 };
+	uint64_t outputTime{ 0 };
+
+	if (!GetFileStamp(input, record.mInputSize, record.mInputTime)) {
+		return false;
+	}
+
+	if (!output.empty() && (!GetFileStamp(output, record.mOutputSize, outputTime) || !HashFile(output, record.mOutputHash))) {
+		return false;
+	}
+
+	//
+	// <checksum> <input size> <input time> <output size> <output hash> <input path>
+	//
+	char        fields[96];
+	std::string path = System::ConvertWstringToString(input);
+
+	std::snprintf(fields, sizeof(fields), "%" PRIx64 " %" PRIx64 " %" PRIx64 " %016" PRIx64 " ", record.mInputSize, record.mInputTime, record.mOutputSize,
+	              record.mOutputHash);
+
+	std::string line = fields + path;
+	char        checksum[16];
+
+	std::snprintf(checksum, sizeof(checksum), "%08" PRIx32 " ", GetLineChecksum(line.data(), line.size()));
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	mRecords[input] = record;
+	mBuffer        += checksum + line + "\n";
+	++mBuffered;
+
+	if (mBuffered >= mSyncRecords || (double)(cv::getTickCount() - mLastSync) / cv::getTickFrequency() >= mSyncInterval) {
+		return write();
+	}
+
+	return true;
+}
+
+bool Checkpoint::Journal::sync(void)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	return write();
+}
+
+size_t Checkpoint::Journal::getRecordCount(void) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	return mRecords.size();
+}
+
+void Checkpoint::Journal::load(void)
+{
+	FILE* file = _wfopen(mFileName.c_str(), L"rb");
+
+	if (!file) {
+		return;
+	}
+
+	std::vector<char> chunk(READ_CHUNK_SIZE);
+	std::string       line;
+	size_t            skipped{ 0 };
+
+	// the last line stays in line if it has no line feed (torn by a crash) and is skipped
+	for (size_t read = std::fread(chunk.data(), 1, chunk.size(), file); read; read = std::fread(chunk.data(), 1, chunk.size(), file)) {
+		for (size_t begin = 0; begin < read;) {
+			const char* end = (const char*)std::memchr(chunk.data() + begin, '\n', read - begin);
+
+			if (!end) {
+				line.append(chunk.data() + begin, read - begin);
+
+				break;
+			}
+
+			line.append(chunk.data() + begin, end - (chunk.data() + begin));
+			begin = end - chunk.data() + 1;
+
+			uint32_t checksum{ 0 };
+			Record   record{ 0, 0, 0, 0 };
+			int      pathOffset{ 0 };
+
+			if (line.size() > 9 && std::sscanf(line.c_str(), "%8" SCNx32 " %" SCNx64 " %" SCNx64 " %" SCNx64 " %" SCNx64 " %n", &checksum, &record.mInputSize,
+			                                   &record.mInputTime, &record.mOutputSize, &record.mOutputHash, &pathOffset) == 5 &&
+			    pathOffset > 0 && (size_t)pathOffset < line.size() && checksum == GetLineChecksum(line.data() + 9, line.size() - 9)) {
+				// a later line of the same input replaces the earlier one
+				mRecords[System::ConvertStringToWstring(line.substr(pathOffset))] = record;
+			} else if (!line.empty()) {
+				++skipped;
+			}
+
+			line.clear();
+		}
+	}
+
+	std::fclose(file);
+
+	if (skipped || !line.empty()) {
+		Log::Write("Journal " + System::ConvertWstringToString(mFileName) + ": " + std::to_string(skipped + (line.empty() ? 0 : 1)) + " damaged lines skipped");
+	}
+}
+
+bool Checkpoint::Journal::write(void)
+{
+	if (!mBuffer.empty()) {
+		DWORD written{ 0 };
+
+		if (!WriteFile(mFile, mBuffer.data(), (DWORD)mBuffer.size(), &written, nullptr) || written != mBuffer.size() || !FlushFileBuffers(mFile)) {
+			if (!mFailed) {
+				Log::Write("Journal " + System::ConvertWstringToString(mFileName) + " can't be written, finished images won't be skipped on restart");
+			}
+
+			mFailed = true;
+		}
+
+		mBuffer.clear();
+		mBuffered = 0;
+	}
+
+	mLastSync = cv::getTickCount();
+
+	return !mFailed;
+}
+
+//
+// Global Functions
+//
+uint64_t Checkpoint::HashBytes(const void* bytes, const size_t length, uint64_t hash)
+{
+	const unsigned char* data = (const unsigned char*)bytes;
+
+	for (size_t i = 0; i < length; ++i) {
+		hash ^= data[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+bool Checkpoint::GetFileStamp(const std::wstring& fileName, uint64_t& size, uint64_t& time)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+
+	if (!GetFileAttributesExW(fileName.c_str(), GetFileExInfoStandard, &data) || (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+		return false;
+	}
+
+	size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+	time = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+
+	return true;
+}
+
+bool Checkpoint::HashFile(const std::wstring& fileName, uint64_t& hash)
+{
+	FILE* file = _wfopen(fileName.c_str(), L"rb");
+
+	if (!file) {
+		return false;
+	}
+
+	std::vector<char> chunk(READ_CHUNK_SIZE);
+
+	hash = FNV_OFFSET_BASIS;
+
+	for (size_t read = std::fread(chunk.data(), 1, chunk.size(), file); read; read = std::fread(chunk.data(), 1, chunk.size(), file)) {
+		hash = HashBytes(chunk.data(), read, hash);
+	}
+
+	bool failed = std::ferror(file) != 0;
+	std::fclose(file);
+
+	return !failed;
+}
\ No newline at end of file
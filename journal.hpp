@@ -0,0 +1,139 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "journal.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Batch Progress Journal Operations
+ *
+ * Structs(Record)
+ * Classes(Journal)
+ * Functions(HashBytes, GetFileStamp, HashFile)
+ *
+ */
+
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include "main.hpp"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace Checkpoint
+{
+	//
+	// Global Definitions
+	//
+	constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL; // FNV-1a hash of no bytes
+	constexpr uint64_t FNV_PRIME        = 1099511628211ULL;
+
+	//
+	// Structs
+	//
+
+	/**
+		A finished input in the journal
+	*/
+	struct Record
+	{
+		uint64_t mInputSize;  // bytes of the input when it was finished
+		uint64_t mInputTime;  // last write time of the input when it was finished (FILETIME)
+		uint64_t mOutputSize; // bytes of the output (0 without an output)
+		uint64_t mOutputHash; // FNV-1a hash of the output (0 without an output)
+	};
+
+	//
+	// Classes
+	//
+
+	/**
+		Append-only journal of the finished inputs of a batch
+
+		Every finished input appends a line with the size and write time of the input and the size and hash of its output.
+		Lines are collected in memory and written and flushed to the disk together ([Journal] SyncRecords and SyncMs), so a
+		crash loses the last few seconds of work at most. Every line carries its own checksum, a line torn by a crash is
+		skipped when the journal is loaded. A restarted batch asks isDone for each input, which compares the stamps of the
+		files with the journal without reading them.
+	*/
+	class Journal
+	{
+		public:
+
+			/**
+				Loads the finished inputs of the journal and opens it for appending (throws Error::Exception if it can't be opened)
+			*/
+			Journal(const std::wstring& fileName);
+			Journal(const Journal& journal) = delete;
+			/**
+				Writes the collected lines and closes the journal
+			*/
+			~Journal();
+
+			const Journal& operator=(const Journal& journal) = delete;
+
+			/**
+				Returns true if the input is finished in the journal and neither it nor its output changed since
+
+				output - output of the input (empty if there is none)
+				verify - hashes the output again instead of comparing its size only
+			*/
+			bool isDone(const std::wstring& input, const std::wstring& output, const bool verify) const;
+			/**
+				Records the input as finished with its output (thread safe, returns false if the files can't be stamped)
+			*/
+			bool record(const std::wstring& input, const std::wstring& output);
+			/**
+				Writes the collected lines and flushes the journal to the disk (returns false if a write failed)
+			*/
+			bool sync(void);
+			/**
+				Returns the number of finished inputs (loaded and recorded)
+			*/
+			size_t getRecordCount(void) const;
+
+		private:
+
+			/**
+				Reads the lines of the journal file (mMutex must be locked)
+			*/
+			void load(void);
+			/**
+				Writes the collected lines (mMutex must be locked)
+			*/
+			bool write(void);
+
+			std::wstring                             mFileName;     // path of the journal
+			HANDLE                                   mFile;         // journal opened for appending
+			std::unordered_map<std::wstring, Record> mRecords;      // finished inputs
+			std::string                              mBuffer;       // lines that aren't written yet
+			size_t                                   mBuffered;     // number of lines in the buffer
+			int64_t                                  mLastSync;     // tick count of the last sync
+			size_t                                   mSyncRecords;  // lines collected before a sync
+			double                                   mSyncInterval; // seconds between two syncs at most
+			bool                                     mFailed;       // did a write fail?
+			mutable std::mutex                       mMutex;        // guards the members above
+	};
+
+	//
+	// Global Functions
+	//
+
+	/**
+		Continues the FNV-1a hash over the bytes
+	*/
+	uint64_t HashBytes(const void* bytes, const size_t length, const uint64_t hash = FNV_OFFSET_BASIS);
+	/**
+		Returns the size and last write time of the file (returns false if it doesn't exist)
+	*/
+	bool GetFileStamp(const std::wstring& fileName, uint64_t& size, uint64_t& time);
+	/**
+		Returns the FNV-1a hash of the file contents (returns false if it can't be read)
+	*/
+	bool HashFile(const std::wstring& fileName, uint64_t& hash);
+}
+
+#endif
\ No newline at end of file
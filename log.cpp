@@ -0,0 +1,65 @@
+#include "log.hpp"
+#include "system.hpp"
+#include <cstdio>
+#include <mutex>
+
+namespace
+{
+	//
+	// Local Variables
+	//
+	std::mutex LogMutex;
+	FILE*      LogFile{ nullptr };
+}
+
+//
+// Global Functions
+//
+bool Log::Initialize(const std::wstring& fileName)
+{
+	std::lock_guard<std::mutex> lock(LogMutex);
+
+	if (LogFile) {
+		return true;
+	}
+
+	LogFile = _wfopen(fileName.c_str(), L"ab");
+
+	return LogFile != nullptr;
+}
+
+void Log::Deinitialize(void)
+{
+	std::lock_guard<std::mutex> lock(LogMutex);
+
+	if (LogFile) {
+		std::fclose(LogFile);
+		LogFile = nullptr;
+	}
+}
+
+void Log::Write(const std::string& message)
+{
+	SYSTEMTIME time;
+	GetLocalTime(&time);
+
+	char stamp[48];
+	std::snprintf(stamp, sizeof(stamp), "%04u-%02u-%02u %02u:%02u:%02u.%03u [%lu] ", time.wYear, time.wMonth, time.wDay,
+	              time.wHour, time.wMinute, time.wSecond, time.wMilliseconds, (unsigned long)GetCurrentThreadId());
+
+	std::lock_guard<std::mutex> lock(LogMutex);
+
+	if (!LogFile) {
+		return;
+	}
+
+	std::fputs(stamp, LogFile);
+	std::fputs(message.c_str(), LogFile);
+	std::fputs("\r\n", LogFile);
+	std::fflush(LogFile);
+}
+
+void Log::Write(const std::wstring& message)
+{
+	Write(System::ConvertWstringToString(message));
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "log.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Logging Operations
+ *
+ * Functions(Initialize, Deinitialize, Write)
+ *
+ */
+
+#ifndef LOG_HPP
+#define LOG_HPP
+
+#include "main.hpp"
+#include <string>
+
+namespace Log
+{
+	//
+	// Global Functions
+	//
+
+	/**
+		Opens the log file for appending (returns true on success)
+
+		fileName - full path of the log file
+	*/
+	bool Initialize(const std::wstring& fileName);
+	/**
+		Closes the log file
+	*/
+	void Deinitialize(void);
+	/**
+		Writes a time stamped line to the log file (safe to call from any thread, does nothing if the log is not open)
+
+		message - UTF-8 message to write
+	*/
+	void Write(const std::string& message);
+	/**
+		Writes a time stamped line to the log file (wstring version)
+	*/
+	void Write(const std::wstring& message);
+}
+
+#endif
\ No newline at end of file
@@ -1,6 +1,7 @@
 ﻿#include "main.hpp"
 #include "application.hpp"
 #include "system.hpp"
+#include "tools.hpp"
 
 //
 // Global Variables
@@ -14,10 +15,19 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 	App = new Application::Application();
 	
 	App->SetInstance(hInstance);
-	App->SetCmdLine(System::ConvertStringToWstring(std::string(lpCmdLine)));
+	App->SetCmdLine(System::ConvertNativeStringToWstring(std::string(lpCmdLine)));
 	App->SetCmdShow(nShowCmd);
 	App->SetAppName(L"Katip");
 
+	// Run the command line tool instead of the window if one is asked for
+	int exitCode{ 0 };
+
+	if (Tools::Run(App->GetCmdLine(), exitCode)) {
+		delete App;
+
+		return exitCode;
+	}
+
 	// Initialize the app
 	App->Initialize();
 
@@ -0,0 +1,750 @@
+#include "memory.hpp"
+#include "settings.hpp"
+#include <psapi.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cwctype>
+#include <functional>
+
+namespace
+{
+	//
+	// Local Definitions
+	//
+	constexpr size_t IMAGE_BYTES_PER_PIXEL = 3;     // decoded BGR image
+	constexpr size_t GREY_BYTES_PER_PIXEL  = 1;     // grey copy given to Tesseract
+	constexpr size_t OCR_BYTES_PER_PIXEL   = 2;     // Tesseract's own pix and thresholded copies (measured, not exact)
+	constexpr size_t MAX_TIFF_PAGES        = 65536; // a longer directory chain is a loop in a damaged file
+	constexpr int    TIFF_IMAGE_WIDTH      = 256;   // tag of the page width
+	constexpr int    TIFF_IMAGE_LENGTH     = 257;   // tag of the page height
+	constexpr int    TIFF_SHORT            = 3;     // 16 bit tag value
+	constexpr int    TIFF_LONG             = 4;     // 32 bit tag value
+
+	typedef std::function<bool(const uint32_t offset, unsigned char* data, const size_t size)> TiffReader; // reads bytes at an offset of a TIFF
+
+	//
+	// Local Variables
+	//
+	size_t                  Budget{ 0 };
+	Memory::BUDGET_POLICY   Policy{ Memory::BP_DOWNSCALE };
+	int                     MaxImagesInFlight{ 0 };
+	size_t                  NetworkBytesPerPixel{ 160 };
+
+	std::atomic<size_t>     TrackedBytes{ 0 };
+	std::atomic<size_t>     PeakTrackedBytes{ 0 };
+
+	std::mutex              TicketMutex;
+	std::condition_variable TicketCondition;
+	size_t                  TicketBytes{ 0 };
+	int                     TicketCount{ 0 };
+
+	//
+	// Local Functions
+	//
+	int ReadBigEndian16(const unsigned char* data)
+	{
+		return (data[0] << 8) | data[1];
+	}
+
+	int ReadBigEndian32(const unsigned char* data)
+	{
+		return (int)(((unsigned int)data[0] << 24) | ((unsigned int)data[1] << 16) | ((unsigned int)data[2] << 8) | data[3]);
+	}
+
+	int ReadLittleEndian32(const unsigned char* data)
+	{
+		return (int)(((unsigned int)data[3] << 24) | ((unsigned int)data[2] << 16) | ((unsigned int)data[1] << 8) | data[0]);
+	}
+
+	uint32_t ReadTiff16(const unsigned char* data, const bool littleEndian)
+	{
+		return littleEndian ? (uint32_t)(data[0] | (data[1] << 8)) : (uint32_t)ReadBigEndian16(data);
+	}
+
+	uint32_t ReadTiff32(const unsigned char* data, const bool littleEndian)
+	{
+		return littleEndian ? (uint32_t)ReadLittleEndian32(data) : (uint32_t)ReadBigEndian32(data);
+	}
+
+	/**
+		Reads the page size of the image file directory at the offset and the offset of the next directory (returns false if
+		the directory can't be read or has no size)
+	*/
+	bool ReadTiffDirectory(const TiffReader& read, const bool littleEndian, const uint32_t offset, int& width, int& height, uint32_t& next)
+	{
+		unsigned char count[2];
+
+		if (!read(offset, count, sizeof(count))) {
+			return false;
+		}
+
+		// 12 bytes per entry and the offset of the next directory
+		const uint32_t             entries = ReadTiff16(count, littleEndian);
+		std::vector<unsigned char> directory(entries * 12 + 4);
+
+		if (!read(offset + 2, directory.data(), directory.size())) {
+			return false;
+		}
+
+		width  = 0;
+		height = 0;
+
+		for (uint32_t i = 0; i < entries; ++i) {
+			const unsigned char* entry = &directory[i * 12];
+			const uint32_t       tag   = ReadTiff16(entry, littleEndian);
+			const uint32_t       type  = ReadTiff16(entry + 2, littleEndian);
+
+			if ((tag != TIFF_IMAGE_WIDTH && tag != TIFF_IMAGE_LENGTH) || (type != TIFF_SHORT && type != TIFF_LONG)) {
+				continue;
+			}
+
+			const int value = (int)(type == TIFF_SHORT ? ReadTiff16(entry + 8, littleEndian) : ReadTiff32(entry + 8, littleEndian));
+
+			if (tag == TIFF_IMAGE_WIDTH) {
+				width = value;
+			} else {
+				height = value;
+			}
+		}
+
+		next = ReadTiff32(&directory[entries * 12], littleEndian);
+
+		return width > 0 && height > 0;
+	}
+
+	/**
+		Reads the byte order and the offset of the first directory from the TIFF header (returns false if it isn't a TIFF)
+	*/
+	bool ReadTiffHeader(const unsigned char* header, bool& littleEndian, uint32_t& offset)
+	{
+		if ((header[0] != 'I' || header[1] != 'I') && (header[0] != 'M' || header[1] != 'M')) {
+			return false;
+		}
+
+		littleEndian = header[0] == 'I';
+		offset       = ReadTiff32(header + 4, littleEndian);
+
+		return ReadTiff16(header + 2, littleEndian) == 42;
+	}
+
+	void AddTrackedBytes(size_t bytes)
+	{
+		size_t total = TrackedBytes.fetch_add(bytes) + bytes;
+		size_t peak  = PeakTrackedBytes.load();
+
+		while (total > peak && !PeakTrackedBytes.compare_exchange_weak(peak, total)) {
+		}
+	}
+}
+
+//
+// Account Class Member Functions
+//
+Memory::Account::Account() :
+	mMutex(), mCurrent(), mPeakCategory(), mTotal(0), mPeak(0), mPeakWorkingSet(GetWorkingSet())
+{}
+
+Memory::Account::~Account()
+{
+	// give back whatever the trackers didn't release
+	TrackedBytes.fetch_sub(mTotal);
+}
+
+void Memory::Account::track(MEMORY_CATEGORY category, size_t bytes)
+{
+	if (bytes == 0) {
+		return;
+	}
+
+	size_t workingSet = GetWorkingSet();
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	mCurrent[category] += bytes;
+	mTotal             += bytes;
+
+	mPeakCategory[category] = std::max(mPeakCategory[category], mCurrent[category]);
+	mPeak                   = std::max(mPeak, mTotal);
+	mPeakWorkingSet         = std::max(mPeakWorkingSet, workingSet);
+
+	AddTrackedBytes(bytes);
+}
+
+void Memory::Account::untrack(MEMORY_CATEGORY category, size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	bytes = std::min(bytes, mCurrent[category]);
+
+	mCurrent[category] -= bytes;
+	mTotal             -= bytes;
+
+	TrackedBytes.fetch_sub(bytes);
+}
+
+size_t Memory::Account::getCurrent(void) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	return mTotal;
+}
+
+size_t Memory::Account::getPeak(void) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	return mPeak;
+}
+
+size_t Memory::Account::getPeak(MEMORY_CATEGORY category) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	return mPeakCategory[category];
+}
+
+size_t Memory::Account::getPeakWorkingSet(void) const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	return std::max(mPeakWorkingSet, GetWorkingSet());
+}
+
+std::string Memory::Account::getReport(void) const
+{
+	size_t peakWorkingSet = getPeakWorkingSet();
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	char report[256];
+	std::snprintf(report, sizeof(report), "tracked peak %.1f MB (image %.1f, grey %.1f, blob %.1f, network %.1f, ocr %.1f), peak RSS %.1f MB, process peak RSS %.1f MB",
+	              (double)mPeak / MEGABYTE, (double)mPeakCategory[MC_IMAGE] / MEGABYTE, (double)mPeakCategory[MC_GREY] / MEGABYTE,
+	              (double)mPeakCategory[MC_BLOB] / MEGABYTE, (double)mPeakCategory[MC_NETWORK] / MEGABYTE, (double)mPeakCategory[MC_OCR] / MEGABYTE,
+	              (double)peakWorkingSet / MEGABYTE, (double)GetPeakWorkingSet() / MEGABYTE);
+
+	return report;
+}
+
+//
+// Tracker Class Member Functions
+//
+Memory::Tracker::Tracker(Account& account, MEMORY_CATEGORY category, size_t bytes) :
+	mAccount(account), mCategory(category), mBytes(bytes)
+{
+	mAccount.track(mCategory, mBytes);
+}
+
+Memory::Tracker::Tracker(Account& account, MEMORY_CATEGORY category, const cv::Mat& mat) :
+	mAccount(account), mCategory(category), mBytes(GetMatBytes(mat))
+{
+	mAccount.track(mCategory, mBytes);
+}
+
+Memory::Tracker::~Tracker()
+{
+	release();
+}
+
+void Memory::Tracker::update(size_t bytes)
+{
+	if (bytes > mBytes) {
+		mAccount.track(mCategory, bytes - mBytes);
+	} else {
+		mAccount.untrack(mCategory, mBytes - bytes);
+	}
+
+	mBytes = bytes;
+}
+
+void Memory::Tracker::update(const cv::Mat& mat)
+{
+	update(GetMatBytes(mat));
+}
+
+void Memory::Tracker::release(void)
+{
+	mAccount.untrack(mCategory, mBytes);
+	mBytes = 0;
+}
+
+//
+// Ticket Class Member Functions
+//
+Memory::Ticket::Ticket(size_t bytes) :
+	mBytes(bytes)
+{
+	std::unique_lock<std::mutex> lock(TicketMutex);
+
+	TicketCondition.wait(lock, [this]() {
+		if (TicketCount == 0) {
+			return true;
+		}
+
+		if (MaxImagesInFlight > 0 && TicketCount >= MaxImagesInFlight) {
+			return false;
+		}
+
+		return Budget == 0 || TicketBytes + mBytes <= Budget;
+	});
+
+	TicketBytes += mBytes;
+	++TicketCount;
+}
+
+Memory::Ticket::~Ticket()
+{
+	{
+		std::lock_guard<std::mutex> lock(TicketMutex);
+
+		TicketBytes -= mBytes;
+		--TicketCount;
+	}
+
+	TicketCondition.notify_all();
+}
+
+//
+// Arena Class Member Functions
+//
+Memory::Arena::Arena(size_t blockSize) :
+	mBlocks(), mBlockSize(blockSize), mBlock(0), mOffset(0), mUsed(0), mPeak(0), mBlockAllocations(0)
+{}
+
+Memory::Arena::~Arena()
+{
+	for (size_t i = 0; i < mBlocks.size(); ++i) {
+		delete[] mBlocks[i].mData;
+	}
+}
+
+void* Memory::Arena::allocate(size_t bytes, size_t alignment)
+{
+	if (bytes == 0) {
+		bytes = 1;
+	}
+
+	// find room in the block in use or in the blocks after it
+	while (mBlock < mBlocks.size()) {
+		Block&    block   = mBlocks[mBlock];
+		uintptr_t address = (uintptr_t)(block.mData + mOffset);
+		size_t    padding = (alignment - (address % alignment)) % alignment;
+
+		if (mOffset + padding + bytes <= block.mSize) {
+			void* pointer = block.mData + mOffset + padding;
+
+			mOffset += padding + bytes;
+			mUsed   += padding + bytes;
+			mPeak    = std::max(mPeak, mUsed);
+
+			return pointer;
+		}
+
+		++mBlock;
+		mOffset = 0;
+	}
+
+	// take a new block from the heap, blocks grow so big images need only a few of them
+	Block block;
+	block.mSize = std::max(mBlockSize, bytes + alignment);
+	block.mData = new char[block.mSize];
+
+	mBlocks.push_back(block);
+	mBlockSize *= 2;
+	++mBlockAllocations;
+
+	mBlock  = mBlocks.size() - 1;
+	mOffset = 0;
+
+	return allocate(bytes, alignment);
+}
+
+Memory::Arena::Marker Memory::Arena::getMarker(void) const
+{
+	Marker marker;
+	marker.mBlock  = mBlock;
+	marker.mOffset = mOffset;
+	marker.mUsed   = mUsed;
+
+	return marker;
+}
+
+void Memory::Arena::rewind(const Marker& marker)
+{
+	if (marker.mUsed == 0) {
+		reset();
+
+		return;
+	}
+
+	mBlock  = marker.mBlock;
+	mOffset = marker.mOffset;
+	mUsed   = marker.mUsed;
+}
+
+void Memory::Arena::reset(void)
+{
+	// merge the blocks into one big enough for everything that was used
+	if (mBlocks.size() > 1) {
+		size_t capacity = getCapacity();
+
+		for (size_t i = 0; i < mBlocks.size(); ++i) {
+			delete[] mBlocks[i].mData;
+		}
+
+		mBlocks.clear();
+
+		Block block;
+		block.mSize = capacity;
+		block.mData = new char[capacity];
+
+		mBlocks.push_back(block);
+		mBlockSize = capacity * 2;
+		++mBlockAllocations;
+	}
+
+	mBlock  = 0;
+	mOffset = 0;
+	mUsed   = 0;
+}
+
+void Memory::Arena::resetPeak(void)
+{
+	mPeak = mUsed;
+}
+
+size_t Memory::Arena::getUsed(void) const
+{
+	return mUsed;
+}
+
+size_t Memory::Arena::getPeak(void) const
+{
+	return mPeak;
+}
+
+size_t Memory::Arena::getCapacity(void) const
+{
+	size_t capacity{ 0 };
+
+	for (size_t i = 0; i < mBlocks.size(); ++i) {
+		capacity += mBlocks[i].mSize;
+	}
+
+	return capacity;
+}
+
+size_t Memory::Arena::getBlockAllocations(void) const
+{
+	return mBlockAllocations;
+}
+
+//
+// Arena Scope Class Member Functions
+//
+Memory::ArenaScope::ArenaScope(Arena& arena) :
+	mArena(arena), mMarker(arena.getMarker())
+{}
+
+Memory::ArenaScope::~ArenaScope()
+{
+	mArena.rewind(mMarker);
+}
+
+//
+// Global Functions
+//
+void Memory::InitializeBudget(void)
+{
+	Budget               = (size_t)std::max(0, Settings::GetInt(L"Memory", L"BudgetMB", 0)) * MEGABYTE;
+	MaxImagesInFlight    = std::max(0, Settings::GetInt(L"Memory", L"MaxImagesInFlight", 0));
+	NetworkBytesPerPixel = (size_t)std::max(0, Settings::GetInt(L"Memory", L"NetworkBytesPerPixel", 160));
+
+	std::wstring policy = Settings::GetString(L"Memory", L"Policy", L"Downscale");
+	std::transform(policy.begin(), policy.end(), policy.begin(), towlower);
+
+	if (policy == L"refuse") {
+		Policy = BP_REFUSE;
+	} else if (policy == L"tile") {
+		Policy = BP_TILE;
+	} else {
+		Policy = BP_DOWNSCALE;
+	}
+}
+
+size_t Memory::GetBudget(void)
+{
+	return Budget;
+}
+
+Memory::BUDGET_POLICY Memory::GetPolicy(void)
+{
+	return Policy;
+}
+
+size_t Memory::EstimateImageBytes(const int width, const int height, const int inputScale)
+{
+	size_t pixels = (size_t)width * (size_t)height;
+
+	return pixels * (IMAGE_BYTES_PER_PIXEL + GREY_BYTES_PER_PIXEL + OCR_BYTES_PER_PIXEL) + EstimateNetworkBytes(inputScale);
+}
+
+size_t Memory::EstimateNetworkBytes(const int inputScale)
+{
+	return EstimateNetworkBytes(cv::Size(inputScale, inputScale));
+}
+
+size_t Memory::EstimateNetworkBytes(const cv::Size& inputSize)
+{
+	size_t inputPixels = (size_t)inputSize.width * (size_t)inputSize.height;
+	size_t blob        = inputPixels * 3 * sizeof(float);
+	size_t outputs     = (inputPixels / 16) * 6 * sizeof(float); // score and geometry maps are 4 times smaller than the input
+
+	return blob + outputs + inputPixels * NetworkBytesPerPixel;
+}
+
+Memory::IMAGE_FORMAT Memory::ProbeImageSize(const char* data, const size_t size, int& width, int& height)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+
+	width  = 0;
+	height = 0;
+
+	// PNG (width and height are the first fields of the IHDR chunk)
+	static const unsigned char pngSignature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+	if (size >= 24 && std::equal(pngSignature, pngSignature + 8, bytes)) {
+		width  = ReadBigEndian32(bytes + 16);
+		height = ReadBigEndian32(bytes + 20);
+
+		return IF_PNG;
+	}
+
+	// BMP (height is negative for top-down bitmaps)
+	if (size >= 26 && bytes[0] == 'B' && bytes[1] == 'M') {
+		width  = std::abs(ReadLittleEndian32(bytes + 18));
+		height = std::abs(ReadLittleEndian32(bytes + 22));
+
+		return IF_BMP;
+	}
+
+	// TIFF (size of the first page, its directory must be in the data)
+	bool     littleEndian{ true };
+	uint32_t offset{ 0 }, next{ 0 };
+
+	if (size >= 8 && ReadTiffHeader(bytes, littleEndian, offset)) {
+		TiffReader read = [bytes, size](const uint32_t position, unsigned char* data, const size_t count) {
+			if ((size_t)position + count > size) {
+				return false;
+			}
+
+			std::copy(bytes + position, bytes + position + count, data);
+
+			return true;
+		};
+
+		if (ReadTiffDirectory(read, littleEndian, offset, width, height, next)) {
+			return IF_TIFF;
+		}
+
+		width  = 0;
+		height = 0;
+
+		return IF_UNKNOWN;
+	}
+
+	// JPEG (walk the segments until a start of frame marker)
+	if (size >= 4 && bytes[0] == 0xFF && bytes[1] == 0xD8) {
+		size_t pos = 2;
+
+		while (pos + 4 <= size) {
+			if (bytes[pos] != 0xFF) {
+				return IF_UNKNOWN;
+			}
+
+			unsigned char marker = bytes[pos + 1];
+
+			if (marker == 0xFF) { // fill byte
+				++pos;
+				continue;
+			}
+
+			if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) { // markers without a length
+				pos += 2;
+				continue;
+			}
+
+			int length = ReadBigEndian16(bytes + pos + 2);
+
+			if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+				if (pos + 9 > size) {
+					return IF_UNKNOWN;
+				}
+
+				height = ReadBigEndian16(bytes + pos + 5);
+				width  = ReadBigEndian16(bytes + pos + 7);
+
+				return IF_JPEG;
+			}
+
+			pos += 2 + length;
+		}
+	}
+
+	return IF_UNKNOWN;
+}
+
+bool Memory::ProbeTiffPages(const std::wstring& file, std::vector<cv::Size>& pages)
+{
+	pages.clear();
+
+	FILE* stream = _wfopen(file.c_str(), L"rb");
+
+	if (!stream) {
+		return false;
+	}
+
+	// only the header and the directories are read, the pages stay on the disk
+	TiffReader read = [stream](const uint32_t position, unsigned char* data, const size_t count) {
+		return _fseeki64(stream, (long long)position, SEEK_SET) == 0 && std::fread(data, 1, count, stream) == count;
+	};
+
+	unsigned char header[8];
+	bool          littleEndian{ true };
+	uint32_t      offset{ 0 };
+	bool          valid = read(0, header, sizeof(header)) && ReadTiffHeader(header, littleEndian, offset);
+
+	while (valid && offset != 0) {
+		int      width{ 0 }, height{ 0 };
+		uint32_t next{ 0 };
+
+		if (!ReadTiffDirectory(read, littleEndian, offset, width, height, next) || pages.size() >= MAX_TIFF_PAGES) {
+			valid = false;
+
+			break;
+		}
+
+		pages.push_back(cv::Size(width, height));
+		offset = next;
+	}
+
+	std::fclose(stream);
+
+	if (!valid || pages.empty()) {
+		pages.clear();
+
+		return false;
+	}
+
+	return true;
+}
+
+Memory::Plan Memory::PlanImage(const IMAGE_FORMAT format, const int width, const int height, const int inputScale, const bool tiling)
+{
+	Plan plan;
+	plan.mFormat = format;
+	plan.mWidth  = width;
+	plan.mHeight = height;
+
+	if (format == IF_UNKNOWN || width <= 0 || height <= 0) {
+		return plan;
+	}
+
+	plan.mEstimate = EstimateImageBytes(width, height, inputScale);
+
+	if (Budget == 0 || plan.mEstimate <= Budget) {
+		return plan;
+	}
+
+	size_t network = EstimateNetworkBytes(inputScale);
+	size_t pixels  = (size_t)width * (size_t)height;
+
+	if (Policy == BP_REFUSE || network >= Budget) {
+		plan.mAction = PA_REFUSE;
+
+		return plan;
+	}
+
+	// tiles keep the decoded image whole and only make the grey and Tesseract copies per tile
+	if (Policy == BP_TILE && tiling && pixels * IMAGE_BYTES_PER_PIXEL + network < Budget) {
+		size_t free = Budget - pixels * IMAGE_BYTES_PER_PIXEL - network;
+		int    tile = (int)std::sqrt((double)free / (GREY_BYTES_PER_PIXEL + OCR_BYTES_PER_PIXEL));
+
+		tile -= tile % 32;
+
+		if (tile >= MIN_TILE) {
+			plan.mAction   = PA_TILE;
+			plan.mTileSize = tile;
+			plan.mEstimate = pixels * IMAGE_BYTES_PER_PIXEL + (size_t)tile * tile * (GREY_BYTES_PER_PIXEL + OCR_BYTES_PER_PIXEL) + network;
+
+			return plan;
+		}
+	}
+
+	// downscale until the image fits, tiling falls back here when the decoded image alone doesn't fit or the caller has no tiles
+	double scale = std::sqrt((double)(Budget - network) / (double)(pixels * (IMAGE_BYTES_PER_PIXEL + GREY_BYTES_PER_PIXEL + OCR_BYTES_PER_PIXEL)));
+
+	plan.mAction   = PA_DOWNSCALE;
+	plan.mScale    = std::min(scale, 1.0);
+	plan.mEstimate = EstimateImageBytes((int)(width * plan.mScale), (int)(height * plan.mScale), inputScale);
+
+	// JPEG decoder can skip the full size decode by scaling in the DCT domain
+	if (format == IF_JPEG) {
+		if (plan.mScale <= 1.0 / 8.0) {
+			plan.mDecodeFlags = cv::IMREAD_REDUCED_COLOR_8;
+		} else if (plan.mScale <= 1.0 / 4.0) {
+			plan.mDecodeFlags = cv::IMREAD_REDUCED_COLOR_4;
+		} else if (plan.mScale <= 1.0 / 2.0) {
+			plan.mDecodeFlags = cv::IMREAD_REDUCED_COLOR_2;
+		}
+	}
+
+	return plan;
+}
+
+size_t Memory::GetWorkingSet(void)
+{
+	PROCESS_MEMORY_COUNTERS counters;
+	ZeroMemory(&counters, sizeof(counters));
+
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+
+	return counters.WorkingSetSize;
+}
+
+size_t Memory::GetPeakWorkingSet(void)
+{
+	PROCESS_MEMORY_COUNTERS counters;
+	ZeroMemory(&counters, sizeof(counters));
+
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+
+	return counters.PeakWorkingSetSize;
+}
+
+size_t Memory::GetTrackedBytes(void)
+{
+	return TrackedBytes.load();
+}
+
+size_t Memory::GetPeakTrackedBytes(void)
+{
+	return PeakTrackedBytes.load();
+}
+
+size_t Memory::GetMatBytes(const cv::Mat& mat)
+{
+	return mat.empty() ? 0 : mat.total() * mat.elemSize();
+}
+
+Memory::Arena& Memory::GetThreadArena(void)
+{
+	thread_local Arena arena;
+
+	return arena;
+}
\ No newline at end of file
@@ -0,0 +1,410 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "memory.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Memory Accounting and Budget Operations
+ *
+ * Classes(Account, Tracker, Ticket, Arena, ArenaScope, ArenaAllocator)
+ * Functions(InitializeBudget, GetBudget, GetPolicy, EstimateImageBytes, EstimateNetworkBytes, ProbeImageSize, ProbeTiffPages, PlanImage,
+ *           GetWorkingSet, GetPeakWorkingSet, GetTrackedBytes, GetPeakTrackedBytes, GetMatBytes, GetThreadArena)
+ *
+ */
+
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include "main.hpp"
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Memory
+{
+	//
+	// Global Definitions
+	//
+	enum MEMORY_CATEGORY
+	{
+		MC_IMAGE,   // decoded BGR image
+		MC_GREY,    // grey copy for Tesseract
+		MC_BLOB,    // network input blob
+		MC_NETWORK, // network activations and output maps (estimated)
+		MC_OCR,     // Tesseract's internal copies (estimated)
+		MC_COUNT,
+	};
+
+	enum BUDGET_POLICY
+	{
+		BP_REFUSE,    // images that exceed the budget are not processed
+		BP_DOWNSCALE, // images that exceed the budget are decoded at a smaller size
+		BP_TILE,      // images that exceed the budget are processed tile by tile
+	};
+
+	enum PLAN_ACTION
+	{
+		PA_PROCESS,
+		PA_DOWNSCALE,
+		PA_TILE,
+		PA_REFUSE,
+	};
+
+	enum IMAGE_FORMAT
+	{
+		IF_UNKNOWN,
+		IF_JPEG,
+		IF_PNG,
+		IF_BMP,
+		IF_TIFF,
+	};
+
+	constexpr size_t MEGABYTE     = 1024 * 1024;
+	constexpr int    TILE_OVERLAP = 64;  // pixels shared by neighbouring tiles so words on the seams are not lost
+	constexpr int    MIN_TILE     = 512; // smallest tile edge, smaller tiles cut too many words
+	constexpr size_t ARENA_BLOCK  = 256 * 1024; // first block size of an arena
+
+	/**
+		Memory plan of an image, decided before the image is decoded
+	*/
+	struct Plan
+	{
+		PLAN_ACTION  mAction{ PA_PROCESS };
+		IMAGE_FORMAT mFormat{ IF_UNKNOWN };
+		int          mWidth{ 0 };                      // width of the encoded image
+		int          mHeight{ 0 };                     // height of the encoded image
+		int          mDecodeFlags{ cv::IMREAD_COLOR }; // flags to pass to imdecode
+		double       mScale{ 1.0 };                    // final scale of the decoded image
+		int          mTileSize{ 0 };                   // edge of the tiles in pixels (PA_TILE)
+		size_t       mEstimate{ 0 };                   // estimated peak bytes while processing the image
+	};
+
+	//
+	// Classes
+	//
+
+	/**
+		Tracked allocations of a single image
+
+		Keeps current and peak bytes per category and samples the working set of the process whenever a buffer is tracked
+	*/
+	class Account
+	{
+		public:
+
+			Account();
+			Account(const Account& account) = delete;
+			~Account();
+
+			const Account& operator=(const Account& account) = delete;
+
+			/**
+				Adds bytes to a category
+			*/
+			void track(MEMORY_CATEGORY category, size_t bytes);
+			/**
+				Removes bytes from a category
+			*/
+			void untrack(MEMORY_CATEGORY category, size_t bytes);
+
+			size_t getCurrent(void) const;
+			size_t getPeak(void) const;
+			size_t getPeak(MEMORY_CATEGORY category) const;
+			size_t getPeakWorkingSet(void) const;
+
+			/**
+				Returns a one line report of the peaks (in megabytes)
+			*/
+			std::string getReport(void) const;
+
+		private:
+
+			mutable std::mutex mMutex;
+			size_t             mCurrent[MC_COUNT];      // current bytes of each category
+			size_t             mPeakCategory[MC_COUNT]; // peak bytes of each category
+			size_t             mTotal;                  // current bytes of all categories
+			size_t             mPeak;                   // peak bytes of all categories
+			size_t             mPeakWorkingSet;         // peak working set sampled while tracking
+	};
+
+	/**
+		Tracks a buffer in an account for its lifetime
+	*/
+	class Tracker
+	{
+		public:
+
+			Tracker(Account& account, MEMORY_CATEGORY category, size_t bytes = 0);
+			Tracker(Account& account, MEMORY_CATEGORY category, const cv::Mat& mat);
+			Tracker(const Tracker& tracker) = delete;
+			~Tracker();
+
+			const Tracker& operator=(const Tracker& tracker) = delete;
+
+			/**
+				Replaces the tracked size (call after the buffer is reallocated)
+			*/
+			void update(size_t bytes);
+			void update(const cv::Mat& mat);
+			/**
+				Stops tracking before the destructor runs (call after the buffer is released)
+			*/
+			void release(void);
+
+		private:
+
+			Account&        mAccount;
+			MEMORY_CATEGORY mCategory;
+			size_t          mBytes;
+	};
+
+	/**
+		Admission ticket of an image to the memory budget
+
+		Blocks until the estimated bytes fit into the budget and an in-flight slot is free.
+		An image is always admitted when nothing else is in flight, so an oversized image can't wait forever.
+	*/
+	class Ticket
+	{
+		public:
+
+			Ticket(size_t bytes);
+			Ticket(const Ticket& ticket) = delete;
+			~Ticket();
+
+			const Ticket& operator=(const Ticket& ticket) = delete;
+
+		private:
+
+			size_t mBytes;
+	};
+
+	/**
+		Monotonic arena for per-image scratch data
+
+		Allocation is a pointer bump, nothing is freed until the arena is rewound. When an arena is rewound to
+		its start after spilling into more blocks, the blocks are merged into one so the next image fits in a single
+		block and the arena stops touching the heap in steady state. An arena belongs to one thread.
+	*/
+	class Arena
+	{
+		public:
+
+			/**
+				Position in the arena to rewind to
+			*/
+			struct Marker
+			{
+				size_t mBlock;
+				size_t mOffset;
+				size_t mUsed;
+			};
+
+			Arena(size_t blockSize = ARENA_BLOCK);
+			Arena(const Arena& arena) = delete;
+			~Arena();
+
+			const Arena& operator=(const Arena& arena) = delete;
+
+			/**
+				Allocates uninitialized bytes from the arena
+			*/
+			void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+			/**
+				Allocates uninitialized elements from the arena (T must not need a destructor)
+			*/
+			template<typename T>
+			T* allocate(size_t count)
+			{
+				return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+			}
+			/**
+				Returns the current position of the arena
+			*/
+			Marker getMarker(void) const;
+			/**
+				Releases everything allocated after the marker
+			*/
+			void rewind(const Marker& marker);
+			/**
+				Releases everything (keeps the blocks)
+			*/
+			void reset(void);
+			/**
+				Starts a new peak at the current use, so the peak covers one image of a long lived arena
+			*/
+			void resetPeak(void);
+
+			size_t getUsed(void) const;
+			size_t getPeak(void) const;
+			size_t getCapacity(void) const;
+			size_t getBlockAllocations(void) const;
+
+		private:
+
+			struct Block
+			{
+				char*  mData;
+				size_t mSize;
+			};
+
+			std::vector<Block> mBlocks;           // blocks of the arena, only the last ones may be partly used
+			size_t             mBlockSize;        // size of the next block
+			size_t             mBlock;            // index of the block in use
+			size_t             mOffset;           // offset in the block in use
+			size_t             mUsed;             // bytes handed out since the last reset
+			size_t             mPeak;             // peak of mUsed
+			size_t             mBlockAllocations; // blocks taken from the heap during the life of the arena
+	};
+
+	/**
+		Rewinds an arena to the position it had when the scope is created
+	*/
+	class ArenaScope
+	{
+		public:
+
+			ArenaScope(Arena& arena);
+			ArenaScope(const ArenaScope& scope) = delete;
+			~ArenaScope();
+
+			const ArenaScope& operator=(const ArenaScope& scope) = delete;
+
+		private:
+
+			Arena&        mArena;
+			Arena::Marker mMarker;
+	};
+
+	/**
+		Standard allocator on top of an arena, deallocation does nothing
+	*/
+	template<typename T>
+	class ArenaAllocator
+	{
+		public:
+
+			typedef T value_type;
+
+			ArenaAllocator(Arena& arena) : mArena(&arena)
+			{}
+
+			template<typename U>
+			ArenaAllocator(const ArenaAllocator<U>& allocator) : mArena(allocator.getArena())
+			{}
+
+			T* allocate(size_t count)
+			{
+				return mArena->allocate<T>(count);
+			}
+
+			void deallocate(T* pointer, size_t count)
+			{}
+
+			Arena* getArena(void) const
+			{
+				return mArena;
+			}
+
+			template<typename U>
+			bool operator==(const ArenaAllocator<U>& allocator) const
+			{
+				return mArena == allocator.getArena();
+			}
+
+			template<typename U>
+			bool operator!=(const ArenaAllocator<U>& allocator) const
+			{
+				return mArena != allocator.getArena();
+			}
+
+		private:
+
+			Arena* mArena;
+	};
+
+	/**
+		Vector allocating from an arena
+	*/
+	template<typename T>
+	using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+	//
+	// Global Functions
+	//
+
+	/**
+		Reads the budget settings ([Memory] BudgetMB, Policy, MaxImagesInFlight, NetworkBytesPerPixel)
+	*/
+	void InitializeBudget(void);
+	/**
+		Returns the memory budget of an image in bytes (zero means unlimited)
+	*/
+	size_t GetBudget(void);
+	/**
+		Returns the configured budget policy
+	*/
+	BUDGET_POLICY GetPolicy(void);
+	/**
+		Estimates the peak bytes of processing an image
+
+		width, height - dimensions of the image that is processed
+		inputScale    - network input size
+	*/
+	size_t EstimateImageBytes(const int width, const int height, const int inputScale);
+	/**
+		Estimates the bytes used by the network input and activations for an input size
+	*/
+	size_t EstimateNetworkBytes(const int inputScale);
+	/**
+		Estimates the bytes used by the network input and activations for an input width and height
+	*/
+	size_t EstimateNetworkBytes(const cv::Size& inputSize);
+	/**
+		Reads width and height from an encoded image header without decoding it (returns IF_UNKNOWN on failure)
+	*/
+	IMAGE_FORMAT ProbeImageSize(const char* data, const size_t size, int& width, int& height);
+	/**
+		Reads the size of every page of a TIFF file from its image file directories without decoding or loading the pages
+		(returns false if the file isn't a TIFF or a directory is damaged, BigTIFF isn't read)
+	*/
+	bool ProbeTiffPages(const std::wstring& file, std::vector<cv::Size>& pages);
+	/**
+		Decides how an image is decoded and processed to stay in the memory budget
+
+		tiling - can the caller process the image tile by tile (the batch pool and the pipeline can't, the Tile policy
+		         downscales there)
+	*/
+	Plan PlanImage(const IMAGE_FORMAT format, const int width, const int height, const int inputScale, const bool tiling = true);
+	/**
+		Returns the current working set of the process in bytes
+	*/
+	size_t GetWorkingSet(void);
+	/**
+		Returns the peak working set of the process in bytes
+	*/
+	size_t GetPeakWorkingSet(void);
+	/**
+		Returns bytes tracked by all accounts at the moment
+	*/
+	size_t GetTrackedBytes(void);
+	/**
+		Returns the peak of the bytes tracked by all accounts
+	*/
+	size_t GetPeakTrackedBytes(void);
+	/**
+		Returns the byte size of the matrix data
+	*/
+	size_t GetMatBytes(const cv::Mat& mat);
+	/**
+		Returns the scratch arena of the calling thread (each worker has its own)
+	*/
+	Arena& GetThreadArena(void);
+}
+
+#endif
\ No newline at end of file
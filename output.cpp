@@ -0,0 +1,182 @@
+#include "output.hpp"
+#include <algorithm>
+#include <cstring>
+
+//
+// Word Writer Class Member Functions
+//
+Output::WordWriter::WordWriter() :
+	mFile(nullptr), mBufferSize(WRITER_BUFFER_SIZE), mBuffer(), mPending(), mPendingFull(false), mStop(false), mFailed(false), mFlushThread(), mMutex(), mCondition()
+{}
+
+Output::WordWriter::WordWriter(const std::wstring& fileName, const size_t bufferSize, const bool asyncFlush) :
+	mFile(nullptr), mBufferSize(bufferSize), mBuffer(), mPending(), mPendingFull(false), mStop(false), mFailed(false), mFlushThread(), mMutex(), mCondition()
+{
+	open(fileName, bufferSize, asyncFlush);
+}
+
+Output::WordWriter::~WordWriter()
+{
+	close();
+}
+
+bool Output::WordWriter::open(const std::wstring& fileName, const size_t bufferSize, const bool asyncFlush)
+{
+	close();
+
+	mFile = _wfopen(fileName.c_str(), L"wb");
+
+	if (!mFile) {
+		return false;
+	}
+
+	// the writer does its own buffering, CRT buffer would only split the chunks
+	std::setvbuf(mFile, nullptr, _IONBF, 0);
+
+	mBufferSize  = std::max<size_t>(bufferSize, 4096);
+	mPendingFull = false;
+	mStop        = false;
+	mFailed      = false;
+
+	mBuffer.clear();
+	mBuffer.reserve(mBufferSize);
+
+	if (asyncFlush) {
+		mPending.clear();
+		mPending.reserve(mBufferSize);
+
+		mFlushThread = std::thread(&WordWriter::flushLoop, this);
+	}
+
+	return true;
+}
+
+void Output::WordWriter::write(const char* text, const size_t length)
+{
+	if (!mFile) {
+		return;
+	}
+
+	for (size_t i = 0; i < length; ++i) {
+		// keep room for CR LF
+		if (mBuffer.size() + 2 > mBufferSize) {
+			submit();
+		}
+
+		if (text[i] == '\n') {
+			mBuffer.push_back('\r');
+		}
+
+		mBuffer.push_back(text[i]);
+	}
+}
+
+void Output::WordWriter::writeLine(const char* text)
+{
+	write(text, std::strlen(text));
+	write("\n", 1);
+}
+
+bool Output::WordWriter::flush(void)
+{
+	if (!mFile) {
+		return false;
+	}
+
+	if (!mBuffer.empty()) {
+		submit();
+	}
+
+	// wait for the flush thread to finish the pending buffer
+	std::unique_lock<std::mutex> lock(mMutex);
+	mCondition.wait(lock, [this]() { return !mPendingFull; });
+
+	return !mFailed;
+}
+
+bool Output::WordWriter::close(void)
+{
+	if (!mFile) {
+		return true;
+	}
+
+	bool result = flush();
+
+	if (mFlushThread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStop = true;
+		}
+
+		mCondition.notify_all();
+		mFlushThread.join();
+	}
+
+	if (std::fclose(mFile)) {
+		result = false;
+	}
+
+	mFile = nullptr;
+
+	return result;
+}
+
+bool Output::WordWriter::isOpen(void) const
+{
+	return mFile != nullptr;
+}
+
+void Output::WordWriter::submit(void)
+{
+	if (!mFlushThread.joinable()) {
+		writeChunk(mBuffer);
+		mBuffer.clear();
+
+		return;
+	}
+
+	// swap the buffers, the flush thread writes the full one while the caller fills the other
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mCondition.wait(lock, [this]() { return !mPendingFull; });
+
+		mPending.swap(mBuffer);
+		mPendingFull = true;
+	}
+
+	mCondition.notify_all();
+	mBuffer.clear();
+}
+
+void Output::WordWriter::writeChunk(const std::vector<char>& chunk)
+{
+	if (chunk.empty()) {
+		return;
+	}
+
+	if (std::fwrite(chunk.data(), 1, chunk.size(), mFile) != chunk.size()) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		mFailed = true;
+	}
+}
+
+void Output::WordWriter::flushLoop(void)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	while (true) {
+		mCondition.wait(lock, [this]() { return mPendingFull || mStop; });
+
+		if (mPendingFull) {
+			lock.unlock();
+			writeChunk(mPending);
+			mPending.clear();
+			lock.lock();
+
+			mPendingFull = false;
+			mCondition.notify_all();
+		} else if (mStop) {
+			return;
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,110 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "output.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Output Operations
+ *
+ * Classes(WordWriter)
+ *
+ */
+
+#ifndef OUTPUT_HPP
+#define OUTPUT_HPP
+
+#include "main.hpp"
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Output
+{
+	//
+	// Global Definitions
+	//
+	constexpr size_t WRITER_BUFFER_SIZE = 1024 * 1024; // default buffer size of a word writer
+
+	//
+	// Classes
+	//
+
+	/**
+		Buffered UTF-8 writer of the recognized words
+
+		Tesseract's UTF-8 bytes are appended to a large buffer as they are and the buffer is written to the file
+		in big chunks. With async flush a full buffer is handed to a flush thread and the caller keeps appending
+		to the second buffer. Line feeds are written as CR LF like the text mode streams did before.
+	*/
+	class WordWriter
+	{
+		public:
+
+			WordWriter();
+			WordWriter(const std::wstring& fileName, const size_t bufferSize = WRITER_BUFFER_SIZE, const bool asyncFlush = false);
+			WordWriter(const WordWriter& writer) = delete;
+			~WordWriter();
+
+			const WordWriter& operator=(const WordWriter& writer) = delete;
+
+			/**
+				Opens (truncates) the file (returns true on success)
+
+				fileName   - full path of the file
+				bufferSize - bytes collected before a write
+				asyncFlush - writes full buffers on a flush thread
+			*/
+			bool open(const std::wstring& fileName, const size_t bufferSize = WRITER_BUFFER_SIZE, const bool asyncFlush = false);
+			/**
+				Appends UTF-8 bytes
+			*/
+			void write(const char* text, const size_t length);
+			/**
+				Appends a zero terminated UTF-8 word and a line break
+			*/
+			void writeLine(const char* text);
+			/**
+				Writes the buffered bytes to the file (returns false if a write failed)
+			*/
+			bool flush(void);
+			/**
+				Flushes, stops the flush thread and closes the file (returns false if a write failed)
+			*/
+			bool close(void);
+
+			bool isOpen(void) const;
+
+		private:
+
+			/**
+				Writes the current buffer or hands it to the flush thread
+			*/
+			void submit(void);
+			/**
+				Writes a chunk to the file
+			*/
+			void writeChunk(const std::vector<char>& chunk);
+			/**
+				Main loop of the flush thread
+			*/
+			void flushLoop(void);
+
+			FILE*                   mFile;         // file of the words
+			size_t                  mBufferSize;   // bytes collected before a write
+			std::vector<char>       mBuffer;       // buffer being filled
+			std::vector<char>       mPending;      // buffer being written by the flush thread
+			bool                    mPendingFull;  // is mPending waiting to be written?
+			bool                    mStop;         // asks the flush thread to stop
+			bool                    mFailed;       // did a write fail?
+			std::thread             mFlushThread;  // flush thread (async flush only)
+			std::mutex              mMutex;        // guards mPending, mPendingFull, mStop and mFailed
+			std::condition_variable mCondition;
+	};
+}
+
+#endif
\ No newline at end of file
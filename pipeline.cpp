@@ -0,0 +1,660 @@
+#include "pipeline.hpp"
+#include "error.hpp"
+#include "graphics.hpp"
+#include "inference.hpp"
+#include "log.hpp"
+#include "recognizer.hpp"
+#include "rectifier.hpp"
+#include "settings.hpp"
+#include "system.hpp"
+#include "trace.hpp"
+#include <opencv2/imgproc.hpp>
+#include <chrono>
+#include <cwctype>
+#include <functional>
+#include <thread>
+
+namespace
+{
+	//
+	// Local Functions
+	//
+
+	/**
+		Starts the workers of a stage, the last worker to leave closes the queue after the stage
+
+		A worker that stops on an error closes the queue before the stage too, so the stages before it don't wait for room forever
+
+		threads - threads of the pipeline (the workers are appended)
+		name    - thread name prefix for the trace
+		workers - number of workers
+		body    - loop of a worker, returns when its input is closed and drained
+		input   - queue before the stage
+		output  - queue after the stage (null for the last stage)
+	*/
+	template<typename Input, typename Output>
+	void StartStage(std::vector<std::thread>& threads, const std::string& name, const int workers, const std::function<void(void)>& body, Input* input, Output* output)
+	{
+		std::shared_ptr<std::atomic<int> > remaining(new std::atomic<int>(std::max(1, workers)));
+
+		for (int i = 0; i < std::max(1, workers); ++i) {
+			threads.push_back(std::thread([=]() {
+				Trace::SetThreadName(name + " " + std::to_string(i));
+
+				try {
+					body();
+				} catch (Error::Exception& ex) {
+					Log::Write(name + " stage stopped: " + System::ConvertWstringToString(ex.getErrorMessage()));
+
+					if (input) {
+						input->close();
+					}
+				} catch (std::exception& ex) {
+					Log::Write(name + " stage stopped: " + ex.what());
+
+					if (input) {
+						input->close();
+					}
+				}
+
+				if (--*remaining == 0 && output) {
+					output->close();
+				}
+			}));
+		}
+	}
+}
+
+//
+// Runner Class Member Functions
+//
+Pipeline::Runner::Runner(const Options& options) :
+	mOptions(options), mCallback(), mIndex(), mSearch(), mResults(), mInput(), mDecode(), mDetect(), mRecognize(), mRender(), mWrite(), mThreads(), mSampler(),
+	mStarted(false), mStart(0), mImages(0), mDuplicates(0), mFailed(0), mBoxes(0), mWords(0)
+{
+	if (mOptions.mBatch.mIndexes) {
+		mIndex   = Deduplication::CreateIndex();
+		mSearch  = Search::CreateWriter();
+		mResults = Results::CreateWriter(mOptions.mBatch.mResultsFolder);
+	}
+}
+
+Pipeline::Runner::~Runner()
+{
+	if (mStarted) {
+		finish();
+	}
+}
+
+Batch::Statistics Pipeline::Runner::run(const std::vector<std::wstring>& files)
+{
+	start();
+
+	for (const std::wstring& file : files) {
+		submit(file);
+	}
+
+	return finish();
+}
+
+void Pipeline::Runner::start(void)
+{
+	if (mStarted) {
+		return;
+	}
+
+	mImages     = 0;
+	mDuplicates = 0;
+	mFailed     = 0;
+	mBoxes      = 0;
+	mWords      = 0;
+
+	// file names are small, the input holds a whole burst so the producer never waits
+	mInput.reset(new FileQueue("read", std::max<size_t>(mOptions.mQueueCapacity, 1 << 20)));
+	mDecode.reset(new Queue("decode", mOptions.mQueueCapacity));
+	mDetect.reset(new Queue("detect", mOptions.mQueueCapacity));
+	mRecognize.reset(new Queue("recognize", mOptions.mQueueCapacity));
+	mRender.reset(new Queue("render", mOptions.mQueueCapacity));
+	mWrite.reset(new Queue("write", mOptions.mQueueCapacity));
+
+	mStart   = cv::getTickCount();
+	mStarted = true;
+
+	StartStage(mThreads, "read", mOptions.mWorkers.mRead, [this]() { readStage(); }, mInput.get(), mDecode.get());
+	StartStage(mThreads, "decode", mOptions.mWorkers.mDecode, [this]() { decodeStage(); }, mDecode.get(), mDetect.get());
+	StartStage(mThreads, "detect", mOptions.mWorkers.mDetect, [this]() { detectStage(); }, mDetect.get(), mRecognize.get());
+	StartStage(mThreads, "recognize", mOptions.mWorkers.mRecognize, [this]() { recognizeStage(); }, mRecognize.get(), mRender.get());
+	StartStage(mThreads, "render", mOptions.mWorkers.mRender, [this]() { renderStage(); }, mRender.get(), mWrite.get());
+	StartStage(mThreads, "write", mOptions.mWorkers.mWrite, [this]() { writeStage(); }, mWrite.get(), (Queue*)nullptr);
+
+	//
+	// Sample the queue depths into the trace until the runner is finished
+	//
+	if (mOptions.mMetricsInterval > 0 && Trace::IsEnabled()) {
+		mSampler = std::thread([this]() {
+			Trace::SetThreadName("pipeline metrics");
+
+			while (mStarted) {
+				Trace::Counter("read queue", (long long)mInput->getDepth());
+				Trace::Counter("decode queue", (long long)mDecode->getDepth());
+				Trace::Counter("detect queue", (long long)mDetect->getDepth());
+				Trace::Counter("recognize queue", (long long)mRecognize->getDepth());
+				Trace::Counter("render queue", (long long)mRender->getDepth());
+				Trace::Counter("write queue", (long long)mWrite->getDepth());
+
+				std::this_thread::sleep_for(std::chrono::milliseconds(mOptions.mMetricsInterval));
+			}
+		});
+	}
+}
+
+bool Pipeline::Runner::submit(const std::wstring& file)
+{
+	return mStarted && mInput->push(file);
+}
+
+Batch::Statistics Pipeline::Runner::finish(void)
+{
+	if (mStarted) {
+		// the stages close one after the other as their inputs drain
+		mInput->close();
+
+		for (auto& thread : mThreads) {
+			thread.join();
+		}
+
+		mThreads.clear();
+		mStarted = false;
+
+		if (mSampler.joinable()) {
+			mSampler.join();
+		}
+
+		if (mSearch && !mSearch->flush()) {
+			Log::Write("The last words of the pipeline can't be written to the search index");
+		}
+
+		if (mResults && !mResults->flush()) {
+			Log::Write("The last rows of the pipeline can't be written to the results");
+		}
+
+		for (const QueueMetrics& metrics : getMetrics()) {
+			char line[256];
+			std::snprintf(line, sizeof(line), "%s queue: %zu items, peak %zu/%zu, mean depth %.2f, %zu blocked pushes, %zu starved pops", metrics.mName.c_str(),
+			              metrics.mItems, metrics.mPeakDepth, metrics.mCapacity, metrics.mMeanDepth, metrics.mBlockedPushes, metrics.mBlockedPops);
+
+			Log::Write(line);
+		}
+	}
+
+	Batch::Statistics statistics;
+	statistics.mImages     = mImages;
+	statistics.mDuplicates = mDuplicates;
+	statistics.mFailed     = mFailed;
+	statistics.mBoxes      = mBoxes;
+	statistics.mWords      = mWords;
+	statistics.mSeconds    = (double)(cv::getTickCount() - mStart) / cv::getTickFrequency();
+
+	return statistics;
+}
+
+void Pipeline::Runner::setCallback(const Batch::Callback& callback)
+{
+	mCallback = callback;
+}
+
+std::vector<Pipeline::QueueMetrics> Pipeline::Runner::getMetrics(void) const
+{
+	std::vector<QueueMetrics> metrics;
+
+	if (mInput) {
+		metrics.push_back(mInput->getMetrics());
+	}
+
+	for (const Queue* queue : { mDecode.get(), mDetect.get(), mRecognize.get(), mRender.get(), mWrite.get() }) {
+		if (queue) {
+			metrics.push_back(queue->getMetrics());
+		}
+	}
+
+	return metrics;
+}
+
+void Pipeline::Runner::readStage(void)
+{
+	std::wstring file;
+
+	std::vector<cv::Size> pages;
+
+	while (mInput->pop(file)) {
+		// a multi-page TIFF goes page by page, a single page TIFF is read like any other image
+		if (Batch::IsTiff(file) && Memory::ProbeTiffPages(file, pages) && pages.size() > 1) {
+			if (!readPages(file, pages)) {
+				break;
+			}
+
+			continue;
+		}
+
+		ItemPointer item(new Item());
+		item->mFile        = file;
+		item->mFingerprint = Deduplication::Fingerprint{};
+		item->mPage        = 0;
+
+		{
+			Trace::Span span("read", item->mFile);
+
+			if (!System::ReadFile(item->mFile, item->mData)) {
+				fail(item, "can't be read");
+
+				continue;
+			}
+		}
+
+		// plan the memory of the image from its header before decoding it
+		int                  width{ 0 }, height{ 0 };
+		Memory::IMAGE_FORMAT format = Memory::ProbeImageSize((const char*)item->mData.data(), item->mData.size(), width, height);
+
+		item->mPlan = Memory::PlanImage(format, width, height, mOptions.mBatch.mInputScale, false);
+
+		if (item->mPlan.mAction == Memory::PA_REFUSE) {
+			fail(item, "refused: estimated " + std::to_string(item->mPlan.mEstimate / Memory::MEGABYTE) + " MB exceeds the memory budget");
+
+			continue;
+		}
+
+		// reading waits here while the images in flight fill the budget
+		item->mTicket.reset(new Memory::Ticket(item->mPlan.mEstimate ? item->mPlan.mEstimate : item->mData.size() * 4));
+
+		if (!mDecode->push(item)) {
+			fail(item, "pipeline stopped");
+
+			break;
+		}
+	}
+}
+
+void Pipeline::Runner::decodeStage(void)
+{
+	ItemPointer item;
+
+	while (mDecode->pop(item)) {
+		const bool decoded = item->mDocument ? Batch::DecodePage(item->mFile, item->mPage, item->mPlan, item->mImage)
+		                                     : Batch::DecodeImage(item->mData, item->mPlan, item->mImage);
+
+		if (!decoded) {
+			fail(item, "can't be decoded");
+
+			continue;
+		}
+
+		item->mData = std::vector<unsigned char>{};
+
+		if (reuse(item)) {
+			continue;
+		}
+
+		item->mAccount.track(Memory::MC_IMAGE, Memory::GetMatBytes(item->mImage));
+
+		if (!mDetect->push(item)) {
+			fail(item, "pipeline stopped");
+		}
+	}
+}
+
+void Pipeline::Runner::detectStage(void)
+{
+	// the detector belongs to this thread (the int8 network is per thread)
+	std::unique_ptr<Detection::Detector> detector = Detection::CreateDetector();
+
+	ItemPointer                 item;
+	std::vector<Detection::Box> boxes;
+
+	while (mDetect->pop(item)) {
+		Trace::Span span("detect", item->mFile);
+
+		try {
+			detector->detect(item->mImage, mOptions.mBatch.mInputScale, item->mAccount, boxes);
+		} catch (Error::Exception& ex) {
+			fail(item, "detection failed: " + System::ConvertWstringToString(ex.getErrorMessage()));
+
+			continue;
+		} catch (std::exception& ex) {
+			fail(item, std::string{ "detection failed: " } + ex.what());
+
+			continue;
+		}
+
+		Batch::SelectBoxes(item->mImage.size(), boxes, item->mBoxes, item->mRects);
+
+		cv::cvtColor(item->mImage, item->mGrey, cv::COLOR_BGR2GRAY);
+		item->mAccount.track(Memory::MC_GREY, Memory::GetMatBytes(item->mGrey));
+
+		if (!mRecognize->push(item)) {
+			fail(item, "pipeline stopped");
+		}
+	}
+}
+
+void Pipeline::Runner::recognizeStage(void)
+{
+	// Tesseract isn't thread safe, every recognize worker has its own instance
+	Rectification::Rectifier                 rectifier;
+	std::unique_ptr<Recognition::Recognizer> recognizer = Recognition::CreateRecognizer();
+
+	ItemPointer          item;
+	std::vector<cv::Mat> strips;
+
+	while (mRecognize->pop(item)) {
+		Trace::Span span("recognize", item->mFile);
+
+		try {
+			rectifier.rectify(item->mGrey, item->mBoxes, strips);
+			recognizer->recognize(strips, item->mAccount, item->mWords);
+			item->mConfidences = recognizer->getConfidences();
+		} catch (Error::Exception& ex) {
+			fail(item, "recognition failed: " + System::ConvertWstringToString(ex.getErrorMessage()));
+
+			continue;
+		} catch (std::exception& ex) {
+			fail(item, std::string{ "recognition failed: " } + ex.what());
+
+			continue;
+		}
+
+		// the grey copy isn't needed after recognition
+		item->mAccount.untrack(Memory::MC_GREY, Memory::GetMatBytes(item->mGrey));
+		item->mGrey.release();
+
+		if (!mRender->push(item)) {
+			fail(item, "pipeline stopped");
+		}
+	}
+}
+
+void Pipeline::Runner::renderStage(void)
+{
+	ItemPointer item;
+
+	while (mRender->pop(item)) {
+		if (mOptions.mBatch.mRender) {
+			Trace::Span span("render", item->mFile);
+
+			Batch::DrawBoxes(item->mImage, item->mBoxes);
+
+			for (size_t i = 0; i < item->mWords.size(); ++i) {
+				if (!item->mWords[i].empty()) {
+					Graphics::RenderText(item->mImage, item->mWords[i], item->mRects[i].x, item->mRects[i].y, mOptions.mBatch.mFontSize);
+				}
+			}
+		}
+
+		if (!mWrite->push(item)) {
+			fail(item, "pipeline stopped");
+		}
+	}
+}
+
+void Pipeline::Runner::writeStage(void)
+{
+	// the words of a page go to the words file of its image, only the rendered page is written here
+	Batch::Options pageOptions = mOptions.mBatch;
+	pageOptions.mWriteWords    = false;
+
+	ItemPointer item;
+
+	while (mWrite->pop(item)) {
+		Trace::Span span("write", item->mFile);
+		std::string error;
+
+		const std::wstring name = item->mDocument ? Batch::GetPagePath(item->mFile, item->mPage) : item->mFile;
+
+		if (!Batch::WriteOutputs(name, item->mBoxes, item->mWords, item->mImage, item->mDocument ? pageOptions : mOptions.mBatch, error)) {
+			fail(item, error);
+
+			continue;
+		}
+
+		size_t words{ 0 };
+
+		for (const std::string& word : item->mWords) {
+			words += word.empty() ? 0 : 1;
+		}
+
+		Log::Write(System::ConvertWstringToString(name) + ": " + std::to_string(item->mBoxes.size()) + " boxes, " + std::to_string(words) +
+		           " words (" + item->mAccount.getReport() + ")");
+
+		mBoxes += item->mBoxes.size();
+		mWords += words;
+		++mImages;
+
+		if (mIndex && !item->mDocument) {
+			mIndex->add(item->mFingerprint, item->mFile);
+		}
+
+		if (mSearch) {
+			mSearch->add(name, item->mWords);
+		}
+
+		if (mResults) {
+			mResults->add(name, item->mBoxes, item->mWords, item->mConfidences);
+		}
+
+		// the ticket goes back to the budget with the item
+		item->mAccount.untrack(Memory::MC_IMAGE, Memory::GetMatBytes(item->mImage));
+		item->mTicket.reset();
+		item->mImage.release();
+
+		if (item->mDocument) {
+			finishPage(item, true);
+		} else if (mCallback) {
+			mCallback(item->mFile, true);
+		}
+
+		item.reset();
+	}
+}
+
+bool Pipeline::Runner::readPages(const std::wstring& file, const std::vector<cv::Size>& pages)
+{
+	std::shared_ptr<Document> document(new Document());
+	document->mFile       = file;
+	document->mPages      = pages.size();
+	document->mWriting    = false;
+	document->mWriteError = false;
+	document->mNext       = 0;
+	document->mInFlight   = 0;
+
+	if (mOptions.mBatch.mWriteWords) {
+		document->mWriting = document->mWriter.open(Batch::GetWordsPath(file), (size_t)std::max(Settings::GetInt(L"Output", L"BufferKB", 1024), 4) * 1024,
+		                                            Settings::GetBool(L"Output", L"AsyncFlush", false));
+		document->mWriteError = !document->mWriting;
+	}
+
+	Log::Write(System::ConvertWstringToString(file) + ": " + std::to_string(pages.size()) + " pages");
+
+	for (size_t page = 0; page < pages.size(); ++page) {
+		// only a few pages of the file are decoded at once, the next page waits until one leaves the pipeline
+		{
+			std::unique_lock<std::mutex> lock(document->mMutex);
+			document->mPageDone.wait(lock, [this, &document]() {
+				return document->mInFlight < mOptions.mPagesInFlight;
+			});
+
+			++document->mInFlight;
+		}
+
+		ItemPointer item(new Item());
+		item->mFile        = file;
+		item->mFingerprint = Deduplication::Fingerprint{};
+		item->mDocument    = document;
+		item->mPage        = page;
+		item->mPlan        = Memory::PlanImage(Memory::IF_TIFF, pages[page].width, pages[page].height, mOptions.mBatch.mInputScale, false);
+
+		if (item->mPlan.mAction == Memory::PA_REFUSE) {
+			fail(item, "refused: estimated " + std::to_string(item->mPlan.mEstimate / Memory::MEGABYTE) + " MB exceeds the memory budget");
+
+			continue;
+		}
+
+		item->mTicket.reset(new Memory::Ticket(item->mPlan.mEstimate));
+
+		if (!mDecode->push(item)) {
+			fail(item, "pipeline stopped");
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void Pipeline::Runner::finishPage(const ItemPointer& item, const bool success)
+{
+	Document& document = *item->mDocument;
+	bool      finished{ false }, written{ false };
+
+	{
+		std::lock_guard<std::mutex> lock(document.mMutex);
+
+		document.mWaiting[item->mPage] = success ? std::move(item->mWords) : std::vector<std::string>{};
+
+		if (!success) {
+			document.mFailedPages.insert(item->mPage);
+		}
+
+		//
+		// Pages go to the words file in order, a page that finished early waits for the pages before it
+		//
+		for (auto waiting = document.mWaiting.find(document.mNext); waiting != document.mWaiting.end(); waiting = document.mWaiting.find(document.mNext)) {
+			if (document.mWriting) {
+				const bool failed = document.mFailedPages.count(document.mNext) != 0;
+
+				document.mWriter.writeLine(("# page " + std::to_string(document.mNext + 1) + (failed ? " failed" : "")).c_str());
+
+				for (const std::string& word : waiting->second) {
+					if (!word.empty()) {
+						document.mWriter.writeLine(word.c_str());
+					}
+				}
+			}
+
+			document.mWaiting.erase(waiting);
+			++document.mNext;
+		}
+
+		--document.mInFlight;
+
+		if (document.mNext == document.mPages) {
+			if (document.mWriting && !document.mWriter.close()) {
+				document.mWriteError = true;
+			}
+
+			document.mWriting = false;
+			finished          = true;
+			written           = !document.mWriteError && document.mFailedPages.empty();
+		}
+	}
+
+	document.mPageDone.notify_all();
+
+	if (!finished) {
+		return;
+	}
+
+	Log::Write(System::ConvertWstringToString(document.mFile) + ": " + std::to_string(document.mPages) + " pages finished, " +
+	           std::to_string(document.mFailedPages.size()) + " failed" + (document.mWriteError ? ", the words file can't be written" : ""));
+
+	if (mCallback) {
+		mCallback(document.mFile, written);
+	}
+}
+
+bool Pipeline::Runner::reuse(const ItemPointer& item)
+{
+	if (!mIndex || item->mDocument) {
+		return false;
+	}
+
+	std::wstring original;
+
+	{
+		Trace::Span span("dedup", item->mFile);
+		item->mFingerprint = Deduplication::ComputeFingerprint(item->mImage);
+
+		// the search index and the results get the words and boxes of the original from its boxes file
+		const bool indexed = mSearch || mResults;
+
+		if ((indexed && !mOptions.mBatch.mWriteBoxes) || !mIndex->find(item->mFingerprint, item->mFile, original) ||
+		    (indexed && !Batch::ReadBoxes(original, item->mBoxes, item->mWords)) || !Batch::CopyOutputs(original, item->mFile, mOptions.mBatch)) {
+			item->mBoxes.clear();
+			item->mWords.clear();
+
+			return false;
+		}
+	}
+
+	Log::Write(System::ConvertWstringToString(item->mFile) + ": near duplicate of " + System::ConvertWstringToString(original) + ", outputs copied");
+
+	if (mSearch) {
+		mSearch->add(item->mFile, item->mWords);
+	}
+
+	// the recognizer confidences aren't in the boxes file, the rows of a copy have 0
+	if (mResults) {
+		mResults->add(item->mFile, item->mBoxes, item->mWords, item->mConfidences);
+	}
+
+	++mDuplicates;
+	++mImages;
+
+	item->mImage.release();
+	item->mTicket.reset();
+
+	if (mCallback) {
+		mCallback(item->mFile, true);
+	}
+
+	return true;
+}
+
+void Pipeline::Runner::fail(const ItemPointer& item, const std::string& reason)
+{
+	const std::wstring name = item->mDocument ? Batch::GetPagePath(item->mFile, item->mPage) : item->mFile;
+
+	Log::Write(System::ConvertWstringToString(name) + " failed: " + reason);
+	++mFailed;
+
+	item->mTicket.reset();
+
+	if (item->mDocument) {
+		finishPage(item, false);
+	} else if (mCallback) {
+		mCallback(item->mFile, false);
+	}
+}
+
+//
+// Global Functions
+//
+Pipeline::Options Pipeline::GetOptions(void)
+{
+	Options options;
+	options.mBatch = Batch::GetOptions();
+
+	// recognition is the slowest stage, it gets the threads that are left unless it is set
+	const int hardware  = std::max(1, (int)std::thread::hardware_concurrency());
+	const int recognize = Settings::GetInt(L"Pipeline", L"RecognizeWorkers", 0);
+
+	options.mWorkers.mRead      = std::max(1, Settings::GetInt(L"Pipeline", L"ReadWorkers", 1));
+	options.mWorkers.mDecode    = std::max(1, Settings::GetInt(L"Pipeline", L"DecodeWorkers", 2));
+	options.mWorkers.mDetect    = std::max(1, Settings::GetInt(L"Pipeline", L"DetectWorkers", 1));
+	options.mWorkers.mRecognize = recognize > 0 ? recognize : std::max(1, hardware - 4);
+	options.mWorkers.mRender    = std::max(1, Settings::GetInt(L"Pipeline", L"RenderWorkers", 1));
+	options.mWorkers.mWrite     = std::max(1, Settings::GetInt(L"Pipeline", L"WriteWorkers", 1));
+	options.mQueueCapacity      = (size_t)std::max(1, Settings::GetInt(L"Pipeline", L"QueueCapacity", 4));
+	options.mPagesInFlight      = (size_t)std::max(1, Settings::GetInt(L"Pipeline", L"PagesInFlight", 2));
+	options.mMetricsInterval    = std::max(0, Settings::GetInt(L"Pipeline", L"MetricsIntervalMs", 100));
+
+	return options;
+}
\ No newline at end of file
@@ -0,0 +1,383 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "pipeline.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Staged Pipeline Operations
+ *
+ * Structs(QueueMetrics, StageWorkers, Options)
+ * Classes(BoundedQueue, Runner)
+ * Functions(GetOptions)
+ *
+ */
+
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include "main.hpp"
+#include "batch.hpp"
+#include "dedup.hpp"
+#include "detector.hpp"
+#include "memory.hpp"
+#include "output.hpp"
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Pipeline
+{
+	//
+	// Structs
+	//
+
+	/**
+		Metrics of a queue between two stages
+	*/
+	struct QueueMetrics
+	{
+		std::string mName;          // name of the stage the queue feeds
+		size_t      mCapacity;      // items the queue holds before a push blocks
+		size_t      mDepth;         // items in the queue now
+		size_t      mPeakDepth;     // most items the queue held
+		double      mMeanDepth;     // mean depth seen by the pushes and pops
+		size_t      mItems;         // items pushed through the queue
+		size_t      mBlockedPushes; // pushes that waited for room (backpressure on the producer)
+		size_t      mBlockedPops;   // pops that waited for an item (starved consumer)
+	};
+
+	/**
+		Worker threads of each stage
+	*/
+	struct StageWorkers
+	{
+		int mRead;      // read the files and take the memory tickets
+		int mDecode;    // decode the images
+		int mDetect;    // detect the boxes (one detector per worker)
+		int mRecognize; // rectify and recognize the boxes (one recognizer per worker)
+		int mRender;    // render the boxes and the words over the image
+		int mWrite;     // encode and write the outputs
+	};
+
+	/**
+		Options of the pipeline
+	*/
+	struct Options
+	{
+		Batch::Options mBatch;           // processing options shared with the pool
+		StageWorkers   mWorkers;         // worker threads of each stage
+		size_t         mQueueCapacity;   // items a queue holds before its producer blocks
+		size_t         mPagesInFlight;   // pages of a multi-page image between the read stage and the end of the pipeline
+		int            mMetricsInterval; // milliseconds between queue depth samples in the trace (0 disables them)
+	};
+
+	//
+	// Classes
+	//
+
+	/**
+		Blocking queue with a fixed capacity
+
+		A push waits while the queue is full, so a slow stage holds back the stages before it instead of letting images
+		pile up in memory. A pop waits while the queue is empty and fails once the queue is closed and drained.
+	*/
+	template<typename T>
+	class BoundedQueue
+	{
+		public:
+
+			BoundedQueue(const std::string& name, const size_t capacity) :
+				mName(name), mCapacity(capacity ? capacity : 1), mItems(), mMutex(), mNotFull(), mNotEmpty(), mClosed(false),
+				mPeakDepth(0), mDepthSum(0), mSamples(0), mPushed(0), mBlockedPushes(0), mBlockedPops(0)
+			{}
+			BoundedQueue(const BoundedQueue& queue) = delete;
+
+			const BoundedQueue& operator=(const BoundedQueue& queue) = delete;
+
+			/**
+				Adds the item, waits while the queue is full (returns false if the queue is closed)
+			*/
+			bool push(T item)
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+
+				if (mItems.size() >= mCapacity && !mClosed) {
+					++mBlockedPushes;
+					mNotFull.wait(lock, [this]() {
+						return mItems.size() < mCapacity || mClosed;
+					});
+				}
+
+				if (mClosed) {
+					return false;
+				}
+
+				mItems.push_back(std::move(item));
+				++mPushed;
+				sample();
+				lock.unlock();
+
+				mNotEmpty.notify_one();
+
+				return true;
+			}
+			/**
+				Takes the oldest item, waits while the queue is empty (returns false if the queue is closed and empty)
+			*/
+			bool pop(T& item)
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+
+				if (mItems.empty() && !mClosed) {
+					++mBlockedPops;
+					mNotEmpty.wait(lock, [this]() {
+						return !mItems.empty() || mClosed;
+					});
+				}
+
+				if (mItems.empty()) {
+					return false;
+				}
+
+				item = std::move(mItems.front());
+				mItems.pop_front();
+				sample();
+				lock.unlock();
+
+				mNotFull.notify_one();
+
+				return true;
+			}
+			/**
+				Closes the queue, waiting pops return the remaining items and then fail
+			*/
+			void close(void)
+			{
+				{
+					std::lock_guard<std::mutex> lock(mMutex);
+					mClosed = true;
+				}
+
+				mNotFull.notify_all();
+				mNotEmpty.notify_all();
+			}
+			/**
+				Returns the number of items in the queue
+			*/
+			size_t getDepth(void) const
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+
+				return mItems.size();
+			}
+			/**
+				Returns the metrics of the queue
+			*/
+			QueueMetrics getMetrics(void) const
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+
+				return QueueMetrics{ mName, mCapacity, mItems.size(), mPeakDepth, mSamples ? (double)mDepthSum / mSamples : 0.0, mPushed,
+				                     mBlockedPushes, mBlockedPops };
+			}
+
+		private:
+
+			/**
+				Records the depth (mMutex must be locked)
+			*/
+			void sample(void)
+			{
+				mPeakDepth  = std::max(mPeakDepth, mItems.size());
+				mDepthSum  += mItems.size();
+				++mSamples;
+			}
+
+			std::string             mName;          // name of the stage the queue feeds
+			size_t                  mCapacity;      // items the queue holds before a push blocks
+			std::deque<T>           mItems;         // items of the queue
+			mutable std::mutex      mMutex;         // guards the members below
+			std::condition_variable mNotFull;       // signals room for a push
+			std::condition_variable mNotEmpty;      // signals an item for a pop
+			bool                    mClosed;        // no more pushes
+			size_t                  mPeakDepth;     // most items the queue held
+			size_t                  mDepthSum;      // sum of the sampled depths
+			size_t                  mSamples;       // number of sampled depths
+			size_t                  mPushed;        // items pushed
+			size_t                  mBlockedPushes; // pushes that waited for room
+			size_t                  mBlockedPops;   // pops that waited for an item
+	};
+
+	/**
+		Staged image pipeline: read -> decode -> detect -> recognize -> render -> write
+
+		Every stage has its own worker threads and a bounded queue in front of it, so image N+1 is read and decoded while
+		image N is in the detector and image N-1 is in the recognizer. A full queue blocks the stage that feeds it
+		(backpressure), and the read stage also waits for the memory ticket of each image. Detectors and recognizers are
+		created by the thread that uses them.
+
+		A runner can be kept warm: start it once, submit files as they arrive and finish it when there are no more.
+
+		With [Dedup] Enabled, the decode stage sends an image whose perceptual hash is close to an image processed before
+		straight out of the pipeline with copies of that image's outputs.
+
+		A multi-page TIFF is split into pages by the read stage from its directories, without loading the file. Every page
+		goes through the stages as its own image and only [Pipeline] PagesInFlight pages of a file are in the pipeline at
+		once. The words of the pages go to <file>_words.txt in page order under "# page <n>" lines, pages finished early
+		wait as words only, and the rendered pages go to <file>_p<page>_katip.png. The callback is called once per file
+		after its last page.
+
+		With [Search] Enabled, the write stage adds the words of every written image (or page, as <file>_p<page>) to the
+		search index, the last segment is written when the runner finishes.
+	*/
+	class Runner
+	{
+		public:
+
+			Runner(const Options& options);
+			Runner(const Runner& runner) = delete;
+			/**
+				Finishes the runner if it is still started
+			*/
+			~Runner();
+
+			const Runner& operator=(const Runner& runner) = delete;
+
+			/**
+				Processes the files and returns when all of them are written
+			*/
+			Batch::Statistics run(const std::vector<std::wstring>& files);
+			/**
+				Starts the stage workers, the detectors and recognizers are created before the first file arrives
+			*/
+			void start(void);
+			/**
+				Queues a file for the read stage (returns false if the runner isn't started)
+			*/
+			bool submit(const std::wstring& file);
+			/**
+				Waits until the submitted files are written, stops the workers and returns the counters of the run
+			*/
+			Batch::Statistics finish(void);
+			/**
+				Sets the function called from the pipeline threads whenever an image is written or fails (set it before start)
+			*/
+			void setCallback(const Batch::Callback& callback);
+			/**
+				Returns the metrics of the queues in front of the read, decode, detect, recognize, render and write stages
+			*/
+			std::vector<QueueMetrics> getMetrics(void) const;
+
+		private:
+
+			/**
+				A multi-page image whose pages are in the pipeline
+			*/
+			struct Document
+			{
+				std::wstring                                mFile;        // path of the image
+				size_t                                      mPages;       // number of pages
+				Output::WordWriter                          mWriter;      // words of the pages in page order (<file>_words.txt)
+				bool                                        mWriting;     // is the words file open?
+				bool                                        mWriteError;  // did a write to the words file fail?
+				std::map<size_t, std::vector<std::string> > mWaiting;     // words of the pages finished before an earlier page
+				std::set<size_t>                            mFailedPages; // pages that failed
+				size_t                                      mNext;        // next page of the words file
+				size_t                                      mInFlight;    // pages in the pipeline
+				std::mutex                                  mMutex;       // guards the members above
+				std::condition_variable                     mPageDone;    // signals a page leaving the pipeline
+			};
+
+			/**
+				An image (or a page of a multi-page image) going through the stages
+			*/
+			struct Item
+			{
+				std::wstring                    mFile;        // path of the image
+				std::vector<unsigned char>      mData;        // encoded image (released after decoding)
+				Memory::Plan                    mPlan;        // memory plan of the image
+				std::unique_ptr<Memory::Ticket> mTicket;      // admission to the memory budget
+				Memory::Account                 mAccount;     // tracked allocations of the image
+				cv::Mat                         mImage;       // decoded BGR image
+				cv::Mat                         mGrey;        // grey copy for the recognizer
+				std::vector<Detection::Box>     mBoxes;       // boxes inside the image
+				std::vector<cv::Rect>           mRects;       // axis-aligned bounds of the boxes
+				std::vector<std::string>        mWords;       // UTF-8 word of each box
+				std::vector<float>              mConfidences; // recognizer confidence of each box
+				Deduplication::Fingerprint      mFingerprint; // perceptual fingerprint of the decoded image
+				std::shared_ptr<Document>       mDocument;    // multi-page image of the page (empty for a single image)
+				size_t                          mPage;        // index of the page from 0
+			};
+
+			typedef std::shared_ptr<Item> ItemPointer;
+			typedef BoundedQueue<ItemPointer> Queue;
+			typedef BoundedQueue<std::wstring> FileQueue;
+
+			void readStage(void);
+			void decodeStage(void);
+			void detectStage(void);
+			void recognizeStage(void);
+			void renderStage(void);
+			void writeStage(void);
+			/**
+				Sends the pages of a multi-page image to the decode stage one after the other (returns false if the pipeline stopped)
+			*/
+			bool readPages(const std::wstring& file, const std::vector<cv::Size>& pages);
+			/**
+				Adds the words of a written or failed page to the words file of its image in page order, the callback is called
+				after the last page
+			*/
+			void finishPage(const ItemPointer& item, const bool success);
+			/**
+				Copies the outputs of a near duplicate of the decoded image (returns false if the image must be processed)
+			*/
+			bool reuse(const ItemPointer& item);
+			/**
+				Counts the image as failed, logs the reason and calls the callback or finishes the page (the ticket goes with the item)
+			*/
+			void fail(const ItemPointer& item, const std::string& reason);
+
+			Options                               mOptions;    // options of the pipeline
+			Batch::Callback                       mCallback;   // called when an image leaves the pipeline (may be empty)
+			std::unique_ptr<Deduplication::Index> mIndex;      // perceptual hashes of the processed images (empty without [Dedup])
+			std::unique_ptr<Search::Writer>       mSearch;     // search index of the recognized words (empty without [Search])
+			std::unique_ptr<Results::Writer>      mResults;    // columnar results of the processed images (empty without [Results])
+			std::unique_ptr<FileQueue>            mInput;      // submitted files -> read
+			std::unique_ptr<Queue>                mDecode;     // read -> decode
+			std::unique_ptr<Queue>                mDetect;     // decode -> detect
+			std::unique_ptr<Queue>                mRecognize;  // detect -> recognize
+			std::unique_ptr<Queue>                mRender;     // recognize -> render
+			std::unique_ptr<Queue>                mWrite;      // render -> write
+			std::vector<std::thread>              mThreads;    // stage workers
+			std::thread                           mSampler;    // samples the queue depths into the trace
+			std::atomic<bool>                     mStarted;    // are the workers running?
+			int64_t                               mStart;      // tick count at start
+			std::atomic<size_t>                   mImages;     // written images
+			std::atomic<size_t>                   mDuplicates; // images copied from a near duplicate
+			std::atomic<size_t>                   mFailed;     // failed images
+			std::atomic<size_t>                   mBoxes;      // detected boxes
+			std::atomic<size_t>                   mWords;      // recognized words
+	};
+
+	//
+	// Global Functions
+	//
+
+	/**
+		Returns the pipeline options of the settings ([Pipeline] and [Batch])
+	*/
+	Options GetOptions(void);
+}
+
+#endif
\ No newline at end of file
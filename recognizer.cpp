@@ -0,0 +1,334 @@
+#include "recognizer.hpp"
+#include "error.hpp"
+#include "inference.hpp"
+#include "settings.hpp"
+#include "system.hpp"
+#include "trace.hpp"
+#include <opencv2/imgproc.hpp>
+#include <tesseract/baseapi.h>
+#include <tesseract/resultiterator.h>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	//
+	// Local Functions
+	//
+
+	/**
+		Reads the vocabulary file (one UTF-8 symbol per line, in the class order of the model)
+	*/
+	std::vector<std::string> ReadVocabulary(const std::wstring& fileName)
+	{
+		std::vector<unsigned char> data;
+
+		if (!System::ReadFile(fileName, data)) {
+			throw Error::Exception(L"Can't read the CRNN vocabulary " + fileName + L"!", L"Image Processing Error");
+		}
+
+		std::vector<std::string> vocabulary;
+		std::string              symbol;
+		size_t                   start = data.size() >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF ? 3 : 0; // skip BOM
+
+		for (size_t i = start; i <= data.size(); ++i) {
+			if (i == data.size() || data[i] == '\n') {
+				if (!symbol.empty() && symbol.back() == '\r') {
+					symbol.pop_back();
+				}
+
+				if (!symbol.empty()) {
+					vocabulary.push_back(symbol);
+				}
+
+				symbol.clear();
+			} else {
+				symbol.push_back((char)data[i]);
+			}
+		}
+
+		if (vocabulary.empty() || !System::IsValidUtf8((const char*)data.data(), data.size())) {
+			throw Error::Exception(L"CRNN vocabulary " + fileName + L" is empty or not UTF-8!", L"Image Processing Error");
+		}
+
+		return vocabulary;
+	}
+}
+
+//
+// Recognizer Class Member Functions
+//
+Recognition::Recognizer::~Recognizer()
+{}
+
+const std::vector<float>& Recognition::Recognizer::getConfidences(void) const
+{
+	return mConfidences;
+}
+
+//
+// Tesseract Recognizer Class Member Functions
+//
+Recognition::TesseractRecognizer::TesseractRecognizer() :
+	mApi(new tesseract::TessBaseAPI())
+{
+	const std::wstring tessdata = System::GetApplicationDirectory() + L"\\tessdata";
+	std::string        path;
+	std::string        language = System::ConvertWstringToString(Settings::GetString(L"Recognition", L"Language", L"tur"));
+
+	if (!System::GetNativePath(tessdata, path)) {
+		delete mApi;
+		mApi = nullptr;
+
+		throw Error::Exception(L"The path " + tessdata + L" can't be given to Tesseract, the ANSI code page can't represent it and it has no short name!",
+		                       L"Image Processing Error");
+	}
+
+	if (mApi->Init(path.c_str(), language.c_str())) {
+		delete mApi;
+		mApi = nullptr;
+
+		throw Error::Exception(L"Can't initialize Tesserract!", L"Image Processing Error");
+	}
+
+	// set page seg mode
+	mApi->SetPageSegMode(tesseract::PSM_SINGLE_WORD);
+}
+
+Recognition::TesseractRecognizer::~TesseractRecognizer()
+{
+	// Destroy tesseract object and release memory
+	if (mApi) {
+		mApi->End();
+		delete mApi;
+		mApi = nullptr;
+	}
+}
+
+void Recognition::TesseractRecognizer::recognize(const std::vector<cv::Mat>& strips, Memory::Account& account, std::vector<std::string>& words)
+{
+	words.assign(strips.size(), std::string{});
+	mConfidences.assign(strips.size(), 0.0f);
+
+	for (size_t i = 0; i < strips.size(); ++i) {
+		const cv::Mat& strip = strips[i];
+
+		if (strip.empty()) {
+			continue;
+		}
+
+		// set strip (Tesseract keeps its own copies of it)
+		Trace::Span     span("tesseract region", i);
+		mApi->SetImage(strip.data, (int)strip.cols, (int)strip.rows, 1, (int)strip.step);
+		Memory::Tracker ocrTracker(account, Memory::MC_OCR, Memory::GetMatBytes(strip) * 2);
+
+		const int confidence = mApi->MeanTextConf();
+
+		if (!confidence) {
+			continue;
+		}
+
+		mConfidences[i] = (float)confidence / 100.0f;
+
+		char* text = mApi->GetUTF8Text();
+		words[i]   = text;
+		delete[] text;
+
+		// Tesseract ends the word with a line feed
+		while (!words[i].empty() && (words[i].back() == '\n' || words[i].back() == '\r' || words[i].back() == ' ')) {
+			words[i].pop_back();
+		}
+	}
+}
+
+std::string Recognition::TesseractRecognizer::getName(void) const
+{
+	return "Tesseract";
+}
+
+void Recognition::TesseractRecognizer::recognizePage(const cv::Mat& grey, Memory::Account& account, std::vector<cv::Rect>& rects, std::vector<std::string>& words)
+{
+	rects.clear();
+	words.clear();
+
+	Trace::Span span("tesseract page");
+	mApi->SetPageSegMode(tesseract::PSM_AUTO);
+	mApi->SetImage(grey.data, (int)grey.cols, (int)grey.rows, 1, (int)grey.step);
+	Memory::Tracker ocrTracker(account, Memory::MC_OCR, Memory::GetMatBytes(grey) * 2);
+
+	if (mApi->Recognize(nullptr)) {
+		mApi->SetPageSegMode(tesseract::PSM_SINGLE_WORD);
+
+		throw Error::Exception(L"Tesseract can't recognize the page!", L"Image Processing Error");
+	}
+
+	std::unique_ptr<tesseract::ResultIterator> iterator(mApi->GetIterator());
+
+	if (iterator) {
+		do {
+			if (iterator->Empty(tesseract::RIL_WORD) || iterator->Confidence(tesseract::RIL_WORD) <= 0.0f) {
+				continue;
+			}
+
+			int left{ 0 }, top{ 0 }, right{ 0 }, bottom{ 0 };
+
+			if (!iterator->BoundingBox(tesseract::RIL_WORD, &left, &top, &right, &bottom)) {
+				continue;
+			}
+
+			char* text = iterator->GetUTF8Text(tesseract::RIL_WORD);
+
+			if (text) {
+				rects.push_back(cv::Rect(left, top, right - left, bottom - top));
+				words.push_back(text);
+				delete[] text;
+			}
+		} while (iterator->Next(tesseract::RIL_WORD));
+	}
+
+	// back to the word mode of recognize
+	mApi->SetPageSegMode(tesseract::PSM_SINGLE_WORD);
+}
+
+//
+// CRNN Recognizer Class Member Functions
+//
+Recognition::CrnnRecognizer::CrnnRecognizer() :
+	mNet(), mVocabulary(), mBatchSize(std::max(1, Settings::GetInt(L"Recognition", L"BatchSize", 32))),
+	mInputWidth(std::max(8, Settings::GetInt(L"Recognition", L"CrnnInputWidth", 100))), mInputHeight(std::max(8, Settings::GetInt(L"Recognition", L"CrnnInputHeight", 32))),
+	mTimeMajor(true)
+{
+	mNet = cv::dnn::readNet(System::GetNativePath(Settings::GetPath(L"Recognition", L"CrnnModel", L"crnn_tur.onnx")));
+
+	if (mNet.empty()) {
+		throw Error::Exception(L"Can't load the CRNN text recognition model!", L"Image Processing Error");
+	}
+
+	mNet.setPreferableBackend(Inference::GetBackend().mBackend);
+	mNet.setPreferableTarget(Inference::GetBackend().mTarget);
+
+	mVocabulary = ReadVocabulary(Settings::GetPath(L"Recognition", L"Vocabulary", L"vocabulary_tur.txt"));
+
+	//
+	// CRNN models give time x batch x classes, some exports give batch x time x classes. A batch of one tells them apart,
+	// a full batch can't when the strips are as many as the time steps.
+	//
+	const int sizes[] = { 1, 1, mInputHeight, mInputWidth };
+	cv::Mat   blob(4, sizes, CV_32F, cv::Scalar(0.0f));
+
+	mNet.setInput(blob);
+	cv::Mat output = mNet.forward();
+
+	if (output.dims != 3 || (output.size[0] != 1 && output.size[1] != 1)) {
+		throw Error::Exception(L"The CRNN text recognition model doesn't give a time x batch x classes output!", L"Image Processing Error");
+	}
+
+	mTimeMajor = output.size[1] == 1 && output.size[0] != 1;
+}
+
+void Recognition::CrnnRecognizer::recognize(const std::vector<cv::Mat>& strips, Memory::Account& account, std::vector<std::string>& words)
+{
+	words.assign(strips.size(), std::string{});
+	mConfidences.assign(strips.size(), 0.0f);
+
+	cv::Mat blob;
+	cv::Mat scaled;
+
+	for (size_t first = 0; first < strips.size(); first += mBatchSize) {
+		const int count = (int)std::min(strips.size() - first, (size_t)mBatchSize);
+
+		// blob of the batch (count x 1 x height x width), strips are normalized to -1..1 like the CRNN training data
+		Trace::Span batchSpan("crnn batch", (size_t)count);
+		const int   sizes[] = { count, 1, mInputHeight, mInputWidth };
+		blob.create(4, sizes, CV_32F);
+		Memory::Tracker blobTracker(account, Memory::MC_BLOB, blob);
+
+		for (int i = 0; i < count; ++i) {
+			cv::Mat        plane(mInputHeight, mInputWidth, CV_32F, blob.ptr<float>(i));
+			const cv::Mat& strip = strips[first + i];
+
+			if (strip.empty()) {
+				plane.setTo(cv::Scalar(0.0));
+
+				continue;
+			}
+
+			// keep the aspect ratio and pad the rest of the width with the last column
+			int width = std::min(mInputWidth, std::max(1, (int)std::lround((double)strip.cols * mInputHeight / strip.rows)));
+
+			cv::resize(strip, scaled, cv::Size(width, mInputHeight), 0, 0, cv::INTER_AREA);
+
+			if (width < mInputWidth) {
+				cv::copyMakeBorder(scaled, scaled, 0, 0, 0, mInputWidth - width, cv::BORDER_REPLICATE);
+			}
+
+			scaled.convertTo(plane, CV_32F, 1.0 / 127.5, -1.0);
+		}
+
+		Memory::Tracker networkTracker(account, Memory::MC_NETWORK, Memory::GetMatBytes(blob) * 16);
+		mNet.setInput(blob);
+		cv::Mat output = mNet.forward();
+
+		decode(output, first, count, words, mConfidences);
+	}
+}
+
+std::string Recognition::CrnnRecognizer::getName(void) const
+{
+	return "CRNN";
+}
+
+void Recognition::CrnnRecognizer::decode(const cv::Mat& output, const size_t first, const int count, std::vector<std::string>& words,
+                                         std::vector<float>& confidences) const
+{
+	CV_Assert(output.dims == 3 && output.size[mTimeMajor ? 1 : 0] == count);
+
+	const int steps   = mTimeMajor ? output.size[0] : output.size[1];
+	const int classes = output.size[2];
+
+	for (int i = 0; i < count; ++i) {
+		std::string& word = words[first + i];
+		int          previous{ 0 };
+		double       probability{ 0.0 };
+		int          symbols{ 0 };
+
+		for (int t = 0; t < steps; ++t) {
+			const float* scores = mTimeMajor ? output.ptr<float>(t, i) : output.ptr<float>(i, t);
+			const int    best   = (int)(std::max_element(scores, scores + classes) - scores);
+
+			// repeated symbols are merged unless a blank separates them
+			if (best != 0 && best != previous && best - 1 < (int)mVocabulary.size()) {
+				word += mVocabulary[best - 1];
+
+				// softmax probability of the best class (the scores may be logits or log probabilities)
+				double sum{ 0.0 };
+
+				for (int c = 0; c < classes; ++c) {
+					sum += std::exp((double)(scores[c] - scores[best]));
+				}
+
+				probability += 1.0 / sum;
+				++symbols;
+			}
+
+			previous = best;
+		}
+
+		confidences[first + i] = symbols ? (float)(probability / symbols) : 0.0f;
+	}
+}
+
+//
+// Global Functions
+//
+std::unique_ptr<Recognition::Recognizer> Recognition::CreateRecognizer(void)
+{
+	std::wstring recognizer = Settings::GetString(L"Recognition", L"Recognizer", L"Tesseract");
+	std::transform(recognizer.begin(), recognizer.end(), recognizer.begin(), towlower);
+
+	if (recognizer == L"crnn") {
+		return std::unique_ptr<Recognizer>(new CrnnRecognizer());
+	}
+
+	return std::unique_ptr<Recognizer>(new TesseractRecognizer());
+}
\ No newline at end of file
@@ -0,0 +1,148 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "recognizer.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Text Recognition Operations
+ *
+ * Classes(Recognizer, TesseractRecognizer, CrnnRecognizer)
+ * Functions(CreateRecognizer)
+ *
+ */
+
+#ifndef RECOGNIZER_HPP
+#define RECOGNIZER_HPP
+
+#include "main.hpp"
+#include "memory.hpp"
+#include <opencv2/dnn.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace tesseract
+{
+	class TessBaseAPI;
+}
+
+namespace Recognition
+{
+	//
+	// Classes
+	//
+
+	/**
+		Text recognizer interface
+	*/
+	class Recognizer
+	{
+		public:
+
+			virtual ~Recognizer();
+
+			/**
+				Recognizes the word on each strip
+
+				strips  - 8 bit grey strip of each word (see Rectification::Rectifier)
+				account - memory account of the image
+				words   - UTF-8 word of each strip, empty if nothing is recognized (replaced)
+			*/
+			virtual void recognize(const std::vector<cv::Mat>& strips, Memory::Account& account, std::vector<std::string>& words) = 0;
+			/**
+				Returns the name of the recognizer for the log
+			*/
+			virtual std::string getName(void) const = 0;
+			/**
+				Returns the confidence (0 to 1) of each word of the last recognize call, 0 if nothing is recognized
+			*/
+			const std::vector<float>& getConfidences(void) const;
+
+		protected:
+
+			std::vector<float> mConfidences; // confidence of each word of the last recognize call
+	};
+
+	/**
+		Tesseract recognizer, recognizes the strips one by one as single words
+	*/
+	class TesseractRecognizer : public Recognizer
+	{
+		public:
+
+			/**
+				Initializes Tesseract with the tessdata of the application directory ([Recognition] Language, throws Error::Exception on failure)
+			*/
+			TesseractRecognizer();
+			TesseractRecognizer(const TesseractRecognizer& recognizer) = delete;
+			~TesseractRecognizer();
+
+			const TesseractRecognizer& operator=(const TesseractRecognizer& recognizer) = delete;
+
+			void        recognize(const std::vector<cv::Mat>& strips, Memory::Account& account, std::vector<std::string>& words) override;
+			std::string getName(void) const override;
+
+			/**
+				Recognizes the whole page with the layout analysis (PSM_AUTO) and gives the words with their boxes from the result iterator
+
+				grey  - 8 bit grey image of the page
+				rects - word boxes in grey image coordinates (replaced)
+				words - UTF-8 words (replaced)
+			*/
+			void recognizePage(const cv::Mat& grey, Memory::Account& account, std::vector<cv::Rect>& rects, std::vector<std::string>& words);
+
+		private:
+
+			tesseract::TessBaseAPI* mApi; // Tesseract instance
+	};
+
+	/**
+		CRNN recognizer, recognizes the strips in batches with a CTC model
+
+		Strips are scaled to the input height keeping their aspect ratio and padded to the input width,
+		a batch goes through the network in a single forward call and is decoded greedily with the vocabulary.
+		cv::dnn::TextRecognitionModel runs a forward call per image, so the network is used directly.
+	*/
+	class CrnnRecognizer : public Recognizer
+	{
+		public:
+
+			/**
+				Loads the CRNN model and its vocabulary ([Recognition] CrnnModel and Vocabulary, throws Error::Exception on failure)
+
+				A blank strip goes through the network once, the axis of its output that isn't 1 is the time axis
+			*/
+			CrnnRecognizer();
+
+			void        recognize(const std::vector<cv::Mat>& strips, Memory::Account& account, std::vector<std::string>& words) override;
+			std::string getName(void) const override;
+
+		private:
+
+			/**
+				Decodes the network output of a batch (greedy CTC, class 0 is the blank), the confidence of a word is the mean
+				softmax probability of its symbols
+			*/
+			void decode(const cv::Mat& output, const size_t first, const int count, std::vector<std::string>& words, std::vector<float>& confidences) const;
+
+			cv::dnn::Net             mNet;         // CRNN network
+			std::vector<std::string> mVocabulary;  // UTF-8 symbol of each class after the blank
+			int                      mBatchSize;   // strips in a forward call
+			int                      mInputWidth;  // input width of the network
+			int                      mInputHeight; // input height of the network
+			bool                     mTimeMajor;   // is the output time x batch x classes (else batch x time x classes)?
+	};
+
+	//
+	// Global Functions
+	//
+
+	/**
+		Creates the recognizer of the settings ([Recognition] Recognizer = Tesseract or CRNN)
+	*/
+	std::unique_ptr<Recognizer> CreateRecognizer(void);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include "rectifier.hpp"
+#include "settings.hpp"
+#include "trace.hpp"
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	//
+	// Local Functions
+	//
+
+	/**
+		Returns the axis-aligned bounds of the box clipped to the image
+	*/
+	cv::Rect GetBounds(const Detection::Box& box, const cv::Size& size)
+	{
+		float minX{ box.mVertices[0].x }, maxX{ box.mVertices[0].x };
+		float minY{ box.mVertices[0].y }, maxY{ box.mVertices[0].y };
+
+		for (int j = 1; j < 4; ++j) {
+			minX = std::min(minX, box.mVertices[j].x);
+			maxX = std::max(maxX, box.mVertices[j].x);
+			minY = std::min(minY, box.mVertices[j].y);
+			maxY = std::max(maxY, box.mVertices[j].y);
+		}
+
+		cv::Rect bounds((int)minX, (int)minY, (int)std::roundf(maxX) - (int)minX, (int)std::roundf(maxY) - (int)minY);
+
+		return bounds & cv::Rect(0, 0, size.width, size.height);
+	}
+}
+
+//
+// Rectifier Class Member Functions
+//
+Rectification::Rectifier::Rectifier() :
+	mBuffer(), mTransforms(), mEnabled(Settings::GetBool(L"Recognition", L"Rectify", true)),
+	mMargin(std::max(0.0f, Settings::GetFloat(L"Recognition", L"RectifyMargin", 0.15f)))
+{}
+
+void Rectification::Rectifier::rectify(const cv::Mat& grey, const std::vector<Detection::Box>& boxes, std::vector<cv::Mat>& strips)
+{
+	Trace::Span span("rectify", boxes.size());
+	strips.assign(boxes.size(), cv::Mat{});
+
+	if (!mEnabled) {
+		for (size_t i = 0; i < boxes.size(); ++i) {
+			strips[i] = grey(GetBounds(boxes[i], grey.size()));
+		}
+
+		return;
+	}
+
+	//
+	// Transform and size of each strip
+	//
+	std::vector<cv::Size> sizes(boxes.size());
+	size_t                total{ 0 };
+
+	mTransforms.resize(boxes.size());
+
+	for (size_t i = 0; i < boxes.size(); ++i) {
+		cv::RotatedRect rect = cv::minAreaRect(std::vector<cv::Point2f>(boxes[i].mVertices, boxes[i].mVertices + 4));
+
+		// make the long side the width so the word reads left to right
+		float width  = rect.size.width;
+		float height = rect.size.height;
+		float angle  = rect.angle;
+
+		if (width < height) {
+			std::swap(width, height);
+			angle += 90.0f;
+		}
+
+		// fold the angle into -90..90 so the strip isn't upside down
+		if (angle > 90.0f) {
+			angle -= 180.0f;
+		}
+
+		const float margin = height * mMargin;
+		sizes[i]           = cv::Size(std::max(1, (int)std::lround(width + margin * 2.0f)), std::max(1, (int)std::lround(height + margin * 2.0f)));
+		total             += (size_t)sizes[i].area();
+
+		// rotate around the box center and move the center to the middle of the strip
+		mTransforms[i]                  = cv::getRotationMatrix2D(rect.center, angle, 1.0);
+		mTransforms[i].at<double>(0, 2) += sizes[i].width * 0.5 - rect.center.x;
+		mTransforms[i].at<double>(1, 2) += sizes[i].height * 0.5 - rect.center.y;
+	}
+
+	// grow the buffer only (strips of the previous call become invalid)
+	if (mBuffer.size() < total) {
+		mBuffer.resize(total);
+	}
+
+	size_t offset{ 0 };
+
+	for (size_t i = 0; i < boxes.size(); ++i) {
+		strips[i] = cv::Mat(sizes[i], CV_8UC1, mBuffer.data() + offset);
+		offset   += (size_t)sizes[i].area();
+	}
+
+	//
+	// Warp the boxes in parallel (strips already have their size, so warpAffine writes into the buffer)
+	//
+	cv::parallel_for_(cv::Range(0, (int)boxes.size()), [&](const cv::Range& range) {
+		for (int i = range.start; i < range.end; ++i) {
+			cv::warpAffine(grey, strips[i], mTransforms[i], sizes[i], cv::INTER_LINEAR, cv::BORDER_REPLICATE);
+		}
+	});
+}
+
+size_t Rectification::Rectifier::getBufferBytes(void) const
+{
+	return mBuffer.capacity();
+}
\ No newline at end of file
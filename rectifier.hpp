@@ -0,0 +1,71 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "rectifier.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Text Box Rectification Operations
+ *
+ * Classes(Rectifier)
+ *
+ */
+
+#ifndef RECTIFIER_HPP
+#define RECTIFIER_HPP
+
+#include "main.hpp"
+#include "detector.hpp"
+#include <opencv2/core.hpp>
+#include <vector>
+
+namespace Rectification
+{
+	//
+	// Classes
+	//
+
+	/**
+		Warps the rotated text boxes into upright strips for the recognizer
+
+		Each box is rotated around its center so that its long side is horizontal and only the box (with a small margin)
+		is sampled, so the recognizer gets neither the background of the axis-aligned bounds nor the neighbouring words.
+		Strips are views on one buffer that only grows, and the boxes are warped in parallel.
+	*/
+	class Rectifier
+	{
+		public:
+
+			/**
+				Reads the rectification settings ([Recognition] Rectify and RectifyMargin)
+			*/
+			Rectifier();
+			Rectifier(const Rectifier& rectifier) = delete;
+
+			const Rectifier& operator=(const Rectifier& rectifier) = delete;
+
+			/**
+				Cuts the strip of each box from the grey image
+
+				grey   - 8 bit grey image (region views are fine)
+				boxes  - text boxes in grey image coordinates
+				strips - upright 8 bit strip of each box (replaced), valid until the next call.
+				         If rectification is off these are views of the axis-aligned bounds on the grey image.
+			*/
+			void rectify(const cv::Mat& grey, const std::vector<Detection::Box>& boxes, std::vector<cv::Mat>& strips);
+			/**
+				Returns the bytes of the strip buffer
+			*/
+			size_t getBufferBytes(void) const;
+
+		private:
+
+			std::vector<unsigned char> mBuffer;     // pixels of the strips (capacity is kept between calls)
+			std::vector<cv::Mat>       mTransforms; // affine transform of each strip (grey image to strip)
+			bool                       mEnabled;    // warp the boxes upright ([Recognition] Rectify)
+			float                      mMargin;     // margin around a box as a share of its height ([Recognition] RectifyMargin)
+	};
+}
+
+#endif
\ No newline at end of file
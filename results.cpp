@@ -0,0 +1,416 @@
+#include "results.hpp"
+#include "error.hpp"
+#include "log.hpp"
+#include "settings.hpp"
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <share.h>
+
+namespace
+{
+	//
+	// Local Definitions
+	//
+	const wchar_t* const HEADER_FILE = L"header.krs"; // header file of the folder
+
+	// file of each column in the folder
+	const wchar_t* const COLUMN_FILES[Results::RC_COUNT] = { L"image.col", L"vertices.col", L"angle.col",  L"score.col", L"confidence.col",
+	                                                         L"text.col",  L"images.tab",   L"words.heap", L"paths.heap" };
+
+	// bytes of a value of each column
+	const uint64_t COLUMN_SIZES[Results::RC_COUNT] = { sizeof(uint32_t), 8 * sizeof(float), sizeof(float), sizeof(float), sizeof(float),
+	                                                   sizeof(uint64_t), sizeof(Results::ImageEntry), 1, 1 };
+
+	//
+	// Local Functions
+	//
+
+	/**
+		Returns the committed bytes of the column
+	*/
+	uint64_t GetColumnBytes(const Results::Header& header, const Results::RESULTS_COLUMN column)
+	{
+		switch (column) {
+			case Results::RC_IMAGES:
+				return header.mImages * COLUMN_SIZES[column];
+			case Results::RC_WORDS:
+				return header.mWordsSize;
+			case Results::RC_PATHS:
+				return header.mPathsSize;
+			default:
+				return header.mRows * COLUMN_SIZES[column];
+		}
+	}
+
+	/**
+		Cuts the file to the size, creates it if it isn't there (returns false if it is shorter or can't be cut)
+	*/
+	bool CutFile(const std::wstring& fileName, const uint64_t size)
+	{
+		HANDLE file = CreateFileW(fileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		LARGE_INTEGER length;
+		bool          cut = GetFileSizeEx(file, &length) && (uint64_t)length.QuadPart >= size;
+
+		// a mapped file can't be cut, readers must be closed after a crash of the writer
+		if (cut && (uint64_t)length.QuadPart > size) {
+			length.QuadPart = (LONGLONG)size;
+			cut             = SetFilePointerEx(file, length, NULL, FILE_BEGIN) && SetEndOfFile(file);
+		}
+
+		CloseHandle(file);
+
+		return cut;
+	}
+
+	/**
+		Appends the values to the file (returns false on failure)
+	*/
+	template <typename Value>
+	bool AppendValues(FILE* file, const Value* values, const size_t count)
+	{
+		return count == 0 || std::fwrite(values, sizeof(Value), count, file) == count;
+	}
+
+	/**
+		Writes the header at the start of the header file (returns false on failure)
+	*/
+	bool WriteHeader(FILE* file, const Results::Header& header)
+	{
+		return std::fseek(file, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, file) == 1 && std::fflush(file) == 0;
+	}
+}
+
+//
+// Writer Class Member Functions
+//
+Results::Writer::Writer(const std::wstring& folder, const size_t flushRows) :
+	mFolder(folder), mFlushRows(std::max<size_t>(1, flushRows)), mHeader{ RESULTS_MAGIC, RESULTS_VERSION, 0, 0, 0, 0 }, mHeaderFile(nullptr), mFiles(),
+	mImageIds(), mVertices(), mAngles(), mScores(), mConfidences(), mTextEnds(), mImages(), mWords(), mPaths(), mMutex()
+{
+	if (!CreateDirectoryW(mFolder.c_str(), NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+		throw Error::Exception(L"Can't create the results folder " + mFolder + L"!", L"Results Error");
+	}
+
+	const std::wstring headerPath = mFolder + L"\\" + HEADER_FILE;
+
+	// the header stays open without write sharing while the writer lives, so a second writer (another shard or process) fails
+	// here instead of interleaving its rows with ours, readers can still read it
+	mHeaderFile = _wfsopen(headerPath.c_str(), L"r+b", _SH_DENYWR);
+
+	if (!mHeaderFile && errno == EACCES) {
+		throw Error::Exception(L"The results folder " + mFolder + L" is used by another writer! Give every shard or process its own [Results] Folder.",
+		                       L"Results Error");
+	}
+
+	// the header of an earlier batch gives the committed counts, a new folder starts empty
+	if (mHeaderFile) {
+		if (std::fread(&mHeader, sizeof(mHeader), 1, mHeaderFile) != 1 || mHeader.mMagic != RESULTS_MAGIC || mHeader.mVersion != RESULTS_VERSION) {
+			std::fclose(mHeaderFile);
+			mHeaderFile = nullptr;
+
+			throw Error::Exception(L"The results header " + headerPath + L" is damaged!", L"Results Error");
+		}
+	} else {
+		mHeaderFile = _wfsopen(headerPath.c_str(), L"w+b", _SH_DENYWR);
+
+		if (!mHeaderFile && errno == EACCES) {
+			throw Error::Exception(L"The results folder " + mFolder + L" is used by another writer! Give every shard or process its own [Results] Folder.",
+			                       L"Results Error");
+		}
+
+		if (!mHeaderFile || !WriteHeader(mHeaderFile, mHeader)) {
+			if (mHeaderFile) {
+				std::fclose(mHeaderFile);
+				mHeaderFile = nullptr;
+			}
+
+			throw Error::Exception(L"Can't create the results header " + headerPath + L"!", L"Results Error");
+		}
+	}
+
+	if (!rollBack()) {
+		close();
+
+		throw Error::Exception(L"The columns of " + mFolder + L" are damaged or in use!", L"Results Error");
+	}
+}
+
+Results::Writer::~Writer()
+{
+	flush();
+	close();
+}
+
+void Results::Writer::add(const std::wstring& image, const std::vector<Detection::Box>& boxes, const std::vector<std::string>& words,
+                          const std::vector<float>& confidences)
+{
+	const std::string path = System::ConvertWstringToString(image);
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	const uint32_t id = (uint32_t)(mHeader.mImages + mImages.size());
+
+	mImages.push_back(ImageEntry{ mHeader.mPathsSize + mPaths.size(), mHeader.mRows + mImageIds.size(), (uint32_t)path.size(), (uint32_t)boxes.size() });
+	mPaths += path;
+
+	for (size_t i = 0; i < boxes.size(); ++i) {
+		const cv::Point2f* vertices = boxes[i].mVertices;
+
+		for (int j = 0; j < 4; ++j) {
+			mVertices.push_back(vertices[j].x);
+			mVertices.push_back(vertices[j].y);
+		}
+
+		// the corners go from bottom left clockwise, the top edge runs from the second corner to the third
+		mAngles.push_back((float)(std::atan2(vertices[2].y - vertices[1].y, vertices[2].x - vertices[1].x) * 180.0 / CV_PI));
+		mScores.push_back(boxes[i].mConfidence);
+		mConfidences.push_back(i < confidences.size() ? confidences[i] : 0.0f);
+		mImageIds.push_back(id);
+
+		if (i < words.size()) {
+			mWords += words[i];
+		}
+
+		mTextEnds.push_back(mHeader.mWordsSize + mWords.size());
+	}
+
+	if (mImageIds.size() >= mFlushRows && !flushLocked()) {
+		Log::Write("Results " + System::ConvertWstringToString(mFolder) + " can't be written, the rows are kept in memory");
+	}
+}
+
+bool Results::Writer::flush(void)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	return flushLocked();
+}
+
+bool Results::Writer::flushLocked(void)
+{
+	if (mImages.empty()) {
+		return true;
+	}
+
+	if (!mHeaderFile || !mFiles[RC_IMAGE]) {
+		return false;
+	}
+
+	//
+	// The columns are appended first and the header is written last, a crash before the header leaves only rows the next writer cuts off
+	//
+	bool written = AppendValues(mFiles[RC_IMAGE], mImageIds.data(), mImageIds.size()) && AppendValues(mFiles[RC_VERTICES], mVertices.data(), mVertices.size()) &&
+	               AppendValues(mFiles[RC_ANGLE], mAngles.data(), mAngles.size()) && AppendValues(mFiles[RC_SCORE], mScores.data(), mScores.size()) &&
+	               AppendValues(mFiles[RC_CONFIDENCE], mConfidences.data(), mConfidences.size()) &&
+	               AppendValues(mFiles[RC_TEXT], mTextEnds.data(), mTextEnds.size()) && AppendValues(mFiles[RC_IMAGES], mImages.data(), mImages.size()) &&
+	               AppendValues(mFiles[RC_WORDS], mWords.data(), mWords.size()) && AppendValues(mFiles[RC_PATHS], mPaths.data(), mPaths.size());
+
+	for (int column = 0; column < RC_COUNT; ++column) {
+		written = std::fflush(mFiles[column]) == 0 && written;
+	}
+
+	Header header = mHeader;
+	header.mRows      += mImageIds.size();
+	header.mImages    += mImages.size();
+	header.mWordsSize += mWords.size();
+	header.mPathsSize += mPaths.size();
+
+	if (!written || !WriteHeader(mHeaderFile, header)) {
+		// the half written rows are cut off, so the next flush appends them again at the right place
+		if (!rollBack()) {
+			close();
+		}
+
+		return false;
+	}
+
+	mHeader = header;
+
+	mImageIds.clear();
+	mVertices.clear();
+	mAngles.clear();
+	mScores.clear();
+	mConfidences.clear();
+	mTextEnds.clear();
+	mImages.clear();
+	mWords.clear();
+	mPaths.clear();
+
+	return true;
+}
+
+bool Results::Writer::rollBack(void)
+{
+	for (int column = 0; column < RC_COUNT; ++column) {
+		if (mFiles[column]) {
+			std::fclose(mFiles[column]);
+			mFiles[column] = nullptr;
+		}
+	}
+
+	for (int column = 0; column < RC_COUNT; ++column) {
+		const std::wstring path = mFolder + L"\\" + COLUMN_FILES[column];
+
+		if (!CutFile(path, GetColumnBytes(mHeader, (RESULTS_COLUMN)column)) || !(mFiles[column] = _wfopen(path.c_str(), L"ab"))) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void Results::Writer::close(void)
+{
+	for (int column = 0; column < RC_COUNT; ++column) {
+		if (mFiles[column]) {
+			std::fclose(mFiles[column]);
+			mFiles[column] = nullptr;
+		}
+	}
+
+	if (mHeaderFile) {
+		std::fclose(mHeaderFile);
+		mHeaderFile = nullptr;
+	}
+}
+
+//
+// Reader Class Member Functions
+//
+Results::Reader::Reader() :
+	mFolder(), mHeader{ 0, 0, 0, 0, 0, 0 }, mFiles(), mMapped()
+{
+}
+
+bool Results::Reader::open(const std::wstring& folder)
+{
+	mFolder = folder;
+	mHeader = Header{ 0, 0, 0, 0, 0, 0 };
+
+	for (int column = 0; column < RC_COUNT; ++column) {
+		mFiles[column].close();
+		mMapped[column] = false;
+	}
+
+	FILE* file = _wfopen((folder + L"\\" + HEADER_FILE).c_str(), L"rb");
+
+	if (!file) {
+		return false;
+	}
+
+	const bool read = std::fread(&mHeader, sizeof(mHeader), 1, file) == 1;
+	std::fclose(file);
+
+	return read && mHeader.mMagic == RESULTS_MAGIC && mHeader.mVersion == RESULTS_VERSION;
+}
+
+uint64_t Results::Reader::getRowCount(void) const
+{
+	return mHeader.mRows;
+}
+
+uint64_t Results::Reader::getImageCount(void) const
+{
+	return mHeader.mImages;
+}
+
+const uint32_t* Results::Reader::getImageIds(void)
+{
+	return (const uint32_t*)mapColumn(RC_IMAGE);
+}
+
+const float* Results::Reader::getVertices(void)
+{
+	return (const float*)mapColumn(RC_VERTICES);
+}
+
+const float* Results::Reader::getAngles(void)
+{
+	return (const float*)mapColumn(RC_ANGLE);
+}
+
+const float* Results::Reader::getScores(void)
+{
+	return (const float*)mapColumn(RC_SCORE);
+}
+
+const float* Results::Reader::getConfidences(void)
+{
+	return (const float*)mapColumn(RC_CONFIDENCE);
+}
+
+const Results::ImageEntry* Results::Reader::getImages(void)
+{
+	return (const ImageEntry*)mapColumn(RC_IMAGES);
+}
+
+std::string Results::Reader::getText(const uint64_t row)
+{
+	const uint64_t* ends  = (const uint64_t*)mapColumn(RC_TEXT);
+	const char*     words = (const char*)mapColumn(RC_WORDS);
+
+	if (!ends || !words || row >= mHeader.mRows) {
+		return std::string{};
+	}
+
+	const uint64_t begin = row ? ends[row - 1] : 0;
+
+	if (begin > ends[row] || ends[row] > mHeader.mWordsSize) {
+		return std::string{};
+	}
+
+	return std::string(words + begin, (size_t)(ends[row] - begin));
+}
+
+std::string Results::Reader::getImage(const uint32_t image)
+{
+	const ImageEntry* images = getImages();
+	const char*       paths  = (const char*)mapColumn(RC_PATHS);
+
+	if (!images || !paths || image >= mHeader.mImages || images[image].mPath + images[image].mLength > mHeader.mPathsSize) {
+		return std::string{};
+	}
+
+	return std::string(paths + images[image].mPath, images[image].mLength);
+}
+
+const void* Results::Reader::mapColumn(const RESULTS_COLUMN column)
+{
+	const uint64_t bytes = GetColumnBytes(mHeader, column);
+
+	if (bytes == 0) {
+		return nullptr;
+	}
+
+	// rows past the committed counts belong to a writer that is still appending and are never read
+	if (!mMapped[column]) {
+		mMapped[column] = true;
+
+		if (!mFiles[column].open(mFolder + L"\\" + COLUMN_FILES[column]) || mFiles[column].getSize() < bytes) {
+			Log::Write("Results column " + System::ConvertWstringToString(mFolder + L"\\" + COLUMN_FILES[column]) + " can't be mapped or is cut");
+			mFiles[column].close();
+		}
+	}
+
+	return mFiles[column].getData();
+}
+
+//
+// Global Functions
+//
+std::unique_ptr<Results::Writer> Results::CreateWriter(const std::wstring& folder)
+{
+	if (!Settings::GetBool(L"Results", L"Enabled", false)) {
+		return std::unique_ptr<Writer>();
+	}
+
+	return std::unique_ptr<Writer>(new Writer(folder.empty() ? Settings::GetPath(L"Results", L"Folder", L"katip_results") : folder,
+	                                          (size_t)std::max(1, Settings::GetInt(L"Results", L"FlushRows", 1000000))));
+}
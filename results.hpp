@@ -0,0 +1,251 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "results.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Columnar Results Operations
+ *
+ * Structs(Header, ImageEntry)
+ * Classes(Writer, Reader)
+ * Functions(CreateWriter)
+ *
+ */
+
+#ifndef RESULTS_HPP
+#define RESULTS_HPP
+
+#include "main.hpp"
+#include "detector.hpp"
+#include "system.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Results
+{
+	//
+	// Global Definitions
+	//
+	constexpr uint32_t RESULTS_MAGIC   = 0x3153524B; // "KRS1"
+	constexpr uint32_t RESULTS_VERSION = 1;
+
+	enum RESULTS_COLUMN
+	{
+		RC_IMAGE,      // uint32_t image ID of each row
+		RC_VERTICES,   // float[8] x and y of the four box corners of each row in image pixels
+		RC_ANGLE,      // float angle of the top edge of each box in degrees
+		RC_SCORE,      // float detector score of each box
+		RC_CONFIDENCE, // float recognizer confidence (0 to 1) of each word
+		RC_TEXT,       // uint64_t end of the word of each row in the words (a word starts where the word of the row before ends)
+		RC_IMAGES,     // ImageEntry of each image
+		RC_WORDS,      // UTF-8 words of the rows back to back
+		RC_PATHS,      // UTF-8 paths of the images back to back
+		RC_COUNT,
+	};
+
+	//
+	// Structs
+	//
+
+	/*
+		A results folder holds a header file and a file per column:
+
+		header.krs | image.col | vertices.col | angle.col | score.col | confidence.col | text.col | images.tab | words.heap | paths.heap
+
+		A row is a box of an image, the rows of an image are its boxes in detector order (empty words count), so row minus
+		the first row of the image is the box index of the search index and the boxes file. Writers append rows to the
+		end of every column and then commit the new counts to the header, readers map only the columns they scan and
+		ignore anything past the committed counts. Values are little endian and read in place.
+	*/
+
+	/**
+		Header of a results folder (the committed counts)
+	*/
+	struct Header
+	{
+		uint32_t mMagic;     // RESULTS_MAGIC
+		uint32_t mVersion;   // RESULTS_VERSION
+		uint64_t mRows;      // rows of the row columns
+		uint64_t mImages;    // entries of the image table
+		uint64_t mWordsSize; // bytes of the words
+		uint64_t mPathsSize; // bytes of the paths
+	};
+
+	/**
+		An image of the results (its ID is its position in the table)
+	*/
+	struct ImageEntry
+	{
+		uint64_t mPath;     // offset of the UTF-8 path in the paths
+		uint64_t mFirstRow; // first row of the image
+		uint32_t mLength;   // bytes of the path
+		uint32_t mRowCount; // rows of the image
+	};
+
+	//
+	// Classes
+	//
+
+	/**
+		Appends the results of the processed images to a results folder while a batch runs
+
+		Rows are collected in memory and appended to the columns every [Results] FlushRows rows and when the batch
+		finishes, the header is written after the columns. A crash loses the rows after the last commit only, the next
+		writer cuts the columns back to the committed counts. Only one writer may use a folder at a time, the writer keeps the
+		header open without write sharing so a second one fails to open it.
+	*/
+	class Writer
+	{
+		public:
+
+			/**
+				Opens or creates the results folder and cuts its columns back to the committed counts (throws Error::Exception
+				if the folder is damaged, can't be written or is used by another writer)
+
+				folder    - results folder
+				flushRows - rows collected before they are appended
+			*/
+			Writer(const std::wstring& folder, const size_t flushRows);
+			Writer(const Writer& writer) = delete;
+			/**
+				Appends the collected rows
+			*/
+			~Writer();
+
+			const Writer& operator=(const Writer& writer) = delete;
+
+			/**
+				Adds the boxes of an image as rows (thread safe)
+
+				image       - path of the image
+				boxes       - boxes of the image in image pixels
+				words       - UTF-8 word of each box
+				confidences - recognizer confidence of each box (missing ones are 0)
+			*/
+			void add(const std::wstring& image, const std::vector<Detection::Box>& boxes, const std::vector<std::string>& words, const std::vector<float>& confidences);
+			/**
+				Appends the collected rows and commits them (returns false if they can't be written, the rows are kept)
+			*/
+			bool flush(void);
+
+		private:
+
+			/**
+				Appends the collected rows (mMutex must be locked)
+			*/
+			bool flushLocked(void);
+			/**
+				Cuts the columns back to the committed counts and opens them for appending (returns false on failure)
+			*/
+			bool rollBack(void);
+			/**
+				Closes the column files
+			*/
+			void close(void);
+
+			std::wstring            mFolder;          // results folder
+			size_t                  mFlushRows;       // rows collected before they are appended
+			Header                  mHeader;          // committed counts
+			FILE*                   mHeaderFile;      // header file opened for updating
+			FILE*                   mFiles[RC_COUNT]; // column files opened for appending
+			std::vector<uint32_t>   mImageIds;        // collected image column
+			std::vector<float>      mVertices;        // collected vertices column (8 per row)
+			std::vector<float>      mAngles;          // collected angle column
+			std::vector<float>      mScores;          // collected score column
+			std::vector<float>      mConfidences;     // collected confidence column
+			std::vector<uint64_t>   mTextEnds;        // collected text column
+			std::vector<ImageEntry> mImages;          // collected image table
+			std::string             mWords;           // collected words
+			std::string             mPaths;           // collected paths
+			std::mutex              mMutex;           // guards the members above
+	};
+
+	/**
+		Reads a results folder, a column is mapped the first time it is asked for and the other columns are never touched
+	*/
+	class Reader
+	{
+		public:
+
+			Reader();
+			Reader(const Reader& reader) = delete;
+
+			const Reader& operator=(const Reader& reader) = delete;
+
+			/**
+				Reads the header of the results folder (returns false if it can't be read or is damaged)
+			*/
+			bool open(const std::wstring& folder);
+			/**
+				Returns the committed rows
+			*/
+			uint64_t getRowCount(void) const;
+			/**
+				Returns the committed images
+			*/
+			uint64_t getImageCount(void) const;
+			/**
+				Returns the image column (null if it can't be mapped or there are no rows)
+			*/
+			const uint32_t* getImageIds(void);
+			/**
+				Returns the vertices column, 8 values per row (null if it can't be mapped or there are no rows)
+			*/
+			const float* getVertices(void);
+			/**
+				Returns the angle column (null if it can't be mapped or there are no rows)
+			*/
+			const float* getAngles(void);
+			/**
+				Returns the score column (null if it can't be mapped or there are no rows)
+			*/
+			const float* getScores(void);
+			/**
+				Returns the confidence column (null if it can't be mapped or there are no rows)
+			*/
+			const float* getConfidences(void);
+			/**
+				Returns the image table (null if it can't be mapped or there are no images)
+			*/
+			const ImageEntry* getImages(void);
+			/**
+				Returns the UTF-8 word of the row (empty if the text column or the words can't be mapped)
+			*/
+			std::string getText(const uint64_t row);
+			/**
+				Returns the UTF-8 path of the image (empty if the image table or the paths can't be mapped)
+			*/
+			std::string getImage(const uint32_t image);
+
+		private:
+
+			/**
+				Maps the column once and checks that it holds the committed values (returns null on failure)
+			*/
+			const void* mapColumn(const RESULTS_COLUMN column);
+
+			std::wstring       mFolder;           // results folder
+			Header             mHeader;           // committed counts
+			System::MappedFile mFiles[RC_COUNT];  // mapped columns
+			bool               mMapped[RC_COUNT]; // has the column been checked?
+	};
+
+	//
+	// Global Functions
+	//
+
+	/**
+		Creates the results writer of the settings ([Results]), returns an empty pointer if the results are off
+
+		folder - results folder (empty uses [Results] Folder)
+	*/
+	std::unique_ptr<Writer> CreateWriter(const std::wstring& folder = std::wstring{});
+}
+
+#endif
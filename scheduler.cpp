@@ -0,0 +1,204 @@
+#include "scheduler.hpp"
+#include "error.hpp"
+#include "log.hpp"
+#include "system.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <exception>
+
+namespace
+{
+	//
+	// Local Variables
+	//
+	thread_local Scheduler::Pool* WorkerPool{ nullptr }; // pool of the calling worker
+	thread_local int              WorkerIndex{ -1 };     // index of the calling worker in its pool
+}
+
+//
+// Pool Class Member Functions
+//
+Scheduler::Pool::Pool(int workerCount) :
+	mWorkers(), mMutex(), mWake(), mIdle(), mQueued(0), mPending(0), mNext(0), mStop(false)
+{
+	if (workerCount <= 0) {
+		workerCount = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+
+	for (int i = 0; i < workerCount; ++i) {
+		mWorkers.push_back(std::unique_ptr<Worker>(new Worker()));
+		mWorkers.back()->mExecuted = 0;
+		mWorkers.back()->mStolen   = 0;
+	}
+
+	// threads start after every deque exists, they steal from each other right away
+	for (int i = 0; i < workerCount; ++i) {
+		mWorkers[i]->mThread = std::thread(&Pool::run, this, i);
+	}
+}
+
+Scheduler::Pool::~Pool()
+{
+	wait();
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStop = true;
+	}
+
+	mWake.notify_all();
+
+	for (auto& worker : mWorkers) {
+		if (worker->mThread.joinable()) {
+			worker->mThread.join();
+		}
+	}
+}
+
+void Scheduler::Pool::submit(Task task)
+{
+	size_t index;
+
+	if (WorkerPool == this) {
+		index = (size_t)WorkerIndex;
+	} else {
+		std::lock_guard<std::mutex> lock(mMutex);
+		index = mNext++ % mWorkers.size();
+	}
+
+	// counted before it is visible, so a thief can't finish it before it is pending
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		++mQueued;
+		++mPending;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mWorkers[index]->mMutex);
+		mWorkers[index]->mTasks.push_back(std::move(task));
+	}
+
+	mWake.notify_one();
+}
+
+void Scheduler::Pool::wait(void)
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+
+	mIdle.wait(lock, [this]() {
+		return mPending == 0;
+	});
+}
+
+int Scheduler::Pool::getWorkerCount(void) const
+{
+	return (int)mWorkers.size();
+}
+
+std::vector<Scheduler::WorkerStatistics> Scheduler::Pool::getStatistics(void) const
+{
+	std::vector<WorkerStatistics> statistics;
+
+	for (const auto& worker : mWorkers) {
+		statistics.push_back(WorkerStatistics{ worker->mExecuted.load(), worker->mStolen.load() });
+	}
+
+	return statistics;
+}
+
+void Scheduler::Pool::run(const int index)
+{
+	WorkerPool  = this;
+	WorkerIndex = index;
+
+	Trace::SetThreadName("worker " + std::to_string(index));
+
+	Task task;
+
+	for (;;) {
+		if (!take(index, task)) {
+			std::unique_lock<std::mutex> lock(mMutex);
+
+			mWake.wait(lock, [this]() {
+				return mStop || mQueued > 0;
+			});
+
+			if (mStop && mQueued == 0) {
+				break;
+			}
+
+			continue;
+		}
+
+		try {
+			task();
+		} catch (Error::Exception& ex) {
+			Log::Write("Task failed on worker " + std::to_string(index) + ": " + System::ConvertWstringToString(ex.getErrorMessage()));
+		} catch (std::exception& ex) {
+			Log::Write("Task failed on worker " + std::to_string(index) + ": " + ex.what());
+		}
+
+		// drop the captures before the task counts as done
+		task = nullptr;
+		++mWorkers[index]->mExecuted;
+
+		bool idle;
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			idle = --mPending == 0;
+		}
+
+		if (idle) {
+			mIdle.notify_all();
+		}
+	}
+
+	WorkerPool  = nullptr;
+	WorkerIndex = -1;
+}
+
+bool Scheduler::Pool::take(const int index, Task& task)
+{
+	bool found{ false };
+
+	// own deque, newest first
+	{
+		Worker&                     worker = *mWorkers[index];
+		std::lock_guard<std::mutex> lock(worker.mMutex);
+
+		if (!worker.mTasks.empty()) {
+			task = std::move(worker.mTasks.back());
+			worker.mTasks.pop_back();
+			found = true;
+		}
+	}
+
+	// other deques, oldest first, starting from the neighbour so the thieves spread out
+	for (size_t i = 1; !found && i < mWorkers.size(); ++i) {
+		Worker&                     victim = *mWorkers[(index + i) % mWorkers.size()];
+		std::lock_guard<std::mutex> lock(victim.mMutex);
+
+		if (!victim.mTasks.empty()) {
+			task = std::move(victim.mTasks.front());
+			victim.mTasks.pop_front();
+			found = true;
+			++mWorkers[index]->mStolen;
+		}
+	}
+
+	if (found) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		--mQueued;
+	}
+
+	return found;
+}
+
+//
+// Global Functions
+//
+int Scheduler::GetWorkerIndex(void)
+{
+	return WorkerIndex;
+}
\ No newline at end of file
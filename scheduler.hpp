@@ -0,0 +1,141 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "scheduler.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Task Scheduling Operations
+ *
+ * Structs(WorkerStatistics)
+ * Classes(Pool)
+ * Functions(GetWorkerIndex)
+ *
+ */
+
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include "main.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Scheduler
+{
+	//
+	// Global Definitions
+	//
+	typedef std::function<void(void)> Task;
+
+	//
+	// Structs
+	//
+
+	/**
+		Counters of a worker
+	*/
+	struct WorkerStatistics
+	{
+		size_t mExecuted; // tasks run by the worker
+		size_t mStolen;   // tasks the worker took from the other workers
+	};
+
+	//
+	// Classes
+	//
+
+	/**
+		Work-stealing thread pool
+
+		Every worker has its own deque. Tasks submitted by a worker go to the back of its deque and the worker takes them back
+		from there (newest first, so a task's children run while its data is still in the cache). A worker with an empty deque
+		steals from the front of the other deques (oldest first, which are the biggest pieces of work), so a dense image doesn't
+		leave the others idle. Tasks submitted from outside the pool are spread over the workers.
+	*/
+	class Pool
+	{
+		public:
+
+			/**
+				Starts the workers
+
+				workerCount - number of worker threads (0 uses the hardware threads)
+			*/
+			Pool(int workerCount = 0);
+			Pool(const Pool& pool) = delete;
+			/**
+				Waits for the queued tasks and stops the workers
+			*/
+			~Pool();
+
+			const Pool& operator=(const Pool& pool) = delete;
+
+			/**
+				Queues a task (to the deque of the calling worker, or to the next worker if it is called from outside the pool)
+
+				Exceptions of a task are logged, they don't stop the worker
+			*/
+			void submit(Task task);
+			/**
+				Blocks until every queued task and the tasks they submit are done (don't call from a worker)
+			*/
+			void wait(void);
+			/**
+				Returns the number of workers
+			*/
+			int getWorkerCount(void) const;
+			/**
+				Returns the counters of each worker
+			*/
+			std::vector<WorkerStatistics> getStatistics(void) const;
+
+		private:
+
+			struct Worker
+			{
+				std::mutex          mMutex;    // guards the deque
+				std::deque<Task>    mTasks;    // tasks of the worker
+				std::thread         mThread;   // thread of the worker
+				std::atomic<size_t> mExecuted; // tasks run by the worker
+				std::atomic<size_t> mStolen;   // tasks taken from the other workers
+			};
+
+			/**
+				Loop of a worker thread
+			*/
+			void run(const int index);
+			/**
+				Takes a task from the back of the worker's own deque or steals one from the front of another deque
+			*/
+			bool take(const int index, Task& task);
+
+			std::vector<std::unique_ptr<Worker> > mWorkers;   // workers of the pool
+			std::mutex                            mMutex;     // guards the counters below
+			std::condition_variable               mWake;      // signals queued tasks or the stop to idle workers
+			std::condition_variable               mIdle;      // signals that nothing is pending any more
+			size_t                                mQueued;    // tasks in the deques
+			size_t                                mPending;   // tasks queued or running
+			size_t                                mNext;      // next worker of a task submitted from outside
+			bool                                  mStop;      // workers leave when their deques are empty
+	};
+
+	//
+	// Global Functions
+	//
+
+	/**
+		Returns the index of the calling worker in its pool (-1 if the caller isn't a worker)
+
+		Engines that must stay on one thread (Tesseract) are kept per worker index
+	*/
+	int GetWorkerIndex(void);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,776 @@
+#include "search.hpp"
+#include "error.hpp"
+#include "log.hpp"
+#include "settings.hpp"
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cwctype>
+#include <unordered_map>
+
+namespace
+{
+	//
+	// Local Definitions
+	//
+	constexpr wchar_t SEGMENT_PATTERN[] = L"segment-*.kix"; // segment-<number>.kix, a higher number is a newer segment
+
+	//
+	// Local Classes
+	//
+
+	/**
+		Writes a segment file: postings are streamed to the file term by term, the tables follow at the end
+	*/
+	class SegmentBuilder
+	{
+		public:
+
+			SegmentBuilder() :
+				mTemporary(), mFile(nullptr), mImages(), mTerms(), mStrings(), mPostings(0), mWritten(true)
+			{}
+			SegmentBuilder(const SegmentBuilder& builder) = delete;
+			~SegmentBuilder()
+			{
+				if (mFile) {
+					std::fclose(mFile);
+					DeleteFileW(mTemporary.c_str());
+				}
+			}
+
+			const SegmentBuilder& operator=(const SegmentBuilder& builder) = delete;
+
+			/**
+				Creates the temporary file of the segment (returns false on failure)
+			*/
+			bool open(const std::wstring& temporary)
+			{
+				mTemporary = temporary;
+				mFile      = _wfopen(mTemporary.c_str(), L"wb");
+
+				// the header is written again at the end with the offsets
+				Search::SegmentHeader header{};
+				mWritten = mFile && std::fwrite(&header, sizeof(header), 1, mFile) == 1;
+
+				return mWritten;
+			}
+			/**
+				Adds an image and returns its ID
+			*/
+			uint32_t addImage(const std::string& path)
+			{
+				mImages.push_back(Search::ImageEntry{ mStrings.size(), (uint32_t)path.size(), 0 });
+				mStrings += path;
+
+				return (uint32_t)(mImages.size() - 1);
+			}
+			/**
+				Starts the postings of the next term (terms must come in sorted order)
+			*/
+			void addTerm(const std::string& term)
+			{
+				mTerms.push_back(Search::TermEntry{ mStrings.size(), mPostings, 0, (uint32_t)term.size(), 0 });
+				mStrings += term;
+			}
+			/**
+				Adds postings to the last term
+			*/
+			void addPostings(const Search::Posting* postings, const size_t count)
+			{
+				mWritten = mWritten && std::fwrite(postings, sizeof(Search::Posting), count, mFile) == count;
+
+				mTerms.back().mPostingCount += count;
+				mPostings                   += count;
+			}
+			/**
+				Writes the tables and the header and closes the temporary file (returns false on failure, the file is deleted then)
+			*/
+			bool finish(void)
+			{
+				// the terms of a compaction may end up without postings, they are dropped
+				mTerms.erase(std::remove_if(mTerms.begin(), mTerms.end(), [](const Search::TermEntry& term) { return term.mPostingCount == 0; }),
+				             mTerms.end());
+
+				// path order of the images, a path indexed twice keeps its IDs in order
+				std::vector<uint32_t> order(mImages.size());
+
+				for (size_t i = 0; i < order.size(); ++i) {
+					order[i] = (uint32_t)i;
+				}
+
+				std::stable_sort(order.begin(), order.end(), [this](const uint32_t first, const uint32_t second) {
+					return mStrings.compare(mImages[first].mPath, mImages[first].mLength, mStrings, mImages[second].mPath, mImages[second].mLength) < 0;
+				});
+
+				for (size_t i = 0; i < order.size(); ++i) {
+					mImages[i].mOrder = order[i];
+				}
+
+				Search::SegmentHeader header{};
+				header.mMagic        = Search::SEGMENT_MAGIC;
+				header.mVersion      = Search::SEGMENT_VERSION;
+				header.mImageCount   = mImages.size();
+				header.mTermCount    = mTerms.size();
+				header.mPostingCount = mPostings;
+				header.mPostings     = sizeof(header);
+				header.mImages       = header.mPostings + mPostings * sizeof(Search::Posting);
+				header.mTerms        = header.mImages + mImages.size() * sizeof(Search::ImageEntry);
+				header.mStrings      = header.mTerms + mTerms.size() * sizeof(Search::TermEntry);
+				header.mStringsSize  = mStrings.size();
+
+				bool written = mWritten && std::fwrite(mImages.data(), sizeof(Search::ImageEntry), mImages.size(), mFile) == mImages.size() &&
+				               std::fwrite(mTerms.data(), sizeof(Search::TermEntry), mTerms.size(), mFile) == mTerms.size() &&
+				               std::fwrite(mStrings.data(), 1, mStrings.size(), mFile) == mStrings.size() && _fseeki64(mFile, 0, SEEK_SET) == 0 &&
+				               std::fwrite(&header, sizeof(header), 1, mFile) == 1;
+
+				written = std::fclose(mFile) == 0 && written;
+				mFile   = nullptr;
+
+				if (!written) {
+					DeleteFileW(mTemporary.c_str());
+				}
+
+				return written;
+			}
+
+		private:
+
+			std::wstring                    mTemporary; // temporary path of the segment
+			FILE*                           mFile;      // temporary segment file
+			std::vector<Search::ImageEntry> mImages;    // image table
+			std::vector<Search::TermEntry>  mTerms;     // term table
+			std::string                     mStrings;   // paths and terms
+			uint64_t                        mPostings;  // postings written
+			bool                            mWritten;   // did every write succeed?
+	};
+
+	//
+	// Local Functions
+	//
+
+	/**
+		Returns the number of a segment file (0 if the name isn't a segment name)
+	*/
+	unsigned long GetSegmentNumber(const std::wstring& fileName)
+	{
+		const size_t name = fileName.find_last_of(L'\\');
+
+		return std::wcstoul(fileName.c_str() + (name == std::wstring::npos ? 0 : name + 1) + std::wcslen(L"segment-"), nullptr, 10);
+	}
+
+	/**
+		Returns the segment files of the folder, oldest first
+	*/
+	std::vector<std::wstring> ListSegments(const std::wstring& folder)
+	{
+		std::vector<std::wstring> segments = System::ListFiles(folder, { SEGMENT_PATTERN });
+
+		std::sort(segments.begin(), segments.end(), [](const std::wstring& first, const std::wstring& second) {
+			return GetSegmentNumber(first) < GetSegmentNumber(second);
+		});
+
+		return segments;
+	}
+
+	/**
+		Moves a finished segment to the next free segment number of the folder (returns false on failure, the segment is deleted then)
+
+		Shard processes may write to one index, a number another process took first is skipped
+	*/
+	bool PublishSegment(const std::wstring& temporary, const std::wstring& folder)
+	{
+		for (int attempt = 0; attempt < 8; ++attempt) {
+			const std::vector<std::wstring> segments = ListSegments(folder);
+			const unsigned long             number   = segments.empty() ? 1 : GetSegmentNumber(segments.back()) + 1;
+			wchar_t                         name[32];
+
+			std::swprintf(name, sizeof(name) / sizeof(name[0]), L"\\segment-%06lu.kix", number);
+
+			// without MOVEFILE_REPLACE_EXISTING the move fails if the name is taken
+			if (MoveFileExW(temporary.c_str(), (folder + name).c_str(), MOVEFILE_WRITE_THROUGH)) {
+				return true;
+			}
+		}
+
+		DeleteFileW(temporary.c_str());
+
+		return false;
+	}
+
+	/**
+		Returns the Turkish lower case of a UTF-16 character (I and İ fold to ı and i, not to i)
+	*/
+	wchar_t FoldCharacter(const wchar_t character)
+	{
+		switch (character) {
+			case L'I':
+				return 0x0131; // ı
+			case 0x0130: // İ
+				return L'i';
+			case 0x011E: // Ğ
+				return 0x011F;
+			case 0x015E: // Ş
+				return 0x015F;
+		}
+
+		// ASCII and Latin-1 upper case letters (Ç, Ö, Ü and the others), × isn't a letter
+		if ((character >= L'A' && character <= L'Z') || (character >= 0x00C0 && character <= 0x00DE && character != 0x00D7)) {
+			return character + 32;
+		}
+
+		return character;
+	}
+
+	/**
+		Returns true if the character is a part of a term (letters and digits, non-ASCII characters except punctuation)
+	*/
+	bool IsTermCharacter(const wchar_t character)
+	{
+		if (character < 0x80) {
+			return (character >= L'0' && character <= L'9') || (character >= L'a' && character <= L'z') || (character >= L'A' && character <= L'Z');
+		}
+
+		// Latin-1 punctuation and symbols (no-break space, « », §, ©, °), × and ÷, and the general punctuation block (dashes, quotes, ellipsis)
+		return character > 0x00BF && character != 0x00D7 && character != 0x00F7 && (character < 0x2000 || character > 0x206F);
+	}
+
+	/**
+		Returns true if the character is an apostrophe (’ or ')
+	*/
+	bool IsApostrophe(const wchar_t character)
+	{
+		return character == L'\'' || character == 0x2019;
+	}
+}
+
+//
+// Writer Class Member Functions
+//
+Search::Writer::Writer(const std::wstring& folder, const size_t flushPostings, const int flushSeconds) :
+	mFolder(folder), mFlushPostings(std::max<size_t>(1, flushPostings)), mFlushSeconds(std::max(0, flushSeconds)), mImages(), mTerms(), mPostings(0),
+	mLastFlush(cv::getTickCount()), mMutex()
+{
+	if (!CreateDirectoryW(mFolder.c_str(), NULL) && GetLastError() != ERROR_ALREADY_EXISTS) {
+		throw Error::Exception(L"Can't create the search index folder " + mFolder + L"!", L"Search Error");
+	}
+}
+
+Search::Writer::~Writer()
+{
+	flush();
+}
+
+void Search::Writer::add(const std::wstring& image, const std::vector<std::string>& words)
+{
+	// words are split and folded before the lock, the workers only wait for the postings
+	std::vector<std::vector<std::string> > terms(words.size());
+
+	for (size_t box = 0; box < words.size(); ++box) {
+		SplitTerms(words[box], terms[box]);
+	}
+
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	const uint32_t id = (uint32_t)mImages.size();
+	mImages.push_back(System::ConvertWstringToString(image));
+
+	for (size_t box = 0; box < terms.size(); ++box) {
+		for (const std::string& term : terms[box]) {
+			std::vector<Posting>& postings = mTerms[term];
+
+			// a term twice in a box is one posting
+			if (postings.empty() || postings.back().mImage != id || postings.back().mBox != (uint32_t)box) {
+				postings.push_back(Posting{ id, (uint32_t)box });
+				++mPostings;
+			}
+		}
+	}
+
+	const bool due = mFlushSeconds > 0 && (double)(cv::getTickCount() - mLastFlush) / cv::getTickFrequency() >= mFlushSeconds;
+
+	if (mPostings >= mFlushPostings || (due && mPostings > 0)) {
+		flushLocked();
+	}
+}
+
+bool Search::Writer::flush(void)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+
+	return flushLocked();
+}
+
+bool Search::Writer::flushLocked(void)
+{
+	mLastFlush = cv::getTickCount();
+
+	if (mImages.empty()) {
+		return true;
+	}
+
+	const std::wstring temporary = mFolder + L"\\segment.tmp" + std::to_wstring(GetCurrentProcessId());
+	SegmentBuilder     builder;
+	bool               written = builder.open(temporary);
+
+	for (size_t i = 0; written && i < mImages.size(); ++i) {
+		builder.addImage(mImages[i]);
+	}
+
+	// the map keeps the terms sorted by their bytes
+	for (auto term = mTerms.begin(); written && term != mTerms.end(); ++term) {
+		builder.addTerm(term->first);
+		builder.addPostings(term->second.data(), term->second.size());
+	}
+
+	if (written && builder.finish() && PublishSegment(temporary, mFolder)) {
+		Log::Write("Search index: " + std::to_string(mImages.size()) + " images, " + std::to_string(mTerms.size()) + " terms and " +
+		           std::to_string(mPostings) + " postings written to a new segment");
+
+		mImages.clear();
+		mTerms.clear();
+		mPostings = 0;
+
+		return true;
+	}
+
+	Log::Write("Search index segment can't be written to " + System::ConvertWstringToString(mFolder) + ", the postings are kept");
+
+	return false;
+}
+
+//
+// Segment Class Member Functions
+//
+Search::Segment::Segment() :
+	mFile(), mHeader(nullptr), mImages(nullptr), mTerms(nullptr), mPostings(nullptr), mStrings(nullptr), mOrder()
+{}
+
+bool Search::Segment::open(const std::wstring& fileName)
+{
+	if (!mFile.open(fileName) || mFile.getSize() < sizeof(SegmentHeader)) {
+		return false;
+	}
+
+	const unsigned char* data = mFile.getData();
+	const uint64_t       size = mFile.getSize();
+
+	mHeader = (const SegmentHeader*)data;
+
+	// every table must be inside the file, a half written segment never got its name but a copied one may be cut
+	if (mHeader->mMagic != SEGMENT_MAGIC || mHeader->mVersion < 1 || mHeader->mVersion > SEGMENT_VERSION || mHeader->mPostings > size ||
+	    mHeader->mPostingCount > (size - mHeader->mPostings) / sizeof(Posting) || mHeader->mImages > size ||
+	    mHeader->mImageCount > (size - mHeader->mImages) / sizeof(ImageEntry) || mHeader->mTerms > size ||
+	    mHeader->mTermCount > (size - mHeader->mTerms) / sizeof(TermEntry) || mHeader->mStrings > size || mHeader->mStringsSize > size - mHeader->mStrings) {
+		mFile.close();
+
+		return false;
+	}
+
+	mPostings = (const Posting*)(data + mHeader->mPostings);
+	mImages   = (const ImageEntry*)(data + mHeader->mImages);
+	mTerms    = (const TermEntry*)(data + mHeader->mTerms);
+	mStrings  = (const char*)(data + mHeader->mStrings);
+
+	for (uint64_t i = 0; i < mHeader->mTermCount; ++i) {
+		if (mTerms[i].mText + mTerms[i].mLength > mHeader->mStringsSize || mTerms[i].mFirstPosting + mTerms[i].mPostingCount > mHeader->mPostingCount) {
+			mFile.close();
+
+			return false;
+		}
+	}
+
+	for (uint64_t i = 0; i < mHeader->mImageCount; ++i) {
+		if (mImages[i].mPath + mImages[i].mLength > mHeader->mStringsSize || (mHeader->mVersion > 1 && mImages[i].mOrder >= mHeader->mImageCount)) {
+			mFile.close();
+
+			return false;
+		}
+	}
+
+	// a version 1 segment has no path order, it is sorted once here
+	if (mHeader->mVersion == 1) {
+		mOrder.resize((size_t)mHeader->mImageCount);
+
+		for (size_t i = 0; i < mOrder.size(); ++i) {
+			mOrder[i] = (uint32_t)i;
+		}
+
+		std::stable_sort(mOrder.begin(), mOrder.end(), [this](const uint32_t first, const uint32_t second) {
+			return comparePath(first, getImage(second)) < 0;
+		});
+	}
+
+	return true;
+}
+
+void Search::Segment::findTerms(const std::string& term, const bool prefix, size_t& first, size_t& last) const
+{
+	const TermEntry* begin = mTerms;
+	const TermEntry* end   = mTerms + mHeader->mTermCount;
+
+	// terms are compared as unsigned bytes, the order of std::string the writer sorted them in
+	auto compare = [this](const TermEntry& entry, const std::string& text) {
+		const int order = std::memcmp(mStrings + entry.mText, text.data(), std::min<size_t>(entry.mLength, text.size()));
+
+		return order < 0 || (order == 0 && entry.mLength < text.size());
+	};
+
+	const TermEntry* lower = std::lower_bound(begin, end, term, compare);
+	const TermEntry* upper = lower;
+
+	while (upper != end && upper->mLength >= term.size() && std::memcmp(mStrings + upper->mText, term.data(), term.size()) == 0 &&
+	       (prefix || upper->mLength == term.size())) {
+		++upper;
+	}
+
+	first = (size_t)(lower - begin);
+	last  = (size_t)(upper - begin);
+}
+
+const Search::SegmentHeader& Search::Segment::getHeader(void) const
+{
+	return *mHeader;
+}
+
+std::string Search::Segment::getTerm(const size_t term) const
+{
+	return getString(mTerms[term].mText, mTerms[term].mLength);
+}
+
+const Search::Posting* Search::Segment::getPostings(const size_t term, size_t& count) const
+{
+	count = (size_t)mTerms[term].mPostingCount;
+
+	return mPostings + mTerms[term].mFirstPosting;
+}
+
+std::string Search::Segment::getImage(const uint32_t image) const
+{
+	return getString(mImages[image].mPath, mImages[image].mLength);
+}
+
+bool Search::Segment::findImage(const std::string& path, uint32_t& image) const
+{
+	// the last position of the path holds its newest ID
+	size_t first = 0;
+	size_t last  = (size_t)mHeader->mImageCount;
+
+	while (first < last) {
+		const size_t middle = first + (last - first) / 2;
+
+		if (comparePath(getOrder(middle), path) <= 0) {
+			first = middle + 1;
+		} else {
+			last = middle;
+		}
+	}
+
+	if (first == 0 || comparePath(getOrder(first - 1), path) != 0) {
+		return false;
+	}
+
+	image = getOrder(first - 1);
+
+	return true;
+}
+
+std::string Search::Segment::getString(const uint64_t offset, const uint32_t length) const
+{
+	return std::string(mStrings + offset, length);
+}
+
+int Search::Segment::comparePath(const uint32_t image, const std::string& path) const
+{
+	const int order = std::memcmp(mStrings + mImages[image].mPath, path.data(), std::min<size_t>(mImages[image].mLength, path.size()));
+
+	return order != 0 ? order : (mImages[image].mLength < path.size() ? -1 : (mImages[image].mLength > path.size() ? 1 : 0));
+}
+
+uint32_t Search::Segment::getOrder(const size_t position) const
+{
+	return mOrder.empty() ? mImages[position].mOrder : mOrder[position];
+}
+
+//
+// Reader Class Member Functions
+//
+Search::Reader::Reader(const std::wstring& folder) :
+	mFileNames(), mSegments(), mImages(0)
+{
+	for (const std::wstring& fileName : ListSegments(folder)) {
+		std::unique_ptr<Segment> segment(new Segment());
+
+		if (!segment->open(fileName)) {
+			Log::Write("Search index segment " + System::ConvertWstringToString(fileName) + " is damaged and skipped");
+
+			continue;
+		}
+
+		mImages += (size_t)segment->getHeader().mImageCount;
+
+		mFileNames.push_back(fileName);
+		mSegments.push_back(std::move(segment));
+	}
+}
+
+size_t Search::Reader::find(const std::string& query, std::vector<Hit>& hits, const size_t limit) const
+{
+	hits.clear();
+
+	const bool  prefix = !query.empty() && query.back() == '*';
+	std::string term   = FoldTerm(prefix ? query.substr(0, query.size() - 1) : query);
+
+	if (term.empty()) {
+		return 0;
+	}
+
+	// an image is looked up in the newer segments once per query
+	std::unordered_map<uint64_t, bool> current;
+	size_t                             found{ 0 };
+
+	for (size_t i = 0; i < mSegments.size(); ++i) {
+		size_t first, last;
+		mSegments[i]->findTerms(term, prefix, first, last);
+
+		for (size_t entry = first; entry < last; ++entry) {
+			size_t         count;
+			const Posting* postings = mSegments[i]->getPostings(entry, count);
+			std::string    text;
+
+			for (size_t j = 0; j < count; ++j) {
+				const uint64_t key   = (uint64_t)i << 32 | postings[j].mImage;
+				auto           known = current.find(key);
+
+				if (known == current.end()) {
+					known = current.emplace(key, isCurrent(i, postings[j].mImage)).first;
+				}
+
+				if (!known->second) {
+					continue;
+				}
+
+				// only the stored hits pay for the strings
+				if (hits.size() < limit) {
+					if (text.empty()) {
+						text = mSegments[i]->getTerm(entry);
+					}
+
+					hits.push_back(Hit{ text, System::ConvertStringToWstring(mSegments[i]->getImage(postings[j].mImage)), postings[j].mBox });
+				}
+
+				++found;
+			}
+		}
+	}
+
+	return found;
+}
+
+size_t Search::Reader::getSegmentCount(void) const
+{
+	return mSegments.size();
+}
+
+size_t Search::Reader::getImageCount(void) const
+{
+	return mImages;
+}
+
+bool Search::Reader::isCurrent(const size_t segment, const uint32_t image) const
+{
+	const std::string path = mSegments[segment]->getImage(image);
+	uint32_t          newest;
+
+	// a path indexed twice in one segment is current at its last ID
+	if (mSegments[segment]->findImage(path, newest) && newest != image) {
+		return false;
+	}
+
+	for (size_t i = segment + 1; i < mSegments.size(); ++i) {
+		if (mSegments[i]->findImage(path, newest)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//
+// Global Functions
+//
+std::string Search::FoldTerm(const std::string& term)
+{
+	std::wstring wide = System::ConvertStringToWstring(term);
+	std::wstring folded;
+
+	folded.reserve(wide.size());
+
+	for (const wchar_t character : wide) {
+		// İ decomposed as I and a combining dot above folds to i
+		if (character == 0x0307 && !folded.empty() && folded.back() == 0x0131) {
+			folded.back() = L'i';
+
+			continue;
+		}
+
+		folded += FoldCharacter(character);
+	}
+
+	return System::ConvertWstringToString(folded);
+}
+
+void Search::SplitTerms(const std::string& word, std::vector<std::string>& terms)
+{
+	terms.clear();
+
+	const std::wstring wide = System::ConvertStringToWstring(word);
+	size_t             i{ 0 };
+
+	while (i < wide.size()) {
+		while (i < wide.size() && !IsTermCharacter(wide[i])) {
+			++i;
+		}
+
+		const size_t begin = i;
+
+		while (i < wide.size() && IsTermCharacter(wide[i])) {
+			++i;
+		}
+
+		if (i > begin) {
+			terms.push_back(FoldTerm(System::ConvertWstringToString(wide.substr(begin, i - begin))));
+		}
+
+		// Turkish suffixes of proper nouns follow an apostrophe, the term is the noun
+		if (i < wide.size() && IsApostrophe(wide[i])) {
+			while (i < wide.size() && !iswspace(wide[i])) {
+				++i;
+			}
+		}
+	}
+}
+
+std::unique_ptr<Search::Writer> Search::CreateWriter(void)
+{
+	if (!Settings::GetBool(L"Search", L"Enabled", false)) {
+		return std::unique_ptr<Writer>();
+	}
+
+	return std::unique_ptr<Writer>(new Writer(Settings::GetPath(L"Search", L"Index", L"katip_index"),
+	                                          (size_t)std::max(1, Settings::GetInt(L"Search", L"FlushPostings", 1000000)),
+	                                          Settings::GetInt(L"Search", L"FlushSeconds", 60)));
+}
+
+size_t Search::Compact(const std::wstring& folder)
+{
+	Reader reader(folder);
+
+	if (reader.mSegments.size() < 2) {
+		return reader.mSegments.size();
+	}
+
+	const std::wstring temporary = folder + L"\\segment.tmp" + std::to_wstring(GetCurrentProcessId());
+	SegmentBuilder     builder;
+
+	if (!builder.open(temporary)) {
+		throw Error::Exception(L"Can't create a segment in " + folder + L"!", L"Search Error");
+	}
+
+	//
+	// Current images get new IDs in segment order
+	//
+	std::vector<std::vector<bool> >     current(reader.mSegments.size());
+	std::vector<std::vector<uint32_t> > ids(reader.mSegments.size());
+
+	for (size_t i = 0; i < reader.mSegments.size(); ++i) {
+		const size_t count = (size_t)reader.mSegments[i]->getHeader().mImageCount;
+
+		current[i].assign(count, false);
+		ids[i].assign(count, 0);
+
+		for (size_t image = 0; image < count; ++image) {
+			if (reader.isCurrent(i, (uint32_t)image)) {
+				current[i][image] = true;
+				ids[i][image]     = builder.addImage(reader.mSegments[i]->getImage((uint32_t)image));
+			}
+		}
+	}
+
+	//
+	// Merge of the sorted term tables, the postings of a term stay sorted since the new IDs follow the segment order
+	//
+	std::vector<size_t>  positions(reader.mSegments.size(), 0);
+	std::vector<Posting> postings;
+
+	while (true) {
+		std::string term;
+		bool        found{ false };
+
+		for (size_t i = 0; i < reader.mSegments.size(); ++i) {
+			if (positions[i] < reader.mSegments[i]->getHeader().mTermCount) {
+				const std::string text = reader.mSegments[i]->getTerm(positions[i]);
+
+				if (!found || text < term) {
+					term  = text;
+					found = true;
+				}
+			}
+		}
+
+		if (!found) {
+			break;
+		}
+
+		builder.addTerm(term);
+
+		for (size_t i = 0; i < reader.mSegments.size(); ++i) {
+			if (positions[i] >= reader.mSegments[i]->getHeader().mTermCount || reader.mSegments[i]->getTerm(positions[i]) != term) {
+				continue;
+			}
+
+			size_t         count;
+			const Posting* source = reader.mSegments[i]->getPostings(positions[i]++, count);
+
+			postings.clear();
+
+			for (size_t j = 0; j < count; ++j) {
+				if (current[i][source[j].mImage]) {
+					postings.push_back(Posting{ ids[i][source[j].mImage], source[j].mBox });
+				}
+			}
+
+			builder.addPostings(postings.data(), postings.size());
+		}
+	}
+
+	if (!builder.finish()) {
+		throw Error::Exception(L"Can't write the compacted segment to " + folder + L"!", L"Search Error");
+	}
+
+	//
+	// The compacted segment takes the number of the newest merged segment, so the segments writers published while the
+	// compaction ran stay newer than it and keep hiding the older copies of their images
+	//
+	const size_t       merged = reader.mSegments.size();
+	const std::wstring newest = reader.mFileNames.back();
+
+	reader.mSegments.clear();
+
+	if (!MoveFileExW(temporary.c_str(), newest.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+		DeleteFileW(temporary.c_str());
+
+		throw Error::Exception(L"Can't replace " + newest + L" with the compacted segment, a reader may still have it open!", L"Search Error");
+	}
+
+	// a merged segment that can't be deleted now is hidden by the compacted one
+	for (size_t i = 0; i + 1 < reader.mFileNames.size(); ++i) {
+		const std::wstring& fileName = reader.mFileNames[i];
+
+		if (!DeleteFileW(fileName.c_str())) {
+			Log::Write("Search index segment " + System::ConvertWstringToString(fileName) + " can't be deleted after compaction");
+		}
+	}
+
+	return merged;
+}
\ No newline at end of file
@@ -0,0 +1,312 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "search.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Text Search Operations
+ *
+ * Structs(SegmentHeader, ImageEntry, TermEntry, Posting, Hit)
+ * Classes(Writer, Segment, Reader)
+ * Functions(FoldTerm, SplitTerms, CreateWriter, Compact)
+ *
+ */
+
+#ifndef SEARCH_HPP
+#define SEARCH_HPP
+
+#include "main.hpp"
+#include "system.hpp"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Search
+{
+	//
+	// Global Definitions
+	//
+	constexpr uint32_t SEGMENT_MAGIC   = 0x3158494B; // "KIX1"
+	constexpr uint32_t SEGMENT_VERSION = 2;          // version 1 segments have no path order, it is sorted when they are mapped
+
+	//
+	// Structs
+	//
+
+	/*
+		A segment file is written once and never changed:
+
+		SegmentHeader | Posting[mPostingCount] | ImageEntry[mImageCount] | TermEntry[mTermCount] | UTF-8 strings
+
+		Terms are sorted by their folded UTF-8 bytes, so a prefix is a range of terms, and the postings of a term are one
+		run sorted by image and box. The image table also holds the image IDs in path order, so a reader finds an image of
+		a newer segment by its path without reading every path. Every table is 8 byte aligned and read in place from the
+		mapped file (little endian).
+	*/
+
+	/**
+		Header of a segment file
+	*/
+	struct SegmentHeader
+	{
+		uint32_t mMagic;        // SEGMENT_MAGIC
+		uint32_t mVersion;      // SEGMENT_VERSION
+		uint64_t mImageCount;   // images of the segment
+		uint64_t mTermCount;    // distinct terms of the segment
+		uint64_t mPostingCount; // postings of all terms
+		uint64_t mImages;       // offset of the image table
+		uint64_t mTerms;        // offset of the term table
+		uint64_t mPostings;     // offset of the postings
+		uint64_t mStrings;      // offset of the strings
+		uint64_t mStringsSize;  // bytes of the strings
+	};
+
+	/**
+		An image of a segment (its ID is its position in the table)
+	*/
+	struct ImageEntry
+	{
+		uint64_t mPath;   // offset of the UTF-8 path in the strings
+		uint32_t mLength; // bytes of the path
+		uint32_t mOrder;  // ID of the image at this position in path order (zero in version 1)
+	};
+
+	/**
+		A term of a segment
+	*/
+	struct TermEntry
+	{
+		uint64_t mText;         // offset of the folded UTF-8 term in the strings
+		uint64_t mFirstPosting; // index of the first posting of the term
+		uint64_t mPostingCount; // postings of the term
+		uint32_t mLength;       // bytes of the term
+		uint32_t mReserved;     // zero
+	};
+
+	/**
+		An occurrence of a term
+	*/
+	struct Posting
+	{
+		uint32_t mImage; // image ID in the segment
+		uint32_t mBox;   // index of the box in the image (the order of the detector, empty words count)
+	};
+
+	/**
+		A match of a query
+	*/
+	struct Hit
+	{
+		std::string  mTerm;  // folded term that matched
+		std::wstring mImage; // path of the image
+		uint32_t     mBox;   // index of the box in the image
+	};
+
+	//
+	// Classes
+	//
+
+	/**
+		Builds the index of the processed images while a batch runs
+
+		Terms of the images are collected in memory and written as a new sorted segment file whenever [Search]
+		FlushPostings postings or FlushSeconds are reached, and when the batch finishes. Segments are never changed, so
+		readers can map them while the batch goes on. An image indexed again lands in a newer segment, which hides it in
+		the older ones.
+	*/
+	class Writer
+	{
+		public:
+
+			/**
+				Creates the index folder if it isn't there (throws Error::Exception if it can't be created)
+
+				folder        - index folder
+				flushPostings - postings collected before a segment is written
+				flushSeconds  - seconds after which collected postings are written (0 writes them only when full)
+			*/
+			Writer(const std::wstring& folder, const size_t flushPostings, const int flushSeconds);
+			Writer(const Writer& writer) = delete;
+			/**
+				Writes the collected postings
+			*/
+			~Writer();
+
+			const Writer& operator=(const Writer& writer) = delete;
+
+			/**
+				Adds the words of an image (thread safe)
+
+				image - path of the image
+				words - UTF-8 word of each box (box IDs are the positions)
+			*/
+			void add(const std::wstring& image, const std::vector<std::string>& words);
+			/**
+				Writes the collected postings as a new segment (returns false if the segment can't be written, the postings are kept)
+			*/
+			bool flush(void);
+
+		private:
+
+			/**
+				Writes the collected postings (mMutex must be locked)
+			*/
+			bool flushLocked(void);
+
+			std::wstring                                 mFolder;        // index folder
+			size_t                                       mFlushPostings; // postings collected before a segment is written
+			int                                          mFlushSeconds;  // seconds after which collected postings are written
+			std::vector<std::string>                     mImages;        // UTF-8 paths of the collected images (IDs are the positions)
+			std::map<std::string, std::vector<Posting> > mTerms;         // postings of each collected term
+			size_t                                       mPostings;      // collected postings
+			int64_t                                      mLastFlush;     // tick count of the last segment
+			std::mutex                                   mMutex;         // guards the members above
+	};
+
+	/**
+		A segment file mapped into memory
+	*/
+	class Segment
+	{
+		public:
+
+			Segment();
+			Segment(const Segment& segment) = delete;
+
+			const Segment& operator=(const Segment& segment) = delete;
+
+			/**
+				Maps the segment and checks its tables (returns false if it can't be mapped or is damaged)
+			*/
+			bool open(const std::wstring& fileName);
+			/**
+				Returns the range [first, last) of the terms equal to the term, or starting with it if prefix is set
+			*/
+			void findTerms(const std::string& term, const bool prefix, size_t& first, size_t& last) const;
+			/**
+				Returns the header of the segment
+			*/
+			const SegmentHeader& getHeader(void) const;
+			/**
+				Returns the folded term
+			*/
+			std::string getTerm(const size_t term) const;
+			/**
+				Returns the postings of the term (count is set to their number)
+			*/
+			const Posting* getPostings(const size_t term, size_t& count) const;
+			/**
+				Returns the UTF-8 path of the image
+			*/
+			std::string getImage(const uint32_t image) const;
+			/**
+				Finds an image by its UTF-8 path (returns false if the segment doesn't have it, image is set to the newest ID of the path)
+			*/
+			bool findImage(const std::string& path, uint32_t& image) const;
+
+		private:
+
+			/**
+				Returns the string at the offset of the strings
+			*/
+			std::string getString(const uint64_t offset, const uint32_t length) const;
+
+			/**
+				Compares the path of the image with a path as unsigned bytes
+			*/
+			int comparePath(const uint32_t image, const std::string& path) const;
+			/**
+				Returns the ID of the image at the position in path order
+			*/
+			uint32_t getOrder(const size_t position) const;
+
+			System::MappedFile    mFile;     // mapped segment file
+			const SegmentHeader*  mHeader;   // header of the segment
+			const ImageEntry*     mImages;   // image table
+			const TermEntry*      mTerms;    // term table
+			const Posting*        mPostings; // postings
+			const char*           mStrings;  // strings
+			std::vector<uint32_t> mOrder;    // image IDs in path order of a version 1 segment
+	};
+
+	/**
+		Answers term and prefix queries over all segments of an index
+	*/
+	class Reader
+	{
+		public:
+
+			/**
+				Maps the segments of the index folder, damaged segments are skipped and logged
+
+				The newest segment of an image hides the image in the older segments, only the images a query hits are looked
+				up in the newer segments
+			*/
+			Reader(const std::wstring& folder);
+			Reader(const Reader& reader) = delete;
+
+			const Reader& operator=(const Reader& reader) = delete;
+
+			/**
+				Finds the boxes of a query (returns the number of hits, at most limit are stored)
+
+				query - word, or a prefix ending with '*', folded like the indexed words
+				hits  - matches in segment, term, image and box order (replaced)
+			*/
+			size_t find(const std::string& query, std::vector<Hit>& hits, const size_t limit) const;
+			/**
+				Returns the number of mapped segments
+			*/
+			size_t getSegmentCount(void) const;
+			/**
+				Returns the number of images in all segments (an image indexed again counts in every segment that has it)
+			*/
+			size_t getImageCount(void) const;
+
+		private:
+
+			friend size_t Compact(const std::wstring& folder);
+
+			/**
+				Returns true if the image of the segment is the newest copy of its path (no newer segment or later ID has it)
+			*/
+			bool isCurrent(const size_t segment, const uint32_t image) const;
+
+			std::vector<std::wstring>              mFileNames; // paths of the mapped segments, oldest first
+			std::vector<std::unique_ptr<Segment> > mSegments;  // mapped segments, oldest first
+			size_t                                 mImages;    // images of all segments
+	};
+
+	//
+	// Global Functions
+	//
+
+	/**
+		Folds a UTF-8 term for the index with the Turkish rules: I becomes ı, İ becomes i, the other letters become lower case
+	*/
+	std::string FoldTerm(const std::string& term);
+	/**
+		Splits a recognized word into folded terms at spaces and punctuation, the suffix after an apostrophe is dropped
+		(İstanbul'da is indexed as istanbul)
+	*/
+	void SplitTerms(const std::string& word, std::vector<std::string>& terms);
+	/**
+		Creates the index writer of the settings ([Search]), returns an empty pointer if indexing is off
+	*/
+	std::unique_ptr<Writer> CreateWriter(void);
+	/**
+		Merges all segments of the index folder into one, drops the hidden images and deletes the merged segments
+		(returns the number of merged segments, throws Error::Exception if the merged segment can't be written)
+
+		The merged segment replaces the newest merged segment under its number, segments published while the compaction
+		runs stay newer
+	*/
+	size_t Compact(const std::wstring& folder);
+}
+
+#endif
\ No newline at end of file
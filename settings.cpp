@@ -0,0 +1,84 @@
+#include "settings.hpp"
+#include "system.hpp"
+#include <algorithm>
+#include <cwctype>
+
+//
+// Global Functions
+//
+std::wstring Settings::GetSettingsFile(void)
+{
+	return System::GetApplicationDirectory() + L"\\" + SETTINGS_FILE_NAME;
+}
+
+std::wstring Settings::GetString(const std::wstring& section, const std::wstring& key, const std::wstring& defaultValue)
+{
+	wchar_t buffer[1024] = { 0 };
+
+	GetPrivateProfileString(section.c_str(), key.c_str(), defaultValue.c_str(), buffer, 1024, GetSettingsFile().c_str());
+
+	if (buffer[0] == L'\0') {
+		return std::wstring{};
+	}
+
+	return System::TrimWideString(buffer);
+}
+
+int Settings::GetInt(const std::wstring& section, const std::wstring& key, const int defaultValue)
+{
+	std::wstring value = GetString(section, key);
+
+	if (value.empty()) {
+		return defaultValue;
+	}
+
+	try {
+		return std::stoi(value);
+	} catch (std::exception&) {
+		return defaultValue;
+	}
+}
+
+float Settings::GetFloat(const std::wstring& section, const std::wstring& key, const float defaultValue)
+{
+	std::wstring value = GetString(section, key);
+
+	if (value.empty()) {
+		return defaultValue;
+	}
+
+	try {
+		return std::stof(value);
+	} catch (std::exception&) {
+		return defaultValue;
+	}
+}
+
+bool Settings::GetBool(const std::wstring& section, const std::wstring& key, const bool defaultValue)
+{
+	std::wstring value = GetString(section, key);
+
+	if (value.empty()) {
+		return defaultValue;
+	}
+
+	std::transform(value.begin(), value.end(), value.begin(), towlower);
+
+	return value == L"1" || value == L"true" || value == L"yes" || value == L"on";
+}
+
+std::wstring Settings::GetPath(const std::wstring& section, const std::wstring& key, const std::wstring& defaultValue)
+{
+	std::wstring path = GetString(section, key, defaultValue);
+
+	if (path.empty()) {
+		return path;
+	}
+
+	//absolute paths (drive letter or UNC) are returned as they are
+	if ((path.size() > 1 && path[1] == L':') || (path.size() > 1 && path[0] == L'\\' && path[1] == L'\\')) {
+		return path;
+	}
+
+	return System::GetApplicationDirectory() + L"\\" + path;
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "settings.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Settings Operations
+ *
+ * Functions(GetSettingsFile, GetString, GetInt, GetFloat, GetBool, GetPath)
+ *
+ */
+
+#ifndef SETTINGS_HPP
+#define SETTINGS_HPP
+
+#include "main.hpp"
+#include <string>
+
+namespace Settings
+{
+	//
+	// Global Definitions
+	//
+	constexpr wchar_t SETTINGS_FILE_NAME[] = L"katip.ini";
+
+	//
+	// Global Functions
+	//
+
+	/**
+		Returns full path of the settings file (katip.ini in the application directory)
+	*/
+	std::wstring GetSettingsFile(void);
+	/**
+		Reads a string value from the settings file (returns defaultValue if the key is missing)
+
+		section      - section name of the key ([Section])
+		key          - name of the key
+		defaultValue - value to return if the key is not found
+	*/
+	std::wstring GetString(const std::wstring& section, const std::wstring& key, const std::wstring& defaultValue = std::wstring{});
+	/**
+		Reads an integer value from the settings file (returns defaultValue if the key is missing or invalid)
+	*/
+	int GetInt(const std::wstring& section, const std::wstring& key, const int defaultValue);
+	/**
+		Reads a floating point value from the settings file (returns defaultValue if the key is missing or invalid)
+	*/
+	float GetFloat(const std::wstring& section, const std::wstring& key, const float defaultValue);
+	/**
+		Reads a boolean value from the settings file (1, true, yes and on are accepted as true)
+	*/
+	bool GetBool(const std::wstring& section, const std::wstring& key, const bool defaultValue);
+	/**
+		Reads a file path from the settings file, relative paths are resolved against the application directory
+	*/
+	std::wstring GetPath(const std::wstring& section, const std::wstring& key, const std::wstring& defaultValue = std::wstring{});
+}
+
+#endif
\ No newline at end of file
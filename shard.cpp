@@ -0,0 +1,273 @@
+#include "shard.hpp"
+#include "batch.hpp"
+#include "error.hpp"
+#include "journal.hpp"
+#include "output.hpp"
+#include "system.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cwctype>
+
+namespace
+{
+	//
+	// Local Functions
+	//
+
+	/**
+		Writes the text to the file through a temporary file, so a reader never sees half of it (returns false on failure)
+	*/
+	bool WriteWholeFile(const std::wstring& fileName, const std::string& text)
+	{
+		const std::wstring temporary = fileName + L".tmp";
+		FILE*              file      = _wfopen(temporary.c_str(), L"wb");
+
+		if (!file) {
+			return false;
+		}
+
+		bool written = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+
+		if (std::fclose(file) != 0 || !written) {
+			DeleteFileW(temporary.c_str());
+
+			return false;
+		}
+
+		return MoveFileExW(temporary.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING) != FALSE;
+	}
+}
+
+//
+// Global Functions
+//
+size_t Sharding::GetShard(const std::wstring& entry, const size_t count)
+{
+	if (count < 2) {
+		return 0;
+	}
+
+	// paths are case insensitive on Windows and take both separators, scans\A.tif and Scans/a.tif are one image
+	std::wstring folded(entry);
+	std::transform(folded.begin(), folded.end(), folded.begin(), towlower);
+	std::replace(folded.begin(), folded.end(), L'/', L'\\');
+
+	const std::string path = System::ConvertWstringToString(folded);
+
+	return (size_t)(Checkpoint::HashBytes(path.data(), path.size()) % count);
+}
+
+std::vector<std::wstring> Sharding::SelectShard(const std::vector<std::wstring>& files, const std::vector<std::wstring>& entries, const size_t index,
+                                                 const size_t count)
+{
+	std::vector<std::wstring> selected;
+
+	for (size_t i = 0; i < files.size() && i < entries.size(); ++i) {
+		if (GetShard(entries[i], count) == index) {
+			selected.push_back(files[i]);
+		}
+	}
+
+	return selected;
+}
+
+std::wstring Sharding::GetShardPath(const std::wstring& manifest, const size_t index, const size_t count, const std::wstring& extension)
+{
+	return manifest + L".shard-" + std::to_wstring(index) + L"-of-" + std::to_wstring(count) + extension;
+}
+
+bool Sharding::WriteSummary(const std::wstring& fileName, const Summary& summary)
+{
+	char line[256];
+
+	std::snprintf(line, sizeof(line),
+	              "shard=%zu\r\ncount=%zu\r\nassigned=%zu\r\nskipped=%zu\r\nimages=%zu\r\nfailed=%zu\r\nboxes=%zu\r\nwords=%zu\r\nseconds=%.3f\r\n",
+	              summary.mIndex, summary.mCount, summary.mAssigned, summary.mSkipped, summary.mImages, summary.mFailed, summary.mBoxes, summary.mWords,
+	              summary.mSeconds);
+
+	std::string text = line;
+
+	for (const std::wstring& file : summary.mFailedFiles) {
+		text += "failed file=" + System::ConvertWstringToString(file) + "\r\n";
+	}
+
+	return WriteWholeFile(fileName, text);
+}
+
+bool Sharding::ReadSummary(const std::wstring& fileName, Summary& summary)
+{
+	std::vector<unsigned char> data;
+
+	if (!System::ReadFile(fileName, data)) {
+		return false;
+	}
+
+	summary = Summary{ 0, 0, 0, 0, 0, 0, 0, 0, 0.0, {} };
+
+	std::string text((const char*)data.data(), data.size());
+	size_t      begin{ 0 };
+
+	while (begin < text.size()) {
+		size_t end = text.find('\n', begin);
+
+		if (end == std::string::npos) {
+			end = text.size();
+		}
+
+		std::string line = text.substr(begin, end - begin);
+		begin            = end + 1;
+
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+
+		size_t separator = line.find('=');
+
+		if (separator == std::string::npos) {
+			continue;
+		}
+
+		const std::string key   = line.substr(0, separator);
+		const std::string value = line.substr(separator + 1);
+		const size_t      count = (size_t)std::strtoull(value.c_str(), nullptr, 10);
+
+		if (key == "shard") {
+			summary.mIndex = count;
+		} else if (key == "count") {
+			summary.mCount = count;
+		} else if (key == "assigned") {
+			summary.mAssigned = count;
+		} else if (key == "skipped") {
+			summary.mSkipped = count;
+		} else if (key == "images") {
+			summary.mImages = count;
+		} else if (key == "failed") {
+			summary.mFailed = count;
+		} else if (key == "boxes") {
+			summary.mBoxes = count;
+		} else if (key == "words") {
+			summary.mWords = count;
+		} else if (key == "seconds") {
+			summary.mSeconds = std::strtod(value.c_str(), nullptr);
+		} else if (key == "failed file") {
+			summary.mFailedFiles.push_back(System::ConvertStringToWstring(value));
+		}
+	}
+
+	return true;
+}
+
+Sharding::MergeStatistics Sharding::Merge(const std::wstring& manifest, const size_t count)
+{
+	const std::vector<std::wstring> files = Batch::ReadManifest(manifest);
+
+	MergeStatistics      statistics{ 0, {}, files.size(), 0, 0, 0, 0, 0, 0.0, manifest + L".words.txt", manifest + L".summary.txt", {} };
+	std::vector<Summary> summaries;
+
+	//
+	// Summaries of the shards
+	//
+	for (size_t i = 0; i < count; ++i) {
+		Summary summary;
+
+		if (!ReadSummary(GetShardPath(manifest, i, count, L".txt"), summary)) {
+			statistics.mMissingShards.push_back(i);
+
+			continue;
+		}
+
+		// every shard writes its own results folder, a writer can't share one
+		const std::wstring results    = GetShardPath(manifest, i, count, L".results");
+		const DWORD        attributes = GetFileAttributesW(results.c_str());
+
+		if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+			statistics.mResults.push_back(results);
+		}
+
+		statistics.mFailed  += summary.mFailed;
+		statistics.mBoxes   += summary.mBoxes;
+		statistics.mSeconds  = std::max(statistics.mSeconds, summary.mSeconds);
+		++statistics.mShards;
+
+		summaries.push_back(summary);
+	}
+
+	//
+	// Words of every image in manifest order, each image starts with a "# <path>" line
+	//
+	Output::WordWriter writer;
+
+	if (!writer.open(statistics.mOutput)) {
+		throw Error::Exception(L"Can't create " + statistics.mOutput + L"!", L"Merge Error");
+	}
+
+	std::vector<unsigned char> data;
+
+	for (const std::wstring& file : files) {
+		if (!System::ReadFile(Batch::GetWordsPath(file), data)) {
+			++statistics.mMissing;
+
+			continue;
+		}
+
+		writer.writeLine(("# " + System::ConvertWstringToString(file)).c_str());
+
+		// the words files have CR LF line breaks, the writer adds its own CR
+		std::string words((const char*)data.data(), data.size());
+		words.erase(std::remove(words.begin(), words.end(), '\r'), words.end());
+
+		if (!words.empty() && words.back() != '\n') {
+			words += '\n';
+		}
+
+		writer.write(words.data(), words.size());
+
+		statistics.mWords += (size_t)std::count(words.begin(), words.end(), '\n');
+		++statistics.mMerged;
+	}
+
+	if (!writer.close()) {
+		throw Error::Exception(L"Can't write " + statistics.mOutput + L"!", L"Merge Error");
+	}
+
+	//
+	// Summary of the whole manifest and a line per shard
+	//
+	char line[512];
+
+	std::snprintf(line, sizeof(line),
+	              "shards\t%zu of %zu\r\nimages\t%zu\r\nmerged\t%zu\r\nmissing\t%zu\r\nfailed\t%zu\r\nboxes\t%zu\r\nwords\t%zu\r\nseconds\t%.1f\r\n\r\n",
+	              statistics.mShards, count, statistics.mImages, statistics.mMerged, statistics.mMissing, statistics.mFailed, statistics.mBoxes,
+	              statistics.mWords, statistics.mSeconds);
+
+	std::string report = "manifest\t" + System::ConvertWstringToString(manifest) + "\r\n" + line;
+
+	report += "shard\tassigned\tskipped\timages\tfailed\tboxes\twords\tseconds\r\n";
+
+	for (const Summary& summary : summaries) {
+		std::snprintf(line, sizeof(line), "%zu\t%zu\t%zu\t%zu\t%zu\t%zu\t%zu\t%.1f\r\n", summary.mIndex, summary.mAssigned, summary.mSkipped, summary.mImages,
+		              summary.mFailed, summary.mBoxes, summary.mWords, summary.mSeconds);
+		report += line;
+	}
+
+	for (size_t index : statistics.mMissingShards) {
+		report += std::to_string(index) + "\tno summary\r\n";
+	}
+
+	for (const std::wstring& results : statistics.mResults) {
+		report += "results\t" + System::ConvertWstringToString(results) + "\r\n";
+	}
+
+	for (const Summary& summary : summaries) {
+		for (const std::wstring& file : summary.mFailedFiles) {
+			report += "failed\t" + System::ConvertWstringToString(file) + "\r\n";
+		}
+	}
+
+	if (!WriteWholeFile(statistics.mReport, report)) {
+		throw Error::Exception(L"Can't write " + statistics.mReport + L"!", L"Merge Error");
+	}
+
+	return statistics;
+}
\ No newline at end of file
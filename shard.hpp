@@ -0,0 +1,105 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "shard.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Manifest Sharding Operations
+ *
+ * Structs(Summary, MergeStatistics)
+ * Functions(GetShard, SelectShard, GetShardPath, WriteSummary, ReadSummary, Merge)
+ *
+ */
+
+#ifndef SHARD_HPP
+#define SHARD_HPP
+
+#include "main.hpp"
+#include <string>
+#include <vector>
+
+namespace Sharding
+{
+	//
+	// Structs
+	//
+
+	/**
+		Result of a shard run
+	*/
+	struct Summary
+	{
+		size_t                    mIndex;       // index of the shard
+		size_t                    mCount;       // number of shards
+		size_t                    mAssigned;    // images of the manifest in the shard
+		size_t                    mSkipped;     // images finished by an earlier run of the shard
+		size_t                    mImages;      // images processed by this run
+		size_t                    mFailed;      // images that failed in this run
+		size_t                    mBoxes;       // detected boxes
+		size_t                    mWords;       // recognized words
+		double                    mSeconds;     // wall time of the run
+		std::vector<std::wstring> mFailedFiles; // images that failed in this run
+	};
+
+	/**
+		Result of merging the shards of a manifest
+	*/
+	struct MergeStatistics
+	{
+		size_t                    mShards;        // shards with a summary
+		std::vector<size_t>       mMissingShards; // shards without a summary
+		size_t                    mImages;        // images of the manifest
+		size_t                    mMerged;        // images whose words are in the merged output
+		size_t                    mMissing;       // images without a words file
+		size_t                    mFailed;        // images the shards reported as failed
+		size_t                    mBoxes;         // boxes detected by the shards
+		size_t                    mWords;         // words in the merged output
+		double                    mSeconds;       // wall time of the slowest shard
+		std::wstring              mOutput;        // merged words (<manifest>.words.txt)
+		std::wstring              mReport;        // merged summary (<manifest>.summary.txt)
+		std::vector<std::wstring> mResults;       // results folders the shards wrote (<manifest>.shard-<index>-of-<count>.results)
+	};
+
+	//
+	// Global Functions
+	//
+
+	/**
+		Returns the shard of a manifest entry (FNV-1a hash of the entry in lower case with / as \ modulo the count)
+
+		The shard only depends on the line of the manifest, not on where the manifest is or how its path was given, so
+		every process and every node agrees on it without talking to the others
+	*/
+	size_t GetShard(const std::wstring& entry, const size_t count);
+	/**
+		Returns the images of the shard in manifest order
+
+		files   - images of the manifest
+		entries - manifest entry of each image (Batch::ReadManifest)
+	*/
+	std::vector<std::wstring> SelectShard(const std::vector<std::wstring>& files, const std::vector<std::wstring>& entries, const size_t index,
+	                                      const size_t count);
+	/**
+		Returns the path of a file of the shard next to the manifest (<manifest>.shard-<index>-of-<count><extension>)
+	*/
+	std::wstring GetShardPath(const std::wstring& manifest, const size_t index, const size_t count, const std::wstring& extension);
+	/**
+		Writes the summary of a shard run (returns false on failure)
+	*/
+	bool WriteSummary(const std::wstring& fileName, const Summary& summary);
+	/**
+		Reads the summary of a shard run (returns false if it can't be read)
+	*/
+	bool ReadSummary(const std::wstring& fileName, Summary& summary);
+	/**
+		Merges the words of the images in manifest order into <manifest>.words.txt and the shard summaries into
+		<manifest>.summary.txt (throws Error::Exception if an output can't be written)
+
+		The merged files only depend on the manifest and the words files, not on the order the shards finished in
+	*/
+	MergeStatistics Merge(const std::wstring& manifest, const size_t count);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,397 @@
+#include "spatial.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+
+namespace
+{
+	//
+	// Local Definitions
+	//
+	constexpr uint32_t HILBERT_SIZE = 65536; // side of the Hilbert grid the box centers are put on
+
+	//
+	// Local Functions
+	//
+
+	/**
+		Returns the distance of the cell along the Hilbert curve of the grid
+	*/
+	uint64_t GetHilbertValue(uint32_t x, uint32_t y)
+	{
+		uint64_t value{ 0 };
+
+		for (uint32_t side = HILBERT_SIZE / 2; side > 0; side /= 2) {
+			const uint32_t rx = (x & side) ? 1 : 0;
+			const uint32_t ry = (y & side) ? 1 : 0;
+
+			value += (uint64_t)side * side * ((3 * rx) ^ ry);
+
+			// the quadrant is turned so the curve inside it starts where the last one ended
+			if (ry == 0) {
+				if (rx == 1) {
+					x = HILBERT_SIZE - 1 - x;
+					y = HILBERT_SIZE - 1 - y;
+				}
+
+				std::swap(x, y);
+			}
+		}
+
+		return value;
+	}
+
+	/**
+		Sets the node bounds to the axis-aligned bounds of the box
+	*/
+	void GetBounds(const Spatial::BoxRecord& box, Spatial::Node& bounds)
+	{
+		bounds.mLeft = bounds.mRight = box.mVertices[0];
+		bounds.mTop = bounds.mBottom = box.mVertices[1];
+
+		for (int j = 1; j < 4; ++j) {
+			bounds.mLeft   = std::min(bounds.mLeft, box.mVertices[j * 2]);
+			bounds.mRight  = std::max(bounds.mRight, box.mVertices[j * 2]);
+			bounds.mTop    = std::min(bounds.mTop, box.mVertices[j * 2 + 1]);
+			bounds.mBottom = std::max(bounds.mBottom, box.mVertices[j * 2 + 1]);
+		}
+	}
+
+	/**
+		Grows the bounds of the node to hold the other bounds
+	*/
+	void AddBounds(Spatial::Node& node, const Spatial::Node& bounds)
+	{
+		node.mLeft   = std::min(node.mLeft, bounds.mLeft);
+		node.mTop    = std::min(node.mTop, bounds.mTop);
+		node.mRight  = std::max(node.mRight, bounds.mRight);
+		node.mBottom = std::max(node.mBottom, bounds.mBottom);
+	}
+
+	/**
+		Returns true if the bounds overlap the region (touching edges count)
+	*/
+	bool Overlaps(const Spatial::Node& bounds, const cv::Rect2f& region)
+	{
+		return bounds.mLeft <= region.x + region.width && bounds.mRight >= region.x && bounds.mTop <= region.y + region.height && bounds.mBottom >= region.y;
+	}
+
+	/**
+		Returns true if the rotated box intersects the region
+	*/
+	bool Intersects(const Spatial::BoxRecord& box, const cv::Rect2f& region)
+	{
+		Spatial::Node bounds;
+		GetBounds(box, bounds);
+
+		// the axes of the region are the axis-aligned bounds, the axes of the box are the normals of two of its edges
+		if (!Overlaps(bounds, region)) {
+			return false;
+		}
+
+		const float corners[8] = { region.x, region.y, region.x + region.width, region.y, region.x + region.width, region.y + region.height, region.x,
+		                           region.y + region.height };
+
+		for (int edge = 0; edge < 2; ++edge) {
+			const float normalX = box.mVertices[edge * 2 + 3] - box.mVertices[edge * 2 + 1];
+			const float normalY = box.mVertices[edge * 2] - box.mVertices[edge * 2 + 2];
+
+			float boxMin{ std::numeric_limits<float>::max() }, boxMax{ std::numeric_limits<float>::lowest() };
+			float regionMin{ std::numeric_limits<float>::max() }, regionMax{ std::numeric_limits<float>::lowest() };
+
+			for (int j = 0; j < 4; ++j) {
+				const float boxProjection    = box.mVertices[j * 2] * normalX + box.mVertices[j * 2 + 1] * normalY;
+				const float regionProjection = corners[j * 2] * normalX + corners[j * 2 + 1] * normalY;
+
+				boxMin    = std::min(boxMin, boxProjection);
+				boxMax    = std::max(boxMax, boxProjection);
+				regionMin = std::min(regionMin, regionProjection);
+				regionMax = std::max(regionMax, regionProjection);
+			}
+
+			if (boxMax < regionMin || regionMax < boxMin) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+//
+// BoxIndex Class Member Functions
+//
+Spatial::BoxIndex::BoxIndex() :
+	mFile(), mHeader(nullptr), mBoxes(nullptr), mNodes(nullptr), mStrings(nullptr)
+{
+}
+
+bool Spatial::BoxIndex::open(const std::wstring& fileName)
+{
+	if (!mFile.open(fileName) || mFile.getSize() < sizeof(BoxHeader)) {
+		mFile.close();
+
+		return false;
+	}
+
+	const unsigned char* data = mFile.getData();
+	const uint64_t       size = mFile.getSize();
+
+	mHeader = (const BoxHeader*)data;
+
+	if (mHeader->mMagic != BOXES_MAGIC || mHeader->mVersion != BOXES_VERSION || mHeader->mBoxes > size ||
+	    mHeader->mBoxCount > (size - mHeader->mBoxes) / sizeof(BoxRecord) || mHeader->mNodes > size ||
+	    mHeader->mNodeCount > (size - mHeader->mNodes) / sizeof(Node) || mHeader->mLeafCount > mHeader->mNodeCount || mHeader->mStrings > size ||
+	    mHeader->mStringsSize > size - mHeader->mStrings) {
+		mFile.close();
+
+		return false;
+	}
+
+	mBoxes   = (const BoxRecord*)(data + mHeader->mBoxes);
+	mNodes   = (const Node*)(data + mHeader->mNodes);
+	mStrings = (const char*)(data + mHeader->mStrings);
+
+	for (uint32_t i = 0; i < mHeader->mBoxCount; ++i) {
+		if ((uint64_t)mBoxes[i].mText + mBoxes[i].mLength > mHeader->mStringsSize) {
+			mFile.close();
+
+			return false;
+		}
+	}
+
+	// the children of a node come before it, so a damaged file can't send a query around in circles (the leaves are nodes too,
+	// the first inner level points at them), and the root is the last node
+	if (mHeader->mNodeCount && (mHeader->mLeafCount == 0 || (mHeader->mNodeCount > 1 && mHeader->mLeafCount == mHeader->mNodeCount))) {
+		mFile.close();
+
+		return false;
+	}
+
+	for (uint32_t i = 0; i < mHeader->mNodeCount; ++i) {
+		const uint64_t last = (uint64_t)mNodes[i].mFirst + mNodes[i].mCount;
+
+		if (mNodes[i].mCount == 0 || (i < mHeader->mLeafCount ? last > mHeader->mBoxCount : last > i)) {
+			mFile.close();
+
+			return false;
+		}
+	}
+
+	return true;
+}
+
+size_t Spatial::BoxIndex::query(const cv::Rect2f& region, std::vector<Word>& words) const
+{
+	words.clear();
+
+	if (!mFile.getData() || mHeader->mNodeCount == 0) {
+		return 0;
+	}
+
+	Trace::Span span("region query");
+
+	std::vector<uint32_t> stack(1, mHeader->mNodeCount - 1);
+
+	while (!stack.empty()) {
+		const uint32_t index = stack.back();
+		const Node&    node  = mNodes[index];
+
+		stack.pop_back();
+
+		if (!Overlaps(node, region)) {
+			continue;
+		}
+
+		if (index >= mHeader->mLeafCount) {
+			for (uint32_t child = node.mFirst; child < node.mFirst + node.mCount; ++child) {
+				stack.push_back(child);
+			}
+
+			continue;
+		}
+
+		for (uint32_t i = node.mFirst; i < node.mFirst + node.mCount; ++i) {
+			const BoxRecord& box = mBoxes[i];
+
+			if (!Intersects(box, region)) {
+				continue;
+			}
+
+			Word word;
+
+			for (int j = 0; j < 4; ++j) {
+				word.mBox.mVertices[j] = cv::Point2f(box.mVertices[j * 2], box.mVertices[j * 2 + 1]);
+			}
+
+			word.mBox.mConfidence = box.mConfidence;
+			word.mIndex           = box.mIndex;
+			word.mText.assign(mStrings + box.mText, box.mLength);
+
+			words.push_back(word);
+		}
+	}
+
+	std::sort(words.begin(), words.end(), [](const Word& first, const Word& second) { return first.mIndex < second.mIndex; });
+
+	return words.size();
+}
+
+size_t Spatial::BoxIndex::read(std::vector<Word>& words) const
+{
+	words.clear();
+
+	if (!mFile.getData()) {
+		return 0;
+	}
+
+	words.resize(mHeader->mBoxCount);
+
+	for (uint32_t i = 0; i < mHeader->mBoxCount; ++i) {
+		const BoxRecord& box  = mBoxes[i];
+		Word&            word = words[i];
+
+		for (int j = 0; j < 4; ++j) {
+			word.mBox.mVertices[j] = cv::Point2f(box.mVertices[j * 2], box.mVertices[j * 2 + 1]);
+		}
+
+		word.mBox.mConfidence = box.mConfidence;
+		word.mIndex           = box.mIndex;
+		word.mText.assign(mStrings + box.mText, box.mLength);
+	}
+
+	std::sort(words.begin(), words.end(), [](const Word& first, const Word& second) { return first.mIndex < second.mIndex; });
+
+	return words.size();
+}
+
+const Spatial::BoxHeader& Spatial::BoxIndex::getHeader(void) const
+{
+	return *mHeader;
+}
+
+//
+// Global Functions
+//
+bool Spatial::WriteBoxes(const std::wstring& fileName, const cv::Size& size, const std::vector<Detection::Box>& boxes, const std::vector<std::string>& words)
+{
+	Trace::Span span("write boxes");
+
+	//
+	// Boxes in Hilbert order of their centers, boxes next to each other on the page land in the same leaf
+	//
+	const float           scaleX = (float)(HILBERT_SIZE - 1) / (float)std::max(1, size.width);
+	const float           scaleY = (float)(HILBERT_SIZE - 1) / (float)std::max(1, size.height);
+	std::vector<uint64_t> values(boxes.size());
+	std::vector<uint32_t> order(boxes.size());
+
+	for (size_t i = 0; i < boxes.size(); ++i) {
+		cv::Point2f center(0.0f, 0.0f);
+
+		for (const cv::Point2f& vertex : boxes[i].mVertices) {
+			center += vertex * 0.25f;
+		}
+
+		const float x = std::max(0.0f, std::min((float)(HILBERT_SIZE - 1), center.x * scaleX));
+		const float y = std::max(0.0f, std::min((float)(HILBERT_SIZE - 1), center.y * scaleY));
+
+		values[i] = GetHilbertValue((uint32_t)x, (uint32_t)y);
+		order[i]  = (uint32_t)i;
+	}
+
+	std::sort(order.begin(), order.end(), [&values](const uint32_t first, const uint32_t second) {
+		return values[first] != values[second] ? values[first] < values[second] : first < second;
+	});
+
+	std::vector<BoxRecord> records(boxes.size());
+	std::string            strings;
+
+	for (size_t i = 0; i < order.size(); ++i) {
+		const Detection::Box& box    = boxes[order[i]];
+		const std::string&    word   = order[i] < words.size() ? words[order[i]] : std::string{};
+		BoxRecord&            record = records[i];
+
+		for (int j = 0; j < 4; ++j) {
+			record.mVertices[j * 2]     = box.mVertices[j].x;
+			record.mVertices[j * 2 + 1] = box.mVertices[j].y;
+		}
+
+		record.mConfidence = box.mConfidence;
+		record.mIndex      = order[i];
+		record.mText       = (uint32_t)strings.size();
+		record.mLength     = (uint32_t)word.size();
+
+		strings += word;
+	}
+
+	//
+	// Leaves of NODE_FANOUT boxes, then every level packs NODE_FANOUT nodes of the level below until one root is left
+	//
+	std::vector<Node> nodes;
+	Node              bounds;
+
+	for (size_t first = 0; first < records.size(); first += NODE_FANOUT) {
+		Node node;
+		GetBounds(records[first], node);
+
+		node.mFirst = (uint32_t)first;
+		node.mCount = (uint32_t)std::min<size_t>(NODE_FANOUT, records.size() - first);
+
+		for (uint32_t i = 1; i < node.mCount; ++i) {
+			GetBounds(records[first + i], bounds);
+			AddBounds(node, bounds);
+		}
+
+		nodes.push_back(node);
+	}
+
+	const uint32_t leaves = (uint32_t)nodes.size();
+	size_t         begin{ 0 }, end{ nodes.size() };
+
+	while (end - begin > 1) {
+		for (size_t first = begin; first < end; first += NODE_FANOUT) {
+			Node node = nodes[first];
+
+			node.mFirst = (uint32_t)first;
+			node.mCount = (uint32_t)std::min<size_t>(NODE_FANOUT, end - first);
+
+			for (uint32_t i = 1; i < node.mCount; ++i) {
+				AddBounds(node, nodes[first + i]);
+			}
+
+			nodes.push_back(node);
+		}
+
+		begin = end;
+		end   = nodes.size();
+	}
+
+	BoxHeader header{};
+	header.mMagic       = BOXES_MAGIC;
+	header.mVersion     = BOXES_VERSION;
+	header.mWidth       = (uint32_t)std::max(0, size.width);
+	header.mHeight      = (uint32_t)std::max(0, size.height);
+	header.mBoxCount    = (uint32_t)records.size();
+	header.mNodeCount   = (uint32_t)nodes.size();
+	header.mLeafCount   = leaves;
+	header.mFanout      = NODE_FANOUT;
+	header.mBoxes       = sizeof(BoxHeader);
+	header.mNodes       = header.mBoxes + records.size() * sizeof(BoxRecord);
+	header.mStrings     = header.mNodes + nodes.size() * sizeof(Node);
+	header.mStringsSize = strings.size();
+
+	FILE* file = _wfopen(fileName.c_str(), L"wb");
+
+	if (!file) {
+		return false;
+	}
+
+	bool written = std::fwrite(&header, sizeof(header), 1, file) == 1;
+
+	written = written && std::fwrite(records.data(), sizeof(BoxRecord), records.size(), file) == records.size();
+	written = written && std::fwrite(nodes.data(), sizeof(Node), nodes.size(), file) == nodes.size();
+	written = written && std::fwrite(strings.data(), 1, strings.size(), file) == strings.size();
+
+	return std::fclose(file) == 0 && written;
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "spatial.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Spatial Index Operations
+ *
+ * Structs(BoxHeader, BoxRecord, Node, Word)
+ * Classes(BoxIndex)
+ * Functions(WriteBoxes)
+ *
+ */
+
+#ifndef SPATIAL_HPP
+#define SPATIAL_HPP
+
+#include "main.hpp"
+#include "detector.hpp"
+#include "system.hpp"
+#include <opencv2/core.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Spatial
+{
+	//
+	// Global Definitions
+	//
+	constexpr uint32_t BOXES_MAGIC   = 0x3158424B; // "KBX1"
+	constexpr uint32_t BOXES_VERSION = 1;
+	constexpr uint32_t NODE_FANOUT   = 16;         // children of a node
+
+	//
+	// Structs
+	//
+
+	/*
+		A boxes file is written once for an image:
+
+		BoxHeader | BoxRecord[mBoxCount] | Node[mNodeCount] | UTF-8 strings
+
+		The boxes are sorted along a Hilbert curve by their centers and packed NODE_FANOUT to a leaf, the leaves are packed
+		the same way into their parents up to one root (a packed Hilbert R-tree). Leaves come first and the root is the
+		last node, a node below mLeafCount holds boxes and the others hold nodes. Every table is 8 byte aligned and read in
+		place from the mapped file (little endian).
+	*/
+
+	/**
+		Header of a boxes file
+	*/
+	struct BoxHeader
+	{
+		uint32_t mMagic;       // BOXES_MAGIC
+		uint32_t mVersion;     // BOXES_VERSION
+		uint32_t mWidth;       // width of the image in pixels
+		uint32_t mHeight;      // height of the image in pixels
+		uint32_t mBoxCount;    // boxes of the image
+		uint32_t mNodeCount;   // nodes of the tree (0 if there are no boxes)
+		uint32_t mLeafCount;   // nodes holding boxes
+		uint32_t mFanout;      // NODE_FANOUT of the writer
+		uint64_t mBoxes;       // offset of the boxes
+		uint64_t mNodes;       // offset of the nodes
+		uint64_t mStrings;     // offset of the strings
+		uint64_t mStringsSize; // bytes of the strings
+	};
+
+	/**
+		A box of the image
+	*/
+	struct BoxRecord
+	{
+		float    mVertices[8]; // x and y of the four corners in image pixels
+		float    mConfidence;  // score of the box
+		uint32_t mIndex;       // index of the box in the image (the order of the detector, empty words count)
+		uint32_t mText;        // offset of the UTF-8 word in the strings
+		uint32_t mLength;      // bytes of the word (0 if nothing was recognized)
+	};
+
+	/**
+		A node of the tree
+	*/
+	struct Node
+	{
+		float    mLeft;   // left of the axis-aligned bounds of the children
+		float    mTop;    // top of the bounds
+		float    mRight;  // right of the bounds
+		float    mBottom; // bottom of the bounds
+		uint32_t mFirst;  // first box (leaf) or node of the children
+		uint32_t mCount;  // children
+	};
+
+	/**
+		A word found by a region query
+	*/
+	struct Word
+	{
+		Detection::Box mBox;   // rotated box in image pixels
+		uint32_t       mIndex; // index of the box in the image
+		std::string    mText;  // UTF-8 word (empty if nothing was recognized)
+	};
+
+	//
+	// Classes
+	//
+
+	/**
+		A boxes file mapped into memory that answers region queries
+
+		A query walks down the nodes whose bounds overlap the region and tests the rotated boxes of the reached leaves
+		exactly, so it touches a few nodes of a page with thousands of words instead of every box.
+	*/
+	class BoxIndex
+	{
+		public:
+
+			BoxIndex();
+			BoxIndex(const BoxIndex& index) = delete;
+
+			const BoxIndex& operator=(const BoxIndex& index) = delete;
+
+			/**
+				Maps the boxes file and checks its tables (returns false if it can't be mapped or is damaged)
+			*/
+			bool open(const std::wstring& fileName);
+			/**
+				Finds the boxes intersecting the region (returns their number)
+
+				region - rectangle in image pixels
+				words  - boxes and words in box index order (replaced)
+			*/
+			size_t query(const cv::Rect2f& region, std::vector<Word>& words) const;
+			/**
+				Returns every box of the file (returns their number)
+
+				words - boxes and words in box index order (replaced)
+			*/
+			size_t read(std::vector<Word>& words) const;
+			/**
+				Returns the header of the boxes file
+			*/
+			const BoxHeader& getHeader(void) const;
+
+		private:
+
+			System::MappedFile mFile;    // mapped boxes file
+			const BoxHeader*   mHeader;  // header of the file
+			const BoxRecord*   mBoxes;   // boxes in Hilbert order
+			const Node*        mNodes;   // nodes, root last
+			const char*        mStrings; // strings
+	};
+
+	//
+	// Global Functions
+	//
+
+	/**
+		Writes the boxes and their words with their tree to a boxes file (returns false if the file can't be written)
+
+		size  - size of the image the boxes are on
+		boxes - boxes of the image
+		words - UTF-8 word of each box
+	*/
+	bool WriteBoxes(const std::wstring& fileName, const cv::Size& size, const std::vector<Detection::Box>& boxes, const std::vector<std::string>& words);
+}
+
+#endif
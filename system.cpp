@@ -3,8 +3,198 @@
 #include "system.hpp"
 #include "gui.hpp"
 #include "error.hpp"
-#include <clocale>
-#include <locale>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+	//
+	// Local Definitions
+	//
+	constexpr char32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+	//
+	// Local Functions
+	//
+
+	/**
+		Decodes the UTF-8 sequence at position and moves the position after it
+
+		Overlong forms, surrogates, code points above U+10FFFF and truncated sequences give U+FFFD (one byte is skipped)
+	*/
+	char32_t DecodeUtf8(const unsigned char* text, const size_t length, size_t& position)
+	{
+		const unsigned char lead = text[position++];
+
+		if (lead < 0x80) {
+			return lead;
+		}
+
+		size_t   count;
+		char32_t codePoint;
+		char32_t minimum;
+
+		if ((lead & 0xE0) == 0xC0) {
+			count = 1; codePoint = lead & 0x1F; minimum = 0x80;
+		} else if ((lead & 0xF0) == 0xE0) {
+			count = 2; codePoint = lead & 0x0F; minimum = 0x800;
+		} else if ((lead & 0xF8) == 0xF0) {
+			count = 3; codePoint = lead & 0x07; minimum = 0x10000;
+		} else {
+			return REPLACEMENT_CHARACTER;
+		}
+
+		if (position + count > length) {
+			return REPLACEMENT_CHARACTER;
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			if ((text[position + i] & 0xC0) != 0x80) {
+				return REPLACEMENT_CHARACTER;
+			}
+
+			codePoint = (codePoint << 6) | (text[position + i] & 0x3F);
+		}
+
+		if (codePoint < minimum || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+			return REPLACEMENT_CHARACTER;
+		}
+
+		position += count;
+
+		return codePoint;
+	}
+
+	/**
+		Appends the UTF-8 sequence of the code point
+	*/
+	void EncodeUtf8(const char32_t codePoint, std::string& text)
+	{
+		if (codePoint < 0x80) {
+			text.push_back((char)codePoint);
+		} else if (codePoint < 0x800) {
+			text.push_back((char)(0xC0 | (codePoint >> 6)));
+			text.push_back((char)(0x80 | (codePoint & 0x3F)));
+		} else if (codePoint < 0x10000) {
+			text.push_back((char)(0xE0 | (codePoint >> 12)));
+			text.push_back((char)(0x80 | ((codePoint >> 6) & 0x3F)));
+			text.push_back((char)(0x80 | (codePoint & 0x3F)));
+		} else {
+			text.push_back((char)(0xF0 | (codePoint >> 18)));
+			text.push_back((char)(0x80 | ((codePoint >> 12) & 0x3F)));
+			text.push_back((char)(0x80 | ((codePoint >> 6) & 0x3F)));
+			text.push_back((char)(0x80 | (codePoint & 0x3F)));
+		}
+	}
+
+	/**
+		Converts wstring to the ANSI code page (returns false if a character can't be represented)
+	*/
+	bool ConvertWstringToAnsi(const std::wstring& wstring, std::string& ansi)
+	{
+		ansi.clear();
+
+		if (wstring.empty()) {
+			return true;
+		}
+
+		// UTF-8 code page (beta option of Windows 10) represents everything and doesn't report lossy conversions
+		if (GetACP() == CP_UTF8) {
+			ansi = System::ConvertWstringToString(wstring);
+
+			return true;
+		}
+
+		BOOL lossy{ FALSE };
+		int  size = WideCharToMultiByte(CP_ACP, WC_NO_BEST_FIT_CHARS, wstring.data(), (int)wstring.length(), nullptr, 0, nullptr, &lossy);
+
+		if (size <= 0) {
+			return false;
+		}
+
+		ansi.resize(size);
+		WideCharToMultiByte(CP_ACP, WC_NO_BEST_FIT_CHARS, wstring.data(), (int)wstring.length(), &ansi[0], size, nullptr, &lossy);
+
+		return !lossy;
+	}
+}
+
+//
+// MappedFile Class Member Functions
+//
+System::MappedFile::MappedFile() :
+	mFile(INVALID_HANDLE_VALUE), mMapping(NULL), mData(nullptr), mSize(0)
+{}
+
+System::MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool System::MappedFile::open(const std::wstring& fileName)
+{
+	close();
+
+	// a writer may still append to the file, only the part that was there when it was mapped is seen
+	mFile = CreateFileW(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	LARGE_INTEGER size;
+
+	if (mFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(mFile, &size)) {
+		close();
+
+		return false;
+	}
+
+	mSize = (size_t)size.QuadPart;
+
+	// a mapping of an empty file fails, the file is just empty
+	if (mSize == 0) {
+		return true;
+	}
+
+	mMapping = CreateFileMappingW(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	mData    = mMapping ? (const unsigned char*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+	if (!mData) {
+		close();
+
+		return false;
+	}
+
+	return true;
+}
+
+void System::MappedFile::close(void)
+{
+	if (mData) {
+		UnmapViewOfFile(mData);
+		mData = nullptr;
+	}
+
+	if (mMapping) {
+		CloseHandle(mMapping);
+		mMapping = NULL;
+	}
+
+	if (mFile != INVALID_HANDLE_VALUE) {
+		CloseHandle(mFile);
+		mFile = INVALID_HANDLE_VALUE;
+	}
+
+	mSize = 0;
+}
+
+const unsigned char* System::MappedFile::getData(void) const
+{
+	return mData;
+}
+
+size_t System::MappedFile::getSize(void) const
+{
+	return mSize;
+}
 
 //
 // Global Functions
@@ -23,31 +213,121 @@ RECT System::GetScreenResolution(HWND hwnd)
 
 std::wstring System::ConvertStringToWstring(const std::string& string)
 {
-	std::wstring temp(string.length(), L' ');
-	std::copy(string.begin(), string.end(), temp.begin());
+	std::wstring temp;
+	temp.reserve(string.length());
+
+	const unsigned char* text   = (const unsigned char*)string.data();
+	const size_t         length = string.length();
+
+	for (size_t i = 0; i < length;) {
+		char32_t codePoint = DecodeUtf8(text, length, i);
+
+		// characters outside of the BMP are written as surrogate pairs (wchar_t is UTF-16 on Windows)
+		if (codePoint >= 0x10000 && sizeof(wchar_t) == 2) {
+			codePoint -= 0x10000;
+			temp.push_back((wchar_t)(0xD800 + (codePoint >> 10)));
+			temp.push_back((wchar_t)(0xDC00 + (codePoint & 0x3FF)));
+		} else {
+			temp.push_back((wchar_t)codePoint);
+		}
+	}
 
 	return temp;
 }
 
 std::string System::ConvertWstringToString(const std::wstring& wstring)
 {
-	std::setlocale(LC_ALL, "");
+	std::string temp;
+	temp.reserve(wstring.length());
+
+	for (size_t i = 0; i < wstring.length(); ++i) {
+		char32_t codePoint = (char32_t)wstring[i];
+
+		// join surrogate pairs, unpaired ones are replaced
+		if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+			if (i + 1 < wstring.length() && wstring[i + 1] >= 0xDC00 && wstring[i + 1] <= 0xDFFF) {
+				codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + ((char32_t)wstring[++i] - 0xDC00);
+			} else {
+				codePoint = REPLACEMENT_CHARACTER;
+			}
+		} else if ((codePoint >= 0xDC00 && codePoint <= 0xDFFF) || codePoint > 0x10FFFF) {
+			codePoint = REPLACEMENT_CHARACTER;
+		}
+
+		EncodeUtf8(codePoint, temp);
+	}
+
+	return temp;
+}
+
+bool System::IsValidUtf8(const char* text, const size_t length)
+{
+	const unsigned char* bytes = (const unsigned char*)text;
+
+	for (size_t i = 0; i < length;) {
+		const size_t start = i;
+
+		// a replacement character in the text is valid, one made by the decoder isn't
+		if (DecodeUtf8(bytes, length, i) == REPLACEMENT_CHARACTER && !(i - start == 3 && bytes[start] == 0xEF && bytes[start + 1] == 0xBF && bytes[start + 2] == 0xBD)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+std::wstring System::ConvertNativeStringToWstring(const std::string& string)
+{
+	if (string.empty()) {
+		return std::wstring{};
+	}
+
+	int size = MultiByteToWideChar(CP_ACP, 0, string.data(), (int)string.length(), nullptr, 0);
+
+	if (size <= 0) {
+		return std::wstring{};
+	}
+
+	std::wstring temp(size, L'\0');
+	MultiByteToWideChar(CP_ACP, 0, string.data(), (int)string.length(), &temp[0], size);
+
+	return temp;
+}
+
+std::string System::GetNativePath(const std::wstring& path)
+{
+	std::string native;
 
-	const std::locale                                   locale("");
-	typedef std::codecvt<wchar_t, char, std::mbstate_t> converter_type;
-	const converter_type&                               converter = std::use_facet<converter_type>(locale);
-	std::vector<char>                                   to(wstring.length() * converter.max_length());
-	std::mbstate_t                                      state;
-	const wchar_t*                                      from_next;
-	char*                                               to_next;
-	const converter_type::result                        result = converter.out(state, wstring.data(), wstring.data() + wstring.length(),
-		                                                                      from_next, &to[0], &to[0] + to.size(), to_next);
-	if (result == converter_type::ok || result == converter_type::noconv) {
-		return std::string(&to[0], to_next);
+	if (!GetNativePath(path, native)) {
+		throw Error::Exception(L"The path " + path + L" can't be opened, the ANSI code page can't represent it and it has no short name! Rename or move it.",
+		                       L"Path Error");
 	}
-	else {
-		return std::string{};
+
+	return native;
+}
+
+bool System::GetNativePath(const std::wstring& path, std::string& native)
+{
+	native.clear();
+
+	if (ConvertWstringToAnsi(path, native)) {
+		return true;
+	}
+
+	// short names are ASCII, so they pass through any code page
+	DWORD size = GetShortPathNameW(path.c_str(), nullptr, 0);
+
+	if (size) {
+		std::vector<WCHAR> shortPath(size);
+
+		if (GetShortPathNameW(path.c_str(), shortPath.data(), size) && ConvertWstringToAnsi(shortPath.data(), native)) {
+			return true;
+		}
 	}
+
+	native.clear();
+
+	return false;
 }
 
 std::wstring System::GetApplicationDirectory(void)
@@ -62,6 +342,60 @@ std::wstring System::GetApplicationDirectory(void)
 	return directory;
 }
 
+bool System::ReadFile(const std::wstring& fileName, std::vector<unsigned char>& data)
+{
+	FILE* file = _wfopen(fileName.c_str(), L"rb");
+
+	if (!file) {
+		return false;
+	}
+
+	std::fseek(file, 0, SEEK_END);
+	long size = std::ftell(file);
+	std::fseek(file, 0, SEEK_SET);
+
+	if (size < 0) {
+		std::fclose(file);
+
+		return false;
+	}
+
+	data.resize((size_t)size);
+
+	size_t read = size ? std::fread(data.data(), 1, data.size(), file) : 0;
+	std::fclose(file);
+
+	return read == data.size();
+}
+
+std::vector<std::wstring> System::ListFiles(const std::wstring& directory, const std::vector<std::wstring>& patterns)
+{
+	std::vector<std::wstring> files;
+
+	for (const std::wstring& pattern : patterns) {
+		WIN32_FIND_DATAW findData;
+		HANDLE           find = FindFirstFileW((directory + L"\\" + pattern).c_str(), &findData);
+
+		if (find == INVALID_HANDLE_VALUE) {
+			continue;
+		}
+
+		do {
+			if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+				files.push_back(directory + L"\\" + findData.cFileName);
+			}
+		} while (FindNextFileW(find, &findData));
+
+		FindClose(find);
+	}
+
+	// patterns can match the same file twice (*.jp*g and *.jpg)
+	std::sort(files.begin(), files.end());
+	files.erase(std::unique(files.begin(), files.end()), files.end());
+
+	return files;
+}
+
 std::wstring System::TrimWideString(const std::wstring& wstring)
 {
 	size_t frontTrimEnd{ 0 }, endTrimEnd{ wstring.length() };
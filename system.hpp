@@ -17,9 +17,54 @@
 
 #include "main.hpp"
 #include <string>
+#include <vector>
 
 namespace System
 {
+	//
+	// Classes
+	//
+
+	/**
+		Read-only view of a whole file mapped into memory
+
+		Pages are loaded by the OS as they are touched, so a reader of a large file only pays for the parts it reads
+	*/
+	class MappedFile
+	{
+		public:
+
+			MappedFile();
+			MappedFile(const MappedFile& file) = delete;
+			~MappedFile();
+
+			const MappedFile& operator=(const MappedFile& file) = delete;
+
+			/**
+				Maps the file (returns false if it can't be opened or mapped, an empty file maps to no data)
+			*/
+			bool open(const std::wstring& fileName);
+			/**
+				Unmaps the file
+			*/
+			void close(void);
+			/**
+				Returns the bytes of the file (null if nothing is mapped)
+			*/
+			const unsigned char* getData(void) const;
+			/**
+				Returns the size of the file in bytes
+			*/
+			size_t getSize(void) const;
+
+		private:
+
+			HANDLE               mFile;    // file handle
+			HANDLE               mMapping; // file mapping object
+			const unsigned char* mData;    // mapped view
+			size_t               mSize;    // size of the view
+	};
+
 	//
 	// Global Functions
 	//
@@ -28,18 +73,49 @@ namespace System
 		Gets screen resolution for the primary monitor
 	*/
 	RECT GetScreenResolution(HWND hwnd = GetDesktopWindow()); 
-	/** 
-		Converts string to wstring
+	/**
+		Converts UTF-8 string to wstring (invalid sequences become U+FFFD, safe to call from any thread)
+
+		Strings are UTF-8 inside the program, wide strings are only used for Win32 and the overlay text
 	*/
 	std::wstring ConvertStringToWstring(const std::string& string);
 	/**
-		Converts wstring to string
+		Converts wstring to UTF-8 string (unpaired surrogates become U+FFFD, safe to call from any thread)
 	*/
 	std::string ConvertWstringToString(const std::wstring& wstring);
+	/**
+		Checks if the bytes are valid UTF-8
+	*/
+	bool IsValidUtf8(const char* text, const size_t length);
+	/**
+		Converts string in the ANSI code page (narrow Win32 parameters like lpCmdLine) to wstring
+	*/
+	std::wstring ConvertNativeStringToWstring(const std::string& string);
+	/**
+		Converts path to a narrow path for the libraries opening files with narrow CRT functions (OpenCV, Tesseract, FreeType)
+
+		Path is converted to the ANSI code page, its short name is used if the ANSI code page can't represent it (throws
+		Error::Exception naming the path if neither works, short names may be off on the volume or the file may not exist)
+	*/
+	std::string GetNativePath(const std::wstring& path);
+	/**
+		Converts path to a narrow path like GetNativePath (returns false if the path has no narrow form, native is empty then)
+	*/
+	bool GetNativePath(const std::wstring& path, std::string& native);
 	/**
 		Gets Application directory
 	*/
 	std::wstring GetApplicationDirectory(void);
+	/**
+		Reads the whole file into data (returns false if the file can't be read)
+	*/
+	bool ReadFile(const std::wstring& fileName, std::vector<unsigned char>& data);
+	/**
+		Lists full paths of the files in the directory matching one of the patterns (sorted by name, sub directories are skipped)
+
+		patterns - wildcards like L"*.png"
+	*/
+	std::vector<std::wstring> ListFiles(const std::wstring& directory, const std::vector<std::wstring>& patterns);
 	/**
 		Trims wide string from both ends
 	*/
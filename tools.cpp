@@ -0,0 +1,1144 @@
+#include "tools.hpp"
+#include "batch.hpp"
+#include "error.hpp"
+#include "detector.hpp"
+#include "graphics.hpp"
+#include "inference.hpp"
+#include "journal.hpp"
+#include "log.hpp"
+#include "memory.hpp"
+#include "pipeline.hpp"
+#include "results.hpp"
+#include "scheduler.hpp"
+#include "search.hpp"
+#include "shard.hpp"
+#include "settings.hpp"
+#include "spatial.hpp"
+#include "system.hpp"
+#include "video.hpp"
+#include "watcher.hpp"
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/dnn.hpp>
+#include <shellapi.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+	//
+	// Local Definitions
+	//
+	typedef int (*ToolFunction)(const std::vector<std::wstring>& args);
+
+	//
+	// Local Variables
+	//
+	bool              HasConsole{ false };
+	std::atomic<bool> StopRequested{ false }; // Ctrl+C or the console closing asks a long running tool to stop
+
+	//
+	// Local Functions
+	//
+
+	/**
+		Sets up everything the batch processor needs outside of the window (backend, memory budget and the font of the overlay)
+	*/
+	void InitializeBatch(const Batch::Options& options)
+	{
+		if (!Inference::Initialize()) {
+			throw Error::Exception(L"Can't initialize the inference backend!", L"Batch Error");
+		}
+
+		// the workers of the pool and the pipeline share OpenCV's one pool of the process
+		Inference::ConfigureThreads(true);
+
+		Memory::InitializeBudget();
+		Graphics::SetTextCacheSize((size_t)std::max(0, Settings::GetInt(L"Graphics", L"TextCacheSize", 0)));
+
+		if (options.mRender && !Graphics::MainFont) {
+			if (FT_Init_FreeType(&Graphics::FontLibrary)) {
+				throw Error::Exception(L"Can't init FreeType!", L"Batch Error");
+			}
+
+			Graphics::MainFont = new Graphics::Font();
+
+			if (!Graphics::MainFont->load("font.ttf")) {
+				throw Error::Exception(L"Can't load the main font!", L"Batch Error");
+			}
+		}
+	}
+
+	/**
+		Releases the font of InitializeBatch
+	*/
+	void DeinitializeBatch(void)
+	{
+		if (Graphics::MainFont) {
+			delete Graphics::MainFont;
+			Graphics::MainFont = nullptr;
+		}
+	}
+
+	/**
+		Runs EAST on the blob and returns the forward time in milliseconds, boxes are the ones left after NMS
+	*/
+	double DetectBoxes(cv::dnn::Net& net, const cv::Mat& blob, std::vector<cv::RotatedRect>& boxes)
+	{
+		std::vector<cv::String> outputLayers{ Inference::EAST_SCORES_LAYER, Inference::EAST_GEOMETRY_LAYER };
+		std::vector<cv::Mat>    output;
+
+		int64_t start = cv::getTickCount();
+		net.setInput(blob);
+		net.forward(output, outputLayers);
+		double time = (double)(cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+
+		std::vector<cv::RotatedRect> candidates;
+		std::vector<float>           confidences;
+		std::vector<int>             indices;
+
+		Inference::DecodeEast(output[0], output[1], Inference::EAST_CONFIDENCE_THRESHOLD, candidates, confidences);
+		cv::dnn::NMSBoxes(candidates, confidences, Inference::EAST_CONFIDENCE_THRESHOLD, Inference::EAST_NMS_THRESHOLD, indices);
+
+		boxes.clear();
+
+		for (int index : indices) {
+			boxes.push_back(candidates[index]);
+		}
+
+		return time;
+	}
+
+	/**
+		Returns the number of boxes that overlap a reference box by at least half (intersection over union of the bounding rectangles,
+		each reference box is matched once)
+	*/
+	size_t MatchBoxes(const std::vector<cv::Rect2f>& reference, const std::vector<cv::Rect2f>& boxes)
+	{
+		std::vector<bool> used(reference.size(), false);
+		size_t            matched{ 0 };
+
+		for (const cv::Rect2f& bounds : boxes) {
+			float bestOverlap{ 0.5f };
+			int   best{ -1 };
+
+			for (size_t i = 0; i < reference.size(); ++i) {
+				if (used[i]) {
+					continue;
+				}
+
+				float intersection = (bounds & reference[i]).area();
+				float overlap      = intersection / (bounds.area() + reference[i].area() - intersection);
+
+				if (overlap >= bestOverlap) {
+					bestOverlap = overlap;
+					best        = (int)i;
+				}
+			}
+
+			if (best >= 0) {
+				used[best] = true;
+				++matched;
+			}
+		}
+
+		return matched;
+	}
+
+	/**
+		Returns the bounding rectangles of the rotated boxes
+	*/
+	std::vector<cv::Rect2f> GetBounds(const std::vector<cv::RotatedRect>& boxes)
+	{
+		std::vector<cv::Rect2f> bounds;
+
+		for (const cv::RotatedRect& box : boxes) {
+			bounds.push_back(box.boundingRect2f());
+		}
+
+		return bounds;
+	}
+
+	/**
+		Returns the bounding rectangles of the detected boxes
+	*/
+	std::vector<cv::Rect2f> GetBounds(const std::vector<Detection::Box>& boxes)
+	{
+		std::vector<cv::Rect2f> bounds;
+
+		for (const Detection::Box& box : boxes) {
+			bounds.push_back(cv::boundingRect(std::vector<cv::Point2f>(box.mVertices, box.mVertices + 4)));
+		}
+
+		return bounds;
+	}
+
+	/**
+		Reads and decodes the image file (returns an empty Mat if it can't be read)
+	*/
+	cv::Mat ReadImage(const std::wstring& file)
+	{
+		std::vector<unsigned char> data;
+
+		if (!System::ReadFile(file, data)) {
+			return cv::Mat{};
+		}
+
+		return cv::imdecode(data, cv::IMREAD_COLOR);
+	}
+
+	/**
+		Formats the arguments like printf
+	*/
+	std::string Format(const char* format, ...)
+	{
+		char    buffer[512];
+		va_list args;
+
+		va_start(args, format);
+		std::vsnprintf(buffer, sizeof(buffer), format, args);
+		va_end(args);
+
+		return buffer;
+	}
+
+	/**
+		Asks the running tool to stop instead of ending the process, so it can finish the images in flight
+	*/
+	BOOL WINAPI HandleConsoleControl(DWORD type)
+	{
+		if (type == CTRL_C_EVENT || type == CTRL_BREAK_EVENT || type == CTRL_CLOSE_EVENT) {
+			StopRequested = true;
+
+			return TRUE;
+		}
+
+		return FALSE;
+	}
+
+	/**
+		Formats the count, median, 95th percentile and maximum of the latencies in milliseconds
+	*/
+	std::string FormatLatencies(std::vector<double> latencies)
+	{
+		if (latencies.empty()) {
+			return "no images";
+		}
+
+		std::sort(latencies.begin(), latencies.end());
+
+		return Format("%zu images, median %.0f ms, p95 %.0f ms, max %.0f ms", latencies.size(), latencies[latencies.size() / 2],
+		              latencies[std::min(latencies.size() - 1, latencies.size() * 95 / 100)], latencies.back());
+	}
+
+	/**
+		Returns the output the journal keeps the hash of for the image (empty if the words aren't written)
+	*/
+	std::wstring GetJournalOutput(const std::wstring& file, const Batch::Options& options)
+	{
+		return options.mWriteWords ? Batch::GetWordsPath(file) : std::wstring();
+	}
+
+	/**
+		Removes the images the journal has as done from files (returns the number of removed images)
+	*/
+	size_t SkipDoneImages(const Checkpoint::Journal& journal, const Batch::Options& options, std::vector<std::wstring>& files)
+	{
+		const bool                verify = Settings::GetBool(L"Journal", L"Verify", false);
+		std::vector<std::wstring> remaining;
+
+		for (const std::wstring& file : files) {
+			if (!journal.isDone(file, GetJournalOutput(file, options), verify)) {
+				remaining.push_back(file);
+			}
+		}
+
+		const size_t skipped = files.size() - remaining.size();
+		files.swap(remaining);
+
+		return skipped;
+	}
+
+	/**
+		Processes the images on the work-stealing pool or through the staged pipeline ([Batch] Mode) and prints the counters
+
+		workers  - workers of the pool (0 uses the hardware threads, the pipeline takes its workers from [Pipeline])
+		callback - called whenever an image is written or fails (may be empty)
+	*/
+	Batch::Statistics ProcessImages(const std::vector<std::wstring>& files, const Batch::Options& options, const int workers, const Batch::Callback& callback)
+	{
+		InitializeBatch(options);
+
+		std::wstring mode = Settings::GetString(L"Batch", L"Mode", L"Pool");
+		std::transform(mode.begin(), mode.end(), mode.begin(), towlower);
+
+		Batch::Statistics statistics;
+
+		if (mode == L"pipeline") {
+			Pipeline::Options pipelineOptions = Pipeline::GetOptions();
+			pipelineOptions.mBatch            = options;
+
+			Pipeline::Runner runner(pipelineOptions);
+
+			runner.setCallback(callback);
+			statistics = runner.run(files);
+
+			Tools::Print(Format("%zu images (%zu failed, %zu near duplicates) through the pipeline in %.1f s: %.2f images/s, %zu boxes, %zu words",
+			                    statistics.mImages, statistics.mFailed, statistics.mDuplicates, statistics.mSeconds,
+			                    statistics.mSeconds > 0.0 ? statistics.mImages / statistics.mSeconds : 0.0, statistics.mBoxes, statistics.mWords));
+
+			for (const Pipeline::QueueMetrics& metrics : runner.getMetrics()) {
+				Tools::Print(Format("  %-9s queue: peak %zu/%zu, mean depth %.2f, %zu blocked pushes, %zu starved pops", metrics.mName.c_str(), metrics.mPeakDepth,
+				                    metrics.mCapacity, metrics.mMeanDepth, metrics.mBlockedPushes, metrics.mBlockedPops));
+			}
+		} else {
+			Scheduler::Pool  pool(workers);
+			Batch::Processor processor(pool, options);
+
+			processor.setCallback(callback);
+			statistics = processor.run(files);
+
+			Tools::Print(Format("%zu images (%zu failed, %zu near duplicates) on %d workers in %.1f s: %.2f images/s, %zu boxes, %zu words", statistics.mImages,
+			                    statistics.mFailed, statistics.mDuplicates, pool.getWorkerCount(), statistics.mSeconds,
+			                    statistics.mSeconds > 0.0 ? statistics.mImages / statistics.mSeconds : 0.0, statistics.mBoxes, statistics.mWords));
+		}
+
+		DeinitializeBatch();
+
+		return statistics;
+	}
+
+	/**
+		Starts a process for every shard of the manifest on this machine, waits for them and merges their results (returns the exit code)
+	*/
+	int LaunchShards(const std::wstring& manifest, const size_t count)
+	{
+		if (count > MAXIMUM_WAIT_OBJECTS) {
+			throw Error::Exception(L"At most " + std::to_wstring(MAXIMUM_WAIT_OBJECTS) + L" shards run on one machine, start the others with their index!",
+			                       L"Shard Error");
+		}
+
+		wchar_t application[MAX_PATH];
+		GetModuleFileNameW(NULL, application, MAX_PATH);
+
+		// the shards share the hardware threads
+		const int           workers = std::max(1, (int)std::thread::hardware_concurrency() / (int)count);
+		std::vector<HANDLE> processes;
+
+		for (size_t i = 0; i < count; ++i) {
+			std::wstring commandLine = L"\"" + std::wstring(application) + L"\" /shard \"" + manifest + L"\" " + std::to_wstring(count) + L" " + std::to_wstring(i) +
+			                           L" " + std::to_wstring(workers);
+			std::vector<wchar_t> buffer(commandLine.begin(), commandLine.end());
+			buffer.push_back(L'\0');
+
+			STARTUPINFOW        startupInfo{};
+			PROCESS_INFORMATION processInfo{};
+			startupInfo.cb = sizeof(startupInfo);
+
+			if (!CreateProcessW(application, buffer.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startupInfo, &processInfo)) {
+				Tools::Print("Can't start shard " + std::to_string(i));
+
+				continue;
+			}
+
+			CloseHandle(processInfo.hThread);
+			processes.push_back(processInfo.hProcess);
+		}
+
+		Tools::Print(Format("%zu of %zu shards started with %d workers each", processes.size(), count, workers));
+
+		if (!processes.empty()) {
+			WaitForMultipleObjects((DWORD)processes.size(), processes.data(), TRUE, INFINITE);
+		}
+
+		int exitCode = processes.size() == count ? 0 : 1;
+
+		for (HANDLE process : processes) {
+			DWORD code{ 0 };
+
+			if (GetExitCodeProcess(process, &code) && code != 0) {
+				exitCode = std::max(exitCode, (int)code);
+			}
+
+			CloseHandle(process);
+		}
+
+		const int mergeCode = Tools::MergeShards({ L"/merge", manifest, std::to_wstring(count) });
+
+		return std::max(exitCode, mergeCode);
+	}
+}
+
+//
+// Global Functions
+//
+bool Tools::Run(const std::wstring& cmdLine, int& exitCode)
+{
+	// CommandLineToArgvW returns the path of the executable for an empty command line
+	if (System::TrimWideString(cmdLine).empty()) {
+		return false;
+	}
+
+	int     argc{ 0 };
+	LPWSTR* argv = CommandLineToArgvW(cmdLine.c_str(), &argc);
+
+	if (!argv) {
+		return false;
+	}
+
+	std::vector<std::wstring> args(argv, argv + argc);
+	LocalFree(argv);
+
+	// tools are asked with /name or -name
+	if (args.empty() || args[0].size() < 2 || (args[0][0] != L'/' && args[0][0] != L'-')) {
+		return false;
+	}
+
+	std::wstring name = args[0].substr(args[0].find_first_not_of(L"/-"));
+	std::transform(name.begin(), name.end(), name.begin(), towlower);
+
+	const std::map<std::wstring, ToolFunction> tools{
+		{ L"batch", ProcessBatch },
+		{ L"bench", Benchmark },
+		{ L"calibrate", Calibrate },
+		{ L"compact", CompactIndex },
+		{ L"detectors", CompareDetectors },
+		{ L"merge", MergeShards },
+		{ L"region", QueryRegion },
+		{ L"results", ScanResults },
+		{ L"search", SearchIndex },
+		{ L"shard", ProcessShard },
+		{ L"video", ProcessVideo },
+		{ L"watch", WatchFolder }
+	};
+
+	// write to the console of the caller (the application has no console of its own)
+	if (AttachConsole(ATTACH_PARENT_PROCESS)) {
+		HasConsole = std::freopen("CONOUT$", "w", stdout) != nullptr;
+		SetConsoleOutputCP(CP_UTF8);
+	}
+
+	if (Settings::GetBool(L"Log", L"Enabled", true)) {
+		Log::Initialize(Settings::GetPath(L"Log", L"File", L"katip.log"));
+	}
+
+	auto tool = tools.find(name);
+
+	if (tool == tools.end()) {
+		Print("Unknown tool: " + System::ConvertWstringToString(args[0]));
+		exitCode = 1;
+	} else {
+		try {
+			exitCode = tool->second(args);
+		} catch (Error::Exception& ex) {
+			Print(System::ConvertWstringToString(ex.getErrorTitle() + L": " + ex.getErrorMessage()));
+			exitCode = 1;
+		} catch (std::exception& ex) {
+			Print(std::string{ "Error: " } + ex.what());
+			exitCode = 1;
+		}
+	}
+
+	Log::Deinitialize();
+
+	return true;
+}
+
+void Tools::Print(const std::string& line)
+{
+	if (HasConsole) {
+		std::fputs((line + "\n").c_str(), stdout);
+		std::fflush(stdout);
+	}
+
+	Log::Write(line);
+}
+
+int Tools::Calibrate(const std::vector<std::wstring>& args)
+{
+	const std::wstring directory        = args.size() > 1 ? args[1] : Settings::GetPath(L"Inference", L"CalibrationImages", L"calibration");
+	const int          inputScale       = std::max(32, (args.size() > 2 ? std::stoi(args[2]) : 1280) / 32 * 32);
+	const int          calibrationScale = std::max(32, Settings::GetInt(L"Inference", L"CalibrationScale", 640) / 32 * 32);
+	const size_t       calibrationCount = (size_t)std::max(1, Settings::GetInt(L"Inference", L"CalibrationCount", 16));
+
+	Inference::ConfigureThreads(false);
+
+	// both precisions run on the OpenCV CPU backend, int8 layers have no other backend
+	Print("Quantizing " + System::ConvertWstringToString(Inference::GetModelPath()) + " with up to " + std::to_string(calibrationCount) +
+	      " images of " + System::ConvertWstringToString(directory) + " at " + std::to_string(calibrationScale) + "x" + std::to_string(calibrationScale));
+
+	cv::dnn::Net fp32 = Inference::LoadNetwork(Inference::PR_FP32);
+	fp32.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+	fp32.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+
+	cv::dnn::Net source = Inference::LoadNetwork(Inference::PR_FP32);
+	cv::dnn::Net int8   = Inference::QuantizeNetwork(source, Inference::BuildCalibrationBlobs(directory, calibrationCount, calibrationScale));
+
+	std::vector<std::wstring> files = System::ListFiles(directory, { L"*.png", L"*.jpg", L"*.jpeg", L"*.bmp", L"*.tif", L"*.tiff" });
+
+	std::wstring reportPath = Settings::GetPath(L"Inference", L"CalibrationReport", L"katip_calibration.txt");
+	FILE*        report     = _wfopen(reportPath.c_str(), L"wb");
+
+	if (!report) {
+		throw Error::Exception(L"Can't create the calibration report!", L"Calibration Error");
+	}
+
+	std::fputs(Format("EAST int8 vs fp32 at %dx%d, int8 boxes matched to fp32 boxes at IoU >= 0.5\r\n\r\n", inputScale, inputScale).c_str(), report);
+	std::fputs("image\tfp32 ms\tint8 ms\tfp32 boxes\tint8 boxes\tmatched\trecall\tprecision\r\n", report);
+
+	double fp32Time{ 0.0 }, int8Time{ 0.0 };
+	size_t fp32Boxes{ 0 }, int8Boxes{ 0 }, matchedBoxes{ 0 }, images{ 0 };
+	bool   warm{ false };
+
+	for (const std::wstring& file : files) {
+		cv::Mat image = ReadImage(file);
+
+		if (image.empty()) {
+			continue;
+		}
+
+		cv::Mat blob;
+		cv::dnn::blobFromImage(image, blob, 1.0f, cv::Size(inputScale, inputScale), cv::Scalar(123.68, 116.78, 103.94), true, false);
+
+		std::vector<cv::RotatedRect> reference, boxes;
+
+		// first passes allocate the layers, they are not timed
+		if (!warm) {
+			DetectBoxes(fp32, blob, reference);
+			DetectBoxes(int8, blob, boxes);
+			warm = true;
+		}
+
+		double referenceTime = DetectBoxes(fp32, blob, reference);
+		double time          = DetectBoxes(int8, blob, boxes);
+		size_t matched       = MatchBoxes(GetBounds(reference), GetBounds(boxes));
+
+		std::string name = System::ConvertWstringToString(file.substr(file.find_last_of(L'\\') + 1));
+
+		std::fputs(Format("%s\t%.1f\t%.1f\t%zu\t%zu\t%zu\t%.3f\t%.3f\r\n", name.c_str(), referenceTime, time, reference.size(), boxes.size(), matched,
+		                  reference.empty() ? 1.0 : (double)matched / reference.size(), boxes.empty() ? 1.0 : (double)matched / boxes.size()).c_str(), report);
+
+		fp32Time     += referenceTime;
+		int8Time     += time;
+		fp32Boxes    += reference.size();
+		int8Boxes    += boxes.size();
+		matchedBoxes += matched;
+		++images;
+	}
+
+	if (!images) {
+		std::fclose(report);
+
+		throw Error::Exception(L"There are no readable images in " + directory + L"!", L"Calibration Error");
+	}
+
+	double recall    = fp32Boxes ? (double)matchedBoxes / fp32Boxes : 1.0;
+	double precision = int8Boxes ? (double)matchedBoxes / int8Boxes : 1.0;
+	double f1        = recall + precision > 0.0 ? 2.0 * recall * precision / (recall + precision) : 0.0;
+
+	std::string summary = Format("%zu images: fp32 %.1f ms, int8 %.1f ms per image (%.2fx), recall %.3f, precision %.3f, F1 %.3f against fp32",
+	                             images, fp32Time / images, int8Time / images, int8Time > 0.0 ? fp32Time / int8Time : 0.0, recall, precision, f1);
+
+	std::fputs(("\r\n" + summary + "\r\n").c_str(), report);
+	std::fclose(report);
+
+	Print(summary);
+	Print("Report: " + System::ConvertWstringToString(reportPath));
+
+	return 0;
+}
+
+int Tools::CompareDetectors(const std::vector<std::wstring>& args)
+{
+	const std::wstring directory  = args.size() > 1 ? args[1] : Settings::GetPath(L"Inference", L"CalibrationImages", L"calibration");
+	const int          inputScale = std::max(32, (args.size() > 2 ? std::stoi(args[2]) : 1280) / 32 * 32);
+
+	Inference::Initialize();
+	Inference::ConfigureThreads(false);
+
+	std::unique_ptr<Detection::Detector> east = Detection::CreateDetector(L"EAST");
+	std::unique_ptr<Detection::Detector> db   = Detection::CreateDetector(L"DB");
+
+	std::vector<std::wstring> files = System::ListFiles(directory, { L"*.png", L"*.jpg", L"*.jpeg", L"*.bmp", L"*.tif", L"*.tiff" });
+
+	std::wstring reportPath = Settings::GetPath(L"Detection", L"Report", L"katip_detectors.txt");
+	FILE*        report     = _wfopen(reportPath.c_str(), L"wb");
+
+	if (!report) {
+		throw Error::Exception(L"Can't create the detector report!", L"Detector Comparison Error");
+	}
+
+	const int dbScale = std::max(0, Settings::GetInt(L"Detection", L"DbInputScale", 736) / 32 * 32);
+
+	std::fputs(Format("EAST at %dx%d vs DB at %dx%d, DB boxes matched to EAST boxes at IoU >= 0.5 (times include decoding)\r\n\r\n", inputScale, inputScale,
+	                  dbScale ? dbScale : inputScale, dbScale ? dbScale : inputScale).c_str(), report);
+	std::fputs("image\tEAST ms\tDB ms\tEAST boxes\tDB boxes\tmatched\r\n", report);
+
+	Memory::Account account;
+	double          eastTime{ 0.0 }, dbTime{ 0.0 };
+	size_t          eastBoxes{ 0 }, dbBoxes{ 0 }, matchedBoxes{ 0 }, images{ 0 };
+	bool            warm{ false };
+
+	for (const std::wstring& file : files) {
+		cv::Mat image = ReadImage(file);
+
+		if (image.empty()) {
+			continue;
+		}
+
+		std::vector<Detection::Box> reference, boxes;
+
+		// first passes allocate the layers, they are not timed
+		if (!warm) {
+			east->detect(image, inputScale, account, reference);
+			db->detect(image, inputScale, account, boxes);
+			warm = true;
+		}
+
+		int64_t start = cv::getTickCount();
+		east->detect(image, inputScale, account, reference);
+		int64_t middle = cv::getTickCount();
+		db->detect(image, inputScale, account, boxes);
+		int64_t end = cv::getTickCount();
+
+		double referenceTime = (double)(middle - start) * 1000.0 / cv::getTickFrequency();
+		double time          = (double)(end - middle) * 1000.0 / cv::getTickFrequency();
+		size_t matched       = MatchBoxes(GetBounds(reference), GetBounds(boxes));
+
+		std::string name = System::ConvertWstringToString(file.substr(file.find_last_of(L'\\') + 1));
+
+		std::fputs(Format("%s\t%.1f\t%.1f\t%zu\t%zu\t%zu\r\n", name.c_str(), referenceTime, time, reference.size(), boxes.size(), matched).c_str(), report);
+
+		eastTime     += referenceTime;
+		dbTime       += time;
+		eastBoxes    += reference.size();
+		dbBoxes      += boxes.size();
+		matchedBoxes += matched;
+		++images;
+	}
+
+	if (!images) {
+		std::fclose(report);
+
+		throw Error::Exception(L"There are no readable images in " + directory + L"!", L"Detector Comparison Error");
+	}
+
+	std::string summary = Format("%zu images: EAST %.1f ms, DB %.1f ms per image (%.2fx), EAST %zu boxes, DB %zu boxes, %zu matched",
+	                             images, eastTime / images, dbTime / images, dbTime > 0.0 ? eastTime / dbTime : 0.0, eastBoxes, dbBoxes, matchedBoxes);
+
+	std::fputs(("\r\n" + summary + "\r\n").c_str(), report);
+	std::fclose(report);
+
+	Print(summary);
+	Print("Report: " + System::ConvertWstringToString(reportPath));
+
+	return 0;
+}
+
+int Tools::ProcessBatch(const std::vector<std::wstring>& args)
+{
+	const std::wstring input      = args.size() > 1 ? args[1] : Settings::GetPath(L"Batch", L"Images", L"images");
+	const int          workers    = args.size() > 2 ? std::stoi(args[2]) : Settings::GetInt(L"Batch", L"Workers", 0);
+	const DWORD        attributes = GetFileAttributesW(input.c_str());
+	const bool         manifest   = attributes != INVALID_FILE_ATTRIBUTES && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+	Batch::Options     options    = Batch::GetOptions();
+
+	std::vector<std::wstring> files = manifest ? Batch::ReadManifest(input)
+	                                           : System::ListFiles(input, { L"*.png", L"*.jpg", L"*.jpeg", L"*.bmp", L"*.tif", L"*.tiff" });
+
+	if (files.empty()) {
+		throw Error::Exception(L"There are no images in " + input + L"!", L"Batch Error");
+	}
+
+	//
+	// A manifest run journals its finished images, a restarted run skips them after comparing their stamps
+	//
+	std::unique_ptr<Checkpoint::Journal> journal;
+	Batch::Callback                      callback;
+
+	if (manifest) {
+		journal.reset(new Checkpoint::Journal(input + L".journal"));
+
+		const size_t total = files.size();
+
+		Print(Format("%zu of %zu images of the manifest are already done", SkipDoneImages(*journal, options, files), total));
+
+		if (files.empty()) {
+			return 0;
+		}
+
+		callback = [&journal, &options](const std::wstring& file, const bool success) {
+			if (success) {
+				journal->record(file, GetJournalOutput(file, options));
+			}
+		};
+	}
+
+	Batch::Statistics statistics = ProcessImages(files, options, workers, callback);
+
+	if (journal && !journal->sync()) {
+		Print("The journal can't be written, a restarted run will process the images again");
+	}
+
+	return statistics.mFailed ? 2 : 0;
+}
+
+int Tools::ProcessShard(const std::vector<std::wstring>& args)
+{
+	if (args.size() < 3) {
+		throw Error::Exception(L"Usage: katip /shard <manifest> <shard count> [shard index] [workers]", L"Shard Error");
+	}
+
+	const std::wstring manifest = args[1];
+	const size_t       count    = (size_t)std::max(1, std::stoi(args[2]));
+
+	// without an index this process starts every shard and merges them
+	if (args.size() < 4) {
+		return LaunchShards(manifest, count);
+	}
+
+	const size_t   index   = (size_t)std::stoi(args[3]);
+	const int      workers = args.size() > 4 ? std::stoi(args[4]) : Settings::GetInt(L"Batch", L"Workers", 0);
+	Batch::Options options = Batch::GetOptions();
+
+	if (index >= count) {
+		throw Error::Exception(L"The shard index must be less than the shard count!", L"Shard Error");
+	}
+
+	std::vector<std::wstring> entries;
+	std::vector<std::wstring> all     = Batch::ReadManifest(manifest, entries);
+	std::vector<std::wstring> files   = Sharding::SelectShard(all, entries, index, count);
+	Sharding::Summary         summary{ index, count, files.size(), 0, 0, 0, 0, 0, 0.0, {} };
+
+	// every shard has its own journal, so shards restart on their own
+	Checkpoint::Journal journal(Sharding::GetShardPath(manifest, index, count, L".journal"));
+	std::mutex          mutex;
+
+	summary.mSkipped = SkipDoneImages(journal, options, files);
+
+	// a results folder takes one writer, so every shard appends to its own
+	options.mResultsFolder = Sharding::GetShardPath(manifest, index, count, L".results");
+
+	Print(Format("Shard %zu of %zu: %zu images, %zu already done", index, count, summary.mAssigned, summary.mSkipped));
+
+	if (!files.empty()) {
+		Batch::Statistics statistics = ProcessImages(files, options, workers, [&](const std::wstring& file, const bool success) {
+			if (success) {
+				journal.record(file, GetJournalOutput(file, options));
+			} else {
+				std::lock_guard<std::mutex> lock(mutex);
+				summary.mFailedFiles.push_back(file);
+			}
+		});
+
+		summary.mImages  = statistics.mImages;
+		summary.mFailed  = statistics.mFailed;
+		summary.mBoxes   = statistics.mBoxes;
+		summary.mWords   = statistics.mWords;
+		summary.mSeconds = statistics.mSeconds;
+	}
+
+	// failures are listed by path, not in the order the workers hit them
+	std::sort(summary.mFailedFiles.begin(), summary.mFailedFiles.end());
+
+	if (!journal.sync()) {
+		Print("The journal can't be written, a restarted shard will process the images again");
+	}
+
+	if (!Sharding::WriteSummary(Sharding::GetShardPath(manifest, index, count, L".txt"), summary)) {
+		throw Error::Exception(L"Can't write the summary of the shard!", L"Shard Error");
+	}
+
+	return summary.mFailed ? 2 : 0;
+}
+
+int Tools::MergeShards(const std::vector<std::wstring>& args)
+{
+	if (args.size() < 3) {
+		throw Error::Exception(L"Usage: katip /merge <manifest> <shard count>", L"Merge Error");
+	}
+
+	Sharding::MergeStatistics statistics = Sharding::Merge(args[1], (size_t)std::max(1, std::stoi(args[2])));
+
+	Print(Format("%zu of %zu shards merged: %zu of %zu images, %zu missing, %zu failed, %zu boxes, %zu words, slowest shard %.1f s", statistics.mShards,
+	             statistics.mShards + statistics.mMissingShards.size(), statistics.mMerged, statistics.mImages, statistics.mMissing, statistics.mFailed,
+	             statistics.mBoxes, statistics.mWords, statistics.mSeconds));
+
+	for (size_t index : statistics.mMissingShards) {
+		Print("Shard " + std::to_string(index) + " has no summary, run it with katip /shard <manifest> <count> " + std::to_string(index));
+	}
+
+	Print("Words: " + System::ConvertWstringToString(statistics.mOutput));
+	Print("Summary: " + System::ConvertWstringToString(statistics.mReport));
+
+	for (const std::wstring& results : statistics.mResults) {
+		Print("Results: " + System::ConvertWstringToString(results) + " (katip /results <confidence> \"" + System::ConvertWstringToString(results) + "\")");
+	}
+
+	return statistics.mMissingShards.empty() && !statistics.mMissing ? 0 : 2;
+}
+
+int Tools::Benchmark(const std::vector<std::wstring>& args)
+{
+	const std::wstring directory  = args.size() > 1 ? args[1] : Settings::GetPath(L"Batch", L"Images", L"images");
+	const int          maxWorkers = std::min(64, std::max(1, args.size() > 2 ? std::stoi(args[2]) : (int)std::thread::hardware_concurrency()));
+
+	// outputs and indexes aren't written and near duplicates aren't skipped, the benchmark measures the processing only
+	Batch::Options options = Batch::GetOptions();
+	options.mWriteWords    = false;
+	options.mWriteImage    = false;
+	options.mWriteBoxes    = false;
+	options.mIndexes       = false;
+
+	std::vector<std::wstring> files = System::ListFiles(directory, { L"*.png", L"*.jpg", L"*.jpeg", L"*.bmp", L"*.tif", L"*.tiff" });
+
+	if (files.empty()) {
+		throw Error::Exception(L"There are no images in " + directory + L"!", L"Benchmark Error");
+	}
+
+	InitializeBatch(options);
+
+	std::wstring reportPath = Settings::GetPath(L"Batch", L"BenchReport", L"katip_bench.txt");
+	FILE*        report     = _wfopen(reportPath.c_str(), L"wb");
+
+	if (!report) {
+		throw Error::Exception(L"Can't create the benchmark report!", L"Benchmark Error");
+	}
+
+	// the workers share one OpenCV pool of [Inference] Threads threads, 1 if it is 0 (Inference::ConfigureThreads)
+	const int openCvThreads   = Inference::GetThreadCount() ? Inference::GetThreadCount() : 1;
+	const int hardwareThreads = std::max(1, (int)std::thread::hardware_concurrency());
+
+	std::fputs(Format("%zu images at %dx%d, %zu boxes per task, %s, %d hardware threads, %d OpenCV threads shared by the workers\r\n\r\n", files.size(),
+	                  options.mInputScale, options.mInputScale, options.mBoxesPerTask, options.mRender ? "rendered" : "not rendered", hardwareThreads,
+	                  openCvThreads).c_str(), report);
+	std::fputs("workers\tcores\tseconds\timages/s\twords/s\tspeedup\tefficiency\tsteals\tmin tasks\tmax tasks\r\n", report);
+
+	// 1, 2, 4 ... and the maximum itself
+	std::vector<int> counts;
+
+	for (int count = 1; count < maxWorkers; count *= 2) {
+		counts.push_back(count);
+	}
+
+	counts.push_back(maxWorkers);
+
+	double baseline{ 0.0 };
+
+	for (int count : counts) {
+		Scheduler::Pool  pool(count);
+		Batch::Processor processor(pool, options);
+
+		// first images allocate the layers of every worker's network, they are not timed
+		processor.run(std::vector<std::wstring>(files.begin(), files.begin() + std::min(files.size(), (size_t)count)));
+
+		std::vector<Scheduler::WorkerStatistics> before     = pool.getStatistics();
+		Batch::Statistics                        statistics = processor.run(files);
+		std::vector<Scheduler::WorkerStatistics> after      = pool.getStatistics();
+
+		size_t steals{ 0 }, minTasks{ (size_t)-1 }, maxTasks{ 0 };
+
+		for (size_t i = 0; i < after.size(); ++i) {
+			size_t tasks = after[i].mExecuted - before[i].mExecuted;
+
+			steals  += after[i].mStolen - before[i].mStolen;
+			minTasks = std::min(minTasks, tasks);
+			maxTasks = std::max(maxTasks, tasks);
+		}
+
+		double throughput = statistics.mSeconds > 0.0 ? statistics.mImages / statistics.mSeconds : 0.0;
+
+		if (count == 1) {
+			baseline = throughput;
+		}
+
+		// efficiency is per core in use: the workers and the OpenCV pool threads besides the one a parallel loop runs on
+		const int   cores   = std::min(hardwareThreads, count + openCvThreads - 1);
+		const int   base    = std::min(hardwareThreads, openCvThreads);
+		double      speedup = baseline > 0.0 ? throughput / baseline : 0.0;
+		double      scaling = speedup * base / cores;
+		std::string line    = Format("%d\t%d\t%.2f\t%.2f\t%.1f\t%.2f\t%.2f\t%zu\t%zu\t%zu", count, cores, statistics.mSeconds, throughput,
+		                             statistics.mSeconds > 0.0 ? statistics.mWords / statistics.mSeconds : 0.0, speedup, scaling, steals, minTasks, maxTasks);
+
+		std::fputs((line + "\r\n").c_str(), report);
+		std::fflush(report);
+
+		Print(Format("%2d workers on %d cores: %.2f images/s, %.2fx speedup, %.0f%% efficiency, %zu steals", count, cores, throughput, speedup, scaling * 100.0,
+		             steals));
+	}
+
+	std::fclose(report);
+	DeinitializeBatch();
+
+	Print("Report: " + System::ConvertWstringToString(reportPath));
+
+	return 0;
+}
+
+int Tools::WatchFolder(const std::vector<std::wstring>& args)
+{
+	const std::wstring directory      = args.size() > 1 ? args[1] : Settings::GetPath(L"Watch", L"Folder", L"inbox");
+	const DWORD        pollInterval   = (DWORD)std::max(1, Settings::GetInt(L"Watch", L"PollMs", 100));
+	const double       reportInterval = (double)std::max(1, Settings::GetInt(L"Watch", L"ReportSeconds", 10));
+
+	Pipeline::Options options = Pipeline::GetOptions();
+
+	InitializeBatch(options.mBatch);
+
+	Watch::Watcher watcher(directory, { L"*.png", L"*.jpg", L"*.jpeg", L"*.bmp", L"*.tif", L"*.tiff" });
+	watcher.scan(Settings::GetBool(L"Watch", L"ProcessExisting", false));
+
+	// landing ticks of the images in the pipeline and the latencies of the written ones since the last report
+	std::mutex                      mutex;
+	std::map<std::wstring, int64_t> landed;
+	std::vector<double>             latencies, allLatencies;
+
+	Pipeline::Runner runner(options);
+
+	runner.setCallback([&](const std::wstring& file, const bool success) {
+		const int64_t now = cv::getTickCount();
+
+		std::lock_guard<std::mutex> lock(mutex);
+		auto                        arrival = landed.find(file);
+
+		if (arrival != landed.end()) {
+			if (success) {
+				latencies.push_back((double)(now - arrival->second) * 1000.0 / cv::getTickFrequency());
+			}
+
+			landed.erase(arrival);
+		}
+	});
+
+	// the detectors and recognizers are created now, not when the first image lands
+	runner.start();
+
+	StopRequested = false;
+	SetConsoleCtrlHandler(HandleConsoleControl, TRUE);
+
+	Print("Watching " + System::ConvertWstringToString(directory) + ", Ctrl+C stops");
+
+	std::vector<Watch::Arrival> ready;
+	int64_t                     lastReport = cv::getTickCount();
+
+	while (!StopRequested) {
+		ready.clear();
+		watcher.poll(pollInterval, ready);
+
+		for (const Watch::Arrival& arrival : ready) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				landed[arrival.mFile] = arrival.mTick;
+			}
+
+			runner.submit(arrival.mFile);
+		}
+
+		if ((double)(cv::getTickCount() - lastReport) / cv::getTickFrequency() >= reportInterval) {
+			std::vector<double> recent;
+			size_t              inFlight;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				recent.swap(latencies);
+				inFlight = landed.size();
+			}
+
+			if (!recent.empty()) {
+				Print(FormatLatencies(recent) + Format(" from landing to outputs, %zu in flight, %zu being written", inFlight, watcher.getPendingCount()));
+				allLatencies.insert(allLatencies.end(), recent.begin(), recent.end());
+			}
+
+			lastReport = cv::getTickCount();
+		}
+	}
+
+	Print("Stopping, finishing the images in flight");
+
+	Batch::Statistics statistics = runner.finish();
+	SetConsoleCtrlHandler(HandleConsoleControl, FALSE);
+
+	allLatencies.insert(allLatencies.end(), latencies.begin(), latencies.end());
+
+	Print(Format("%zu images (%zu failed) in %.1f s, %zu boxes, %zu words, %zu notification overflows", statistics.mImages, statistics.mFailed,
+	             statistics.mSeconds, statistics.mBoxes, statistics.mWords, watcher.getOverflowCount()));
+	Print("Latency from landing to outputs: " + FormatLatencies(allLatencies));
+
+	DeinitializeBatch();
+
+	return statistics.mFailed ? 2 : 0;
+}
+
+int Tools::ProcessVideo(const std::vector<std::wstring>& args)
+{
+	if (args.size() < 2) {
+		throw Error::Exception(L"Usage: katip /video <video file>", L"Video Error");
+	}
+
+	if (!Inference::Initialize()) {
+		throw Error::Exception(L"Can't initialize the inference backend!", L"Video Error");
+	}
+
+	Memory::InitializeBudget();
+
+	Video::Options   options = Video::GetOptions();
+	Video::Processor processor(options);
+
+	Print("Processing " + System::ConvertWstringToString(args[1]) + Format(", every %d. frame", options.mFrameStep));
+
+	Video::Statistics statistics = processor.run(args[1]);
+
+	Print(Format("%zu frames in %.1f s: %.2f frames/s, %zu with changes (%zu processed whole), %zu regions, %zu boxes recognized, %.1f%% mean changed area",
+	             statistics.mFrames, statistics.mSeconds, statistics.mSeconds > 0.0 ? statistics.mFrames / statistics.mSeconds : 0.0,
+	             statistics.mChangedFrames, statistics.mFullFrames, statistics.mRegions, statistics.mRecognized, statistics.mChangedArea * 100.0));
+	Print("Words: " + System::ConvertWstringToString(Batch::GetWordsPath(args[1])));
+
+	return 0;
+}
+
+int Tools::SearchIndex(const std::vector<std::wstring>& args)
+{
+	if (args.size() < 2) {
+		throw Error::Exception(L"Usage: katip /search <word or prefix*> [limit]", L"Search Error");
+	}
+
+	const std::wstring folder = Settings::GetPath(L"Search", L"Index", L"katip_index");
+	const size_t       limit  = args.size() > 2 ? (size_t)std::stoul(args[2]) : 100;
+
+	int64_t        start = cv::getTickCount();
+	Search::Reader reader(folder);
+	const double   open  = (double)(cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+
+	if (reader.getSegmentCount() == 0) {
+		throw Error::Exception(L"There is no search index in " + folder + L"!", L"Search Error");
+	}
+
+	std::vector<Search::Hit> hits;
+
+	start = cv::getTickCount();
+
+	const size_t found = reader.find(System::ConvertWstringToString(args[1]), hits, limit);
+	const double query = (double)(cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+
+	for (const Search::Hit& hit : hits) {
+		Print(System::ConvertWstringToString(hit.mImage) + Format("\tbox %u\t", hit.mBox) + hit.mTerm);
+	}
+
+	Print(Format("%zu hits (%zu shown), %zu indexed images in %zu segments, query %.2f ms, index opened in %.1f ms", found, hits.size(), reader.getImageCount(),
+	             reader.getSegmentCount(), query, open));
+
+	return found ? 0 : 1;
+}
+
+int Tools::CompactIndex(const std::vector<std::wstring>& args)
+{
+	const std::wstring folder = Settings::GetPath(L"Search", L"Index", L"katip_index");
+	const int64_t      start  = cv::getTickCount();
+	const size_t       merged = Search::Compact(folder);
+
+	Print(Format("%zu segments of %s merged in %.1f s", merged, System::ConvertWstringToString(folder).c_str(),
+	             (double)(cv::getTickCount() - start) / cv::getTickFrequency()));
+
+	return 0;
+}
+
+int Tools::QueryRegion(const std::vector<std::wstring>& args)
+{
+	if (args.size() < 6) {
+		throw Error::Exception(L"Usage: katip /region <image or page> <x> <y> <width> <height>", L"Region Error");
+	}
+
+	const std::wstring fileName = Batch::GetBoxesPath(args[1]);
+	const cv::Rect2f   region(std::stof(args[2]), std::stof(args[3]), std::stof(args[4]), std::stof(args[5]));
+
+	int64_t           start = cv::getTickCount();
+	Spatial::BoxIndex index;
+
+	if (!index.open(fileName)) {
+		throw Error::Exception(L"Can't read the boxes file " + fileName + L"!", L"Region Error");
+	}
+
+	const double open = (double)(cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+
+	std::vector<Spatial::Word> words;
+
+	start = cv::getTickCount();
+
+	const size_t found = index.query(region, words);
+	const double query = (double)(cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+
+	for (const Spatial::Word& word : words) {
+		const cv::Point2f* vertices = word.mBox.mVertices;
+
+		Print(Format("box %u\t%.0f,%.0f %.0f,%.0f %.0f,%.0f %.0f,%.0f\t%.2f\t", word.mIndex, vertices[0].x, vertices[0].y, vertices[1].x, vertices[1].y, vertices[2].x,
+		             vertices[2].y, vertices[3].x, vertices[3].y, word.mBox.mConfidence) +
+		      word.mText);
+	}
+
+	Print(Format("%zu of %u boxes in the region, query %.3f ms, boxes opened in %.1f ms", found, index.getHeader().mBoxCount, query, open));
+
+	return found ? 0 : 1;
+}
+
+int Tools::ScanResults(const std::vector<std::wstring>& args)
+{
+	const std::wstring folder    = args.size() > 2 ? args[2] : Settings::GetPath(L"Results", L"Folder", L"katip_results");
+	const float        threshold = args.size() > 1 ? std::stof(args[1]) : 0.5f;
+
+	Results::Reader reader;
+
+	if (!reader.open(folder)) {
+		throw Error::Exception(L"There are no results in " + folder + L"!", L"Results Error");
+	}
+
+	const uint64_t rows  = reader.getRowCount();
+	const int64_t  start = cv::getTickCount();
+
+	// only the confidence column is mapped and read, the other columns are touched for the printed rows only
+	const float* confidences = reader.getConfidences();
+
+	if (rows && !confidences) {
+		throw Error::Exception(L"Can't map the confidence column of " + folder + L"!", L"Results Error");
+	}
+
+	std::vector<uint64_t> examples;
+	uint64_t              below{ 0 };
+	double                sum{ 0.0 };
+
+	for (uint64_t row = 0; row < rows; ++row) {
+		sum += confidences[row];
+
+		if (confidences[row] < threshold) {
+			if (examples.size() < 20) {
+				examples.push_back(row);
+			}
+
+			++below;
+		}
+	}
+
+	const double seconds = (double)(cv::getTickCount() - start) / cv::getTickFrequency();
+
+	const uint32_t*            imageIds = examples.empty() ? nullptr : reader.getImageIds();
+	const Results::ImageEntry* images   = examples.empty() ? nullptr : reader.getImages();
+
+	for (const uint64_t row : examples) {
+		if (!imageIds || !images || imageIds[row] >= reader.getImageCount()) {
+			break;
+		}
+
+		Print(reader.getImage(imageIds[row]) + Format("\tbox %llu\t%.2f\t", (unsigned long long)(row - images[imageIds[row]].mFirstRow), confidences[row]) +
+		      reader.getText(row));
+	}
+
+	Print(Format("%llu rows of %llu images, mean confidence %.3f, %llu below %.2f, confidence column scanned in %.1f ms (%.2f GB/s)", (unsigned long long)rows,
+	             (unsigned long long)reader.getImageCount(), rows ? sum / (double)rows : 0.0, (unsigned long long)below, threshold, seconds * 1000.0,
+	             seconds > 0.0 ? (double)rows * sizeof(float) / seconds / 1e9 : 0.0));
+
+	return 0;
+}
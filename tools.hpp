@@ -0,0 +1,136 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "tools.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Command Line Tool Operations
+ *
+ * Functions(Run, Print, Calibrate, CompareDetectors, ProcessBatch, ProcessShard, MergeShards, Benchmark, WatchFolder, ProcessVideo, SearchIndex, CompactIndex, QueryRegion, ScanResults)
+ *
+ */
+
+#ifndef TOOLS_HPP
+#define TOOLS_HPP
+
+#include "main.hpp"
+#include <string>
+#include <vector>
+
+namespace Tools
+{
+	//
+	// Global Functions
+	//
+
+	/**
+		Runs the tool asked for on the command line instead of the window (returns false if there is no tool on the command line)
+
+		Tools write to the console they are started from and to the log
+
+		cmdLine  - command line of the application
+		exitCode - exit code of the tool
+	*/
+	bool Run(const std::wstring& cmdLine, int& exitCode);
+	/**
+		Writes a line to the console (UTF-8) and the log
+	*/
+	void Print(const std::string& line);
+	/**
+		katip /calibrate [images folder] [input scale]
+
+		Quantizes the fp32 EAST model with the images and compares both precisions on every image of the folder,
+		writes the accuracy against fp32 and the forward times to the calibration report (returns the exit code)
+	*/
+	int Calibrate(const std::vector<std::wstring>& args);
+	/**
+		katip /detectors [images folder] [input scale]
+
+		Runs the EAST and DB detectors on every image of the folder and writes their times and the boxes they agree on
+		to the detector report (returns the exit code)
+	*/
+	int CompareDetectors(const std::vector<std::wstring>& args);
+	/**
+		katip /batch [images folder or manifest] [workers]
+
+		Processes every image of the folder or the manifest with the [Batch] options, on the work-stealing pool or through the
+		staged pipeline ([Batch] Mode), the pipeline also prints the metrics of its queues. A manifest run journals its finished
+		images to <manifest>.journal and skips them when it is started again (returns the exit code)
+	*/
+	int ProcessBatch(const std::vector<std::wstring>& args);
+	/**
+		katip /shard <manifest> <shard count> [shard index] [workers]
+
+		With an index, processes the images of the manifest that hash to the shard like /batch does, journals them to its own
+		<manifest>.shard-<index>-of-<count>.journal, appends its results ([Results] Enabled) to its own
+		<manifest>.shard-<index>-of-<count>.results folder and writes the summary of the run to <manifest>.shard-<index>-of-<count>.txt.
+		Nodes sharing the folders run one index each. Without an index, starts a process for every shard on this machine,
+		waits for them and merges them (returns the exit code)
+	*/
+	int ProcessShard(const std::vector<std::wstring>& args);
+	/**
+		katip /merge <manifest> <shard count>
+
+		Merges the words of the manifest's images in manifest order to <manifest>.words.txt and the shard summaries to
+		<manifest>.summary.txt, and lists the results folders of the shards (returns the exit code)
+	*/
+	int MergeShards(const std::vector<std::wstring>& args);
+	/**
+		katip /bench [images folder] [max workers]
+
+		Processes the images with 1, 2, 4 ... up to max workers (64 at most) and writes the throughput of each pool size,
+		its speedup and efficiency against one worker and the steals to the benchmark report (returns the exit code)
+	*/
+	int Benchmark(const std::vector<std::wstring>& args);
+	/**
+		katip /watch [folder]
+
+		Keeps the pipeline warm and processes every image that lands in the folder until Ctrl+C, then finishes the images in
+		flight. Prints the latency from landing to written outputs (median, 95th percentile) every [Watch] ReportSeconds and
+		at the end (returns the exit code)
+	*/
+	int WatchFolder(const std::vector<std::wstring>& args);
+	/**
+		katip /video <video file>
+
+		Reads the frames of the video and detects and recognizes the regions that changed since the last processed frame only,
+		the words of the unchanged regions are carried forward. Writes the words of every frame with changes to <video>_words.txt
+		and prints the frames, regions and the changed area (returns the exit code)
+	*/
+	int ProcessVideo(const std::vector<std::wstring>& args);
+	/**
+		katip /search <word or prefix*> [limit]
+
+		Looks the word up in the search index ([Search] Index) with Turkish case folding, a word ending with * matches every
+		term it starts. Prints the image and box of each hit up to the limit (100 by default) and the time of the query
+		(returns 1 if nothing is found)
+	*/
+	int SearchIndex(const std::vector<std::wstring>& args);
+	/**
+		katip /compact
+
+		Merges the segments of the search index into one and drops the images indexed again later, run it while no batch
+		writes to the index (returns the exit code)
+	*/
+	int CompactIndex(const std::vector<std::wstring>& args);
+	/**
+		katip /region <image or page> <x> <y> <width> <height>
+
+		Maps the boxes file of the image (<image>_boxes.kbx, written with [Batch] WriteBoxes) and prints the boxes and words
+		intersecting the rectangle in image pixels with the time of the query, the page of a multi-page image is named like
+		<image>_p0001 (returns 1 if nothing is found)
+	*/
+	int QueryRegion(const std::vector<std::wstring>& args);
+	/**
+		katip /results [confidence] [folder]
+
+		Maps the confidence column of the results folder (the folder or [Results] Folder) and scans it without reading the other columns,
+		prints the rows below the confidence (0.5 by default, the first 20 with their image, box and word), the mean
+		confidence and the scan speed (returns the exit code)
+	*/
+	int ScanResults(const std::vector<std::wstring>& args);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,315 @@
+#include "trace.hpp"
+#include "system.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace
+{
+	//
+	// Local Definitions
+	//
+	struct Event
+	{
+		const char* mName;     //Name of the event
+		const char* mCategory; //Category of the event
+		std::string mDetail;   //Detail argument of the event
+		long long   mStart;    //Start time in microseconds
+		long long   mDuration; //Duration in microseconds (value of a counter event)
+		bool        mCounter;  //Is it a counter event?
+	};
+
+	struct ThreadBuffer
+	{
+		DWORD              mThreadId; //Id of the owner thread
+		std::string        mName;     //Name of the owner thread (may be empty)
+		bool               mNamed;    //Is the thread name written to the file?
+		std::mutex         mMutex;    //Guards the events against Flush (never contended by other writers)
+		std::vector<Event> mEvents;   //Events waiting to be written
+	};
+
+	//
+	// Local Variables
+	//
+	std::atomic<bool>                          Enabled{ false };
+	std::mutex                                 FileMutex;     //Guards the file and the buffer list
+	FILE*                                      File{ nullptr };
+	bool                                       FirstEvent{ true };
+	std::vector<std::shared_ptr<ThreadBuffer>> Buffers;       //Buffers of all threads that recorded an event
+	std::chrono::steady_clock::time_point      StartTime;
+	thread_local std::shared_ptr<ThreadBuffer> LocalBuffer;   //Buffer of the calling thread
+
+	//
+	// Local Functions
+	//
+	ThreadBuffer* GetLocalBuffer(void)
+	{
+		if (!LocalBuffer) {
+			LocalBuffer = std::make_shared<ThreadBuffer>();
+			LocalBuffer->mThreadId = GetCurrentThreadId();
+			LocalBuffer->mNamed    = false;
+
+			std::lock_guard<std::mutex> lock(FileMutex);
+			Buffers.push_back(LocalBuffer);
+		}
+
+		return LocalBuffer.get();
+	}
+
+	std::string EscapeJson(const std::string& text)
+	{
+		std::string escaped;
+		escaped.reserve(text.size() + 8);
+
+		for (size_t i = 0; i < text.size(); ++i) {
+			unsigned char chr = (unsigned char)text[i];
+
+			if (chr == '"' || chr == '\\') {
+				escaped += '\\';
+				escaped += (char)chr;
+			} else if (chr < 0x20) {
+				char code[8];
+				std::snprintf(code, sizeof(code), "\\u%04x", chr);
+				escaped += code;
+			} else {
+				escaped += (char)chr;
+			}
+		}
+
+		return escaped;
+	}
+
+	void WriteRecord(const std::string& record)
+	{
+		if (!FirstEvent) {
+			std::fputs(",\n", File);
+		}
+
+		std::fputs(record.c_str(), File);
+		FirstEvent = false;
+	}
+
+	void WriteBuffers(void)
+	{
+		// FileMutex must be locked by the caller
+		const DWORD processId = GetCurrentProcessId();
+		char        header[160];
+
+		for (size_t i = 0; i < Buffers.size(); ++i) {
+			std::vector<Event> events;
+			bool               writeName{ false };
+			std::string        threadName;
+
+			{
+				std::lock_guard<std::mutex> lock(Buffers[i]->mMutex);
+				events.swap(Buffers[i]->mEvents);
+
+				if (!Buffers[i]->mNamed && !Buffers[i]->mName.empty()) {
+					Buffers[i]->mNamed = true;
+					writeName          = true;
+					threadName         = Buffers[i]->mName;
+				}
+			}
+
+			if (writeName) {
+				std::snprintf(header, sizeof(header), "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":%lu,\"args\":{\"name\":\"",
+				              (unsigned long)processId, (unsigned long)Buffers[i]->mThreadId);
+				WriteRecord(header + EscapeJson(threadName) + "\"}}");
+			}
+
+			for (size_t j = 0; j < events.size(); ++j) {
+				if (events[j].mCounter) {
+					std::snprintf(header, sizeof(header), "{\"ph\":\"C\",\"pid\":%lu,\"tid\":%lu,\"ts\":%lld,\"name\":\"",
+					              (unsigned long)processId, (unsigned long)Buffers[i]->mThreadId, events[j].mStart);
+
+					WriteRecord(header + std::string{ events[j].mName } + "\",\"args\":{\"value\":" + std::to_string(events[j].mDuration) + "}}");
+
+					continue;
+				}
+
+				std::snprintf(header, sizeof(header), "{\"ph\":\"X\",\"pid\":%lu,\"tid\":%lu,\"ts\":%lld,\"dur\":%lld,\"cat\":\"",
+				              (unsigned long)processId, (unsigned long)Buffers[i]->mThreadId, events[j].mStart, events[j].mDuration);
+
+				std::string record = header;
+				record += events[j].mCategory;
+				record += "\",\"name\":\"";
+				record += events[j].mName;
+				record += '"';
+
+				if (!events[j].mDetail.empty()) {
+					record += ",\"args\":{\"detail\":\"" + EscapeJson(events[j].mDetail) + "\"}";
+				}
+
+				record += '}';
+
+				WriteRecord(record);
+			}
+		}
+
+		std::fflush(File);
+	}
+}
+
+//
+// Span Class Member Functions
+//
+Trace::Span::Span(const char* name, const char* category) :
+	mName(name), mCategory(category), mDetail(), mStart(0), mActive(Enabled.load(std::memory_order_relaxed))
+{
+	if (mActive) {
+		mStart = GetTimestamp();
+	}
+}
+
+Trace::Span::Span(const char* name, const std::string& detail, const char* category) :
+	mName(name), mCategory(category), mDetail(), mStart(0), mActive(Enabled.load(std::memory_order_relaxed))
+{
+	if (mActive) {
+		mDetail = detail;
+		mStart  = GetTimestamp();
+	}
+}
+
+Trace::Span::Span(const char* name, const std::wstring& file, const char* category) :
+	mName(name), mCategory(category), mDetail(), mStart(0), mActive(Enabled.load(std::memory_order_relaxed))
+{
+	if (mActive) {
+		mDetail = System::ConvertWstringToString(file);
+		mStart  = GetTimestamp();
+	}
+}
+
+Trace::Span::Span(const char* name, const size_t number, const char* category) :
+	mName(name), mCategory(category), mDetail(), mStart(0), mActive(Enabled.load(std::memory_order_relaxed))
+{
+	if (mActive) {
+		mDetail = std::to_string(number);
+		mStart  = GetTimestamp();
+	}
+}
+
+Trace::Span::~Span()
+{
+	end();
+}
+
+void Trace::Span::end(void)
+{
+	if (!mActive) {
+		return;
+	}
+
+	mActive = false;
+
+	// tracing may be disabled while the span was open
+	if (!Enabled.load(std::memory_order_relaxed)) {
+		return;
+	}
+
+	Event event;
+	event.mName     = mName;
+	event.mCategory = mCategory;
+	event.mStart    = mStart;
+	event.mDuration = GetTimestamp() - mStart;
+	event.mCounter  = false;
+	event.mDetail.swap(mDetail);
+
+	ThreadBuffer*               buffer = GetLocalBuffer();
+	std::lock_guard<std::mutex> lock(buffer->mMutex);
+	buffer->mEvents.push_back(std::move(event));
+}
+
+//
+// Global Functions
+//
+bool Trace::Initialize(const std::wstring& fileName)
+{
+	std::lock_guard<std::mutex> lock(FileMutex);
+
+	if (File) {
+		return true;
+	}
+
+	File = _wfopen(fileName.c_str(), L"wb");
+
+	if (!File) {
+		return false;
+	}
+
+	// JSON array format, the viewers accept the file even if the closing bracket is missing
+	std::fputs("[\n", File);
+	FirstEvent = true;
+	StartTime  = std::chrono::steady_clock::now();
+
+	Enabled.store(true);
+
+	return true;
+}
+
+void Trace::Deinitialize(void)
+{
+	if (!Enabled.exchange(false)) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(FileMutex);
+
+	WriteBuffers();
+
+	std::fputs("\n]\n", File);
+	std::fclose(File);
+	File = nullptr;
+}
+
+void Trace::Flush(void)
+{
+	if (!Enabled.load()) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(FileMutex);
+
+	if (File) {
+		WriteBuffers();
+	}
+}
+
+bool Trace::IsEnabled(void)
+{
+	return Enabled.load(std::memory_order_relaxed);
+}
+
+long long Trace::GetTimestamp(void)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - StartTime).count();
+}
+
+void Trace::SetThreadName(const std::string& name)
+{
+	ThreadBuffer*               buffer = GetLocalBuffer();
+	std::lock_guard<std::mutex> lock(buffer->mMutex);
+
+	buffer->mName  = name;
+	buffer->mNamed = false;
+}
+
+void Trace::Counter(const char* name, const long long value)
+{
+	if (!Enabled.load(std::memory_order_relaxed)) {
+		return;
+	}
+
+	Event event;
+	event.mName     = name;
+	event.mCategory = "counter";
+	event.mStart    = GetTimestamp();
+	event.mDuration = value;
+	event.mCounter  = true;
+
+	ThreadBuffer*               buffer = GetLocalBuffer();
+	std::lock_guard<std::mutex> lock(buffer->mMutex);
+	buffer->mEvents.push_back(std::move(event));
+}
\ No newline at end of file
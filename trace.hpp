@@ -0,0 +1,103 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "trace.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Tracing Operations (Chrome trace_event format, viewable in Perfetto or chrome://tracing)
+ *
+ * Classes(Span)
+ * Functions(Initialize, Deinitialize, Flush, IsEnabled, GetTimestamp, SetThreadName, Counter)
+ *
+ */
+
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include "main.hpp"
+#include <string>
+
+namespace Trace
+{
+	//
+	// Classes
+	//
+
+	/**
+		Records a complete ("X") event from its construction to its destruction
+
+		Spans opened inside other spans on the same thread are shown nested.
+		When tracing is disabled a span costs a single flag check, file name and number details are converted only when
+		the span records. A string detail is built by the caller before the check, guard the costly ones with IsEnabled().
+	*/
+	class Span
+	{
+		public:
+
+			Span(const char* name, const char* category = "katip");
+			Span(const char* name, const std::string& detail, const char* category = "katip");
+			Span(const char* name, const std::wstring& file, const char* category = "katip");
+			Span(const char* name, const size_t number, const char* category = "katip");
+			Span(const Span& span) = delete;
+			~Span();
+
+			const Span& operator=(const Span& span) = delete;
+
+			/**
+				Ends the span before the destructor runs
+			*/
+			void end(void);
+
+		private:
+
+			const char* mName;     //Name of the span (must be a string literal)
+			const char* mCategory; //Category of the span (must be a string literal)
+			std::string mDetail;   //Detail argument of the span (file name, box index etc.)
+			long long   mStart;    //Start time in microseconds
+			bool        mActive;   //Is the span still recording?
+	};
+
+	//
+	// Global Functions
+	//
+
+	/**
+		Initializes the tracer and opens the trace file (returns true on success)
+
+		fileName - full path of the trace file to write
+	*/
+	bool Initialize(const std::wstring& fileName);
+	/**
+		Writes the remaining events, closes the trace file and disables tracing
+
+		Call it after the worker threads are joined
+	*/
+	void Deinitialize(void);
+	/**
+		Writes recorded events to the trace file and clears the event buffers
+	*/
+	void Flush(void);
+	/**
+		Returns true if tracing is enabled
+	*/
+	bool IsEnabled(void);
+	/**
+		Returns microseconds passed since the tracer is initialized
+	*/
+	long long GetTimestamp(void);
+	/**
+		Names the calling thread in the trace viewer
+	*/
+	void SetThreadName(const std::string& name);
+	/**
+		Records a counter ("C") event, the viewer draws the values of a counter as a graph (queue depths etc.)
+
+		name  - name of the counter (must be a string literal)
+		value - value of the counter now
+	*/
+	void Counter(const char* name, const long long value);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,368 @@
+#include "video.hpp"
+#include "batch.hpp"
+#include "error.hpp"
+#include "inference.hpp"
+#include "memory.hpp"
+#include "output.hpp"
+#include "settings.hpp"
+#include "system.hpp"
+#include "trace.hpp"
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace
+{
+	//
+	// Local Functions
+	//
+
+	/**
+		Merges the overlapping regions until no two of them overlap, so no text is detected twice
+	*/
+	void MergeRegions(std::vector<cv::Rect>& regions)
+	{
+		bool merged{ true };
+
+		while (merged) {
+			merged = false;
+
+			for (size_t i = 0; i < regions.size() && !merged; ++i) {
+				for (size_t j = i + 1; j < regions.size(); ++j) {
+					if ((regions[i] & regions[j]).area() > 0) {
+						regions[i] |= regions[j];
+						regions.erase(regions.begin() + j);
+						merged = true;
+
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	/**
+		Returns true if the rectangle overlaps one of the regions
+	*/
+	bool Touches(const cv::Rect& rect, const std::vector<cv::Rect>& regions)
+	{
+		for (const cv::Rect& region : regions) {
+			if ((rect & region).area() > 0) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/**
+		Returns the position of the frame as hh:mm:ss.mmm
+	*/
+	std::string FormatTime(const double milliseconds)
+	{
+		const long long total = std::llround(std::max(0.0, milliseconds));
+		char            text[32];
+
+		std::snprintf(text, sizeof(text), "%02lld:%02lld:%02lld.%03lld", total / 3600000, total / 60000 % 60, total / 1000 % 60, total % 1000);
+
+		return text;
+	}
+}
+
+//
+// Processor Class Member Functions
+//
+Video::Processor::Processor(const Options& options) :
+	mOptions(options), mDetector(), mRectifier(), mRecognizer(), mReference(), mWords(), mStatistics{ 0, 0, 0, 0, 0, 0.0, 0.0 }
+{
+	Inference::ConfigureThreads(false);
+
+	mDetector   = Detection::CreateDetector();
+	mRectifier  = std::unique_ptr<Rectification::Rectifier>(new Rectification::Rectifier());
+	mRecognizer = Recognition::CreateRecognizer();
+}
+
+Video::Statistics Video::Processor::run(const std::wstring& file)
+{
+	cv::VideoCapture capture(System::GetNativePath(file));
+
+	if (!capture.isOpened()) {
+		throw Error::Exception(L"Can't open the video " + file + L"!", L"Video Error");
+	}
+
+	const std::wstring wordsPath = Batch::GetWordsPath(file);
+	Output::WordWriter writer;
+
+	if (!writer.open(wordsPath, (size_t)std::max(Settings::GetInt(L"Output", L"BufferKB", 1024), 4) * 1024)) {
+		throw Error::Exception(L"Can't create " + wordsPath + L"!", L"Video Error");
+	}
+
+	reset();
+	mStatistics = Statistics{ 0, 0, 0, 0, 0, 0.0, 0.0 };
+
+	const double  framesPerSecond = capture.get(cv::CAP_PROP_FPS);
+	const int64_t start           = cv::getTickCount();
+
+	cv::Mat               frame;
+	std::vector<cv::Rect> regions;
+	char                  header[64];
+
+	for (long long index = 0;; ++index) {
+		// skipped frames are only grabbed, they are never decoded to pixels
+		if (index % mOptions.mFrameStep != 0) {
+			if (!capture.grab()) {
+				break;
+			}
+
+			continue;
+		}
+
+		if (!capture.read(frame) || frame.empty()) {
+			break;
+		}
+
+		if (!process(frame, regions)) {
+			continue;
+		}
+
+		const double position = framesPerSecond > 0.0 ? (double)index * 1000.0 / framesPerSecond : 0.0;
+
+		std::snprintf(header, sizeof(header), "# frame %lld %s", index, FormatTime(position).c_str());
+		writer.writeLine(header);
+
+		for (const Word& word : mWords) {
+			writer.writeLine(word.mText.c_str());
+		}
+	}
+
+	if (!writer.close()) {
+		throw Error::Exception(L"Can't write " + wordsPath + L"!", L"Video Error");
+	}
+
+	mStatistics.mSeconds = (double)(cv::getTickCount() - start) / cv::getTickFrequency();
+
+	if (mStatistics.mFrames) {
+		mStatistics.mChangedArea /= (double)mStatistics.mFrames;
+	}
+
+	return mStatistics;
+}
+
+bool Video::Processor::process(const cv::Mat& frame, std::vector<cv::Rect>& regions)
+{
+	Trace::Span span("frame");
+
+	cv::Mat grey;
+
+	if (frame.channels() == 1) {
+		grey = frame;
+	} else {
+		cv::cvtColor(frame, grey, frame.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+	}
+
+	const cv::Rect frameRect(0, 0, frame.cols, frame.rows);
+	const double   changed = findChanges(grey, regions);
+
+	++mStatistics.mFrames;
+	mStatistics.mChangedArea += changed;
+
+	if (regions.empty()) {
+		return false;
+	}
+
+	++mStatistics.mChangedFrames;
+
+	if (changed > mOptions.mFullFrameRatio) {
+		regions.assign(1, frameRect);
+		++mStatistics.mFullFrames;
+	}
+
+	//
+	// Regions take in the words they touch, so a word is either carried forward whole or detected again whole. A grown or
+	// merged region can reach more words, so this repeats until the regions stop changing.
+	//
+	bool changedRegions{ true };
+
+	while (changedRegions) {
+		changedRegions = false;
+
+		for (cv::Rect& region : regions) {
+			for (const Word& word : mWords) {
+				if ((word.mRect & region).area() > 0) {
+					const cv::Rect grown = (region | word.mRect) & frameRect;
+
+					if (grown != region) {
+						region         = grown;
+						changedRegions = true;
+					}
+				}
+			}
+		}
+
+		const size_t count = regions.size();
+		MergeRegions(regions);
+
+		changedRegions = changedRegions || regions.size() != count;
+	}
+
+	mWords.erase(std::remove_if(mWords.begin(), mWords.end(), [&regions](const Word& word) { return Touches(word.mRect, regions); }), mWords.end());
+
+	//
+	// Detection of every region on a crop, the detector input follows the width and height of the crop like the coarse to
+	// fine detector
+	//
+	const cv::Size inputSize = mDetector->getInputSize(mOptions.mInputScale);
+	const float    scaleX    = (float)inputSize.width / (float)frame.cols;
+	const float    scaleY    = (float)inputSize.height / (float)frame.rows;
+
+	Memory::Account             account;
+	std::vector<Detection::Box> boxes, regionBoxes;
+
+	for (const cv::Rect& region : regions) {
+		if (region.empty()) {
+			continue;
+		}
+
+		const cv::Size cropSize = region == frameRect
+		                              ? inputSize
+		                              : cv::Size(std::max(32, (int)std::lround(region.width * scaleX / 32.0f) * 32), std::max(32, (int)std::lround(region.height * scaleY / 32.0f) * 32));
+
+		regionBoxes.clear();
+		mDetector->detect(frame(region), cropSize, account, regionBoxes);
+
+		for (Detection::Box& box : regionBoxes) {
+			for (cv::Point2f& vertex : box.mVertices) {
+				vertex.x += (float)region.x;
+				vertex.y += (float)region.y;
+			}
+
+			boxes.push_back(box);
+		}
+	}
+
+	mStatistics.mRegions += regions.size();
+
+	//
+	// Recognition of the new boxes on the whole grey frame
+	//
+	std::vector<Detection::Box> selected;
+	std::vector<cv::Rect>       rects;
+
+	Batch::SelectBoxes(frame.size(), boxes, selected, rects);
+
+	if (!selected.empty()) {
+		std::vector<cv::Mat>     strips;
+		std::vector<std::string> words;
+
+		mRectifier->rectify(grey, selected, strips);
+		mRecognizer->recognize(strips, account, words);
+
+		for (size_t i = 0; i < selected.size(); ++i) {
+			if (!words[i].empty()) {
+				mWords.push_back(Word{ selected[i], rects[i], words[i] });
+			}
+		}
+
+		mStatistics.mRecognized += selected.size();
+	}
+
+	std::sort(mWords.begin(), mWords.end(), [](const Word& first, const Word& second) {
+		return first.mRect.y != second.mRect.y ? first.mRect.y < second.mRect.y : first.mRect.x < second.mRect.x;
+	});
+
+	return true;
+}
+
+const std::vector<Video::Word>& Video::Processor::getWords(void) const
+{
+	return mWords;
+}
+
+void Video::Processor::reset(void)
+{
+	mReference.release();
+	mWords.clear();
+}
+
+double Video::Processor::findChanges(const cv::Mat& grey, std::vector<cv::Rect>& regions)
+{
+	regions.clear();
+
+	cv::Mat small;
+	cv::resize(grey, small, cv::Size(std::max(1, grey.cols / mOptions.mDownscale), std::max(1, grey.rows / mOptions.mDownscale)), 0.0, 0.0, cv::INTER_AREA);
+
+	// the first frame (or a new frame size) is a change of the whole frame
+	if (mReference.empty() || mReference.size() != small.size()) {
+		mReference = small.clone();
+		regions.push_back(cv::Rect(0, 0, grey.cols, grey.rows));
+
+		return 1.0;
+	}
+
+	//
+	// Mean difference of every block, area interpolation to the block grid averages the pixels of a block
+	//
+	const int block  = mOptions.mBlockSize;
+	const int width  = (small.cols + block - 1) / block;
+	const int height = (small.rows + block - 1) / block;
+
+	cv::Mat difference, blocks, mask;
+
+	cv::absdiff(small, mReference, difference);
+	cv::resize(difference, blocks, cv::Size(width, height), 0.0, 0.0, cv::INTER_AREA);
+	cv::threshold(blocks, mask, mOptions.mBlockThreshold, 255.0, cv::THRESH_BINARY);
+
+	if (cv::countNonZero(mask) == 0) {
+		return 0.0;
+	}
+
+	// neighbouring changed blocks become one region, a word crossing a block edge isn't cut in two
+	cv::dilate(mask, mask, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(3, 3)));
+
+	std::vector<std::vector<cv::Point>> contours;
+	cv::findContours(mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+
+	const cv::Rect smallRect(0, 0, small.cols, small.rows);
+	const cv::Rect frameRect(0, 0, grey.cols, grey.rows);
+	const double   scaleX = (double)grey.cols / (double)small.cols;
+	const double   scaleY = (double)grey.rows / (double)small.rows;
+	double         area{ 0.0 };
+
+	for (const std::vector<cv::Point>& contour : contours) {
+		const cv::Rect blockRect = cv::boundingRect(contour);
+		const cv::Rect changed   = cv::Rect(blockRect.x * block, blockRect.y * block, blockRect.width * block, blockRect.height * block) & smallRect;
+
+		// only the changed regions reach the reference, slow changes elsewhere add up until they cross the threshold
+		small(changed).copyTo(mReference(changed));
+
+		const int left   = (int)std::floor(changed.x * scaleX) - mOptions.mMargin;
+		const int top    = (int)std::floor(changed.y * scaleY) - mOptions.mMargin;
+		const int right  = (int)std::ceil((changed.x + changed.width) * scaleX) + mOptions.mMargin;
+		const int bottom = (int)std::ceil((changed.y + changed.height) * scaleY) + mOptions.mMargin;
+
+		regions.push_back(cv::Rect(left, top, right - left, bottom - top) & frameRect);
+		area += (double)changed.area();
+	}
+
+	return std::min(1.0, area / (double)smallRect.area());
+}
+
+//
+// Global Functions
+//
+Video::Options Video::GetOptions(void)
+{
+	Options options;
+
+	options.mInputScale     = std::max(32, Settings::GetInt(L"Batch", L"InputScale", 1280) / 32 * 32);
+	options.mFrameStep      = std::max(1, Settings::GetInt(L"Video", L"FrameStep", 1));
+	options.mDownscale      = std::max(1, Settings::GetInt(L"Video", L"Downscale", 4));
+	options.mBlockSize      = std::max(1, Settings::GetInt(L"Video", L"BlockSize", 8));
+	options.mBlockThreshold = std::max(0.0, (double)Settings::GetFloat(L"Video", L"BlockThreshold", 12.0f));
+	options.mMargin         = std::max(0, Settings::GetInt(L"Video", L"Margin", 16));
+	options.mFullFrameRatio = std::max(0.0, std::min(1.0, (double)Settings::GetFloat(L"Video", L"FullFrameRatio", 0.5f)));
+
+	return options;
+}
\ No newline at end of file
@@ -0,0 +1,145 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "video.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Video Processing Operations
+ *
+ * Structs(Options, Statistics, Word)
+ * Classes(Processor)
+ * Functions(GetOptions)
+ *
+ */
+
+#ifndef VIDEO_HPP
+#define VIDEO_HPP
+
+#include "main.hpp"
+#include "detector.hpp"
+#include "recognizer.hpp"
+#include "rectifier.hpp"
+#include <opencv2/core.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Video
+{
+	//
+	// Structs
+	//
+
+	/**
+		Options of the video processor
+	*/
+	struct Options
+	{
+		int    mInputScale;     // input size of the detector for a whole frame (multiple of 32)
+		int    mFrameStep;      // every Nth frame is compared and processed
+		int    mDownscale;      // frames are shrunk by this factor before they are compared
+		int    mBlockSize;      // side of a compared block in shrunk pixels
+		double mBlockThreshold; // mean grey difference of a changed block
+		int    mMargin;         // margin around a changed region in frame pixels
+		double mFullFrameRatio; // changed regions covering more of the frame than this are processed as the whole frame
+	};
+
+	/**
+		Counters of a video
+	*/
+	struct Statistics
+	{
+		size_t mFrames;        // compared frames
+		size_t mChangedFrames; // frames with changed regions
+		size_t mFullFrames;    // frames processed as a whole
+		size_t mRegions;       // processed regions
+		size_t mRecognized;    // boxes recognized again
+		double mChangedArea;   // mean changed fraction of the compared frames
+		double mSeconds;       // wall time of the video
+	};
+
+	/**
+		A word on the current frame
+	*/
+	struct Word
+	{
+		Detection::Box mBox;  // rotated box on the frame
+		cv::Rect       mRect; // axis-aligned bounds of the box
+		std::string    mText; // UTF-8 word
+	};
+
+	//
+	// Classes
+	//
+
+	/**
+		Processes video frames and re-runs detection and recognition on the changed regions only
+
+		Every compared frame is shrunk to grey and compared block by block with the reference frame. Blocks whose mean
+		difference is above the threshold are merged into regions, the words touching a region are dropped and the region
+		is detected and recognized again, the other words are carried forward from the earlier frames. The reference is
+		updated in the changed regions only, so slow changes add up until they are noticed. The cost of a frame follows
+		the motion on it instead of its resolution.
+	*/
+	class Processor
+	{
+		public:
+
+			/**
+				Creates the detector, rectifier and recognizer on the calling thread
+			*/
+			Processor(const Options& options);
+			Processor(const Processor& processor) = delete;
+
+			const Processor& operator=(const Processor& processor) = delete;
+
+			/**
+				Reads the video and writes the words of every frame with changes to <video>_words.txt, each frame starts with
+				a "# frame <index> <time>" line (throws Error::Exception if the video can't be opened or the words can't be written)
+			*/
+			Statistics run(const std::wstring& file);
+			/**
+				Updates the words with the changes of the frame (returns false if nothing changed)
+
+				frame   - BGR frame
+				regions - changed regions in frame pixels (replaced)
+			*/
+			bool process(const cv::Mat& frame, std::vector<cv::Rect>& regions);
+			/**
+				Returns the words of the last frame in reading order
+			*/
+			const std::vector<Word>& getWords(void) const;
+			/**
+				Forgets the reference frame and the words (the next frame is processed as a whole)
+			*/
+			void reset(void);
+
+		private:
+
+			/**
+				Finds the changed regions of the frame and updates the reference in them (returns the changed fraction of the frame)
+			*/
+			double findChanges(const cv::Mat& grey, std::vector<cv::Rect>& regions);
+
+			Options                                   mOptions;    // options of the processor
+			std::unique_ptr<Detection::Detector>      mDetector;   // detector of the regions
+			std::unique_ptr<Rectification::Rectifier> mRectifier;  // rectifier of the boxes
+			std::unique_ptr<Recognition::Recognizer>  mRecognizer; // recognizer of the boxes
+			cv::Mat                                   mReference;  // shrunk grey reference frame
+			std::vector<Word>                         mWords;      // words of the last frame
+			Statistics                                mStatistics; // counters of the current video
+	};
+
+	//
+	// Global Functions
+	//
+
+	/**
+		Returns the video options of the settings ([Video] and [Batch] InputScale)
+	*/
+	Options GetOptions(void);
+}
+
+#endif
\ No newline at end of file
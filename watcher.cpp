@@ -0,0 +1,248 @@
+#include "watcher.hpp"
+#include "error.hpp"
+#include "settings.hpp"
+#include "system.hpp"
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <cwctype>
+
+namespace
+{
+	//
+	// Local Definitions
+	//
+	constexpr DWORD WATCH_FILTER       = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+	constexpr DWORD PENDING_CHECK_MS   = 20;            // longest wait of a poll while files are being written
+	const wchar_t   OUTPUT_IMAGE_TAG[] = L"_katip.png"; // rendered images the batch writes next to the inputs
+
+	//
+	// Local Functions
+	//
+
+	/**
+		Returns true if the name matches the wildcard (* and ?, case insensitive)
+	*/
+	bool MatchWildcard(const wchar_t* pattern, const wchar_t* name)
+	{
+		const wchar_t* star{ nullptr };
+		const wchar_t* retry{ nullptr };
+
+		while (*name) {
+			if (*pattern == L'*') {
+				star  = ++pattern;
+				retry = name;
+			} else if (*pattern == L'?' || std::towlower(*pattern) == std::towlower(*name)) {
+				++pattern;
+				++name;
+			} else if (star) {
+				pattern = star;
+				name    = ++retry;
+			} else {
+				return false;
+			}
+		}
+
+		while (*pattern == L'*') {
+			++pattern;
+		}
+
+		return !*pattern;
+	}
+}
+
+//
+// Watcher Class Member Functions
+//
+Watch::Watcher::Watcher(const std::wstring& directory, const std::vector<std::wstring>& patterns) :
+	mDirectory(directory), mPatterns(patterns), mHandle(INVALID_HANDLE_VALUE), mEvent(nullptr), mOverlapped(), mBuffer(), mReading(false),
+	mPending(), mReported(), mOverflows(0)
+{
+	// the buffer holds the notifications between two polls, network shares take 64 KB at most
+	mBuffer.resize((size_t)std::max(4, Settings::GetInt(L"Watch", L"BufferKB", 256)) * 1024 / sizeof(DWORD));
+
+	mHandle = CreateFileW(mDirectory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+	                      FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+
+	if (mHandle == INVALID_HANDLE_VALUE) {
+		throw Error::Exception(L"Can't open " + mDirectory + L" to watch!", L"Watch Error");
+	}
+
+	mEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+	if (!mEvent || !read()) {
+		if (mEvent) {
+			CloseHandle(mEvent);
+		}
+
+		CloseHandle(mHandle);
+
+		throw Error::Exception(L"Can't watch " + mDirectory + L"!", L"Watch Error");
+	}
+}
+
+Watch::Watcher::~Watcher()
+{
+	if (mReading) {
+		CancelIoEx(mHandle, &mOverlapped);
+
+		// the buffer must outlive the cancelled read
+		DWORD bytes{ 0 };
+		GetOverlappedResult(mHandle, &mOverlapped, &bytes, TRUE);
+	}
+
+	CloseHandle(mEvent);
+	CloseHandle(mHandle);
+}
+
+void Watch::Watcher::scan(const bool report)
+{
+	const int64_t now = cv::getTickCount();
+
+	for (const std::wstring& file : System::ListFiles(mDirectory, mPatterns)) {
+		if (!matches(file.substr(mDirectory.size() + 1)) || mReported.count(file) || mPending.count(file)) {
+			continue;
+		}
+
+		if (report) {
+			mPending[file] = now;
+		} else {
+			mReported.insert(file);
+		}
+	}
+}
+
+void Watch::Watcher::poll(const unsigned long timeout, std::vector<Arrival>& ready)
+{
+	// files being written are checked again soon, their writers usually close them within a few milliseconds
+	DWORD wait = mPending.empty() ? (DWORD)timeout : std::min((DWORD)timeout, PENDING_CHECK_MS);
+
+	// handle every read that is already complete, a burst of files fills several buffers
+	while (mReading && WaitForSingleObject(mEvent, wait) == WAIT_OBJECT_0) {
+		DWORD bytes{ 0 };
+		BOOL  result = GetOverlappedResult(mHandle, &mOverlapped, &bytes, FALSE);
+
+		mReading = false;
+
+		if (result && bytes) {
+			handle(bytes);
+		} else {
+			// the notifications didn't fit in the buffer, only a listing can tell what changed
+			++mOverflows;
+			scan(true);
+		}
+
+		if (!read()) {
+			throw Error::Exception(L"Can't watch " + mDirectory + L" any more!", L"Watch Error");
+		}
+
+		wait = 0;
+	}
+
+	for (auto pending = mPending.begin(); pending != mPending.end();) {
+		DWORD attributes = GetFileAttributesW(pending->first.c_str());
+
+		// gone or replaced by a folder before it was complete
+		if (attributes == INVALID_FILE_ATTRIBUTES || (attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+			pending = mPending.erase(pending);
+		} else if (isComplete(pending->first)) {
+			mReported.insert(pending->first);
+			ready.push_back(Arrival{ pending->first, pending->second });
+			pending = mPending.erase(pending);
+		} else {
+			++pending;
+		}
+	}
+}
+
+size_t Watch::Watcher::getPendingCount(void) const
+{
+	return mPending.size();
+}
+
+size_t Watch::Watcher::getOverflowCount(void) const
+{
+	return mOverflows;
+}
+
+bool Watch::Watcher::read(void)
+{
+	mOverlapped        = OVERLAPPED();
+	mOverlapped.hEvent = mEvent;
+
+	mReading = ReadDirectoryChangesW(mHandle, mBuffer.data(), (DWORD)(mBuffer.size() * sizeof(DWORD)), FALSE, WATCH_FILTER, nullptr, &mOverlapped,
+	                                 nullptr) != FALSE;
+
+	return mReading;
+}
+
+void Watch::Watcher::handle(const unsigned long bytes)
+{
+	const int64_t        now    = cv::getTickCount();
+	const unsigned char* buffer = (const unsigned char*)mBuffer.data();
+
+	for (size_t offset = 0; offset < bytes;) {
+		const FILE_NOTIFY_INFORMATION* information = (const FILE_NOTIFY_INFORMATION*)(buffer + offset);
+		const std::wstring             name(information->FileName, information->FileNameLength / sizeof(WCHAR));
+
+		if (matches(name)) {
+			const std::wstring file = mDirectory + L"\\" + name;
+
+			switch (information->Action) {
+				case FILE_ACTION_ADDED:
+				case FILE_ACTION_RENAMED_NEW_NAME:
+					// the name landed again, it is new work even if it was reported before
+					mReported.erase(file);
+					mPending[file] = now;
+
+					break;
+				case FILE_ACTION_MODIFIED:
+					// writes after a report (like touching the file) don't make it new work
+					if (!mReported.count(file)) {
+						mPending[file] = now;
+					}
+
+					break;
+				case FILE_ACTION_REMOVED:
+				case FILE_ACTION_RENAMED_OLD_NAME:
+					mReported.erase(file);
+					mPending.erase(file);
+
+					break;
+			}
+		}
+
+		if (!information->NextEntryOffset) {
+			break;
+		}
+
+		offset += information->NextEntryOffset;
+	}
+}
+
+bool Watch::Watcher::matches(const std::wstring& name) const
+{
+	// outputs of the batch land next to the inputs
+	const size_t tagLength = sizeof(OUTPUT_IMAGE_TAG) / sizeof(wchar_t) - 1;
+
+	if (name.size() >= tagLength && _wcsicmp(name.c_str() + name.size() - tagLength, OUTPUT_IMAGE_TAG) == 0) {
+		return false;
+	}
+
+	return std::any_of(mPatterns.begin(), mPatterns.end(), [&name](const std::wstring& pattern) {
+		return MatchWildcard(pattern.c_str(), name.c_str());
+	});
+}
+
+bool Watch::Watcher::isComplete(const std::wstring& file) const
+{
+	// opening without sharing write access fails while a writer still has the file open
+	HANDLE handle = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	CloseHandle(handle);
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,122 @@
+#pragma once
+
+/*
+ * Image Text Processor Program
+ *
+ * "watcher.hpp" by Caner'Trooper'Kurt
+ *
+ *
+ * Folder Watching Operations
+ *
+ * Structs(Arrival)
+ * Classes(Watcher)
+ *
+ */
+
+#ifndef WATCHER_HPP
+#define WATCHER_HPP
+
+#include "main.hpp"
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Watch
+{
+	//
+	// Structs
+	//
+
+	/**
+		A file that landed in the folder
+	*/
+	struct Arrival
+	{
+		std::wstring mFile; // full path of the file
+		int64_t      mTick; // tick count (cv::getTickCount) of the last change seen before the file was complete
+	};
+
+	//
+	// Classes
+	//
+
+	/**
+		Watches a folder for image files that are completely written
+
+		Changes are read with ReadDirectoryChangesW, so files are found from their notifications and the folder is only listed
+		again when the notification buffer overflows. A file is complete once it can be opened while denying writers, so a file
+		renamed into the folder is reported by the poll that sees the rename and a file written in place by the first poll
+		after its writer closes it. Outputs of the batch (<image>_katip.png) are skipped, and a file is reported once until it
+		is removed or lands again.
+	*/
+	class Watcher
+	{
+		public:
+
+			/**
+				Starts watching the folder (throws Error::Exception if the folder can't be watched)
+
+				directory - folder to watch (sub folders aren't watched)
+				patterns  - wildcards of the files to report like L"*.png"
+			*/
+			Watcher(const std::wstring& directory, const std::vector<std::wstring>& patterns);
+			Watcher(const Watcher& watcher) = delete;
+			/**
+				Stops watching
+			*/
+			~Watcher();
+
+			const Watcher& operator=(const Watcher& watcher) = delete;
+
+			/**
+				Lists the folder, files that weren't reported yet are reported by the next polls (report) or skipped as if they were
+			*/
+			void scan(const bool report);
+			/**
+				Waits up to timeout milliseconds for changes and appends the files that became complete to ready
+			*/
+			void poll(const unsigned long timeout, std::vector<Arrival>& ready);
+			/**
+				Returns the number of files that are still being written
+			*/
+			size_t getPendingCount(void) const;
+			/**
+				Returns the number of times the notification buffer overflowed and the folder was listed again
+			*/
+			size_t getOverflowCount(void) const;
+
+		private:
+
+			/**
+				Queues the next read of the changes (returns false if it can't be queued)
+			*/
+			bool read(void);
+			/**
+				Handles the notifications in the buffer
+			*/
+			void handle(const unsigned long bytes);
+			/**
+				Returns true if the name matches one of the patterns and isn't an output of the batch
+			*/
+			bool matches(const std::wstring& name) const;
+			/**
+				Returns true if nothing has the file open for writing any more
+			*/
+			bool isComplete(const std::wstring& file) const;
+
+			std::wstring                    mDirectory;  // watched folder
+			std::vector<std::wstring>       mPatterns;   // wildcards of the reported files
+			HANDLE                          mHandle;     // folder handle (opened for overlapped reads)
+			HANDLE                          mEvent;      // signaled when a read completes
+			OVERLAPPED                      mOverlapped; // state of the queued read
+			std::vector<DWORD>              mBuffer;     // notification buffer (DWORD aligned)
+			bool                            mReading;    // is a read queued?
+			std::map<std::wstring, int64_t> mPending;    // files being written and the tick of their last change
+			std::set<std::wstring>          mReported;   // files already reported
+			size_t                          mOverflows;  // overflows of the notification buffer
+	};
+}
+
+#endif
\ No newline at end of file